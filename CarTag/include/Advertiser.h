@@ -0,0 +1,114 @@
+/**
+ * Connectable advertising and the telemetry broadcast
+ *
+ * The connectable advertisement carries the flags, the preferred
+ * connection interval range and the service UUID, with the device name in
+ * the scan response, and runs while a peer slot is free. It is built here
+ * as raw data rather than by the Arduino library. broadcast() adds manufacturer data (TelemetryBeacon) that any
+ * number of scanners can read without connecting. How it goes out depends
+ * on the controller:
+ *
+ *   Bluetooth 4.2 (classic ESP32)  the beacon replaces the service UUID in
+ *       the 31-byte advertising packet and the UUID moves to the scan
+ *       response. There is only one advertisement, so the beacon is on the
+ *       air only while the device is connectable.
+ *
+ *   Bluetooth 5 (SOC_BLE_50_SUPPORTED)  two advertising sets. Set 0 is the
+ *       connectable advertisement, still in legacy PDUs so every phone sees
+ *       it. Set 1 is non-connectable extended advertising with the beacon,
+ *       repeated in periodic advertising so a synced scanner receives each
+ *       update without scanning. Set 1 keeps going with every slot taken.
+ *       A controller refuses legacy advertising commands once extended
+ *       ones were used, so on these parts all advertising goes through the
+ *       sets.
+ *
+ * Updates only change the advertising data; the controller picks it up
+ * at the next advertising event, without restarting anything.
+ *
+ * startDirected() replaces the connectable advertisement with high duty
+ * cycle directed advertising to one bonded central, which the controller
+ * ends by itself after DIRECTED_ADV_MS; start() goes back to undirected.
+ * The broadcast set is left alone.
+ *
+ * Starts return false when the stack refuses the call outright; whether
+ * the controller actually started comes later, in the GAP start complete
+ * event that startCompleted() picks out. AdvertisingManager decides when
+ * to start and at which interval.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <BLEDevice.h>
+
+#ifndef CARTAG_NATIVE
+#include <esp_gap_ble_api.h>
+#include <soc/soc_caps.h>
+#endif
+
+#include "AdvertisingManager.h"
+#include "BondTable.h"
+#include "TelemetryBeacon.h"
+
+// Advertising and periodic advertising interval of the broadcast set
+#ifndef BEACON_ADV_INTERVAL_MS
+#define BEACON_ADV_INTERVAL_MS 500
+#endif
+
+// Shortest beacon refresh period; each update is a controller command
+#ifndef BEACON_MIN_INTERVAL_MS
+#define BEACON_MIN_INTERVAL_MS 100
+#endif
+
+#define ADV_LEGACY_MAX 31
+
+struct AdvertiserStats {
+    uint32_t starts;      // connectable advertising (re)started
+    uint32_t directed;    // directed advertising started
+    uint32_t updates;     // beacon updates handed to the controller
+    uint16_t beaconBytes; // manufacturer data in the last update
+    bool extended;        // broadcast set with periodic advertising
+};
+
+class Advertiser {
+public:
+    // Build the connectable advertisement; call once after BLEDevice::init()
+    void begin(const char* serviceUuid, const char* name);
+
+    // (Re)start connectable advertising, undirected, every interval to
+    // twice that (0.625 ms units)
+    bool start(uint16_t interval);
+    void stop();
+
+    // Connectable advertising to one central only, for DIRECTED_ADV_MS
+    bool startDirected(const uint8_t address[6], uint8_t addressType);
+    bool directed() const { return m_directed; }
+
+    // True, with the HCI status, if the GAP event reports the start of the
+    // connectable advertisement
+    bool startCompleted(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t* param,
+                        uint8_t& status) const;
+
+    // Publish new manufacturer data; len 0 takes the beacon off the air
+    void broadcast(const uint8_t* data, size_t len);
+    bool broadcasting() const { return m_broadcasting; }
+
+    // Most manufacturer data one update can carry
+    size_t broadcastCapacity() const;
+
+    AdvertiserStats stats() const { return m_stats; }
+
+private:
+    void setConnectableData(const uint8_t* beacon, size_t len);
+
+    uint8_t m_serviceUuid[16] = {};
+    const char* m_name = "";
+    bool m_broadcasting = false;
+    bool m_directed = false;
+    AdvertiserStats m_stats = {};
+#if SOC_BLE_50_SUPPORTED
+    BLEMultiAdvertising m_sets{2};
+#endif
+};
@@ -0,0 +1,144 @@
+/**
+ * Advertising state machine
+ *
+ * Decides when connectable advertising (re)starts, and at which interval,
+ * from the connection events the BLE callbacks queue; neither this nor
+ * the callbacks ever wait. The BLE event task feeds it the events, asks
+ * service() what to do, does it with the Advertiser and reports back.
+ *
+ *   off       every slot is taken, nothing to advertise
+ *   settling  a disconnect freed a slot; advertising restarts after
+ *             ADV_RESTART_DELAY_MS, once the stack has closed the link
+ *   directed  high duty cycle to a bonded central that lost its link, for
+ *             up to DIRECTED_ADV_MS
+ *   fast      undirected at ADV_FAST_INTERVAL for ADV_DISCOVERY_MS
+ *   backoff   nobody connected in that time: the interval doubles every
+ *             ADV_BACKOFF_STEP_MS, up to ADV_SLOW_INTERVAL
+ *   parked    the ignition is off: ADV_PARKED_INTERVAL
+ *   retry     the last start failed, or was not confirmed within
+ *             ADV_START_TIMEOUT_MS; it is tried again after ADV_RETRY_MS,
+ *             doubling up to ADV_RETRY_MAX_MS, in the state it failed in
+ *
+ * Fast, backoff and parked are the three advertising profiles: discovery
+ * within a few hundred milliseconds while someone is likely to look for
+ * the tag, a slow beacon while the car is driven, and an almost free
+ * heartbeat while it is parked. Boot, a disconnect and the ignition coming
+ * on each open a new discovery window; when it ends, the tag goes to
+ * backoff, or straight to parked with the ignition off. The ignition
+ * going off parks backoff at once.
+ *
+ * A connection takes every state to fast, or to off once every slot is
+ * taken: the controller stops advertising by itself when a central
+ * connects. A start only counts once the GAP start complete event
+ * confirms it.
+ *
+ * Intervals are the shortest advertising interval, in units of 0.625 ms
+ * as on the air; the longest is twice that.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "BondTable.h"
+
+#ifndef ADV_RESTART_DELAY_MS
+#define ADV_RESTART_DELAY_MS 100
+#endif
+#ifndef ADV_FAST_INTERVAL
+#define ADV_FAST_INTERVAL 0x20      // 20 ms
+#endif
+#ifndef ADV_SLOW_INTERVAL
+#define ADV_SLOW_INTERVAL 0x640     // 1 s
+#endif
+#ifndef ADV_PARKED_INTERVAL
+#define ADV_PARKED_INTERVAL 0x2000  // 5.12 s
+#endif
+#ifndef ADV_DISCOVERY_MS
+#define ADV_DISCOVERY_MS 30000
+#endif
+#ifndef ADV_BACKOFF_STEP_MS
+#define ADV_BACKOFF_STEP_MS 30000
+#endif
+#ifndef ADV_START_TIMEOUT_MS
+#define ADV_START_TIMEOUT_MS 1000
+#endif
+#ifndef ADV_RETRY_MS
+#define ADV_RETRY_MS 250
+#endif
+#ifndef ADV_RETRY_MAX_MS
+#define ADV_RETRY_MAX_MS 8000
+#endif
+
+enum AdvState : uint8_t {
+    ADV_STATE_OFF      = 0,
+    ADV_STATE_SETTLING = 1,
+    ADV_STATE_DIRECTED = 2,
+    ADV_STATE_FAST     = 3,
+    ADV_STATE_BACKOFF  = 4,
+    ADV_STATE_PARKED   = 5,
+    ADV_STATE_RETRY    = 6,
+    ADV_STATE_COUNT
+};
+
+// What service() asks the caller to do
+enum AdvAction : uint8_t {
+    ADV_ACTION_NONE,
+    ADV_ACTION_START,     // undirected, at interval()
+    ADV_ACTION_DIRECTED,  // directed, to the bonded central that lost its link
+};
+
+struct AdvManagerStats {
+    AdvState state;
+    AdvState previous;
+    uint16_t interval;                 // of the last undirected start
+    uint32_t entered[ADV_STATE_COUNT]; // transitions into each state
+    uint32_t starts;                   // confirmed by the stack
+    uint32_t failures;                 // refused, or reported failed
+    uint32_t timeouts;                 // never confirmed
+    uint32_t stateSinceMs;
+};
+
+const char* advStateName(AdvState state);
+
+class AdvertisingManager {
+public:
+    // Boot: advertise at the fast interval
+    void begin(bool ignition, uint32_t nowMs);
+
+    // The ignition came on (a new discovery window) or went off
+    void ignition(bool on, uint32_t nowMs);
+
+    // A central connected; full when it took the last slot
+    void connected(bool full, uint32_t nowMs);
+    // A central left; directed when it is a bonded one that lost its link
+    void disconnected(bool full, bool directed, uint32_t nowMs);
+
+    // What to do now; after a start, report with requested()
+    AdvAction service(uint32_t nowMs);
+    uint16_t interval() const { return m_interval; }
+
+    // The start call was made (ok) or refused outright
+    void requested(bool ok, uint32_t nowMs);
+    // GAP start complete event; status 0 is success
+    void startCompleted(uint8_t status, uint32_t nowMs);
+
+    // ms until service() has something to do, or UINT32_MAX
+    uint32_t msUntilService(uint32_t nowMs) const;
+
+    AdvManagerStats stats() const { return m_stats; }
+
+private:
+    void enter(AdvState state, uint32_t nowMs);
+    void failed(uint32_t nowMs);
+
+    uint16_t m_interval = ADV_FAST_INTERVAL;
+    bool m_parked = false;          // ignition off
+    AdvState m_resume = ADV_STATE_FAST;  // where retry goes back to
+    bool m_due = false;             // a start is to be made
+    bool m_awaiting = false;        // a start was made, not confirmed yet
+    uint32_t m_awaitingSinceMs = 0;
+    uint32_t m_retryMs = ADV_RETRY_MS;
+    uint32_t m_deadlineMs = 0;      // settling or retry ends
+    AdvManagerStats m_stats = {};
+};
@@ -0,0 +1,101 @@
+/**
+ * Battery voltage acquisition
+ *
+ * The ADC converts the divided battery voltage continuously into a DMA
+ * buffer, so acquisition costs no CPU until poll() drains it; poll() never
+ * waits for conversions. Every BATTERY_OVERSAMPLE conversions are averaged
+ * into one block by a first-order CIC decimator, calibrated to millivolts
+ * and scaled by the divider: that is the raw value, updated at
+ * BATTERY_ADC_RATE_HZ / BATTERY_OVERSAMPLE (about 78 Hz). Blocks go through
+ * a median-of-3 to drop load spikes and a first-order IIR low-pass in Q16
+ * fixed point, and every BATTERY_FILTER_DECIMATION blocks the filtered
+ * voltage and the state of charge read off the discharge curve are updated
+ * (about 10 Hz). The kernels come from FixedDsp.h.
+ *
+ * Build with -D CARTAG_BATTERY_ADC to read the ADC on BATTERY_ADC_PIN.
+ * Otherwise, and always in the native build, a simulated cell feeds the
+ * same block, filter and curve path with noisy conversions.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FixedDsp.h"
+
+#ifndef BATTERY_ADC_PIN
+#define BATTERY_ADC_PIN 34            // ADC1 channel 6
+#endif
+// Battery voltage = pin voltage * NUM / DEN
+#ifndef BATTERY_DIVIDER_NUM
+#define BATTERY_DIVIDER_NUM 2
+#endif
+#ifndef BATTERY_DIVIDER_DEN
+#define BATTERY_DIVIDER_DEN 1
+#endif
+
+#ifndef BATTERY_ADC_RATE_HZ
+#define BATTERY_ADC_RATE_HZ 20000     // slowest rate the ESP32 DMA mode supports
+#endif
+#ifndef BATTERY_OVERSAMPLE
+#define BATTERY_OVERSAMPLE 256        // conversions per raw block
+#endif
+#ifndef BATTERY_IIR_SHIFT
+#define BATTERY_IIR_SHIFT 3           // filter coefficient 1/8 per block
+#endif
+#ifndef BATTERY_FILTER_DECIMATION
+#define BATTERY_FILTER_DECIMATION 8   // raw blocks per filtered update
+#endif
+
+// How often a caller should poll() so the DMA buffer never overflows
+#define BATTERY_POLL_INTERVAL_MS 50
+
+struct BatteryStats {
+    uint32_t conversions;   // ADC results consumed
+    uint32_t blocks;        // raw values produced
+    uint32_t updates;       // filtered values produced
+    uint32_t overruns;      // times the DMA buffer filled before poll()
+};
+
+class BatteryMonitor {
+public:
+    // Configure and start the ADC; false if the driver refused
+    bool begin();
+
+    // Consume every completed conversion without blocking; returns true if
+    // a new filtered value was produced
+    bool poll();
+
+    // Latest block average, battery-side millivolts
+    uint16_t rawMv() const { return m_rawMv; }
+
+    // Low-pass filtered voltage and the state of charge derived from it
+    uint16_t filteredMv() const { return m_filteredMv; }
+    uint8_t percent() const { return m_percent; }
+
+    // False when the values come from the simulated cell
+    bool measured() const;
+
+    BatteryStats stats() const { return m_stats; }
+
+private:
+    void addConversion(uint16_t code);
+    void finishBlock(uint32_t code);
+
+    dsp::CicDecimator<1, BATTERY_OVERSAMPLE> m_block;
+    dsp::MedianFilter<int32_t, 3> m_spikes;
+    dsp::OnePoleLowPass<BATTERY_IIR_SHIFT> m_lowPass;
+    uint8_t m_decimation = 0;
+
+    volatile uint16_t m_rawMv = 0;
+    volatile uint16_t m_filteredMv = 0;
+    volatile uint8_t m_percent = 0;
+    BatteryStats m_stats = {};
+
+    uint64_t m_lastPollUs = 0;     // simulated cell only
+};
+
+// State of charge for a resting single Li-ion cell, linearly interpolated
+// between the points of a discharge curve
+uint8_t batteryPercentFromMv(uint16_t mv);
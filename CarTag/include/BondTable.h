@@ -0,0 +1,129 @@
+/**
+ * Bonded centrals and the fast reconnect path
+ *
+ * Links in a car drop all the time: the engine cranks, the phone goes in
+ * a pocket or a door pocket. A central that bonded (Just Works, the keys
+ * are kept by the BLE stack) is remembered here, most recent first, with
+ * the GATT database signature it last saw. When a bonded central's link
+ * is lost, the firmware points high duty cycle directed advertising at it
+ * for DIRECTED_ADV_MS: an advertisement every few milliseconds to that one
+ * address, so a phone with a pending connection is back within a few of
+ * its scan windows instead of waiting to catch undirected advertising.
+ *
+ * The GATT database is built in the same order on every boot, so its
+ * handles are stable and a bonded central may keep what it discovered.
+ * The signature (FNV-1a over every attribute's UUID and handle) only
+ * changes when a firmware update changes the layout. A bonded central
+ * that last saw another signature gets a Service Changed indication once
+ * it is encrypted again, and rediscovers once.
+ *
+ * The table is saved as one blob:
+ *
+ *   offset  size  field
+ *   0       1     version (BOND_TABLE_VERSION)
+ *   1       1     number of bonds
+ *   2       11*n  address (6), address type, u32 GATT signature,
+ *                 most recent first
+ *
+ * The BLE event task updates it; command handlers read it under the same
+ * lock as the peer table.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bonds kept; the stack's copy of the least recent one goes when a new
+// central bonds with the table full
+#ifndef CARTAG_MAX_BONDS
+#define CARTAG_MAX_BONDS 4
+#endif
+
+// High duty cycle directed advertising may last at most 1.28 s
+#define DIRECTED_ADV_MS 1280
+
+#define BOND_TABLE_VERSION  1
+#define BOND_RECORD_SIZE    11
+#define BOND_TABLE_MAX_BLOB (2 + BOND_RECORD_SIZE * CARTAG_MAX_BONDS)
+
+// GATT signature of a bond made before its central saw this firmware
+#define BOND_GATT_UNKNOWN 0
+
+struct Bond {
+    uint8_t address[6];
+    uint8_t addressType;     // public or random (identity) address
+    uint32_t gattSignature;  // GATT database the central last saw
+};
+
+struct ReconnectStats {
+    uint32_t reconnects;      // a bonded central came back after losing its link
+    uint32_t directed;        // directed advertising started for one
+    uint32_t directedHits;    // ... and it reconnected while that ran
+    uint32_t lastMs;          // link lost to connected again, last time
+    uint32_t fastestMs;
+    uint32_t serviceChanged;  // indications sent for a changed database
+};
+
+// FNV-1a over the attributes of the GATT database, in the order given
+class GattSignature {
+public:
+    void add(const char* uuid, uint16_t handle);
+    uint32_t value() const { return m_hash; }
+
+private:
+    uint32_t m_hash = 2166136261u;
+};
+
+class BondTable {
+public:
+    // Signature of the database this firmware serves
+    void setGattSignature(uint32_t signature) { m_gattSignature = signature; }
+    uint32_t gattSignature() const { return m_gattSignature; }
+
+    // A central bonded, or encrypted again with its stored keys: move it
+    // to the front, or add it with gattSignature. Returns true if the least
+    // recent bond had to make room; it is copied to evicted.
+    bool add(const uint8_t address[6], uint8_t addressType, uint32_t gattSignature, Bond* evicted);
+    bool remove(const uint8_t address[6]);
+    const Bond* find(const uint8_t address[6]) const;
+
+    // Drop every bond whose address is not in the list, e.g. the ones the
+    // BLE stack has keys for
+    void retain(const uint8_t (*addresses)[6], size_t count);
+
+    size_t count() const { return m_count; }
+    const Bond& at(size_t i) const { return m_bonds[i]; }
+
+    // True, once, if the central last saw another database; its bond then
+    // records the current one
+    bool gattChanged(const uint8_t address[6]);
+
+    // A bonded central lost its link; it becomes the reconnect target
+    void linkLost(const uint8_t address[6], uint32_t nowMs);
+    // The bond to send directed advertising to, until directedStarted()
+    const Bond* reconnectTarget() const;
+    void directedStarted();
+    // Any central connected; counts a reconnect if it is the target
+    void connected(const uint8_t address[6], uint32_t nowMs);
+
+    ReconnectStats stats() const { return m_stats; }
+
+    // Blob for non-volatile storage; returns the length
+    size_t save(uint8_t* out, size_t cap) const;
+    // False, leaving the table empty, if the blob is not a valid one
+    bool load(const uint8_t* data, size_t len);
+
+private:
+    int indexOf(const uint8_t address[6]) const;
+
+    Bond m_bonds[CARTAG_MAX_BONDS];
+    size_t m_count = 0;
+    uint32_t m_gattSignature = BOND_GATT_UNKNOWN;
+
+    uint8_t m_lost[6] = {};
+    bool m_waiting = false;      // m_lost has not come back yet
+    bool m_directed = false;     // ... and directed advertising went to it
+    uint32_t m_lostMs = 0;
+    ReconnectStats m_stats = {};
+};
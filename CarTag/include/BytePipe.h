@@ -0,0 +1,82 @@
+/**
+ * Lock-free single-producer/single-consumer byte stream
+ *
+ * Writers copy a whole block in at most two memcpy calls (around the wrap
+ * point). Readers get a pointer to the contiguous readable span and mark
+ * it consumed when done, so bytes are never copied one at a time.
+ * Capacity must be a power of two.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t N>
+class BytePipe {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Producer: append as much of data as fits; returns bytes written.
+    // Anything that did not fit is counted in overflowBytes().
+    size_t write(const uint8_t* data, size_t len) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t free = N - (head - m_tail.load(std::memory_order_acquire));
+        if (len > free) {
+            m_overflow.fetch_add((uint32_t)(len - free), std::memory_order_relaxed);
+            len = free;
+        }
+
+        size_t offset = head & (N - 1);
+        size_t first = len < N - offset ? len : N - offset;
+        memcpy(m_buf + offset, data, first);
+        memcpy(m_buf, data + first, len - first);
+
+        m_head.store(head + len, std::memory_order_release);
+        return len;
+    }
+
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+
+    // Consumer: contiguous readable bytes starting at the read position.
+    // len is set to the span length, which may be less than available()
+    // when the data wraps.
+    const uint8_t* peek(size_t& len) const {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t avail = m_head.load(std::memory_order_acquire) - tail;
+        size_t offset = tail & (N - 1);
+        len = avail < N - offset ? avail : N - offset;
+        return m_buf + offset;
+    }
+
+    // Consumer: like peek(), for the bytes that follow the first offset
+    // readable ones; len is 0 if there are none
+    const uint8_t* peek(size_t offset, size_t& len) const {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t avail = m_head.load(std::memory_order_acquire) - tail;
+        avail = offset < avail ? avail - offset : 0;
+        size_t at = (tail + offset) & (N - 1);
+        len = avail < N - at ? avail : N - at;
+        return m_buf + at;
+    }
+
+    void consume(size_t len) {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    size_t available() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t space() const { return N - available(); }
+    uint32_t overflowBytes() const { return m_overflow.load(std::memory_order_relaxed); }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    uint8_t m_buf[N];
+    std::atomic<size_t> m_head{0};
+    std::atomic<size_t> m_tail{0};
+    std::atomic<uint32_t> m_overflow{0};
+};
@@ -0,0 +1,53 @@
+/**
+ * Minimal CAN controller interface for the OBD-II stack
+ *
+ * Implemented by the ESP32's TWAI controller on the device and by an
+ * in-process loopback bus on the host. Only 11-bit identifiers are used:
+ * OBD-II requests go to the functional address 0x7DF and engine ECUs
+ * answer on 0x7E8-0x7EF, which is all the acceptance filter lets in.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OBD_CAN_FUNCTIONAL_ID    0x7DF
+#define OBD_CAN_RESPONSE_ID      0x7E8   // first of the eight response ids
+#define OBD_CAN_RESPONSE_MASK    0x7F8
+#define OBD_CAN_PHYSICAL_OFFSET  8       // ECU request id = response id - 8
+
+struct CanFrame {
+    uint32_t id;
+    uint8_t length;
+    uint8_t data[8];
+};
+
+struct CanBusStats {
+    uint32_t txFrames;
+    uint32_t rxFrames;
+    uint32_t filtered;   // frames the acceptance filter dropped
+    uint32_t errors;     // transmit failures, bus-off, rx overruns
+};
+
+inline bool isObdResponseId(uint32_t id) {
+    return (id & OBD_CAN_RESPONSE_MASK) == OBD_CAN_RESPONSE_ID;
+}
+
+class CanBus {
+public:
+    virtual ~CanBus() {}
+
+    // Start the controller with the 0x7E8-0x7EF acceptance filter installed
+    virtual bool begin() = 0;
+
+    virtual bool send(const CanFrame& frame, uint32_t timeoutMs) = 0;
+
+    // Next accepted frame; false if none arrives within timeoutMs
+    virtual bool receive(CanFrame& frame, uint32_t timeoutMs) = 0;
+
+    const CanBusStats& stats() const { return m_stats; }
+
+protected:
+    CanBusStats m_stats = {};
+};
@@ -0,0 +1,52 @@
+/**
+ * OBD-II over CAN (ISO 15765-4) vehicle backend
+ *
+ * Talks to the car through a CanBus directly instead of an external ELM327,
+ * so a request costs one CAN round trip rather than a UART exchange plus
+ * the adapter's own command processing. Requests are sent to the
+ * functional address 0x7DF; the first ECU to answer on 0x7E8-0x7EF is
+ * used, and multi-frame answers (VIN, DTC lists) are reassembled with
+ * ISO-TP, flow control going back to that ECU's physical address.
+ *
+ * Other ECUs may answer the same functional request. Frames still queued
+ * when the next request goes out are discarded, and a reply must echo a
+ * requested PID (modes 01, 02 and 09), so a late answer is never taken
+ * for the next request's.
+ */
+
+#pragma once
+
+#include "CanBus.h"
+#include "IsoTp.h"
+#include "VehicleBackend.h"
+
+// P2 response timeout, and the wait between consecutive frames (N_Cr)
+#ifndef OBD_CAN_TIMEOUT_MS
+#define OBD_CAN_TIMEOUT_MS 50
+#endif
+#define ISOTP_FRAME_TIMEOUT_MS 150
+
+// Extended wait after a "response pending" (7F xx 78) reply
+#define OBD_CAN_PENDING_TIMEOUT_MS 5000
+
+class CanObdBackend : public VehicleBackend {
+public:
+    explicit CanObdBackend(CanBus& bus) : m_bus(bus) {}
+
+    ObdStatus request(const uint8_t* req, size_t reqLen,
+                      uint8_t* resp, size_t respCap, size_t& respLen) override;
+
+    const char* protocolName() const override { return "ISO 15765-4 (CAN 11/500)"; }
+    char protocolNumber() const override { return '6'; }
+    uint16_t responseHeader() const override { return m_lastResponder; }
+
+    uint32_t multiFrameResponses() const { return m_multiFrame; }
+    uint32_t staleFrames() const { return m_stale; }
+
+private:
+    CanBus& m_bus;
+    IsoTpReassembler m_rx;
+    uint16_t m_lastResponder = OBD_CAN_RESPONSE_ID;
+    uint32_t m_multiFrame = 0;
+    uint32_t m_stale = 0;     // frames left over from earlier requests
+};
@@ -0,0 +1,128 @@
+/**
+ * Binary command protocol for writes to the telemetry characteristic
+ *
+ * Request (written by the app):
+ *
+ *   offset  size  field
+ *   0       1     opcode (CommandOpcode)
+ *   1       1     correlation id, echoed in the response
+ *   2       1     payload length
+ *   3       n     payload
+ *
+ * Response (notified on the same characteristic):
+ *
+ *   0       1     magic (0xCD)
+ *   1       1     opcode
+ *   2       1     correlation id
+ *   3       1     status (CommandStatus)
+ *   4       1     payload length
+ *   5       n     payload
+ *
+ * Multi-byte payload fields are little-endian. Handlers are looked up in a
+ * constexpr table indexed by opcode, and each opcode keeps call count and
+ * handler latency counters.
+ *
+ * A response never exceeds RESPONSE_MAX_FRAME or the requesting central's
+ * ATT payload (MTU - 3). Variable-length replies (the jitter histogram)
+ * shrink to fit; a reply that cannot fails with STATUS_TOO_LONG instead of
+ * being cut short by the stack.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "AdvertisingManager.h"
+#include "BatteryMonitor.h"
+#include "BondTable.h"
+#include "CommandQueue.h"
+#include "DeviceConfig.h"
+#include "PeerTable.h"
+#include "SampleTimer.h"
+#include "TelemetryFrame.h"
+
+#define COMMAND_HEADER_SIZE   3
+#define RESPONSE_MAGIC        0xCD
+#define RESPONSE_HEADER_SIZE  5
+#define RESPONSE_MAX_PAYLOAD  48
+#define RESPONSE_MAX_FRAME    (RESPONSE_HEADER_SIZE + RESPONSE_MAX_PAYLOAD)
+
+enum CommandOpcode : uint8_t {
+    OP_PING            = 0x00,  // -> empty
+    OP_SET_INTERVAL    = 0x01,  // u16 sample ms [, u16 batch latency ms] -> empty
+    OP_START_STREAM    = 0x02,  // -> empty
+    OP_STOP_STREAM     = 0x03,  // -> empty
+    OP_SNAPSHOT        = 0x04,  // -> one 0xCA telemetry frame
+    OP_CONFIG_READ     = 0x05,  // u8 key -> u8 key, u32 value
+    OP_CONFIG_WRITE    = 0x06,  // u8 key, u32 value -> u8 key, u32 value
+    OP_READ_STATS      = 0x07,  // u8 opcode -> u32 calls, u32 total us, u32 max us
+    OP_READ_JITTER     = 0x08,  // [u8 first bin] -> u32 period us, u32 ticks, u32 max late us,
+                                //   u32 max early us, u8 first bin, u8 n, n x u32 bin counts
+    OP_READ_BATTERY    = 0x09,  // -> u16 raw mV, u16 filtered mV, u8 percent, u8 measured,
+                                //   u32 raw blocks, u32 filtered updates
+    OP_READ_CONNECTION = 0x0A,  // -> u8 profile, u8 previous profile, u16 interval,
+                                //   u16 latency, u16 timeout (granted), u32 transitions,
+                                //   u32 rejected, u32 adjusted, u32 ms in profile
+                                //   (the requesting central's connection)
+    OP_READ_LINK       = 0x0B,  // -> u8 tx PHY, u8 rx PHY, u16 tx octets, u16 rx octets,
+                                //   u16 MTU, u8 PHY outcome, u8 data length outcome
+                                //   (LinkOutcome), u32 ms to settle (requesting central)
+    OP_READ_PEERS      = 0x0C,  // [u8 index] -> u8 centrals connected, u8 index, u16 conn id,
+                                //   u16 MTU, u8 subscriptions (PeerSubscription), u8 1 if
+                                //   this is the requesting central, u16 queue depth,
+                                //   u16 max queue depth, u32 notifications, u32 bytes,
+                                //   u32 dropped frames, u32 dropped samples, u32 ms connected,
+                                //   u32 sector, u16 offset (acknowledged log sync position)
+    OP_READ_BONDS      = 0x0D,  // [u8 index] -> u8 bonds, u32 reconnects, u32 directed,
+                                //   u32 directed hits, u32 last ms, u32 fastest ms,
+                                //   u32 Service Changed sent, u32 GATT signature, then for
+                                //   bond index if stored: u8 index, 6 address, u8 address
+                                //   type, u8 1 if connected, u32 GATT signature it last saw
+    OP_READ_ADVERTISING = 0x0E, // -> u8 state, u8 previous state (AdvState), u16 interval,
+                                //   u32 ms in state, u32 starts, u32 failures, u32 timeouts,
+                                //   then per state u32 times entered
+    OP_COUNT
+};
+
+enum CommandStatus : uint8_t {
+    STATUS_OK             = 0,
+    STATUS_UNKNOWN_OPCODE = 1,
+    STATUS_BAD_LENGTH     = 2,
+    STATUS_BAD_VALUE      = 3,
+    STATUS_TOO_LONG       = 4,  // the reply does not fit the central's MTU
+};
+
+struct OpcodeStats {
+    uint32_t calls;
+    uint32_t totalUs;
+    uint32_t maxUs;
+};
+
+// What handlers may touch
+struct CommandContext {
+    DeviceConfig* config;
+    TelemetrySample (*snapshot)();
+    const SampleJitter* jitter;
+    const BatteryMonitor* battery;
+    const PeerTable* peers;
+    const BondTable* bonds;
+    const AdvertisingManager* advertising;
+    uint16_t connId;  // central that wrote the request being run
+};
+
+class CommandDispatcher {
+public:
+    explicit CommandDispatcher(const CommandContext& context) : m_context(context) {}
+
+    // Run one request and write the response frame, at most cap bytes,
+    // into out. Returns the response length, or 0 if the bytes are not a
+    // well-formed request.
+    size_t dispatch(const Command& cmd, uint8_t* out, size_t cap);
+
+    const OpcodeStats& stats(uint8_t opcode) const { return m_stats[opcode]; }
+
+private:
+    CommandContext m_context;
+    OpcodeStats m_stats[OP_COUNT] = {};
+};
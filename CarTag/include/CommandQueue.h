@@ -0,0 +1,93 @@
+/**
+ * Queue of incoming characteristic writes
+ *
+ * MyCallbacks::onWrite runs on the BLE host task, so it only copies the
+ * written bytes into a preallocated slot and returns. The command task (the
+ * main loop in the legacy build) drains the queue and does the actual work.
+ * Counters show when the app writes faster than the device consumes.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+#include "SpscQueue.h"
+
+#ifndef COMMAND_SLOT_SIZE
+#define COMMAND_SLOT_SIZE 64
+#endif
+#ifndef COMMAND_QUEUE_DEPTH
+#define COMMAND_QUEUE_DEPTH 16
+#endif
+
+struct Command {
+    uint16_t connId;
+    uint8_t length;
+    uint8_t data[COMMAND_SLOT_SIZE];
+};
+
+struct CommandQueueStats {
+    uint32_t received;   // writes accepted into the queue
+    uint32_t dropped;    // writes lost because every slot was full
+    uint32_t truncated;  // writes longer than COMMAND_SLOT_SIZE
+    uint32_t highWater;  // deepest the queue has been
+};
+
+class CommandQueue {
+public:
+    // Producer (BLE task): copy one write into a free slot, never blocks
+    bool enqueue(const uint8_t* data, size_t len, uint16_t connId = 0) {
+        Command* slot = m_queue.beginPush();
+        if (!slot) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (len > COMMAND_SLOT_SIZE) {
+            len = COMMAND_SLOT_SIZE;
+            m_truncated.fetch_add(1, std::memory_order_relaxed);
+        }
+        slot->connId = connId;
+        slot->length = (uint8_t)len;
+        memcpy(slot->data, data, len);
+        m_queue.commitPush();
+        m_received.fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t depth = (uint32_t)m_queue.size();
+        if (depth > m_highWater.load(std::memory_order_relaxed)) {
+            m_highWater.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer: pass each pending command to handler in place; returns how many ran
+    template <typename Handler>
+    size_t drain(Handler handler) {
+        size_t n = 0;
+        while (Command* cmd = m_queue.front()) {
+            handler(*cmd);
+            m_queue.commitPop();
+            n++;
+        }
+        return n;
+    }
+
+    size_t depth() const { return m_queue.size(); }
+
+    CommandQueueStats stats() const {
+        return {
+            m_received.load(std::memory_order_relaxed),
+            m_dropped.load(std::memory_order_relaxed),
+            m_truncated.load(std::memory_order_relaxed),
+            m_highWater.load(std::memory_order_relaxed),
+        };
+    }
+
+private:
+    SpscQueue<Command, COMMAND_QUEUE_DEPTH> m_queue;
+    std::atomic<uint32_t> m_received{0};
+    std::atomic<uint32_t> m_dropped{0};
+    std::atomic<uint32_t> m_truncated{0};
+    std::atomic<uint32_t> m_highWater{0};
+};
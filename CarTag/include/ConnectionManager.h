@@ -0,0 +1,108 @@
+/**
+ * Connection parameter policy
+ *
+ * Picks the connection interval, slave latency and supervision timeout
+ * for what the link is doing, and keeps the values the central actually
+ * granted. Four profiles, from the slowest to the fastest:
+ *
+ *   profile  interval         latency  timeout  used for
+ *   idle     100-200 ms       4        6 s      connected, nothing streaming
+ *   stream   30-60 ms         0        4 s      batched telemetry, PID polls
+ *   race     7.5-11.25 ms     0        2 s      streaming with a batch
+ *                                               latency of CONN_RACE_LATENCY_MS
+ *                                               or less
+ *   bulk     7.5-15 ms        0        4 s      log download
+ *
+ * A faster profile is requested as soon as the workload needs it. A slower
+ * one only after the workload has wanted it for CONN_PROFILE_HOLD_MS, so a
+ * short gap, such as between two log queries, does not bounce the link
+ * between profiles. Right after connecting, a profile slower than the
+ * interval the central picked counts as slower too, so discovery and the
+ * first subscriptions run at the connect parameters.
+ *
+ * The central has the last word: it may grant other values or reject the
+ * request, e.g. iOS does not go below 15 ms. Granted values come from the
+ * GAP connection update event and are reported as they are; a rejected
+ * profile is not requested again until the workload changes.
+ *
+ * Intervals are in units of 1.25 ms and timeouts in units of 10 ms, as on
+ * the air.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef CONN_PROFILE_HOLD_MS
+#define CONN_PROFILE_HOLD_MS 2000
+#endif
+#ifndef CONN_RACE_LATENCY_MS
+#define CONN_RACE_LATENCY_MS 50
+#endif
+
+enum ConnProfile : uint8_t {
+    CONN_PROFILE_NONE   = 0,  // not connected, or nothing requested yet
+    CONN_PROFILE_IDLE   = 1,
+    CONN_PROFILE_STREAM = 2,
+    CONN_PROFILE_RACE   = 3,
+    CONN_PROFILE_BULK   = 4,
+    CONN_PROFILE_COUNT
+};
+
+struct ConnParams {
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+// What the link is busy with
+struct ConnWorkload {
+    bool streaming;           // binary telemetry or PID results being pushed
+    uint32_t batchLatencyMs;  // CONFIG_BATCH_LATENCY_MS
+    bool bulkTransfer;        // log download running
+};
+
+struct ConnManagerStats {
+    ConnProfile profile;      // last profile requested and not rejected
+    ConnProfile previous;     // profile before the last transition
+    uint16_t interval;        // granted by the central
+    uint16_t latency;
+    uint16_t timeout;
+    uint32_t transitions;     // profile changes requested since boot
+    uint32_t rejected;        // requests the central turned down
+    uint32_t adjusted;        // grants outside the requested interval range
+    uint32_t profileSinceMs;  // time of the last transition
+};
+
+// Parameters requested for a profile
+const ConnParams& connProfileParams(ConnProfile profile);
+const char* connProfileName(ConnProfile profile);
+
+// The profile a workload calls for
+ConnProfile selectConnProfile(const ConnWorkload& workload);
+
+class ConnectionManager {
+public:
+    // A central connected with these parameters
+    void connected(uint16_t interval, uint16_t latency, uint16_t timeout, uint32_t nowMs);
+
+    // Feed the profile the workload wants; true, with the parameters to
+    // request in params, when the link should move to it now
+    bool update(ConnProfile wanted, uint32_t nowMs, ConnParams& params);
+
+    // ms until a held-back move to a slower profile is due, or UINT32_MAX
+    uint32_t msUntilUpdate(uint32_t nowMs) const;
+
+    // Result of the last request, from the GAP connection update event;
+    // status 0 is success
+    void granted(uint8_t status, uint16_t interval, uint16_t latency, uint16_t timeout);
+
+    ConnManagerStats stats() const { return m_stats; }
+
+private:
+    ConnProfile m_wanted = CONN_PROFILE_NONE;
+    uint32_t m_wantedSinceMs = 0;
+    ConnProfile m_rejected = CONN_PROFILE_NONE;  // not asked for again while wanted
+    ConnManagerStats m_stats = {};
+};
@@ -0,0 +1,50 @@
+/**
+ * Runtime configuration, readable and writable over BLE
+ *
+ * Every setting is a uint32 addressed by a one-byte key so the command
+ * protocol can read and write them generically. Defaults come from build
+ * flags; values written by the app are range-checked against the limits
+ * table in DeviceConfig.cpp.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Build-time defaults
+#ifndef SAMPLE_INTERVAL_MS
+#define SAMPLE_INTERVAL_MS 20
+#endif
+#ifndef BATCH_MAX_LATENCY_MS
+#define BATCH_MAX_LATENCY_MS 200
+#endif
+#ifndef BROADCAST_INTERVAL_MS
+#define BROADCAST_INTERVAL_MS 0
+#endif
+
+enum ConfigKey : uint8_t {
+    CONFIG_SAMPLE_INTERVAL_MS = 0,  // binary telemetry sampling period, 1-1000 ms
+    CONFIG_BATCH_LATENCY_MS   = 1,  // longest a sample may wait in a batch
+    CONFIG_TELEMETRY_FORMAT   = 2,  // TelemetryFormat
+    CONFIG_STREAM_ENABLED     = 3,  // 0 = telemetry notifications paused
+    CONFIG_LOG_ENABLED        = 4,  // 1 = record samples to flash while disconnected
+    CONFIG_COMPRESSION        = 5,  // 1 = stream compressed blocks instead of batch frames
+    CONFIG_BROADCAST_MS       = 6,  // telemetry beacon refresh period, 0 = not broadcast
+    CONFIG_KEY_COUNT
+};
+
+class DeviceConfig {
+public:
+    DeviceConfig();
+
+    uint32_t get(ConfigKey key) const { return m_values[key]; }
+
+    // Read by raw key; false if the key does not exist
+    bool get(uint8_t key, uint32_t& value) const;
+
+    // False if the key does not exist or the value is out of range
+    bool set(uint8_t key, uint32_t value);
+
+private:
+    uint32_t m_values[CONFIG_KEY_COUNT];
+};
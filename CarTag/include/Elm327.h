@@ -0,0 +1,81 @@
+/**
+ * ELM327-compatible command interpreter
+ *
+ * Speaks the text protocol the app's useOBD hook already uses over NUS:
+ * "AT..." commands configure the session, hex strings such as "010C" are
+ * sent to the vehicle backend and answered as "41 0C 1A F8", and every
+ * reply ends with the "\r\r>" prompt. Supported AT commands: Z, D, I, @1,
+ * E0/E1, L0/L1, S0/S1, H0/H1, SP, DP, DPN, RV, ST, AT.
+ *
+ * CarTag extensions for on-device polling (see PidScheduler):
+ *   ATSUB ppmmmm   poll PID pp every mmmm ms (hex), results are pushed
+ *                  unsolicited as "41 pp ..." lines without a prompt
+ *   ATUNSUB [pp]   stop polling PID pp, or every PID
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NusService.h"
+#include "PidScheduler.h"
+#include "VehicleBackend.h"
+
+#define ELM_LINE_MAX 48
+#define ELM_VERSION  "ELM327 v1.5"
+
+struct ElmStats {
+    uint32_t commands;           // lines executed, AT and OBD
+    uint32_t obdRequests;        // lines sent to the vehicle backend
+    uint32_t errors;             // "?", NO DATA, CAN ERROR replies
+    uint32_t totalTurnaroundUs;  // line complete -> reply queued
+    uint32_t maxTurnaroundUs;
+};
+
+class Elm327 {
+public:
+    Elm327(VehicleBackend& backend, BytePipe<NUS_PIPE_SIZE>& out);
+
+    // Bytes from the phone; each complete line is executed immediately
+    void feed(const uint8_t* data, size_t len);
+
+    // Back to power-on settings (ATZ / ATD)
+    void reset();
+
+    // Enables ATSUB/ATUNSUB
+    void setScheduler(PidScheduler* scheduler) { m_scheduler = scheduler; }
+
+    // Push one unsolicited response line, formatted like a polled reply
+    void pushResult(const uint8_t* resp, size_t len);
+
+    const ElmStats& stats() const { return m_stats; }
+
+private:
+    void execute(const char* line);
+    void executeAt(const char* cmd);
+    void executeObd(const char* hex);
+    void executeSubscribe(const char* args, bool subscribe);
+    void printResponse(const uint8_t* resp, size_t len);
+
+    void print(const char* text);
+    void printHexByte(uint8_t value, bool leadingSpace);
+    void endLine();
+    void reply(const char* text);
+
+    VehicleBackend& m_backend;
+    BytePipe<NUS_PIPE_SIZE>& m_out;
+    PidScheduler* m_scheduler = nullptr;
+
+    char m_line[ELM_LINE_MAX + 1];
+    size_t m_lineLen = 0;
+    bool m_lineOverflow = false;
+    char m_lastCommand[ELM_LINE_MAX + 1];
+
+    bool m_echo;
+    bool m_linefeeds;
+    bool m_spaces;
+    bool m_headers;
+
+    ElmStats m_stats = {};
+};
@@ -0,0 +1,104 @@
+/**
+ * Event-driven firmware task
+ *
+ * Each task sleeps until another task or a BLE callback signals it with
+ * event bits, or until the wake-up time its handler asked for last time,
+ * then runs the handler once with the bits that arrived. The handler
+ * returns how long the task may sleep before it has timed work again
+ * (EVENT_TASK_WAIT_FOREVER when only events can wake it), so an idle
+ * device does no work at all.
+ *
+ * On the ESP32 every task is a FreeRTOS task pinned to a core and woken
+ * through its direct-to-task notification word. The native build has no
+ * RTOS: runReady() runs the due tasks cooperatively in priority order
+ * from loop() against the virtual clock.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef CARTAG_NATIVE
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
+
+#define EVENT_TASK_WAIT_FOREVER 0xFFFFFFFFu
+
+// The BLE controller and host run on the protocol core; the firmware's
+// time-critical work goes on the application core
+#define EVENT_TASK_CORE_PROTOCOL 0
+#define EVENT_TASK_CORE_APP 1
+
+#ifndef EVENT_TASK_MAX
+#define EVENT_TASK_MAX 8
+#endif
+
+// Runs once per wake-up; returns ms until the next timed wake-up
+typedef uint32_t (*EventTaskHandler)(uint32_t events, uint32_t nowMs);
+
+struct EventTaskStats {
+    uint32_t wakeups;    // handler runs
+    uint32_t timeouts;   // wake-ups with no event bits, i.e. timed work
+    uint32_t maxRunUs;   // longest handler run
+};
+
+class EventTask {
+public:
+    EventTask(const char* name, EventTaskHandler handler, uint8_t priority,
+              uint8_t core, uint32_t stackBytes = 4096);
+
+    // Create the task; its handler runs once straight away with no events
+    bool start();
+
+    // OR event bits into the task's pending set and wake it. Safe from any
+    // task or BLE callback, and a no-op before start(); signalFromIsr() is
+    // the interrupt variant.
+    void signal(uint32_t events);
+    void signalFromIsr(uint32_t events);
+
+    const char* name() const { return m_name; }
+    EventTaskStats stats() const { return m_stats; }
+
+    // Native build: run every task that has events pending or whose
+    // wake-up time has passed, highest priority first, until none is
+    // ready. Returns the number of handler runs.
+    static size_t runReady(uint32_t nowMs);
+
+private:
+    void runOnce(uint32_t events);
+
+    const char* m_name;
+    EventTaskHandler m_handler;
+    uint8_t m_priority;
+    uint8_t m_core;
+    uint32_t m_stackBytes;
+    uint32_t m_sleepMs = 0;
+    EventTaskStats m_stats = {};
+
+#ifdef CARTAG_NATIVE
+    uint32_t m_pending = 0;
+    uint32_t m_wakeMs = 0;
+    bool m_started = false;
+#else
+    static void entry(void* arg);
+    TaskHandle_t m_handle = nullptr;
+#endif
+};
+
+// Mutex for state shared by tasks, e.g. a characteristic two tasks
+// notify on. A no-op in the single-threaded native build.
+class TaskLock {
+public:
+    TaskLock();
+    void lock();
+    void unlock();
+
+private:
+#ifndef CARTAG_NATIVE
+    StaticSemaphore_t m_storage;
+    SemaphoreHandle_t m_mutex;
+#endif
+};
@@ -0,0 +1,264 @@
+/**
+ * Fixed-point filter kernels for sensor sampling
+ *
+ * Integer-only building blocks for the sampling path, so filtering never
+ * touches the FPU (single precision only on the ESP32, and double is done
+ * in software). Everything is header-only and sized by template
+ * parameters, with no heap use:
+ *
+ *   MovingAverage<T, N>      boxcar over the last N samples, running sum
+ *   OnePoleLowPass<SHIFT>    y += (x - y) / 2^SHIFT with a Q-format state
+ *   BiquadCascade<S, FRAC>   S direct form I sections, Q(FRAC) coefficients
+ *   CicDecimator<ORDER, R>   Hogenauer integrate/comb decimator by R
+ *   MedianFilter<T, N>       running median of the last N samples
+ *
+ * Filters start from a zero state unless reset() seeds them. The host
+ * benchmark in src/bench/DspBench.cpp checks each kernel against a double
+ * reference and measures its cost per sample.
+ */
+
+#pragma once
+
+#include <limits>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace dsp {
+
+// Clamp a wide intermediate into the range of T
+template <typename T, typename W>
+inline T saturate(W v) {
+    const W lo = (W)std::numeric_limits<T>::min();
+    const W hi = (W)std::numeric_limits<T>::max();
+    return (T)(v < lo ? lo : v > hi ? hi : v);
+}
+
+// Signed division rounding half away from zero
+template <typename W>
+inline W divRound(W num, W den) {
+    return num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+template <typename T, size_t N, typename Acc = int32_t>
+class MovingAverage {
+    static_assert(N > 0, "window must not be empty");
+
+public:
+    // Fill the window with value, e.g. the first reading
+    void reset(T value = 0) {
+        for (size_t i = 0; i < N; i++) m_window[i] = value;
+        m_sum = (Acc)value * (Acc)N;
+        m_pos = 0;
+    }
+
+    T push(T x) {
+        m_sum += (Acc)x - (Acc)m_window[m_pos];
+        m_window[m_pos] = x;
+        m_pos = m_pos + 1 == N ? 0 : m_pos + 1;
+        return (T)divRound<Acc>(m_sum, (Acc)N);
+    }
+
+private:
+    T m_window[N] = {};
+    Acc m_sum = 0;
+    size_t m_pos = 0;
+};
+
+// First-order IIR low-pass. The state keeps FRAC extra bits so small
+// steps are not lost to truncation; inputs must stay within
+// +-2^(31 - FRAC).
+template <int SHIFT, int FRAC = 16>
+class OnePoleLowPass {
+    static_assert(SHIFT > 0 && SHIFT < FRAC && FRAC < 31, "bad shift or fraction");
+
+public:
+    void reset(int32_t value) {
+        m_state = value * ((int32_t)1 << FRAC);
+        m_primed = true;
+    }
+
+    // The first sample seeds the state instead of ramping up from zero
+    int32_t push(int32_t x) {
+        if (!m_primed) {
+            reset(x);
+        } else {
+            int32_t delta = x * ((int32_t)1 << FRAC) - m_state;
+            m_state += delta >> SHIFT;
+        }
+        return value();
+    }
+
+    int32_t value() const { return (m_state + ((int32_t)1 << (FRAC - 1))) >> FRAC; }
+
+private:
+    int32_t m_state = 0;
+    bool m_primed = false;
+};
+
+// Biquad coefficients normalised by a0, in double for design and reference
+struct BiquadDesign {
+    double b0, b1, b2, a1, a2;
+};
+
+// RBJ cookbook low-pass at cutoffHz for a sample rate of sampleHz
+inline BiquadDesign designLowPass(double cutoffHz, double sampleHz, double q = 0.70710678) {
+    double w0 = 2.0 * M_PI * cutoffHz / sampleHz;
+    double alpha = sin(w0) / (2.0 * q);
+    double cosw = cos(w0);
+    double a0 = 1.0 + alpha;
+    return {(1.0 - cosw) / 2.0 / a0, (1.0 - cosw) / a0, (1.0 - cosw) / 2.0 / a0,
+            -2.0 * cosw / a0, (1.0 - alpha) / a0};
+}
+
+// Quantised section: y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2
+struct BiquadCoeffs {
+    int32_t b0, b1, b2, a1, a2;
+};
+
+// Direct form I, rounding once per section. Samples are carried with GUARD
+// extra fraction bits between sections so rounding noise, amplified by the
+// poles, stays below one input LSB. With FRAC = 28 coefficients reach +-8,
+// and samples must fit in 24 - GUARD bits for the 64-bit accumulator to be
+// exact.
+template <size_t STAGES, int FRAC = 28, int GUARD = 8>
+class BiquadCascade {
+    static_assert(STAGES > 0 && FRAC > 0 && FRAC < 31, "bad cascade shape");
+    static_assert(GUARD >= 0 && GUARD < 16, "bad guard bits");
+
+public:
+    static BiquadCoeffs quantize(const BiquadDesign& d) {
+        const double scale = (double)((int64_t)1 << FRAC);
+        return {(int32_t)lround(d.b0 * scale), (int32_t)lround(d.b1 * scale),
+                (int32_t)lround(d.b2 * scale), (int32_t)lround(d.a1 * scale),
+                (int32_t)lround(d.a2 * scale)};
+    }
+
+    void setStage(size_t i, const BiquadCoeffs& c) { m_coeffs[i] = c; }
+    void setStage(size_t i, const BiquadDesign& d) { m_coeffs[i] = quantize(d); }
+
+    // Settle every section at its DC response to value
+    void reset(int32_t value = 0) {
+        int64_t x = (int64_t)value * ((int64_t)1 << GUARD);
+        for (size_t i = 0; i < STAGES; i++) {
+            const BiquadCoeffs& c = m_coeffs[i];
+            int64_t num = (int64_t)c.b0 + c.b1 + c.b2;
+            int64_t den = ((int64_t)1 << FRAC) + c.a1 + c.a2;
+            int64_t y = den ? x * num / den : 0;
+            m_state[i] = {(int32_t)x, (int32_t)x, (int32_t)y, (int32_t)y};
+            x = y;
+        }
+    }
+
+    int32_t push(int32_t sample) {
+        int32_t x = sample * ((int32_t)1 << GUARD);
+        for (size_t i = 0; i < STAGES; i++) {
+            const BiquadCoeffs& c = m_coeffs[i];
+            State& s = m_state[i];
+            int64_t acc = (int64_t)c.b0 * x + (int64_t)c.b1 * s.x1 + (int64_t)c.b2 * s.x2 -
+                          (int64_t)c.a1 * s.y1 - (int64_t)c.a2 * s.y2;
+            int32_t y = saturate<int32_t>((acc + ((int64_t)1 << (FRAC - 1))) >> FRAC);
+            s.x2 = s.x1;
+            s.x1 = x;
+            s.y2 = s.y1;
+            s.y1 = y;
+            x = y;
+        }
+        if (GUARD == 0) return x;
+        return (x + ((int32_t)1 << GUARD >> 1)) >> GUARD;
+    }
+
+private:
+    struct State {
+        int32_t x1, x2, y1, y2;
+    };
+
+    BiquadCoeffs m_coeffs[STAGES] = {};
+    State m_state[STAGES] = {};
+};
+
+// Cascaded integrator-comb decimator. Integrators run in wrapping unsigned
+// arithmetic, which is exact as long as the true output (gain R^ORDER
+// times the input) fits in 32 bits; push() divides the gain back out.
+template <int ORDER, uint32_t R>
+class CicDecimator {
+    static constexpr uint64_t gainOf(int order) { return order == 0 ? 1 : R * gainOf(order - 1); }
+    static constexpr int shiftOf(uint64_t v) { return v <= 1 ? 0 : 1 + shiftOf(v >> 1); }
+
+public:
+    static constexpr uint64_t GAIN = gainOf(ORDER);
+    static_assert(ORDER > 0 && R > 1, "need at least one stage and a ratio above 1");
+    static_assert(GAIN <= 0x7FFFFFFF, "R^ORDER must fit in 31 bits");
+
+    // True once every R inputs, with the decimated sample in out
+    bool push(int32_t x, int32_t& out) {
+        uint32_t v = (uint32_t)x;
+        for (int i = 0; i < ORDER; i++) {
+            m_integrators[i] += v;
+            v = m_integrators[i];
+        }
+        if (++m_phase < R) return false;
+        m_phase = 0;
+
+        for (int i = 0; i < ORDER; i++) {
+            uint32_t d = v - m_combs[i];
+            m_combs[i] = v;
+            v = d;
+        }
+        if constexpr ((GAIN & (GAIN - 1)) == 0) {
+            out = (int32_t)(((int64_t)(int32_t)v + (int64_t)(GAIN / 2)) >> shiftOf(GAIN));
+        } else {
+            out = (int32_t)divRound<int64_t>((int32_t)v, (int64_t)GAIN);
+        }
+        return true;
+    }
+
+    uint32_t phase() const { return m_phase; }
+
+private:
+    uint32_t m_integrators[ORDER] = {};
+    uint32_t m_combs[ORDER] = {};
+    uint32_t m_phase = 0;
+};
+
+// Running median: a window ring plus a sorted copy updated by one removal
+// and one insertion per sample, O(N) with no allocation. Until N samples
+// have arrived it returns the median of those seen so far.
+template <typename T, size_t N>
+class MedianFilter {
+    static_assert(N % 2 == 1, "use an odd window so the median is a sample");
+
+public:
+    T push(T x) {
+        size_t n = m_count;
+        if (m_count == N) {
+            // Drop the oldest sample from the sorted copy
+            T old = m_window[m_pos];
+            size_t i = 0;
+            while (m_sorted[i] != old) i++;
+            for (; i + 1 < N; i++) m_sorted[i] = m_sorted[i + 1];
+            n = N - 1;
+        } else {
+            m_count++;
+        }
+
+        size_t i = n;
+        while (i > 0 && m_sorted[i - 1] > x) {
+            m_sorted[i] = m_sorted[i - 1];
+            i--;
+        }
+        m_sorted[i] = x;
+
+        m_window[m_pos] = x;
+        m_pos = m_pos + 1 == N ? 0 : m_pos + 1;
+        return m_sorted[m_count / 2];
+    }
+
+private:
+    T m_window[N] = {};
+    T m_sorted[N] = {};
+    size_t m_count = 0;
+    size_t m_pos = 0;
+};
+
+}  // namespace dsp
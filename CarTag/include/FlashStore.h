@@ -0,0 +1,41 @@
+/**
+ * Raw NOR flash region for the telemetry log
+ *
+ * Offsets are relative to the start of the region. Flash semantics apply:
+ * erase() sets a whole sector to 0xFF, and write() can only clear bits,
+ * so a byte may be programmed again as long as no bit goes from 0 to 1.
+ * Implemented by a data partition on the device and by RAM on the host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASH_SECTOR_SIZE 4096
+
+struct FlashStats {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t erases;
+    uint32_t errors;
+};
+
+class FlashStore {
+public:
+    virtual ~FlashStore() {}
+
+    virtual bool begin() = 0;
+    virtual uint32_t sectorCount() const = 0;
+
+    virtual bool read(uint32_t offset, void* out, size_t len) = 0;
+    virtual bool write(uint32_t offset, const void* data, size_t len) = 0;
+
+    // Slow: tens of milliseconds on real flash
+    virtual bool erase(uint32_t sector) = 0;
+
+    const FlashStats& stats() const { return m_stats; }
+
+protected:
+    FlashStats m_stats = {};
+};
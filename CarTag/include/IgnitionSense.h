@@ -0,0 +1,53 @@
+/**
+ * Ignition line sensing
+ *
+ * The switched ignition (or ACC) feed, through an optocoupler or a divider
+ * to 3.3 V, on IGNITION_PIN: high while the ignition is on. Cranking pulls
+ * the line down and relays bounce, so a new level only counts once it has
+ * held for IGNITION_DEBOUNCE_MS. poll() is cheap (one pin read) and never
+ * waits; call it every few tens of milliseconds.
+ *
+ * Build with -D CARTAG_IGNITION_SENSE to read the pin. Otherwise the
+ * ignition is always on, as if the car were being driven. The native build
+ * always reads the pin, which the simulator drives (--ignition).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef IGNITION_PIN
+#define IGNITION_PIN 27
+#endif
+#ifndef IGNITION_DEBOUNCE_MS
+#define IGNITION_DEBOUNCE_MS 2000
+#endif
+
+struct IgnitionStats {
+    uint32_t changes;        // debounced transitions
+    uint32_t glitches;       // level changes that did not hold
+    uint32_t lastChangeMs;
+};
+
+class IgnitionSense {
+public:
+    // Configure the pin and take its level as the starting state
+    void begin(uint32_t nowMs);
+
+    // True if the debounced state changed
+    bool poll(uint32_t nowMs);
+    bool on() const { return m_on; }
+
+    // False when the ignition is assumed on, with no line to read
+    bool sensed() const;
+
+    IgnitionStats stats() const { return m_stats; }
+
+private:
+    bool read() const;
+
+    volatile bool m_on = true;
+    bool m_level = true;          // last raw level
+    uint32_t m_levelSinceMs = 0;
+    IgnitionStats m_stats = {};
+};
@@ -0,0 +1,87 @@
+/**
+ * ISO 15765-2 (ISO-TP) segmentation and reassembly
+ *
+ * Diagnostic messages longer than seven bytes, such as the VIN (mode 09)
+ * or a DTC list (mode 03), are split into a first frame and consecutive
+ * frames paced by the receiver's flow control. These classes only build
+ * and parse frames; the caller owns the bus and the timeouts, so the same
+ * code serves the OBD backend and the simulated ECU on the loopback bus.
+ *
+ * Frames are always padded to eight bytes, as ISO 15765-4 requires.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "CanBus.h"
+
+#ifndef ISOTP_MAX_MESSAGE
+#define ISOTP_MAX_MESSAGE 128
+#endif
+
+#define ISOTP_PADDING 0x55
+
+// Protocol control information, high nibble of the first byte
+#define ISOTP_SINGLE_FRAME       0x00
+#define ISOTP_FIRST_FRAME        0x10
+#define ISOTP_CONSECUTIVE_FRAME  0x20
+#define ISOTP_FLOW_CONTROL       0x30
+
+#define ISOTP_FC_CONTINUE  0x00
+#define ISOTP_FC_WAIT      0x01
+#define ISOTP_FC_OVERFLOW  0x02
+
+enum IsoTpRxResult {
+    ISOTP_RX_IGNORED,            // not a data frame, or unexpected here
+    ISOTP_RX_IN_PROGRESS,
+    ISOTP_RX_SEND_FLOW_CONTROL,  // first frame accepted, sender waits for FC
+    ISOTP_RX_COMPLETE,
+    ISOTP_RX_ERROR,              // sequence error or message too long
+};
+
+// Flow control frame (id left for the caller to fill in)
+void isoTpFlowControl(CanFrame& frame, uint8_t status, uint8_t blockSize, uint8_t stMin);
+
+class IsoTpReassembler {
+public:
+    IsoTpRxResult feed(const CanFrame& frame);
+    void reset();
+
+    const uint8_t* data() const { return m_data; }
+    size_t length() const { return m_length; }
+
+private:
+    uint8_t m_data[ISOTP_MAX_MESSAGE];
+    size_t m_length = 0;     // total message length
+    size_t m_received = 0;
+    uint8_t m_sequence = 0;  // next expected CF sequence number
+    bool m_active = false;
+};
+
+class IsoTpSegmenter {
+public:
+    // Copies the message; false if it exceeds ISOTP_MAX_MESSAGE
+    bool start(const uint8_t* data, size_t len);
+
+    // Next frame to transmit; false when done or waiting for flow control
+    bool next(CanFrame& frame);
+
+    // Flow control from the receiver; false if it aborted the transfer
+    bool onFlowControl(const CanFrame& frame);
+
+    bool waitingForFlowControl() const { return m_waitFc; }
+    bool done() const { return m_sent == m_length && !m_waitFc; }
+    uint8_t separationTimeMs() const { return m_stMin; }
+
+private:
+    uint8_t m_data[ISOTP_MAX_MESSAGE];
+    size_t m_length = 0;
+    size_t m_sent = 0;
+    uint8_t m_sequence = 0;
+    uint8_t m_blockSize = 0;   // CFs per block, 0 = no limit
+    uint8_t m_blockLeft = 0;
+    uint8_t m_stMin = 0;
+    bool m_waitFc = false;
+};
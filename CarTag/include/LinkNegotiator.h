@@ -0,0 +1,98 @@
+/**
+ * Link layer negotiation after a connection comes up
+ *
+ * A new link runs on the LE 1M PHY with 27-byte link layer PDUs, so a
+ * 244-byte notification takes ten PDUs, each with its own header and
+ * inter-frame space. Right after connecting the firmware asks for
+ * LINK_MAX_TX_OCTETS-byte PDUs (data length extension) and for the 2M PHY.
+ * Together they let one notification go out in a single PDU at twice the
+ * air rate, for roughly four times the throughput.
+ *
+ * Each request is in one of four states:
+ *
+ *   accepted     the central switched, e.g. both directions on 2M
+ *   refused      the central answered with an error, kept the old value,
+ *                or did not answer within LINK_NEGOTIATION_TIMEOUT_MS
+ *   unsupported  the controller cannot do it; the classic ESP32 is a
+ *                Bluetooth 4.2 part with no 2M PHY
+ *   pending      still waiting
+ *
+ * A refused request is not sent again on the same connection: the link
+ * just keeps running on 1M and/or 27-byte PDUs. Whatever the outcome, the
+ * negotiated PHY, PDU size and ATT MTU are reported together, since the
+ * MTU only decides how much fits in one notification and the other two
+ * how fast it goes.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define LINK_DEFAULT_OCTETS 27
+#define LINK_MAX_TX_OCTETS  251
+
+#ifndef LINK_NEGOTIATION_TIMEOUT_MS
+#define LINK_NEGOTIATION_TIMEOUT_MS 2000
+#endif
+
+enum LinkPhy : uint8_t {
+    LINK_PHY_1M    = 1,
+    LINK_PHY_2M    = 2,
+    LINK_PHY_CODED = 3,
+};
+
+enum LinkOutcome : uint8_t {
+    LINK_NOT_REQUESTED = 0,
+    LINK_PENDING       = 1,
+    LINK_ACCEPTED      = 2,
+    LINK_REFUSED       = 3,
+    LINK_UNSUPPORTED   = 4,
+};
+
+struct LinkStats {
+    uint8_t txPhy;          // LinkPhy
+    uint8_t rxPhy;
+    uint16_t txOctets;      // link layer payload per PDU
+    uint16_t rxOctets;
+    uint16_t mtu;           // ATT MTU
+    LinkOutcome phy;
+    LinkOutcome dataLength;
+    uint32_t settleMs;      // connect to the last answer; 0 while pending
+};
+
+const char* linkPhyName(uint8_t phy);
+const char* linkOutcomeName(LinkOutcome outcome);
+
+class LinkNegotiator {
+public:
+    // A new link on 1M with default PDUs and MTU
+    void connected(uint32_t nowMs);
+
+    // Record the requests as sent; sent is false if the stack turned the
+    // request down before it reached the central
+    void dataLengthRequested(bool sent, uint32_t nowMs);
+    void phyRequested(bool sent, uint32_t nowMs);
+    void phyUnsupported(uint32_t nowMs);
+
+    // Answers from the GAP events; status 0 is success
+    void dataLengthUpdated(uint8_t status, uint16_t txOctets, uint16_t rxOctets, uint32_t nowMs);
+    void phyUpdated(uint8_t status, uint8_t txPhy, uint8_t rxPhy, uint32_t nowMs);
+    void mtuChanged(uint16_t mtu) { m_stats.mtu = mtu; }
+
+    // Give up on requests that were never answered; true when this call
+    // settled the negotiation
+    bool service(uint32_t nowMs);
+
+    // ms until a pending request times out, or UINT32_MAX
+    uint32_t msUntilTimeout(uint32_t nowMs) const;
+
+    bool settled() const { return m_stats.phy != LINK_PENDING && m_stats.dataLength != LINK_PENDING; }
+    LinkStats stats() const { return m_stats; }
+
+private:
+    void settle(uint32_t nowMs);
+
+    uint32_t m_connectedMs = 0;
+    uint32_t m_requestMs = 0;
+    LinkStats m_stats = {};
+};
@@ -0,0 +1,196 @@
+/**
+ * Bulk download of the offline telemetry log
+ *
+ * A GATT service of its own with three characteristics:
+ *
+ *   control  write / write without response, from the app
+ *   data     notify, log records packed back-to-back
+ *   stats    read / notify, transfer progress and throughput
+ *
+ * Control writes:
+ *
+ *   0x01 START [u32 sector, u16 offset] [u8 window]
+ *        Stream from the given log position, the oldest record if it is
+ *        omitted or 0, or from the last acknowledged position of the
+ *        previous transfer if sector is 0xFFFFFFFF. window is how many
+ *        packets may be unacknowledged (1-LOG_SYNC_MAX_WINDOW, default
+ *        LOG_SYNC_DEFAULT_WINDOW).
+ *   0x02 ACK u16 packet
+ *        Every packet up to and including this one arrived.
+ *   0x03 STOP
+ *   0x04 QUERY u32 fromMs [u32 toMs] [u8 window]
+ *        Stream only the records with samples between fromMs and toMs
+ *        (ms since boot, inclusive; to the end of the log if omitted or
+ *        0xFFFFFFFF). Records go whole, so the first and last may hold
+ *        samples outside the range for the app to drop. The transfer
+ *        seeks straight to the sector holding fromMs through the log's
+ *        time index and ends with the first record past toMs. Only
+ *        records written since the device booted are searched. To resume,
+ *        query again from the newest sample received.
+ *   0x05 RECENT u32 durationMs [u8 window]
+ *        QUERY for the last durationMs, to the end of the log.
+ *
+ * Data packets fill the negotiated ATT payload (MTU - 3):
+ *
+ *   offset  size  field
+ *   0       1     magic (0xCC)
+ *   1       1     flags (LOG_SYNC_FLAG_*)
+ *   2       2     packet number, from 0 at START
+ *   4       4     log position after this packet: sector
+ *   8       2     log position after this packet: offset
+ *   10      ...   records: u8 length, then a log record (a compressed
+ *                 telemetry block, see TelemetryCodec.h)
+ *
+ * The MTU must leave room for LOG_SYNC_MIN_PACKET bytes (an MTU of 23 does
+ * not); a START on a smaller link stops straight away.
+ *
+ * One transfer runs at a time. The central whose START, QUERY or RECENT
+ * began it owns it: data and stats are notified to that central only, and
+ * only its control writes count. Other centrals' writes are ignored until
+ * it ends; a read of the stats characteristic shows them it is running.
+ *
+ * Packets go out back-to-back until the window is full, then wait for an
+ * ACK, written without response so acks cost no round trip. If no ACK
+ * arrives within LOG_SYNC_ACK_TIMEOUT_MS the transfer goes back to the
+ * packet after the last acknowledged one. The app keeps the position of
+ * the last packet it processed and passes it to START after a dropped
+ * connection to resume; packets whose number is not the next expected one
+ * are discarded by the app.
+ *
+ * Stats (little-endian):
+ *
+ *   0       1     state (LogSyncState)
+ *   1       1     window
+ *   2       2     payload bytes per packet
+ *   4       4     records sent
+ *   8       4     bytes sent, packet headers included
+ *   12      4     elapsed ms
+ *   16      4     throughput, bytes/s
+ *   20      4     acknowledged position: sector
+ *   24      2     acknowledged position: offset
+ *   26      2     packets sent again after an ack timeout
+ */
+
+#pragma once
+
+#include <BLEServer.h>
+
+#include "SpscQueue.h"
+#include "TelemetryLog.h"
+
+#define LOG_SYNC_SERVICE_UUID "4fafc202-1fb5-459e-8fcc-c5c9c331914b"
+#define LOG_SYNC_CONTROL_UUID "beb5483f-36e1-4688-b7f5-ea07361b26a8"
+#define LOG_SYNC_DATA_UUID    "beb54840-36e1-4688-b7f5-ea07361b26a8"
+#define LOG_SYNC_STATS_UUID   "beb54841-36e1-4688-b7f5-ea07361b26a8"
+
+#define LOG_SYNC_OP_START 0x01
+#define LOG_SYNC_OP_ACK   0x02
+#define LOG_SYNC_OP_STOP  0x03
+#define LOG_SYNC_OP_QUERY 0x04
+#define LOG_SYNC_OP_RECENT 0x05
+
+#define LOG_SYNC_MAGIC         0xCC
+#define LOG_SYNC_HEADER_SIZE   10
+#define LOG_SYNC_MAX_PACKET    514   // ATT payload at the largest MTU
+#define LOG_SYNC_MIN_PACKET    (LOG_SYNC_HEADER_SIZE + 1 + TELEMETRY_LOG_MAX_PAYLOAD)
+#define LOG_SYNC_STATS_SIZE    28
+#define LOG_SYNC_FLAG_LAST     0x01  // the log had nothing more to send
+#define LOG_SYNC_RESUME        0xFFFFFFFF
+#define LOG_SYNC_OPEN_END      0xFFFFFFFF
+#define LOG_SYNC_NO_OWNER      0xFFFF
+
+#define LOG_SYNC_MAX_WINDOW      16
+#define LOG_SYNC_DEFAULT_WINDOW  8
+#define LOG_SYNC_ACK_TIMEOUT_MS  1000
+#define LOG_SYNC_STATS_PERIOD_MS 1000
+
+enum LogSyncState : uint8_t {
+    LOG_SYNC_IDLE     = 0,
+    LOG_SYNC_RUNNING  = 1,
+    LOG_SYNC_COMPLETE = 2,  // every record sent and acknowledged
+    LOG_SYNC_STOPPED  = 3,  // stopped by the app or a disconnect
+};
+
+struct LogSyncStats {
+    LogSyncState state;
+    uint8_t window;
+    uint16_t payloadSize;
+    uint32_t records;
+    uint32_t bytes;
+    uint32_t elapsedMs;
+    uint32_t bytesPerSecond;
+    LogCursor acked;
+    uint16_t resent;
+};
+
+class LogSyncService : public BLECharacteristicCallbacks {
+public:
+    explicit LogSyncService(TelemetryLog& log) : m_log(log) {}
+
+    void begin(BLEServer* server);
+
+    // Called on the BLE task after each control write, e.g. to wake the
+    // task that runs service()
+    void setControlListener(void (*listener)()) { m_controlListener = listener; }
+
+    // Handle queued control writes and send every packet the window allows,
+    // each at most payloadLimit(owner) (MTU - 3) bytes; 0 means the central
+    // is gone. Must run on the task that owns the log. Returns ms until the
+    // ack timeout or the next stats update, or UINT32_MAX when idle.
+    uint32_t service(uint32_t nowMs, size_t (*payloadLimit)(uint16_t connId));
+
+    // A central disconnected: stop its transfer, but remember the
+    // acknowledged position
+    void disconnected(uint16_t connId);
+
+    // Every central is gone: stop, and drop queued control writes
+    void reset();
+
+    bool running() const { return m_stats.state == LOG_SYNC_RUNNING; }
+    uint16_t owner() const { return m_owner; }
+    LogSyncStats stats() const { return m_stats; }
+
+    // BLE task: queue the control write
+    void onWrite(BLECharacteristic* characteristic, esp_ble_gatts_cb_param_t* param) override;
+
+private:
+    struct Request {
+        uint16_t connId;
+        uint8_t length;
+        uint8_t data[10];
+    };
+
+    void handle(const Request& request, uint32_t nowMs);
+    void start(LogCursor from, uint8_t window, uint32_t nowMs);
+    void query(uint32_t fromMs, uint32_t toMs, uint8_t window, uint32_t nowMs);
+    void finish(LogSyncState state, uint32_t nowMs);
+    void sendPacket(size_t payloadLimit, uint32_t nowMs);
+    void updateRate(uint32_t nowMs);
+    uint16_t inFlight() const { return (uint16_t)(m_nextPacket - m_ackedPackets); }
+    void publishStats(uint32_t nowMs);
+    void notifyOwner(BLECharacteristic* characteristic, uint8_t* data, size_t len);
+
+    TelemetryLog& m_log;
+    BLEServer* m_server = nullptr;
+    uint16_t m_owner = LOG_SYNC_NO_OWNER;  // central running the transfer
+    BLECharacteristic* m_dataCharacteristic = nullptr;
+    BLECharacteristic* m_statsCharacteristic = nullptr;
+    void (*m_controlListener)() = nullptr;
+    SpscQueue<Request, 8> m_requests;
+
+    LogCursor m_cursor = {};
+    LogCursor m_sentCursors[LOG_SYNC_MAX_WINDOW];  // position after each packet in flight
+    uint16_t m_nextPacket = 0;
+    uint16_t m_ackedPackets = 0;     // packets acknowledged so far
+    bool m_drained = false;          // the last packet sent was flagged LOG_SYNC_FLAG_LAST
+    uint32_t m_startMs = 0;
+    uint32_t m_lastAckMs = 0;
+    uint32_t m_lastStatsMs = 0;
+
+    // Time range of a QUERY; a START sends every record
+    bool m_ranged = false;
+    uint32_t m_fromMs = 0;
+    uint32_t m_toMs = 0;
+
+    LogSyncStats m_stats = {};
+};
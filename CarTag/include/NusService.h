@@ -0,0 +1,54 @@
+/**
+ * Nordic UART Service endpoint
+ *
+ * Exposes the 6e400001 service the app's useOBD hook talks to: the phone
+ * writes (with or without response) to RX and receives notifications on TX.
+ * Both directions are byte pipes, so the BLE task only appends the written
+ * block and the main loop reads and answers at its own pace.
+ */
+
+#pragma once
+
+#include <BLEServer.h>
+
+#include "BytePipe.h"
+
+#define NUS_SERVICE_UUID "6e400001-b5a3-f393-e0a9-e50e24dcca9e"
+#define NUS_RX_UUID      "6e400002-b5a3-f393-e0a9-e50e24dcca9e"
+#define NUS_TX_UUID      "6e400003-b5a3-f393-e0a9-e50e24dcca9e"
+
+#ifndef NUS_PIPE_SIZE
+#define NUS_PIPE_SIZE 1024
+#endif
+#ifndef NUS_RETRY_MS
+#define NUS_RETRY_MS 20  // before notifying TX bytes a central's stack refused again
+#endif
+
+class NusService : public BLECharacteristicCallbacks {
+public:
+    void begin(BLEServer* server);
+
+    // Bytes written by the phone, consumed by the main loop
+    BytePipe<NUS_PIPE_SIZE>& rx() { return m_rx; }
+
+    // Bytes queued for the phone, notified on txCharacteristic() to each
+    // subscribed central and consumed once all of them have them
+    BytePipe<NUS_PIPE_SIZE>& tx() { return m_tx; }
+    BLECharacteristic* txCharacteristic() const { return m_txCharacteristic; }
+
+    // Drop anything still buffered, e.g. after a disconnect
+    void reset();
+
+    // Called on the BLE task after each write lands in the RX pipe, e.g.
+    // to wake whichever task serves it
+    void setRxListener(void (*listener)()) { m_rxListener = listener; }
+
+    // BLE task: append the written block to the RX pipe
+    void onWrite(BLECharacteristic* characteristic) override;
+
+private:
+    BLECharacteristic* m_txCharacteristic = nullptr;
+    void (*m_rxListener)() = nullptr;
+    BytePipe<NUS_PIPE_SIZE> m_rx;
+    BytePipe<NUS_PIPE_SIZE> m_tx;
+};
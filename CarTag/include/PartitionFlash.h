@@ -0,0 +1,28 @@
+/**
+ * ESP32 flash partition as a FlashStore
+ *
+ * Uses the data partition named TELEMETRY_PARTITION_LABEL from
+ * partitions.csv. Not available in the native build.
+ */
+
+#pragma once
+
+#include "FlashStore.h"
+
+#define TELEMETRY_PARTITION_LABEL "telemetry"
+
+struct esp_partition_t;
+
+class PartitionFlash : public FlashStore {
+public:
+    bool begin() override;
+    uint32_t sectorCount() const override { return m_sectors; }
+
+    bool read(uint32_t offset, void* out, size_t len) override;
+    bool write(uint32_t offset, const void* data, size_t len) override;
+    bool erase(uint32_t sector) override;
+
+private:
+    const esp_partition_t* m_partition = nullptr;
+    uint32_t m_sectors = 0;
+};
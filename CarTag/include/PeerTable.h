@@ -0,0 +1,108 @@
+/**
+ * Per-central connection contexts
+ *
+ * Up to CARTAG_MAX_PEERS centrals may be connected at once, e.g. the
+ * driver's phone and a pit crew tablet. Each one gets a slot holding what
+ * used to be global: its connection handle and address, ATT MTU, which
+ * characteristics it subscribed to, its own connection parameter policy
+ * and link negotiation, its position in the shared telemetry ring and how
+ * far its log download got.
+ *
+ * Subscriptions are tracked per connection from the CCCD writes, since the
+ * BLE2902 descriptor holds one value for all of them: one phone turning
+ * notifications off must not silence the other.
+ *
+ * Stats per central:
+ *
+ *   notifications   frames sent
+ *   bytes           payload bytes sent
+ *   droppedFrames   notifications the stack refused, e.g. link buffers full
+ *   droppedSamples  samples overwritten in the ring before this central
+ *                   was sent them
+ *   splitSamples    samples too big for a batch on this link, sent as
+ *                   split single frames
+ *   queueDepth      samples waiting for this central after the last flush,
+ *                   and the deepest it has been
+ *
+ * The BLE event task adds and removes slots; every task that reads them
+ * holds the same lock as for notifying.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ConnectionManager.h"
+#include "LinkNegotiator.h"
+#include "TelemetryBatcher.h"
+#include "TelemetryLog.h"
+
+// The ESP32 controller is built for 3 LE connections by default
+// (CONFIG_BTDM_CTRL_BLE_MAX_CONN); more need a matching sdkconfig
+#ifndef CARTAG_MAX_PEERS
+#define CARTAG_MAX_PEERS 3
+#endif
+
+#define PEER_NO_CONN 0xFFFF
+
+// CCCDs a central has turned notifications on for
+enum PeerSubscription : uint8_t {
+    PEER_SUB_TELEMETRY = 1 << 0,  // telemetry characteristic: batches, command responses
+    PEER_SUB_NUS       = 1 << 1,  // NUS TX
+    PEER_SUB_LOG_DATA  = 1 << 2,  // log sync data
+    PEER_SUB_LOG_STATS = 1 << 3,  // log sync stats
+};
+
+struct PeerStats {
+    uint32_t notifications;
+    uint32_t bytes;
+    uint32_t droppedFrames;
+    uint32_t droppedSamples;
+    uint32_t splitSamples;
+    uint16_t queueDepth;
+    uint16_t maxQueueDepth;
+};
+
+struct Peer {
+    uint16_t connId;            // PEER_NO_CONN for a free slot
+    uint8_t address[6];
+    uint16_t mtu;
+    uint8_t subscriptions;      // PeerSubscription bits
+    bool bonded;                // encrypted with keys in the bond table
+    uint32_t connectedMs;
+    BatchCursor telemetry;      // position in the shared sample ring
+    uint32_t nusSent;           // bytes at the head of the NUS TX pipe already sent
+    LogCursor logAcked;         // acknowledged position of its log download
+    ConnectionManager connection;
+    LinkNegotiator link;
+    uint32_t dataLengthOrder;   // order its data length request went out in
+    PeerStats stats;
+
+    bool active() const { return connId != PEER_NO_CONN; }
+    bool subscribed(PeerSubscription sub) const { return subscriptions & sub; }
+};
+
+class PeerTable {
+public:
+    PeerTable();
+
+    // Claim a slot for a new connection; nullptr when every slot is taken
+    Peer* add(uint16_t connId, const uint8_t address[6], uint32_t nowMs);
+    bool remove(uint16_t connId);
+
+    Peer* find(uint16_t connId);
+    const Peer* find(uint16_t connId) const;
+    Peer* findByAddress(const uint8_t address[6]);
+
+    size_t count() const { return m_count; }
+    bool full() const { return m_count == CARTAG_MAX_PEERS; }
+
+    // Slots by index, free ones included; check active()
+    Peer& slot(size_t i) { return m_peers[i]; }
+    const Peer& slot(size_t i) const { return m_peers[i]; }
+
+private:
+    Peer m_peers[CARTAG_MAX_PEERS];
+    size_t m_count = 0;
+};
@@ -0,0 +1,93 @@
+/**
+ * On-device OBD-II PID polling scheduler
+ *
+ * The app subscribes once to a set of mode 01 PIDs, each with its own
+ * period (e.g. RPM every 50 ms, coolant every 2 s). run() polls whatever
+ * is due through the vehicle backend and hands each positive response to
+ * a callback, so only results cross the BLE link instead of one
+ * request/response round trip per value.
+ *
+ * PIDs that fall due together are coalesced into one mode 01 request of up
+ * to six PIDs (allowed on CAN vehicles) and the combined reply is split
+ * back per PID. If the ECU rejects the first multi-PID request the
+ * scheduler falls back to single-PID requests until resetMultiPid().
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "VehicleBackend.h"
+
+#ifndef PID_SCHEDULER_MAX
+#define PID_SCHEDULER_MAX 16
+#endif
+
+// ISO 15765-4 limit for one mode 01 request
+#define OBD_MAX_PIDS_PER_REQUEST 6
+
+// PIDs due this soon are polled early alongside one that is due now
+#ifndef PID_COALESCE_WINDOW_MS
+#define PID_COALESCE_WINDOW_MS 20
+#endif
+
+// Receives the full positive response, e.g. {0x41, 0x0C, A, B}
+typedef void (*PidResultCallback)(const uint8_t* resp, size_t len);
+
+struct PidSubscription {
+    uint8_t pid;
+    uint16_t periodMs;
+    uint32_t nextDueMs;
+    uint32_t polls;      // requests sent
+    uint32_t failures;   // NO DATA / bus errors / replies for another PID
+    uint32_t lateMs;     // worst lateness behind schedule
+};
+
+enum MultiPidSupport {
+    MULTI_PID_UNKNOWN,    // not tried yet
+    MULTI_PID_SUPPORTED,  // the ECU answered a multi-PID request
+    MULTI_PID_REJECTED,   // polling one PID per request
+};
+
+struct PidSchedulerStats {
+    uint32_t singleRequests;
+    uint32_t multiRequests;
+    uint32_t fallbacks;   // multi-PID requests the ECU rejected
+};
+
+class PidScheduler {
+public:
+    PidScheduler(VehicleBackend& backend, PidResultCallback onResult);
+
+    // Add or retime a PID; false if the table is full or the period is 0
+    bool subscribe(uint8_t pid, uint16_t periodMs, uint32_t nowMs);
+    bool unsubscribe(uint8_t pid);
+    void clear();
+
+    // Probe multi-PID support again, e.g. after the vehicle changed
+    void resetMultiPid();
+
+    // Poll every due PID, at most maxPolls of them; returns how many ran
+    size_t run(uint32_t nowMs, size_t maxPolls = PID_SCHEDULER_MAX);
+
+    // Earliest time a PID becomes due; nowMs + 1 day when idle
+    uint32_t nextDueMs(uint32_t nowMs) const;
+
+    size_t count() const { return m_count; }
+    const PidSubscription& at(size_t i) const { return m_subs[i]; }
+    MultiPidSupport multiPidSupport() const { return m_multiPid; }
+    const PidSchedulerStats& stats() const { return m_stats; }
+
+private:
+    size_t takeDue(uint32_t nowMs, PidSubscription** out, size_t maxCount);
+    void pollSingle(PidSubscription* sub);
+    bool pollMulti(PidSubscription** subs, size_t n);
+
+    VehicleBackend& m_backend;
+    PidResultCallback m_onResult;
+    PidSubscription m_subs[PID_SCHEDULER_MAX];
+    size_t m_count = 0;
+    MultiPidSupport m_multiPid = MULTI_PID_UNKNOWN;
+    PidSchedulerStats m_stats = {};
+};
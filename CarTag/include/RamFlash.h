@@ -0,0 +1,29 @@
+/**
+ * In-memory flash for the native build
+ *
+ * Behaves like NOR flash: starts out erased, erase() fills a sector with
+ * 0xFF and write() ANDs data into place, so a rewrite can only clear
+ * bits. Writes that would need a 0 -> 1 transition are counted as errors
+ * to catch log code that forgets to erase first.
+ */
+
+#pragma once
+
+#include "FlashStore.h"
+
+class RamFlash : public FlashStore {
+public:
+    explicit RamFlash(uint32_t sectors);
+    ~RamFlash() override;
+
+    bool begin() override { return m_data != nullptr; }
+    uint32_t sectorCount() const override { return m_sectors; }
+
+    bool read(uint32_t offset, void* out, size_t len) override;
+    bool write(uint32_t offset, const void* data, size_t len) override;
+    bool erase(uint32_t sector) override;
+
+private:
+    uint8_t* m_data;
+    uint32_t m_sectors;
+};
@@ -0,0 +1,77 @@
+/**
+ * Hardware-timer sample clock
+ *
+ * Fires a tick at a fixed period between 1 ms and 1 s (1 kHz down to
+ * 1 Hz) and hands the tick's microsecond timestamp to a callback, so
+ * sample spacing no longer depends on when a task happens to run. Every
+ * interval between two ticks is compared with the nominal period and the
+ * deviation goes into a log2 histogram that the app can read over BLE.
+ *
+ * On the ESP32 this is hardware timer 0 counting at 1 MHz, with its
+ * interrupt on the core that called begin(). The native build has no
+ * interrupts: poll() fires every tick scheduled up to the virtual clock,
+ * stamped with its exact due time.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define SAMPLE_PERIOD_MIN_US 1000      // 1 kHz
+#define SAMPLE_PERIOD_MAX_US 1000000   // 1 Hz
+
+// Bin 0 counts intervals within 1 us of the period, bin n those off by
+// [2^(n-1), 2^n) us; the last bin takes everything larger
+#define SAMPLE_JITTER_BINS 16
+
+struct SampleJitter {
+    uint32_t periodUs;  // nominal period the statistics refer to
+    uint32_t ticks;     // intervals measured
+    uint32_t maxLateUs;
+    uint32_t maxEarlyUs;
+    uint32_t bins[SAMPLE_JITTER_BINS];
+};
+
+// Runs in interrupt context on the ESP32: keep it short and IRAM-safe
+typedef void (*SampleTickCallback)(uint64_t timestampUs);
+
+class SampleTimer {
+public:
+    // Attach the tick callback; the timer stays stopped until start()
+    bool begin(SampleTickCallback onTick);
+
+    // Run at periodUs (clamped to the supported range) and start a fresh
+    // set of jitter statistics; does nothing if already running at it
+    void start(uint32_t periodUs);
+    void stop();
+
+    bool running() const { return m_running; }
+    uint32_t periodUs() const { return m_jitter.periodUs; }
+
+    // Updated from the interrupt without locking, so a reader may see
+    // counters one tick apart
+    const SampleJitter& jitter() const { return m_jitter; }
+
+    // Native build: fire every tick due by now
+    void poll();
+
+    // Time base of the tick timestamps
+    static uint64_t nowUs();
+
+private:
+    void tick(uint64_t timestampUs);
+
+    SampleTickCallback m_onTick = nullptr;
+    bool m_running = false;
+    uint64_t m_lastTickUs = 0;
+    SampleJitter m_jitter = {};
+
+#ifdef CARTAG_NATIVE
+    uint64_t m_nextTickUs = 0;
+#else
+    static void isr();
+    static SampleTimer* s_instance;
+    hw_timer_t* m_timer = nullptr;
+#endif
+};
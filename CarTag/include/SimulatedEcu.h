@@ -0,0 +1,44 @@
+/**
+ * Simulated engine ECU
+ *
+ * Answers mode 01 requests with values derived from millis(): RPM and
+ * speed follow a repeating drive cycle and coolant warms up over the
+ * first few minutes. Mode 03 (stored DTCs) and mode 09 PID 02 (VIN) return
+ * fixed replies long enough to need ISO-TP multi-frame transfers on CAN. It stands in for a car on the bench and in the
+ * native build, and is deterministic under the simulator's virtual clock.
+ *
+ * Requests may carry up to six PIDs, as on a CAN vehicle. Build with
+ * SIM_ECU_SINGLE_PID to behave like an older ECU that answers NO DATA to
+ * multi-PID requests.
+ */
+
+#pragma once
+
+#include "VehicleBackend.h"
+
+class SimulatedEcu : public VehicleBackend {
+public:
+    ObdStatus request(const uint8_t* req, size_t reqLen,
+                      uint8_t* resp, size_t respCap, size_t& respLen) override;
+
+    const char* protocolName() const override { return "ISO 15765-4 (CAN 11/500)"; }
+    char protocolNumber() const override { return '6'; }
+    uint16_t supplyMillivolts() override { return 12600; }
+
+    uint32_t requestCount() const { return m_requests; }
+    void setMultiPidSupported(bool supported) { m_multiPid = supported; }
+
+private:
+    ObdStatus currentData(const uint8_t* req, size_t reqLen,
+                          uint8_t* resp, size_t respCap, size_t& respLen);
+
+    // Append the data bytes for one PID; returns how many were written, 0 if unsupported
+    size_t pidData(uint8_t pid, uint32_t nowMs, uint8_t* out);
+
+    uint32_t m_requests = 0;
+#ifdef SIM_ECU_SINGLE_PID
+    bool m_multiPid = false;
+#else
+    bool m_multiPid = true;
+#endif
+};
@@ -0,0 +1,69 @@
+/**
+ * Lock-free single-producer/single-consumer ring
+ *
+ * One task pushes, one task pops; neither ever blocks. Slots are
+ * preallocated so the producer can write in place with beginPush() /
+ * commitPush() and avoid an extra copy. Capacity must be a power of two.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Producer: slot to fill, or nullptr when full. Must be followed by commitPush().
+    T* beginPush() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == N) return nullptr;
+        return &m_slots[head & (N - 1)];
+    }
+
+    void commitPush() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool push(const T& item) {
+        T* slot = beginPush();
+        if (!slot) return false;
+        *slot = item;
+        commitPush();
+        return true;
+    }
+
+    // Consumer: oldest slot, or nullptr when empty. Must be followed by commitPop().
+    T* front() {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail) return nullptr;
+        return &m_slots[tail & (N - 1)];
+    }
+
+    void commitPop() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool pop(T& out) {
+        T* slot = front();
+        if (!slot) return false;
+        out = *slot;
+        commitPop();
+        return true;
+    }
+
+    size_t size() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T m_slots[N];
+    std::atomic<size_t> m_head{0};  // written by the producer only
+    std::atomic<size_t> m_tail{0};  // written by the consumer only
+};
@@ -0,0 +1,100 @@
+/**
+ * Accumulates telemetry samples and packs them into batch frames
+ *
+ * Samples are pushed at the sampling rate into a fixed ring. A batch is
+ * ready once the pending samples fill the ATT payload (MTU - 3) or the
+ * oldest one has waited maxLatencyMs, whichever comes first, so a slow
+ * or partially filled batch still goes out on time.
+ *
+ * With compression on, batches are compressed blocks (TelemetryCodec.h)
+ * instead of batch frames. Their size depends on the data, so a block is
+ * full once a pending sample no longer fits.
+ *
+ * The ring is shared by every connected central. Each one reads it through
+ * its own BatchCursor and gets frames sized to its own payload limit, so a
+ * second phone costs a cursor rather than a copy of the samples. A reader
+ * that falls a whole ring behind skips the samples that were overwritten
+ * and counts them in its cursor.
+ *
+ * A sample too big for a batch frame on a reader's link (battery plus two
+ * OBD channels at the default MTU) goes out as single frames (0xCA, see
+ * TelemetryFrame.h) instead, its channels split across as many frames as
+ * it takes. Split frames carry the same sequence number and timestamp, so
+ * the app merges them back into one sample.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "TelemetryCodec.h"
+#include "TelemetryFrame.h"
+
+#ifndef TELEMETRY_BATCH_RING_SIZE
+#define TELEMETRY_BATCH_RING_SIZE 128
+#endif
+
+#define ATT_DEFAULT_MTU 23
+#define ATT_NOTIFY_OVERHEAD 3
+#define TELEMETRY_BATCH_MAX_PAYLOAD 514  // ATT payload at the largest MTU, 517
+
+static_assert((TELEMETRY_BATCH_RING_SIZE & (TELEMETRY_BATCH_RING_SIZE - 1)) == 0,
+              "TELEMETRY_BATCH_RING_SIZE must be a power of two");
+
+// One reader's position in the ring
+struct BatchCursor {
+    uint32_t next;      // sequence number of the next sample to send
+    uint32_t dropped;   // samples overwritten before they were sent
+    uint16_t sentMask;  // channels of sample next already sent in split frames
+    uint32_t split;     // samples sent as split single frames
+};
+
+class TelemetryBatcher {
+public:
+    explicit TelemetryBatcher(uint32_t maxLatencyMs);
+
+    void setMaxLatency(uint32_t ms) { m_maxLatencyMs = ms; }
+    void setCompression(bool enabled) { m_compressed = enabled; }
+
+    // Queue a sample; when the ring is full the oldest sample is overwritten
+    void push(const TelemetrySample& sample);
+
+    // A cursor that starts with the next sample pushed
+    BatchCursor open() const { return {m_written, 0, 0, 0}; }
+
+    // Pass over everything pending, e.g. while the reader is not subscribed
+    void skip(BatchCursor& cursor) const {
+        cursor.next = m_written;
+        cursor.sentMask = 0;
+    }
+
+    // True if a batch of at most payloadLimit (MTU - 3) bytes should be
+    // sent to this reader now
+    bool ready(BatchCursor& cursor, size_t payloadLimit, uint32_t nowMs) const;
+
+    // Milliseconds until the reader's oldest pending sample reaches the
+    // latency limit; 0 if a batch is ready, UINT32_MAX if nothing is pending
+    uint32_t msUntilReady(BatchCursor& cursor, size_t payloadLimit, uint32_t nowMs) const;
+
+    // Pack as many of the reader's pending samples as fit into out (at most
+    // payloadLimit) and move its cursor past them; returns the frame
+    // length, 0 if nothing is pending. A sample too big for a batch on its
+    // own is sent as one or more single frames instead.
+    size_t flush(BatchCursor& cursor, uint8_t* out, size_t payloadLimit) const;
+
+    // Samples the reader has not been sent yet
+    size_t pending(BatchCursor& cursor) const;
+
+private:
+    const TelemetrySample& at(uint32_t sequence) const {
+        return m_ring[sequence % TELEMETRY_BATCH_RING_SIZE];
+    }
+    size_t fitCount(uint32_t from, size_t count, size_t cap) const;
+    size_t flushSplit(BatchCursor& cursor, uint8_t* out, size_t payloadLimit) const;
+
+    TelemetrySample m_ring[TELEMETRY_BATCH_RING_SIZE];
+    uint32_t m_written = 0;  // samples pushed since boot
+    uint32_t m_maxLatencyMs;
+    bool m_compressed = false;
+};
@@ -0,0 +1,45 @@
+/**
+ * Telemetry beacon: the latest sample in advertising data
+ *
+ * Scanners that only want a reading (dashboards, fleet gateways) get it
+ * from the manufacturer specific data (AD type 0xFF) without connecting.
+ * The layout follows the single telemetry frame, minus the timestamp,
+ * which means nothing to a scanner:
+ *
+ *   offset  size  field
+ *   0       2     company identifier (BEACON_COMPANY_ID)
+ *   2       1     magic (0xCF)
+ *   3       1     version
+ *   4       2     sequence number, one per update (wraps)
+ *   6       1     battery level, percent
+ *   7       1     flags (TELEMETRY_FLAG_*)
+ *   8       2     channel mask, bit n set = channel n present
+ *   10      2*n   int16 channel values, in ascending channel order
+ *
+ * A legacy advertising packet leaves 20 bytes for this after the flags
+ * and the preferred connection interval, enough for five channels. Channels that do not fit are left out,
+ * highest id first, and dropped from the mask.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "TelemetryFrame.h"
+
+// 0xFFFF is the Bluetooth SIG identifier reserved for internal use and
+// testing; set a registered one for production builds
+#ifndef BEACON_COMPANY_ID
+#define BEACON_COMPANY_ID 0xFFFF
+#endif
+
+#define BEACON_MAGIC        0xCF
+#define BEACON_VERSION      1
+#define BEACON_HEADER_SIZE  10
+#define BEACON_MAX_DATA     (BEACON_HEADER_SIZE + 2 * TELEMETRY_MAX_CHANNELS)
+
+// Encode the manufacturer data for one sample into out, keeping as many
+// channels as fit in cap; returns the length, or 0 if not even the header fits
+size_t encodeTelemetryBeacon(const TelemetrySample& sample, uint16_t sequence,
+                             uint8_t* out, size_t cap);
@@ -0,0 +1,81 @@
+/**
+ * Compressed telemetry blocks
+ *
+ * A block holds consecutive samples that share one channel mask. Its
+ * header has the same layout as a batch frame (see TelemetryFrame.h) with
+ * its own magic, and every block decodes on its own: the first sample is
+ * encoded against zero, so a lost block never affects the next one.
+ *
+ *   offset  size  field
+ *   0       1     magic (0xCE)
+ *   1       1     version
+ *   2       2     sequence number of the first sample
+ *   4       4     base timestamp, ms since boot
+ *   8       1     sample count
+ *   9       1     reserved (0)
+ *   10      2     channel mask shared by every sample
+ *   12      ...   samples
+ *
+ * Each sample starts with a varint bitmap of the fields that changed:
+ * bit 0 the timestamp, bit 1 the battery level, bit 2 the flags, and bit
+ * 3 + i the i-th channel present in the mask. Only changed fields follow,
+ * in that order:
+ *
+ *   timestamp  zigzag varint delta-of-delta; the first sample's delta
+ *              from the base timestamp is 0, so at a steady sample rate
+ *              every later timestamp costs nothing
+ *   battery    zigzag varint delta from the previous sample
+ *   flags      the new flags byte
+ *   channels   zigzag varint delta from the previous value
+ *
+ * Varints are little-endian base 128. A sample whose fields all repeat
+ * the previous one's, at a steady interval, takes a single byte.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "TelemetryFrame.h"
+
+#define TELEMETRY_BLOCK_MAGIC        0xCE
+#define TELEMETRY_BLOCK_HEADER_SIZE  12
+#define TELEMETRY_BLOCK_MAX_SAMPLES  255
+
+// Largest encoding of one sample: a 3-byte bitmap, a 5-byte timestamp,
+// battery and flags, and 3 bytes per channel
+#define TELEMETRY_BLOCK_MAX_SAMPLE_SIZE (3 + 5 + 2 + 1 + 3 * TELEMETRY_MAX_CHANNELS)
+
+class TelemetryBlockEncoder {
+public:
+    // Start an empty block in out; nothing is written until the first add()
+    void begin(uint8_t* out, size_t cap, uint16_t firstSequence);
+
+    // Append a sample; false, with the block unchanged, if it does not
+    // fit, its channel mask differs from the first sample's, its time
+    // delta does not fit in 32 bits, or the block is full
+    bool add(const TelemetrySample& sample);
+
+    // Write the sample count; returns the block length, 0 if empty
+    size_t finish();
+
+    uint8_t count() const { return m_count; }
+    size_t size() const { return m_len; }
+
+private:
+    uint8_t* m_out = nullptr;
+    size_t m_cap = 0;
+    size_t m_len = 0;
+    uint8_t m_count = 0;
+    uint16_t m_firstSequence = 0;
+    uint16_t m_channelMask = 0;
+
+    TelemetrySample m_prev;
+    int64_t m_prevDelta = 0;
+};
+
+// Decode a whole block into samples; returns how many were decoded, or 0
+// if the block is malformed or holds more than maxSamples
+size_t decodeTelemetryBlock(const uint8_t* in, size_t len, TelemetrySample* out,
+                            size_t maxSamples);
@@ -0,0 +1,122 @@
+/**
+ * CarTag telemetry frame encoding
+ *
+ * Binary frames are fixed-layout and little-endian so the app can read
+ * fields at known offsets without any string parsing:
+ *
+ *   offset  size  field
+ *   0       1     magic (0xCA)
+ *   1       1     version
+ *   2       2     sequence number (wraps)
+ *   4       4     timestamp, ms since boot
+ *   8       1     battery level, percent
+ *   9       1     flags (TELEMETRY_FLAG_*)
+ *   10      2     channel mask, bit n set = channel n present
+ *   12      2*n   int16 channel values, in ascending channel order
+ *
+ * The same layout is published as a read-only descriptor on the telemetry
+ * characteristic (see telemetryLayoutDescriptor) so a client can check the
+ * offsets at runtime instead of hardcoding them.
+ *
+ * Batch frames carry several samples that share one channel mask, so a
+ * single notification can fill the negotiated ATT payload (MTU - 3):
+ *
+ *   offset  size  field
+ *   0       1     magic (0xCB)
+ *   1       1     version
+ *   2       2     sequence number of the first sample
+ *   4       4     timestamp of the first sample, ms since boot
+ *   8       1     sample count
+ *   9       1     reserved (0)
+ *   10      2     channel mask shared by every record
+ *   12      ...   records: uint16 ms offset from the first sample,
+ *                 uint8 battery, uint8 flags, then int16 channel values
+ *
+ * ASCII frames ("87%") are kept for older app builds.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_MAGIC         0xCA
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_HEADER_SIZE   12
+#define TELEMETRY_MAX_CHANNELS  16
+#define TELEMETRY_MAX_FRAME     (TELEMETRY_HEADER_SIZE + 2 * TELEMETRY_MAX_CHANNELS)
+
+#define TELEMETRY_BATCH_MAGIC        0xCB
+#define TELEMETRY_BATCH_HEADER_SIZE  12
+#define TELEMETRY_BATCH_RECORD_SIZE  4   // without channel values
+
+// UUID of the layout descriptor attached to the telemetry characteristic
+#define TELEMETRY_LAYOUT_DESCRIPTOR_UUID "beb5483e-36e1-4688-b7f5-ea07361b2900"
+
+// Frame flags
+#define TELEMETRY_FLAG_SIMULATED    0x01  // battery value is not measured
+#define TELEMETRY_FLAG_LOW_BATTERY  0x02
+
+// Optional channel ids (bit positions in the channel mask)
+enum TelemetryChannel {
+    CHANNEL_BATTERY_MV = 0,
+    CHANNEL_RPM        = 1,
+    CHANNEL_SPEED_KMH  = 2,
+    CHANNEL_COOLANT_C  = 3,
+    CHANNEL_LOAD_PCT   = 4,
+};
+
+enum TelemetryFormat {
+    TELEMETRY_FORMAT_BINARY = 0,
+    TELEMETRY_FORMAT_ASCII  = 1,
+};
+
+struct TelemetrySample {
+    uint64_t timestampUs;   // sample clock time; frames carry it in ms
+    uint32_t timestampMs;
+    uint8_t batteryLevel;
+    uint8_t flags;
+    uint16_t channelMask;
+    int16_t channels[TELEMETRY_MAX_CHANNELS];  // indexed by channel id
+};
+
+// Encode one binary frame into out; returns the length, or 0 if cap is too small
+size_t encodeTelemetryFrame(const TelemetrySample& sample, uint16_t sequence,
+                            uint8_t* out, size_t cap);
+
+// Size of one batch record for the given channel mask
+size_t telemetryBatchRecordSize(uint16_t channelMask);
+
+// Write the batch header; records follow at out + TELEMETRY_BATCH_HEADER_SIZE
+void writeTelemetryBatchHeader(uint8_t* out, uint16_t firstSequence, uint32_t baseMs,
+                               uint8_t count, uint16_t channelMask);
+
+// Write one batch record relative to baseMs; returns its length
+size_t writeTelemetryBatchRecord(uint8_t* out, const TelemetrySample& sample, uint32_t baseMs);
+
+// Encode the legacy "<battery>%" text form; returns the length without terminator
+size_t encodeTelemetryAscii(const TelemetrySample& sample, char* out, size_t cap);
+
+// Fill the layout descriptor value; returns its length
+size_t telemetryLayoutDescriptor(uint8_t* out, size_t cap);
+
+// Little-endian helpers shared by the frame encoders
+static inline void putLE16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void putLE32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint16_t getLE16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t getLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
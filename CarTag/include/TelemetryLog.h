@@ -0,0 +1,159 @@
+/**
+ * Flash ring log of telemetry samples recorded while no central is connected
+ *
+ * The log fills the sectors of a FlashStore in order and wraps around,
+ * dropping the oldest sector when it runs out of room, so every sector is
+ * erased equally often. Each sector starts with a header:
+ *
+ *   offset  size  field
+ *   0       4     magic (TELEMETRY_LOG_MAGIC), written last
+ *   4       4     sector sequence number, +1 per sector opened
+ *   8       4     erase count of this sector
+ *   12      4     timestamp of the first record, ms since boot
+ *
+ * followed by records padded to 4 bytes:
+ *
+ *   0       1     state: 0xFF free, 0xFE written, 0xFC committed
+ *   1       1     payload length
+ *   2       2     CRC-16/CCITT of the payload
+ *   4       n     payload, a compressed telemetry block (TelemetryCodec.h)
+ *
+ * Samples collect in a block in RAM until it is full or spans
+ * TELEMETRY_LOG_BLOCK_MS, then the block is written as one record, so a
+ * power loss costs at most the open block. A record only counts once its
+ * state byte has been programmed to committed, after the payload, so a
+ * write cut short by a power loss is recognised and skipped. begin()
+ * reads one header per sector to find the newest and oldest sector and
+ * scans only the newest for the write position, instead of walking the
+ * whole partition.
+ *
+ * The start time of every sector is also kept in a RAM index, filled from
+ * the headers by begin() and updated as sectors are opened, so seek() can
+ * find the sector holding a given time without touching the flash. The
+ * sequence number of a sector follows from its position relative to the
+ * head, so the index holds only times. Timestamps restart at every boot,
+ * so seek() only searches the part of the log written since begin().
+ *
+ * Erasing a sector takes tens of milliseconds, so append() never erases:
+ * the sector after the head is erased ahead of time by service(), and
+ * append() returns false if it needs that sector before service() has run.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FlashStore.h"
+#include "TelemetryCodec.h"
+#include "TelemetryFrame.h"
+
+#define TELEMETRY_LOG_MAGIC        0x324C5443  // "CTL2"
+#define TELEMETRY_LOG_HEADER_SIZE  16
+#define TELEMETRY_LOG_RECORD_HEADER 4
+#define TELEMETRY_LOG_MAX_PAYLOAD  160         // one block; fits a 185-byte MTU
+#define TELEMETRY_LOG_MAX_SECTORS  512         // size of the time index; 2 MB of flash
+
+#ifndef TELEMETRY_LOG_BLOCK_MS
+#define TELEMETRY_LOG_BLOCK_MS 1000
+#endif
+
+// Position of a record; stays valid until its sector is recycled
+struct LogCursor {
+    uint32_t sector;    // sector sequence number
+    uint32_t offset;    // byte offset inside the sector
+};
+
+struct TelemetryLogStats {
+    uint32_t samples;         // appended since boot
+    uint32_t records;         // blocks written since boot
+    uint32_t bytes;           // flash bytes written since boot, headers included
+    uint32_t erases;          // sectors erased since boot
+    uint32_t droppedSectors;  // full sectors recycled before being read
+    uint32_t tornRecords;     // uncommitted or corrupt records skipped
+    uint32_t writeErrors;
+    uint32_t usedSectors;     // sectors currently holding records
+    uint32_t maxEraseCount;   // highest erase count seen in a sector header
+};
+
+class TelemetryLog {
+public:
+    explicit TelemetryLog(FlashStore& flash) : m_flash(flash) {}
+
+    // Open the flash and find the head and tail; false if the flash is
+    // unusable or has more than TELEMETRY_LOG_MAX_SECTORS sectors
+    bool begin();
+    bool ready() const { return m_ready; }
+
+    // Add one sample to the open block, writing the block first if the
+    // sample does not fit; false, with the sample not taken, if the next
+    // sector still has to be erased by service(), or on a flash error
+    bool append(const TelemetrySample& sample);
+
+    // Write the open block now, e.g. before the log is read; same failures
+    // as append()
+    bool flush();
+    bool pending() const { return m_encoder.count() > 0; }
+
+    // Erase the sector after the head if it is not erased yet. Slow; run it
+    // from a low-priority task, never from the sampling path. Returns true
+    // if it erased something.
+    bool service();
+
+    // Oldest record still in the log
+    LogCursor oldest() const;
+
+    // Start of the sector written this boot that holds fromMs, found by a
+    // binary search of the time index; the first record written this boot
+    // if fromMs is older than that, or has been recycled
+    LogCursor seek(uint32_t fromMs) const;
+
+    // Copy the committed record at or after cursor into out, which should
+    // hold TELEMETRY_LOG_MAX_PAYLOAD bytes, and move the cursor past it;
+    // returns the payload length, or 0 at the end of the log.
+    // A cursor whose sector has been recycled restarts at the oldest record.
+    size_t read(LogCursor& cursor, uint8_t* out, size_t cap);
+
+    TelemetryLogStats stats() const { return m_stats; }
+
+private:
+    struct SectorHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t eraseCount;
+        uint32_t firstMs;
+    };
+
+    bool readHeader(uint32_t index, SectorHeader& header);
+    bool isErased(uint32_t index);
+    bool openNext(uint32_t firstMs);
+    bool writeBlock();
+    void startBlock();
+    uint32_t scanForEnd(uint32_t index);
+    uint32_t indexOf(uint32_t sequence) const;
+
+    FlashStore& m_flash;
+    bool m_ready = false;
+
+    bool m_hasHead = false;
+    uint32_t m_headIndex = 0;
+    uint32_t m_headSeq = 0;
+    uint32_t m_writeOffset = 0;
+    uint32_t m_tailSeq = 0;
+
+    uint32_t m_firstMs[TELEMETRY_LOG_MAX_SECTORS];  // by sector index
+    uint32_t m_bootSeq = 0;         // first sector opened since begin()
+    LogCursor m_bootStart = {};     // first record written since begin()
+
+    bool m_nextErased = false;
+    uint32_t m_nextEraseCount = 0;    // header value for the sector after the head
+
+    TelemetryBlockEncoder m_encoder;
+    uint8_t m_block[TELEMETRY_LOG_MAX_PAYLOAD];
+    uint32_t m_blockStartMs = 0;
+    uint16_t m_sampleSeq = 0;
+    TelemetryLogStats m_stats = {};
+};
+
+// CRC-16/CCITT-FALSE, shared with readers of exported log records
+uint16_t crc16Ccitt(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
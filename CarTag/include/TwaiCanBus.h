@@ -0,0 +1,32 @@
+/**
+ * ESP32 TWAI (CAN 2.0) controller
+ *
+ * Runs at 500 kbit/s, the ISO 15765-4 CAN 11/500 rate, behind a CAN
+ * transceiver on TWAI_TX_PIN / TWAI_RX_PIN. The hardware acceptance filter
+ * passes only 0x7E8-0x7EF, so other bus traffic never reaches the RX queue.
+ * Not available in the native build.
+ */
+
+#pragma once
+
+#include "CanBus.h"
+
+#ifndef TWAI_TX_PIN
+#define TWAI_TX_PIN 5
+#endif
+#ifndef TWAI_RX_PIN
+#define TWAI_RX_PIN 4
+#endif
+
+class TwaiCanBus : public CanBus {
+public:
+    bool begin() override;
+    bool send(const CanFrame& frame, uint32_t timeoutMs) override;
+    bool receive(CanFrame& frame, uint32_t timeoutMs) override;
+
+private:
+    // Restart the controller after bus-off
+    void recover();
+
+    bool m_started = false;
+};
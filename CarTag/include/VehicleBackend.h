@@ -0,0 +1,44 @@
+/**
+ * Interface between the OBD-II engine and whatever talks to the car
+ *
+ * A backend takes a raw diagnostic request (mode byte followed by PIDs,
+ * e.g. {0x01, 0x0C}) and returns the ECU's positive response bytes
+ * (e.g. {0x41, 0x0C, 0x1A, 0xF8}). The ELM327 interpreter and the PID
+ * scheduler only ever see this interface, so the simulated ECU, an
+ * external ELM adapter or the ESP32's own CAN controller are
+ * interchangeable.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum ObdStatus {
+    OBD_OK = 0,
+    OBD_NO_DATA,        // ECU did not answer or does not support the request
+    OBD_BUS_ERROR,      // transport failure (bus off, malformed frame, ...)
+    OBD_BUFFER_FULL,    // response larger than the caller's buffer
+};
+
+class VehicleBackend {
+public:
+    virtual ~VehicleBackend() {}
+
+    // Send one request and wait for the response; respLen is set on OBD_OK
+    virtual ObdStatus request(const uint8_t* req, size_t reqLen,
+                              uint8_t* resp, size_t respCap, size_t& respLen) = 0;
+
+    // ELM327 style protocol description ("ISO 15765-4 (CAN 11/500)") and number ("6")
+    virtual const char* protocolName() const = 0;
+    virtual char protocolNumber() const = 0;
+
+    // CAN id of the answering ECU, used when headers are switched on
+    virtual uint16_t responseHeader() const { return 0x7E8; }
+
+    // Vehicle supply voltage in mV, 0 if unknown
+    virtual uint16_t supplyMillivolts() { return 0; }
+};
+
+// Number of data bytes a mode 01 PID returns, 0 if the PID is unknown
+uint8_t obdPidDataLength(uint8_t pid);
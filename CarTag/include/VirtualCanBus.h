@@ -0,0 +1,65 @@
+/**
+ * In-process CAN loopback
+ *
+ * Frames sent by the OBD backend are handed synchronously to every
+ * attached node; frames a node puts on the bus pass the same
+ * 0x7E8-0x7EF acceptance filter as the TWAI hardware and queue up for
+ * receive(). With a CanEcuNode attached, the whole CAN/ISO-TP stack runs
+ * on Linux without hardware or SocketCAN.
+ */
+
+#pragma once
+
+#include "CanBus.h"
+#include "IsoTp.h"
+#include "SpscQueue.h"
+#include "VehicleBackend.h"
+
+#define VIRTUAL_CAN_MAX_NODES 4
+#define VIRTUAL_CAN_RX_DEPTH  32
+
+class VirtualCanBus;
+
+class CanNode {
+public:
+    virtual ~CanNode() {}
+    virtual void onFrame(const CanFrame& frame, VirtualCanBus& bus) = 0;
+};
+
+class VirtualCanBus : public CanBus {
+public:
+    bool attach(CanNode* node);
+
+    bool begin() override { return true; }
+    bool send(const CanFrame& frame, uint32_t timeoutMs) override;
+
+    // Nothing else can arrive while the caller waits, so an empty queue
+    // returns immediately instead of sleeping for timeoutMs
+    bool receive(CanFrame& frame, uint32_t timeoutMs) override;
+
+    // Called by nodes to transmit towards the backend
+    void inject(const CanFrame& frame);
+
+private:
+    CanNode* m_nodes[VIRTUAL_CAN_MAX_NODES];
+    size_t m_nodeCount = 0;
+    SpscQueue<CanFrame, VIRTUAL_CAN_RX_DEPTH> m_rx;
+};
+
+// ECU on the virtual bus: answers functional (0x7DF) and physical
+// requests from any VehicleBackend, segmenting long replies with ISO-TP
+class CanEcuNode : public CanNode {
+public:
+    explicit CanEcuNode(VehicleBackend& ecu, uint16_t responseId = OBD_CAN_RESPONSE_ID)
+        : m_ecu(ecu), m_responseId(responseId) {}
+
+    void onFrame(const CanFrame& frame, VirtualCanBus& bus) override;
+
+private:
+    void transmit(VirtualCanBus& bus);
+
+    VehicleBackend& m_ecu;
+    uint16_t m_responseId;
+    IsoTpReassembler m_rx;
+    IsoTpSegmenter m_tx;
+};
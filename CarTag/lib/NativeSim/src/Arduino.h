@@ -0,0 +1,96 @@
+/**
+ * Minimal Arduino core stand-in for the native simulator.
+ *
+ * Only what the CarTag firmware actually uses is provided. Timing goes
+ * through sim::Clock and Serial writes to stdout (or nowhere when muted).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "SimClock.h"
+
+inline unsigned long millis() { return sim::Clock::nowMs(); }
+inline unsigned long micros() { return (unsigned long)sim::Clock::nowUs(); }
+inline void delay(unsigned long ms) { sim::Clock::advanceMs(ms); }
+inline void delayMicroseconds(unsigned int us) { sim::Clock::advanceUs(us); }
+inline void yield() {}
+
+// No separate instruction RAM on the host
+#define IRAM_ATTR
+
+// Inputs read whatever level the runner set with sim::Gpio
+#define LOW   0
+#define HIGH  1
+#define INPUT 0x01
+inline void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t pin);
+
+class String {
+public:
+    String() {}
+    String(const char* s) : m_str(s ? s : "") {}
+    String(const std::string& s) : m_str(s) {}
+    String(char c) : m_str(1, c) {}
+    String(int v) : m_str(std::to_string(v)) {}
+    String(unsigned int v) : m_str(std::to_string(v)) {}
+    String(long v) : m_str(std::to_string(v)) {}
+    String(unsigned long v) : m_str(std::to_string(v)) {}
+
+    const char* c_str() const { return m_str.c_str(); }
+    unsigned int length() const { return (unsigned int)m_str.length(); }
+
+    String& operator+=(const String& rhs) { m_str += rhs.m_str; return *this; }
+    friend String operator+(const String& lhs, const String& rhs) {
+        String out(lhs);
+        out += rhs;
+        return out;
+    }
+
+private:
+    std::string m_str;
+};
+
+class HardwareSerial {
+public:
+    void begin(unsigned long) {}
+    void setMuted(bool muted) { m_muted = muted; }
+
+    size_t print(const char* s) { return write(s, strlen(s)); }
+    size_t print(const String& s) { return print(s.c_str()); }
+    size_t print(char c) { return write(&c, 1); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(double v) { return printf("%.2f", v); }
+
+    template <typename T>
+    size_t println(const T& v) { size_t n = print(v); return n + print('\n'); }
+    size_t println() { return print('\n'); }
+
+    template <typename... Args>
+    size_t printf(const char* fmt, Args... args) {
+        if (m_muted) return 0;
+        return (size_t)::printf(fmt, args...);
+    }
+
+private:
+    size_t write(const char* s, size_t len) {
+        if (m_muted) return 0;
+        return fwrite(s, 1, len, stdout);
+    }
+
+    bool m_muted = false;
+};
+
+extern HardwareSerial Serial;
+
+// Entry points provided by the firmware sketch
+void setup();
+void loop();
@@ -0,0 +1,3 @@
+// Native simulator: see SimBLE.h
+#pragma once
+#include "SimBLE.h"
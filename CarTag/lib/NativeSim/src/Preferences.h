@@ -0,0 +1,55 @@
+/**
+ * Simulated Arduino Preferences (NVS key/value store) for the native build.
+ *
+ * Keys are kept per namespace in sim::Nvs, which the runner can load from
+ * and save to a file so values survive a restart like they do in flash.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+#include "SimHarness.h"
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        m_namespace = name;
+        m_readOnly = readOnly;
+        m_open = true;
+        return true;
+    }
+    void end() { m_open = false; }
+
+    size_t putBytes(const char* key, const void* value, size_t len) {
+        if (!m_open || m_readOnly) return 0;
+        const uint8_t* bytes = (const uint8_t*)value;
+        sim::Nvs::put(path(key), std::vector<uint8_t>(bytes, bytes + len));
+        return len;
+    }
+
+    size_t getBytesLength(const char* key) {
+        const std::vector<uint8_t>* value = m_open ? sim::Nvs::get(path(key)) : nullptr;
+        return value ? value->size() : 0;
+    }
+
+    // Like the real one: nothing is copied if the value does not fit
+    size_t getBytes(const char* key, void* buf, size_t maxLen) {
+        const std::vector<uint8_t>* value = m_open ? sim::Nvs::get(path(key)) : nullptr;
+        if (!value || value->size() > maxLen) return 0;
+        memcpy(buf, value->data(), value->size());
+        return value->size();
+    }
+
+    bool remove(const char* key) { return m_open && !m_readOnly && sim::Nvs::remove(path(key)); }
+
+private:
+    std::string path(const char* key) const { return m_namespace + "/" + key; }
+
+    std::string m_namespace;
+    bool m_readOnly = false;
+    bool m_open = false;
+};
@@ -0,0 +1,705 @@
+/**
+ * Simulated BLE library and harness implementation.
+ */
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string.h>
+
+#include "Arduino.h"
+#include "SimBLE.h"
+#include "SimHarness.h"
+
+HardwareSerial Serial;
+
+namespace sim {
+
+uint64_t Clock::s_nowUs = 0;
+
+namespace {
+
+struct Connection {
+    uint16_t mtu;
+    std::set<uint16_t> subscribed;  // CCCD handles with notifications on
+};
+
+BLEServer* g_server = nullptr;
+BLEAdvertising g_advertising;
+std::string g_deviceName;
+uint16_t g_localMtu = 23;
+bool g_advertisingActive = false;
+bool g_directed = false;
+esp_bd_addr_t g_directedAddress;
+uint64_t g_directedUntilUs = 0;
+esp_ble_sec_act_t g_encryption = (esp_ble_sec_act_t)0;
+std::map<std::string, std::vector<uint8_t>> g_nvs;
+std::set<uint8_t> g_highPins;
+std::map<uint16_t, Connection> g_connections;
+std::vector<Notification> g_notifications;
+std::vector<ConnParamRequest> g_connParamRequests;
+std::vector<Advertisement> g_advertisements;
+std::vector<AdvertisingRun> g_advertisingRuns;
+uint32_t g_failAdvertisingStarts = 0;
+esp_gap_ble_cb_t g_gapHandler = nullptr;
+gatts_event_handler g_gattsHandler = nullptr;
+uint16_t g_minInterval = 6;
+uint16_t g_maxOctets = 251;
+bool g_phy2m = true;
+
+// Parameters a central starts a connection with
+const uint16_t CENTRAL_INTERVAL = 36;  // 45 ms
+const uint16_t CENTRAL_TIMEOUT = 500;
+
+const uint64_t DIRECTED_ADV_LIMIT_US = 1280000;
+
+// Where the stack keeps its bond keys: address and address type per bond
+const char* BOND_KEYS = "bt_config/bonds";
+const size_t BOND_KEY_SIZE = 7;
+
+// Each simulated central's address ends in its connection id
+void fillAddress(esp_bd_addr_t address, uint16_t connId) {
+    memset(address, 0, sizeof(esp_bd_addr_t));
+    address[5] = (uint8_t)connId;
+}
+
+void fillParam(esp_ble_gatts_cb_param_t& param, uint16_t connId) {
+    memset(&param, 0, sizeof(param));
+    param.connect.conn_id = connId;
+    fillAddress(param.connect.remote_bda, connId);
+    param.connect.conn_params.interval = CENTRAL_INTERVAL;
+    param.connect.conn_params.timeout = CENTRAL_TIMEOUT;
+}
+
+// The advertising run in progress, if any, stopped at atUs
+void endRun(uint64_t atUs) {
+    if (g_advertisingRuns.empty()) return;
+    AdvertisingRun& run = g_advertisingRuns.back();
+    if (run.ok && run.endUs == 0) run.endUs = atUs;
+}
+
+// High duty cycle directed advertising stops by itself
+bool advertisingNow() {
+    if (g_directed && Clock::nowUs() >= g_directedUntilUs) {
+        g_directed = false;
+        g_advertisingActive = false;
+        endRun(g_directedUntilUs);
+    }
+    return g_advertisingActive;
+}
+
+// The central pairs (Just Works) or encrypts with the keys both sides kept
+void pair(uint16_t connId) {
+    esp_bd_addr_t address;
+    fillAddress(address, connId);
+    std::vector<uint8_t> keys;
+    if (const std::vector<uint8_t>* stored = Nvs::get(BOND_KEYS)) keys = *stored;
+    bool known = false;
+    for (size_t i = 0; i + BOND_KEY_SIZE <= keys.size() && !known; i += BOND_KEY_SIZE) {
+        known = memcmp(&keys[i], address, sizeof(address)) == 0;
+    }
+    if (!known) {
+        keys.insert(keys.end(), address, address + sizeof(address));
+        keys.push_back(BLE_ADDR_TYPE_PUBLIC);
+        Nvs::put(BOND_KEYS, keys);
+    }
+    if (!g_gapHandler) return;
+
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    memcpy(param.ble_security.auth_cmpl.bd_addr, address, sizeof(address));
+    param.ble_security.auth_cmpl.success = true;
+    param.ble_security.auth_cmpl.addr_type = BLE_ADDR_TYPE_PUBLIC;
+    g_gapHandler(ESP_GAP_BLE_AUTH_CMPL_EVT, &param);
+}
+
+std::map<uint16_t, Connection>::iterator findByAddress(const uint8_t* address) {
+    return address ? g_connections.find(address[5]) : g_connections.end();
+}
+
+BLECharacteristic* findCharacteristic(const std::string& uuid) {
+    if (!g_server) return nullptr;
+    for (BLEService* service : g_server->services()) {
+        for (BLECharacteristic* ch : service->characteristics()) {
+            if (ch->getUUID().toString() == uuid) return ch;
+        }
+    }
+    return nullptr;
+}
+
+BLECharacteristic* findCharacteristic(uint16_t handle) {
+    if (!g_server) return nullptr;
+    for (BLEService* service : g_server->services()) {
+        for (BLECharacteristic* ch : service->characteristics()) {
+            if (ch->getHandle() == handle) return ch;
+        }
+    }
+    return nullptr;
+}
+
+// A write as the GATT server sees it: the custom handler first, then the
+// characteristic's callbacks
+void deliverWrite(uint16_t connId, uint16_t handle, const uint8_t* data, size_t len,
+                  BLECharacteristic* characteristic) {
+    esp_ble_gatts_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.write.conn_id = connId;
+    fillAddress(param.write.bda, connId);
+    param.write.handle = handle;
+    param.write.len = (uint16_t)len;
+    param.write.value = (uint8_t*)data;
+    if (g_gattsHandler) g_gattsHandler(ESP_GATTS_WRITE_EVT, 3, &param);
+    if (characteristic) {
+        if (BLECharacteristicCallbacks* cb = characteristic->getCallbacks()) cb->onWrite(characteristic, &param);
+    }
+}
+
+}  // namespace
+
+bool Ble::connect(uint16_t connId, uint16_t mtu) {
+    if (!g_server || !advertisingNow() || g_connections.count(connId)) return false;
+    if (g_directed && g_directedAddress[5] != connId) return false;
+
+    // The controller stops advertising once a central connects
+    g_advertisingActive = false;
+    g_directed = false;
+    endRun(Clock::nowUs());
+    g_connections[connId] = Connection{23, {}};
+
+    esp_ble_gatts_cb_param_t param;
+    fillParam(param, connId);
+    if (BLEServerCallbacks* cb = g_server->getCallbacks()) {
+        cb->onConnect(g_server);
+        cb->onConnect(g_server, &param);
+    }
+    if (g_encryption) pair(connId);
+    if (mtu > 23) changeMtu(mtu, connId);
+
+    // The app subscribes to every notifiable characteristic it uses
+    for (BLEService* service : g_server->services()) {
+        for (BLECharacteristic* ch : service->characteristics()) {
+            if (ch->getDescriptorByUUID("2902")) subscribe(ch->getUUID().toString(), true, connId);
+        }
+    }
+    return true;
+}
+
+bool Ble::disconnect(uint16_t connId, int reason) {
+    if (!g_server || !g_connections.erase(connId)) return false;
+
+    esp_ble_gatts_cb_param_t param;
+    fillParam(param, connId);
+    param.disconnect.reason = reason;
+    if (BLEServerCallbacks* cb = g_server->getCallbacks()) {
+        cb->onDisconnect(g_server);
+        cb->onDisconnect(g_server, &param);
+    }
+    return true;
+}
+
+bool Ble::write(const std::string& uuid, const std::vector<uint8_t>& data, uint16_t connId) {
+    BLECharacteristic* ch = findCharacteristic(uuid);
+    if (!ch || !g_connections.count(connId)) return false;
+
+    ch->setValue((uint8_t*)data.data(), data.size());
+    deliverWrite(connId, ch->getHandle(), data.data(), data.size(), ch);
+    return true;
+}
+
+bool Ble::subscribe(const std::string& uuid, bool enable, uint16_t connId) {
+    BLECharacteristic* ch = findCharacteristic(uuid);
+    BLE2902* cccd = ch ? (BLE2902*)ch->getDescriptorByUUID("2902") : nullptr;
+    auto it = g_connections.find(connId);
+    if (!cccd || it == g_connections.end()) return false;
+
+    // Like the library's BLE2902, the descriptor keeps one value for every
+    // connection: the last write wins
+    cccd->setNotifications(enable);
+    if (enable) {
+        it->second.subscribed.insert(cccd->getHandle());
+    } else {
+        it->second.subscribed.erase(cccd->getHandle());
+    }
+    uint8_t value[2] = {(uint8_t)(enable ? 1 : 0), 0};
+    deliverWrite(connId, cccd->getHandle(), value, sizeof(value), nullptr);
+    return true;
+}
+
+bool Ble::changeMtu(uint16_t mtu, uint16_t connId) {
+    auto it = g_connections.find(connId);
+    if (!g_server || it == g_connections.end()) return false;
+
+    // The ATT MTU is the smaller of what each side supports
+    it->second.mtu = mtu < g_localMtu ? mtu : g_localMtu;
+
+    esp_ble_gatts_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.mtu.conn_id = connId;
+    param.mtu.mtu = it->second.mtu;
+    if (BLEServerCallbacks* cb = g_server->getCallbacks()) cb->onMtuChanged(g_server, &param);
+    return true;
+}
+
+void Ble::setMinInterval(uint16_t interval) { g_minInterval = interval; }
+void Ble::setMaxOctets(uint16_t octets) { g_maxOctets = octets; }
+void Ble::setPhy2m(bool supported) { g_phy2m = supported; }
+
+// The controllers settle on what both sides support and report it
+bool Ble::requestDataLength(const uint8_t* address, uint16_t txOctets) {
+    if (findByAddress(address) == g_connections.end()) return false;
+    if (!g_gapHandler) return true;
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    uint16_t octets = txOctets < g_maxOctets ? txOctets : g_maxOctets;
+    param.pkt_data_length_cmpl.params.tx_len = octets;
+    param.pkt_data_length_cmpl.params.rx_len = octets;
+    g_gapHandler(ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, &param);
+    return true;
+}
+
+bool Ble::requestPhy(const uint8_t* address, uint8_t txMask, uint8_t rxMask) {
+    if (findByAddress(address) == g_connections.end()) return false;
+    if (!g_gapHandler) return true;
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    memcpy(param.phy_update.bda, address, sizeof(esp_bd_addr_t));
+    param.phy_update.tx_phy = g_phy2m && (txMask & ESP_BLE_GAP_PHY_2M_PREF_MASK) ? ESP_BLE_GAP_PHY_2M
+                                                                                : ESP_BLE_GAP_PHY_1M;
+    param.phy_update.rx_phy = g_phy2m && (rxMask & ESP_BLE_GAP_PHY_2M_PREF_MASK) ? ESP_BLE_GAP_PHY_2M
+                                                                                : ESP_BLE_GAP_PHY_1M;
+    g_gapHandler(ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT, &param);
+    return true;
+}
+
+bool Ble::isConnected(uint16_t connId) { return g_connections.count(connId) != 0; }
+uint32_t Ble::connectedCount() { return (uint32_t)g_connections.size(); }
+bool Ble::isAdvertising() { return advertisingNow(); }
+
+bool Ble::isBonded(uint16_t connId) {
+    for (const esp_ble_bond_dev_t& bond : bondedDevices()) {
+        if (bond.bd_addr[5] == connId) return true;
+    }
+    return false;
+}
+
+uint16_t Ble::mtu(uint16_t connId) {
+    auto it = g_connections.find(connId);
+    return it == g_connections.end() ? 23 : it->second.mtu;
+}
+
+const std::vector<Notification>& Ble::notifications() { return g_notifications; }
+const std::vector<ConnParamRequest>& Ble::connParamRequests() { return g_connParamRequests; }
+const std::vector<Advertisement>& Ble::advertisements() { return g_advertisements; }
+void Ble::clearNotifications() { g_notifications.clear(); }
+
+// Every connected central that subscribed gets the characteristic's value
+void Ble::recordNotification(BLECharacteristic* characteristic) {
+    BLE2902* cccd = (BLE2902*)characteristic->getDescriptorByUUID("2902");
+    for (const auto& entry : g_connections) {
+        if (cccd && !entry.second.subscribed.count(cccd->getHandle())) continue;
+        recordNotification(entry.first, characteristic->getHandle(), characteristic->getData(),
+                           characteristic->getLength());
+    }
+}
+
+bool Ble::recordNotification(uint16_t connId, uint16_t handle, const uint8_t* data, size_t len) {
+    auto it = g_connections.find(connId);
+    BLECharacteristic* characteristic = findCharacteristic(handle);
+    if (it == g_connections.end() || !characteristic) return false;
+
+    // Like the real stack, anything past MTU - 3 is cut off
+    size_t maxLen = it->second.mtu - 3;
+    if (len > maxLen) len = maxLen;
+
+    Notification n;
+    n.timeUs = Clock::nowUs();
+    n.connId = connId;
+    n.uuid = characteristic->getUUID().toString();
+    n.data.assign(data, data + len);
+    g_notifications.push_back(std::move(n));
+    return true;
+}
+
+// Bluedroid indicates the range 0x0001-0xffff
+bool Ble::recordServiceChanged(const uint8_t* address) {
+    auto it = findByAddress(address);
+    if (it == g_connections.end()) return false;
+
+    Notification n;
+    n.timeUs = Clock::nowUs();
+    n.connId = it->first;
+    n.uuid = "2a05";
+    n.data = {0x01, 0x00, 0xff, 0xff};
+    g_notifications.push_back(std::move(n));
+    return true;
+}
+
+void Ble::recordConnParams(const uint8_t* address, uint16_t minInterval, uint16_t maxInterval,
+                           uint16_t latency, uint16_t timeout) {
+    auto it = findByAddress(address);
+    if (it == g_connections.end()) return;
+    g_connParamRequests.push_back({Clock::nowUs(), it->first, minInterval, maxInterval, latency, timeout});
+    if (!g_gapHandler) return;
+
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    memcpy(param.update_conn_params.bda, address, sizeof(esp_bd_addr_t));
+    param.update_conn_params.min_int = minInterval;
+    param.update_conn_params.max_int = maxInterval;
+    if (maxInterval < g_minInterval) {
+        param.update_conn_params.status = 0x1E;  // unacceptable connection parameters
+    } else {
+        param.update_conn_params.conn_int = minInterval > g_minInterval ? minInterval : g_minInterval;
+        param.update_conn_params.latency = latency;
+        param.update_conn_params.timeout = timeout;
+    }
+    g_gapHandler(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &param);
+}
+
+void Ble::setAdvertising(bool advertising, const uint8_t* directedTo) {
+    if (g_advertisingActive) endRun(Clock::nowUs());
+    g_advertisingActive = advertising;
+    g_directed = advertising && directedTo;
+    if (g_directed) {
+        memcpy(g_directedAddress, directedTo, sizeof(g_directedAddress));
+        g_directedUntilUs = Clock::nowUs() + DIRECTED_ADV_LIMIT_US;
+    }
+}
+
+bool Ble::startAdvertising(int instance, bool connectable, uint16_t interval, const uint8_t* directedTo) {
+    const int HCI_COMMAND_DISALLOWED = 0x0C;
+    int status = ESP_BT_STATUS_SUCCESS;
+    if (connectable) {
+        if (g_failAdvertisingStarts > 0) {
+            g_failAdvertisingStarts--;
+            status = HCI_COMMAND_DISALLOWED;
+        } else {
+            setAdvertising(true, directedTo);
+        }
+        g_advertisingRuns.push_back({Clock::nowUs(), 0, directedTo ? (uint16_t)0 : interval,
+                                     directedTo != nullptr, status == ESP_BT_STATUS_SUCCESS});
+    }
+    if (!g_gapHandler) return true;
+
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    if (instance < 0) {
+        param.adv_start_cmpl.status = status;
+        g_gapHandler(ESP_GAP_BLE_ADV_START_COMPLETE_EVT, &param);
+    } else {
+        param.ext_adv_start.status = status;
+        param.ext_adv_start.instance_num = 1;
+        param.ext_adv_start.instance[0] = (uint8_t)instance;
+        g_gapHandler(ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT, &param);
+    }
+    return true;
+}
+
+void Ble::failAdvertisingStarts(uint32_t count) { g_failAdvertisingStarts = count; }
+const std::vector<AdvertisingRun>& Ble::advertisingRuns() { return g_advertisingRuns; }
+
+void Ble::setEncryptionLevel(esp_ble_sec_act_t level) { g_encryption = level; }
+
+std::vector<esp_ble_bond_dev_t> Ble::bondedDevices() {
+    std::vector<esp_ble_bond_dev_t> bonds;
+    const std::vector<uint8_t>* keys = Nvs::get(BOND_KEYS);
+    for (size_t i = 0; keys && i + BOND_KEY_SIZE <= keys->size(); i += BOND_KEY_SIZE) {
+        esp_ble_bond_dev_t bond;
+        memset(&bond, 0, sizeof(bond));
+        memcpy(bond.bd_addr, &(*keys)[i], sizeof(bond.bd_addr));
+        bond.bond_key.pid_key.addr_type = (esp_ble_addr_type_t)(*keys)[i + 6];
+        bonds.push_back(bond);
+    }
+    return bonds;
+}
+
+bool Ble::removeBond(const uint8_t* address) {
+    const std::vector<uint8_t>* stored = Nvs::get(BOND_KEYS);
+    if (!stored) return false;
+    std::vector<uint8_t> keys = *stored;
+    for (size_t i = 0; i + BOND_KEY_SIZE <= keys.size(); i += BOND_KEY_SIZE) {
+        if (memcmp(&keys[i], address, sizeof(esp_bd_addr_t)) != 0) continue;
+        keys.erase(keys.begin() + i, keys.begin() + i + BOND_KEY_SIZE);
+        Nvs::put(BOND_KEYS, keys);
+        return true;
+    }
+    return false;
+}
+
+void Ble::recordAdvertisement(AdvertisementKind kind, const uint8_t* data, size_t len) {
+    g_advertisements.push_back({Clock::nowUs(), kind, std::vector<uint8_t>(data, data + len)});
+}
+void Ble::setGattsHandler(gatts_event_handler handler) { g_gattsHandler = handler; }
+void Ble::registerServer(BLEServer* server) { g_server = server; }
+BLEServer* Ble::server() { return g_server; }
+
+uint16_t Ble::firstConnId() {
+    return g_connections.empty() ? 0 : g_connections.begin()->first;
+}
+
+void Gpio::set(uint8_t pin, bool high) {
+    if (high) {
+        g_highPins.insert(pin);
+    } else {
+        g_highPins.erase(pin);
+    }
+}
+
+bool Gpio::get(uint8_t pin) { return g_highPins.count(pin) > 0; }
+
+const std::vector<uint8_t>* Nvs::get(const std::string& key) {
+    auto it = g_nvs.find(key);
+    return it == g_nvs.end() ? nullptr : &it->second;
+}
+
+void Nvs::put(const std::string& key, const std::vector<uint8_t>& value) { g_nvs[key] = value; }
+bool Nvs::remove(const std::string& key) { return g_nvs.erase(key) != 0; }
+
+// A missing file is an empty store, like erased flash
+bool Nvs::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) return true;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key, hex;
+        if (!(fields >> key)) continue;
+        fields >> hex;
+        std::vector<uint8_t> value;
+        for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+            value.push_back((uint8_t)strtoul(hex.substr(i, 2).c_str(), nullptr, 16));
+        }
+        g_nvs[key] = value;
+    }
+    return true;
+}
+
+bool Nvs::save(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+    for (const auto& entry : g_nvs) {
+        out << entry.first << ' ';
+        for (uint8_t b : entry.second) {
+            char pair[3];
+            snprintf(pair, sizeof(pair), "%02x", b);
+            out << pair;
+        }
+        out << '\n';
+    }
+    return (bool)out;
+}
+
+}  // namespace sim
+
+int digitalRead(uint8_t pin) { return sim::Gpio::get(pin) ? HIGH : LOW; }
+
+// ---- Simulated library ----
+
+BLEDescriptor* BLECharacteristic::getDescriptorByUUID(const char* uuid) {
+    for (BLEDescriptor* d : m_descriptors) {
+        if (d->getUUID().toString() == uuid) return d;
+    }
+    return nullptr;
+}
+
+void BLECharacteristic::notify(bool) {
+    sim::Ble::recordNotification(this);
+}
+
+namespace {
+uint16_t g_nextHandle = 0x2a;
+}
+
+// Descriptors take the handles after their characteristic's value
+void BLECharacteristic::addDescriptor(BLEDescriptor* descriptor) {
+    descriptor->m_handle = g_nextHandle++;
+    m_descriptors.push_back(descriptor);
+}
+
+BLECharacteristic* BLEService::createCharacteristic(const char* uuid, uint32_t properties) {
+    BLECharacteristic* ch = new BLECharacteristic(uuid, properties, this);
+    g_nextHandle++;  // declaration
+    ch->m_handle = g_nextHandle++;
+    m_characteristics.push_back(ch);
+    return ch;
+}
+
+BLECharacteristic* BLEService::getCharacteristic(const char* uuid) {
+    for (BLECharacteristic* ch : m_characteristics) {
+        if (ch->getUUID().toString() == uuid) return ch;
+    }
+    return nullptr;
+}
+
+BLEService* BLEServer::createService(const char* uuid) {
+    BLEService* service = new BLEService(uuid, this, g_nextHandle++);
+    m_services.push_back(service);
+    return service;
+}
+
+BLEService* BLEServer::getServiceByUUID(const char* uuid) {
+    for (BLEService* s : m_services) {
+        if (s->getUUID().toString() == uuid) return s;
+    }
+    return nullptr;
+}
+
+void BLEServer::startAdvertising() { BLEDevice::startAdvertising(); }
+
+void BLEServer::updateConnParams(esp_bd_addr_t remote_bda, uint16_t minInterval, uint16_t maxInterval,
+                                 uint16_t latency, uint16_t timeout) {
+    sim::Ble::recordConnParams(remote_bda, minInterval, maxInterval, latency, timeout);
+}
+
+uint32_t BLEServer::getConnectedCount() const { return sim::Ble::connectedCount(); }
+uint16_t BLEServer::getConnId() const { return sim::Ble::firstConnId(); }
+uint16_t BLEServer::getPeerMTU(uint16_t conn_id) const { return sim::Ble::mtu(conn_id); }
+void BLEServer::disconnect(uint16_t conn_id) { sim::Ble::disconnect(conn_id); }
+
+void BLEAdvertising::start() {
+    m_advertising = true;
+    sim::Ble::startAdvertising(-1, true, m_minInterval);
+}
+
+void BLEAdvertising::stop() {
+    m_advertising = false;
+    sim::Ble::setAdvertising(false);
+}
+
+void BLEAdvertising::setAdvertisementData(BLEAdvertisementData& data) {
+    std::string payload = data.getPayload();
+    sim::Ble::recordAdvertisement(sim::ADV_KIND_LEGACY, (const uint8_t*)payload.data(), payload.size());
+}
+
+void BLEAdvertising::setScanResponseData(BLEAdvertisementData& data) {
+    std::string payload = data.getPayload();
+    sim::Ble::recordAdvertisement(sim::ADV_KIND_SCAN_RESPONSE, (const uint8_t*)payload.data(),
+                                  payload.size());
+}
+
+#if SOC_BLE_50_SUPPORTED
+bool BLEMultiAdvertising::setAdvertisingParams(uint8_t instance, const esp_ble_gap_ext_adv_params_t* params) {
+    if (instance >= m_sets.size()) return false;
+    m_sets[instance] = *params;
+    return true;
+}
+
+bool BLEMultiAdvertising::setAdvertisingData(uint8_t instance, uint16_t length, const uint8_t* data) {
+    if (instance >= m_sets.size()) return false;
+    bool legacy = m_sets[instance].type & ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY;
+    sim::Ble::recordAdvertisement(legacy ? sim::ADV_KIND_LEGACY : sim::ADV_KIND_EXTENDED, data, length);
+    return true;
+}
+
+bool BLEMultiAdvertising::setScanRspData(uint8_t instance, uint16_t length, const uint8_t* data) {
+    if (instance >= m_sets.size()) return false;
+    sim::Ble::recordAdvertisement(sim::ADV_KIND_SCAN_RESPONSE, data, length);
+    return true;
+}
+
+bool BLEMultiAdvertising::start(uint8_t num, uint8_t from) {
+    if (from + num > m_sets.size()) return false;
+    for (uint8_t i = from; i < from + num; i++) {
+        const esp_ble_gap_ext_adv_params_t& set = m_sets[i];
+        bool connectable = set.type & ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE;
+        bool directed = set.type & ESP_BLE_GAP_SET_EXT_ADV_PROP_DIRECTED;
+        sim::Ble::startAdvertising(i, connectable, (uint16_t)set.interval_min,
+                                   directed ? set.peer_addr : nullptr);
+    }
+    return true;
+}
+
+bool BLEMultiAdvertising::stop(uint8_t num_adv, const uint8_t* ext_adv_inst) {
+    for (uint8_t i = 0; i < num_adv; i++) {
+        if (ext_adv_inst[i] >= m_sets.size()) return false;
+        if (m_sets[ext_adv_inst[i]].type & ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE) {
+            sim::Ble::setAdvertising(false);
+        }
+    }
+    return true;
+}
+
+bool BLEMultiAdvertising::setPeriodicAdvertisingParams(uint8_t instance,
+                                                       const esp_ble_gap_periodic_adv_params_t*) {
+    return instance < m_sets.size();
+}
+
+bool BLEMultiAdvertising::setPeriodicAdvertisingData(uint8_t instance, uint16_t length, const uint8_t* data) {
+    if (instance >= m_sets.size()) return false;
+    sim::Ble::recordAdvertisement(sim::ADV_KIND_PERIODIC, data, length);
+    return true;
+}
+
+bool BLEMultiAdvertising::startPeriodicAdvertising(uint8_t instance) { return instance < m_sets.size(); }
+
+// The simulated controller ends directed sets on its own and runs the rest
+// until stopped
+bool BLEMultiAdvertising::setDuration(uint8_t instance, int, int) { return instance < m_sets.size(); }
+
+esp_err_t esp_ble_gap_periodic_adv_stop(uint8_t) { return ESP_OK; }
+#endif
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length) {
+    return sim::Ble::requestDataLength(remote_device, tx_data_length) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gap_set_preferred_phy(esp_bd_addr_t bd_addr, esp_ble_gap_all_phys_t,
+                                        esp_ble_gap_phy_mask_t tx_phy_mask,
+                                        esp_ble_gap_phy_mask_t rx_phy_mask,
+                                        esp_ble_gap_prefer_phy_options_t) {
+    return sim::Ble::requestPhy(bd_addr, tx_phy_mask, rx_phy_mask) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t* adv_params) {
+    bool directed = adv_params->adv_type == ADV_TYPE_DIRECT_IND_HIGH ||
+                    adv_params->adv_type == ADV_TYPE_DIRECT_IND_LOW;
+    sim::Ble::startAdvertising(-1, true, adv_params->adv_int_min, directed ? adv_params->peer_addr : nullptr);
+    return ESP_OK;
+}
+
+int esp_ble_get_bond_device_num(void) { return (int)sim::Ble::bondedDevices().size(); }
+
+esp_err_t esp_ble_get_bond_device_list(int* dev_num, esp_ble_bond_dev_t* dev_list) {
+    std::vector<esp_ble_bond_dev_t> bonds = sim::Ble::bondedDevices();
+    if (*dev_num > (int)bonds.size()) *dev_num = (int)bonds.size();
+    for (int i = 0; i < *dev_num; i++) dev_list[i] = bonds[i];
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_remove_bond_device(esp_bd_addr_t bd_addr) {
+    return sim::Ble::removeBond(bd_addr) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gatts_send_service_change_indication(esp_gatt_if_t, esp_bd_addr_t remote_bda) {
+    return sim::Ble::recordServiceChanged(remote_bda) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t, uint16_t conn_id, uint16_t attr_handle,
+                                      uint16_t value_len, uint8_t* value, bool) {
+    return sim::Ble::recordNotification(conn_id, attr_handle, value, value_len) ? ESP_OK : ESP_FAIL;
+}
+
+void BLEDevice::setCustomGapHandler(esp_gap_ble_cb_t handler) { sim::g_gapHandler = handler; }
+void BLEDevice::setCustomGattsHandler(gatts_event_handler handler) { sim::Ble::setGattsHandler(handler); }
+void BLEDevice::setEncryptionLevel(esp_ble_sec_act_t level) { sim::Ble::setEncryptionLevel(level); }
+
+void BLEDevice::init(const std::string& deviceName) { sim::g_deviceName = deviceName; }
+
+BLEServer* BLEDevice::createServer() {
+    BLEServer* server = new BLEServer();
+    sim::Ble::registerServer(server);
+    return server;
+}
+
+BLEAdvertising* BLEDevice::getAdvertising() { return &sim::g_advertising; }
+void BLEDevice::startAdvertising() { sim::g_advertising.start(); }
+void BLEDevice::stopAdvertising() { sim::g_advertising.stop(); }
+
+int BLEDevice::setMTU(uint16_t mtu) {
+    sim::g_localMtu = mtu;
+    return 0;
+}
+
+uint16_t BLEDevice::getMTU() { return sim::g_localMtu; }
+std::string BLEDevice::getDeviceName() { return sim::g_deviceName; }
@@ -0,0 +1,508 @@
+/**
+ * Simulated ESP32 BLE library for the native build.
+ *
+ * Mirrors the subset of the Arduino-ESP32 BLE API (BLEDevice, BLEServer,
+ * BLEService, BLECharacteristic, BLE2902, BLEAdvertising,
+ * BLEMultiAdvertising, BLESecurity) used by the firmware. Nothing goes over the air:
+ * notifications and advertising data are recorded with a virtual
+ * timestamp and the harness in sim::Ble fakes centrals connecting,
+ * writing and disconnecting.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// ---- ESP-IDF types the callbacks expose ----
+
+typedef uint8_t esp_bd_addr_t[6];
+
+typedef int esp_err_t;
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+typedef union {
+    struct {
+        uint16_t conn_id;
+        esp_bd_addr_t remote_bda;
+        struct {
+            uint16_t interval;
+            uint16_t latency;
+            uint16_t timeout;
+        } conn_params;
+    } connect;
+    struct {
+        uint16_t conn_id;
+        esp_bd_addr_t remote_bda;
+        int reason;
+    } disconnect;
+    struct {
+        uint16_t conn_id;
+        uint16_t mtu;
+    } mtu;
+    struct {
+        uint16_t conn_id;
+        uint32_t trans_id;
+        esp_bd_addr_t bda;
+        uint16_t handle;
+        uint16_t offset;
+        bool need_rsp;
+        bool is_prep;
+        uint16_t len;
+        uint8_t* value;
+    } write;
+} esp_ble_gatts_cb_param_t;
+
+typedef enum {
+    ESP_GATTS_WRITE_EVT = 2,
+} esp_gatts_cb_event_t;
+
+// Why a link went down (HCI reason codes)
+typedef enum {
+    ESP_GATT_CONN_TIMEOUT = 0x08,              // supervision timeout
+    ESP_GATT_CONN_TERMINATE_PEER_USER = 0x13,
+    ESP_GATT_CONN_LMP_TIMEOUT = 0x22,
+    ESP_GATT_CONN_FAIL_ESTABLISH = 0x3e,
+} esp_gatt_conn_reason_t;
+
+typedef uint8_t esp_gatt_if_t;
+typedef void (*gatts_event_handler)(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
+                                    esp_ble_gatts_cb_param_t* param);
+
+// Notify or indicate one connection; the harness records it
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle,
+                                      uint16_t value_len, uint8_t* value, bool need_confirm);
+
+// Service Changed indication for the whole database to one central
+esp_err_t esp_ble_gatts_send_service_change_indication(esp_gatt_if_t gatts_if, esp_bd_addr_t remote_bda);
+
+// The simulated controller is a Bluetooth 5 part (like the ESP32-C3/S3),
+// so the 2M PHY and extended advertising paths are exercised; build with
+// -D SOC_BLE_50_SUPPORTED=0 for the classic ESP32's legacy advertising
+#ifndef SOC_BLE_50_SUPPORTED
+#define SOC_BLE_50_SUPPORTED 1
+#endif
+
+typedef enum {
+    ESP_GAP_BLE_ADV_START_COMPLETE_EVT = 6,
+    ESP_GAP_BLE_AUTH_CMPL_EVT = 8,
+    ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT = 20,
+    ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT = 21,
+    ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT = 38,
+    ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT = 55,
+} esp_gap_ble_cb_event_t;
+
+#define ESP_BT_STATUS_SUCCESS 0
+
+#define ESP_BLE_GAP_PHY_1M 1
+#define ESP_BLE_GAP_PHY_2M 2
+#define ESP_BLE_GAP_PHY_1M_PREF_MASK (1 << 0)
+#define ESP_BLE_GAP_PHY_2M_PREF_MASK (1 << 1)
+#define ESP_BLE_GAP_PHY_OPTIONS_NO_PREF 0
+typedef uint8_t esp_ble_gap_all_phys_t;
+typedef uint8_t esp_ble_gap_phy_mask_t;
+typedef uint16_t esp_ble_gap_prefer_phy_options_t;
+
+typedef enum { ADV_CHNL_37 = 1, ADV_CHNL_38 = 2, ADV_CHNL_39 = 4, ADV_CHNL_ALL = 7 } esp_ble_adv_channel_t;
+typedef enum { BLE_ADDR_TYPE_PUBLIC = 0, BLE_ADDR_TYPE_RANDOM = 1 } esp_ble_addr_type_t;
+typedef enum { ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0 } esp_ble_adv_filter_t;
+
+typedef union {
+    struct {
+        int status;
+    } adv_start_cmpl;
+    struct {
+        int status;
+        uint8_t instance_num;
+        uint8_t instance[10];
+    } ext_adv_start;
+    struct {
+        int status;
+        esp_bd_addr_t bda;
+        uint16_t min_int;
+        uint16_t max_int;
+        uint16_t latency;
+        uint16_t conn_int;
+        uint16_t timeout;
+    } update_conn_params;
+    struct {
+        int status;
+        struct {
+            uint16_t rx_len;
+            uint16_t tx_len;
+        } params;
+    } pkt_data_length_cmpl;
+    struct {
+        int status;
+        esp_bd_addr_t bda;
+        uint8_t tx_phy;
+        uint8_t rx_phy;
+    } phy_update;
+    struct {
+        struct {
+            esp_bd_addr_t bd_addr;
+            bool success;
+            uint8_t fail_reason;
+            esp_ble_addr_type_t addr_type;
+        } auth_cmpl;
+    } ble_security;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+
+// Link layer requests; the simulated central answers straight away
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length);
+esp_err_t esp_ble_gap_set_preferred_phy(esp_bd_addr_t bd_addr, esp_ble_gap_all_phys_t all_phys_mask,
+                                        esp_ble_gap_phy_mask_t tx_phy_mask,
+                                        esp_ble_gap_phy_mask_t rx_phy_mask,
+                                        esp_ble_gap_prefer_phy_options_t phy_options);
+
+// Legacy advertising through the GAP API, for what the library does not
+// cover (directed advertising)
+typedef enum {
+    ADV_TYPE_IND = 0x00,
+    ADV_TYPE_DIRECT_IND_HIGH = 0x01,
+    ADV_TYPE_DIRECT_IND_LOW = 0x04,
+} esp_ble_adv_type_t;
+
+typedef struct {
+    uint16_t adv_int_min;
+    uint16_t adv_int_max;
+    esp_ble_adv_type_t adv_type;
+    esp_ble_addr_type_t own_addr_type;
+    esp_bd_addr_t peer_addr;
+    esp_ble_addr_type_t peer_addr_type;
+    esp_ble_adv_channel_t channel_map;
+    esp_ble_adv_filter_t adv_filter_policy;
+} esp_ble_adv_params_t;
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t* adv_params);
+
+// Security and the bonds the stack keeps; the simulated central pairs
+// Just Works on connect when an encryption level is set, and the keys
+// live in sim::Nvs like Bluedroid's do in NVS
+typedef enum {
+    ESP_BLE_SEC_ENCRYPT = 1,
+    ESP_BLE_SEC_ENCRYPT_NO_MITM,
+    ESP_BLE_SEC_ENCRYPT_MITM,
+} esp_ble_sec_act_t;
+
+typedef uint8_t esp_ble_auth_req_t;
+typedef uint8_t esp_ble_io_cap_t;
+#define ESP_LE_AUTH_NO_BOND  0x00
+#define ESP_LE_AUTH_BOND     0x01
+#define ESP_IO_CAP_NONE      3
+#define ESP_BLE_ENC_KEY_MASK (1 << 0)
+#define ESP_BLE_ID_KEY_MASK  (1 << 1)
+
+typedef struct {
+    esp_bd_addr_t bd_addr;
+    struct {
+        struct {
+            esp_ble_addr_type_t addr_type;
+        } pid_key;
+    } bond_key;
+} esp_ble_bond_dev_t;
+
+int esp_ble_get_bond_device_num(void);
+esp_err_t esp_ble_get_bond_device_list(int* dev_num, esp_ble_bond_dev_t* dev_list);
+esp_err_t esp_ble_remove_bond_device(esp_bd_addr_t bd_addr);
+
+class BLESecurity {
+public:
+    void setAuthenticationMode(esp_ble_auth_req_t mode) { m_authMode = mode; }
+    void setCapability(esp_ble_io_cap_t capability) { m_capability = capability; }
+    void setInitEncryptionKey(uint8_t keys) { m_initKeys = keys; }
+    void setRespEncryptionKey(uint8_t keys) { m_respKeys = keys; }
+
+private:
+    esp_ble_auth_req_t m_authMode = 0;
+    esp_ble_io_cap_t m_capability = ESP_IO_CAP_NONE;
+    uint8_t m_initKeys = 0;
+    uint8_t m_respKeys = 0;
+};
+
+#if SOC_BLE_50_SUPPORTED
+// Extended and periodic advertising
+typedef uint16_t esp_ble_ext_adv_type_mask_t;
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_NONCONN_NONSCANNABLE_UNDIRECTED (0 << 0)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE (1 << 0)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_SCANNABLE   (1 << 1)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_DIRECTED    (1 << 2)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_HD_DIRECTED (1 << 3)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY      (1 << 4)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_IND  (ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY | \
+                                                  ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE | \
+                                                  ESP_BLE_GAP_SET_EXT_ADV_PROP_SCANNABLE)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_HD_DIRECT (ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY | \
+                                                       ESP_BLE_GAP_SET_EXT_ADV_PROP_HD_DIRECTED | \
+                                                       ESP_BLE_GAP_SET_EXT_ADV_PROP_DIRECTED | \
+                                                       ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE)
+#define EXT_ADV_TX_PWR_NO_PREFERENCE 127
+#define ESP_BLE_GAP_PRI_PHY_1M 1
+
+typedef struct {
+    esp_ble_ext_adv_type_mask_t type;
+    uint32_t interval_min;
+    uint32_t interval_max;
+    esp_ble_adv_channel_t channel_map;
+    esp_ble_addr_type_t own_addr_type;
+    esp_ble_addr_type_t peer_addr_type;
+    esp_bd_addr_t peer_addr;
+    esp_ble_adv_filter_t filter_policy;
+    int8_t tx_power;
+    uint8_t primary_phy;
+    uint8_t max_skip;
+    uint8_t secondary_phy;
+    uint8_t sid;
+    bool scan_req_notif;
+} esp_ble_gap_ext_adv_params_t;
+
+typedef struct {
+    uint16_t interval_min;
+    uint16_t interval_max;
+    uint8_t properties;
+} esp_ble_gap_periodic_adv_params_t;
+
+esp_err_t esp_ble_gap_periodic_adv_stop(uint8_t instance);
+#endif
+
+class BLEServer;
+class BLEService;
+class BLECharacteristic;
+
+class BLEUUID {
+public:
+    BLEUUID() {}
+    BLEUUID(const char* uuid) : m_uuid(uuid) {}
+    BLEUUID(const std::string& uuid) : m_uuid(uuid) {}
+    std::string toString() const { return m_uuid; }
+    bool equals(const BLEUUID& other) const { return m_uuid == other.m_uuid; }
+
+private:
+    std::string m_uuid;
+};
+
+class BLEDescriptor {
+public:
+    explicit BLEDescriptor(const char* uuid, uint16_t maxLen = 100) : m_uuid(uuid), m_maxLen(maxLen) {}
+    virtual ~BLEDescriptor() {}
+    BLEUUID getUUID() const { return m_uuid; }
+    uint16_t getHandle() const { return m_handle; }
+
+    void setValue(uint8_t* data, size_t length) {
+        m_value.assign((const char*)data, length < m_maxLen ? length : m_maxLen);
+    }
+    void setValue(const std::string& value) { setValue((uint8_t*)value.data(), value.size()); }
+    uint8_t* getValue() { return (uint8_t*)m_value.data(); }
+    size_t getLength() const { return m_value.size(); }
+
+private:
+    friend class BLECharacteristic;
+
+    BLEUUID m_uuid;
+    uint16_t m_maxLen;
+    uint16_t m_handle = 0;
+    std::string m_value;
+};
+
+class BLE2902 : public BLEDescriptor {
+public:
+    BLE2902() : BLEDescriptor("2902") {}
+    void setNotifications(bool flag) { m_notifications = flag; }
+    bool getNotifications() const { return m_notifications; }
+    void setIndications(bool flag) { m_indications = flag; }
+    bool getIndications() const { return m_indications; }
+
+private:
+    bool m_notifications = false;
+    bool m_indications = false;
+};
+
+class BLECharacteristicCallbacks {
+public:
+    virtual ~BLECharacteristicCallbacks() {}
+    virtual void onRead(BLECharacteristic*) {}
+    virtual void onWrite(BLECharacteristic*) {}
+    // The library calls this one; it forwards to the overload above
+    virtual void onWrite(BLECharacteristic* characteristic, esp_ble_gatts_cb_param_t*) {
+        onWrite(characteristic);
+    }
+};
+
+class BLECharacteristic {
+public:
+    static const uint32_t PROPERTY_READ      = 1 << 0;
+    static const uint32_t PROPERTY_WRITE     = 1 << 1;
+    static const uint32_t PROPERTY_NOTIFY    = 1 << 2;
+    static const uint32_t PROPERTY_BROADCAST = 1 << 3;
+    static const uint32_t PROPERTY_INDICATE  = 1 << 4;
+    static const uint32_t PROPERTY_WRITE_NR  = 1 << 5;
+
+    BLECharacteristic(const char* uuid, uint32_t properties, BLEService* service)
+        : m_uuid(uuid), m_properties(properties), m_service(service) {}
+
+    void setValue(uint8_t* data, size_t size) { m_value.assign((const char*)data, size); }
+    void setValue(const std::string& value) { m_value = value; }
+    void setValue(const char* value) { m_value = value; }
+    std::string getValue() const { return m_value; }
+    uint8_t* getData() { return (uint8_t*)m_value.data(); }
+    size_t getLength() const { return m_value.size(); }
+
+    void setCallbacks(BLECharacteristicCallbacks* callbacks) { m_callbacks = callbacks; }
+    BLECharacteristicCallbacks* getCallbacks() const { return m_callbacks; }
+    void addDescriptor(BLEDescriptor* descriptor);
+    BLEDescriptor* getDescriptorByUUID(const char* uuid);
+
+    BLEUUID getUUID() const { return m_uuid; }
+    uint32_t getProperties() const { return m_properties; }
+    uint16_t getHandle() const { return m_handle; }
+    BLEService* getService() const { return m_service; }
+
+    void notify(bool isNotification = true);
+    void indicate() { notify(false); }
+
+private:
+    friend class BLEService;
+
+    BLEUUID m_uuid;
+    uint32_t m_properties;
+    BLEService* m_service;
+    uint16_t m_handle = 0;
+    std::string m_value;
+    BLECharacteristicCallbacks* m_callbacks = nullptr;
+    std::vector<BLEDescriptor*> m_descriptors;
+};
+
+class BLEService {
+public:
+    BLEService(const char* uuid, BLEServer* server, uint16_t handle)
+        : m_uuid(uuid), m_server(server), m_handle(handle) {}
+
+    BLECharacteristic* createCharacteristic(const char* uuid, uint32_t properties);
+    BLECharacteristic* getCharacteristic(const char* uuid);
+    void start() { m_started = true; }
+    void stop() { m_started = false; }
+    bool isStarted() const { return m_started; }
+
+    BLEUUID getUUID() const { return m_uuid; }
+    uint16_t getHandle() const { return m_handle; }
+    BLEServer* getServer() const { return m_server; }
+    const std::vector<BLECharacteristic*>& characteristics() const { return m_characteristics; }
+
+private:
+    BLEUUID m_uuid;
+    BLEServer* m_server;
+    uint16_t m_handle;
+    bool m_started = false;
+    std::vector<BLECharacteristic*> m_characteristics;
+};
+
+class BLEServerCallbacks {
+public:
+    virtual ~BLEServerCallbacks() {}
+    virtual void onConnect(BLEServer*) {}
+    virtual void onConnect(BLEServer*, esp_ble_gatts_cb_param_t*) {}
+    virtual void onDisconnect(BLEServer*) {}
+    virtual void onDisconnect(BLEServer*, esp_ble_gatts_cb_param_t*) {}
+    virtual void onMtuChanged(BLEServer*, esp_ble_gatts_cb_param_t*) {}
+};
+
+class BLEServer {
+public:
+    BLEService* createService(const char* uuid);
+    BLEService* getServiceByUUID(const char* uuid);
+    void setCallbacks(BLEServerCallbacks* callbacks) { m_callbacks = callbacks; }
+    BLEServerCallbacks* getCallbacks() const { return m_callbacks; }
+
+    void startAdvertising();
+    void updateConnParams(esp_bd_addr_t remote_bda, uint16_t minInterval,
+                          uint16_t maxInterval, uint16_t latency, uint16_t timeout);
+    uint32_t getConnectedCount() const;
+    uint16_t getConnId() const;
+    uint16_t getGattsIf() const { return 3; }
+    uint16_t getPeerMTU(uint16_t conn_id) const;
+    void disconnect(uint16_t conn_id);
+
+    const std::vector<BLEService*>& services() const { return m_services; }
+
+private:
+    BLEServerCallbacks* m_callbacks = nullptr;
+    std::vector<BLEService*> m_services;
+};
+
+class BLEAdvertisementData {
+public:
+    void addData(const std::string& data) { m_payload += data; }
+    std::string getPayload() const { return m_payload; }
+
+private:
+    std::string m_payload;
+};
+
+class BLEAdvertising {
+public:
+    void addServiceUUID(const char* uuid) { m_serviceUUIDs.push_back(uuid); }
+    void setAdvertisementData(BLEAdvertisementData& data);
+    void setScanResponseData(BLEAdvertisementData& data);
+    void setScanResponse(bool flag) { m_scanResponse = flag; }
+    void setMinPreferred(uint16_t v) { m_minPreferred = v; }
+    void setMaxPreferred(uint16_t v) { m_maxPreferred = v; }
+    void setMinInterval(uint16_t v) { m_minInterval = v; }
+    void setMaxInterval(uint16_t v) { m_maxInterval = v; }
+    void start();
+    void stop();
+
+    bool isAdvertising() const { return m_advertising; }
+    uint16_t minInterval() const { return m_minInterval; }
+    uint16_t maxInterval() const { return m_maxInterval; }
+
+private:
+    std::vector<BLEUUID> m_serviceUUIDs;
+    bool m_scanResponse = false;
+    bool m_advertising = false;
+    uint16_t m_minPreferred = 0;
+    uint16_t m_maxPreferred = 0;
+    uint16_t m_minInterval = 0x20;
+    uint16_t m_maxInterval = 0x40;
+};
+
+#if SOC_BLE_50_SUPPORTED
+// Advertising sets; a connectable set stands in for the legacy advertising
+// a central connects to, the others are only recorded
+class BLEMultiAdvertising {
+public:
+    explicit BLEMultiAdvertising(uint8_t num = 1) : m_sets(num) {}
+
+    bool setAdvertisingParams(uint8_t instance, const esp_ble_gap_ext_adv_params_t* params);
+    bool setAdvertisingData(uint8_t instance, uint16_t length, const uint8_t* data);
+    bool setScanRspData(uint8_t instance, uint16_t length, const uint8_t* data);
+    bool start(uint8_t num, uint8_t from);
+    bool stop(uint8_t num_adv, const uint8_t* ext_adv_inst);
+    bool setPeriodicAdvertisingParams(uint8_t instance, const esp_ble_gap_periodic_adv_params_t* params);
+    bool setPeriodicAdvertisingData(uint8_t instance, uint16_t length, const uint8_t* data);
+    bool startPeriodicAdvertising(uint8_t instance);
+    bool setDuration(uint8_t instance, int duration = 0, int max_events = 0);
+
+private:
+    std::vector<esp_ble_gap_ext_adv_params_t> m_sets;
+};
+#endif
+
+class BLEDevice {
+public:
+    static void init(const std::string& deviceName);
+    static BLEServer* createServer();
+    static BLEAdvertising* getAdvertising();
+    static void startAdvertising();
+    static void stopAdvertising();
+    static int setMTU(uint16_t mtu);
+    static uint16_t getMTU();
+    static std::string getDeviceName();
+    static void setCustomGapHandler(esp_gap_ble_cb_t handler);
+    static void setCustomGattsHandler(gatts_event_handler handler);
+    static void setEncryptionLevel(esp_ble_sec_act_t level);
+};
@@ -0,0 +1,28 @@
+/**
+ * Virtual clock for the native simulator.
+ *
+ * Replaces the ESP32 hardware timer behind millis()/micros()/delay() so a
+ * firmware run is deterministic and independent of host speed: delay()
+ * advances time instantly instead of sleeping.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace sim {
+
+class Clock {
+public:
+    static uint64_t nowUs() { return s_nowUs; }
+    static uint32_t nowMs() { return (uint32_t)(s_nowUs / 1000); }
+
+    static void advanceUs(uint64_t us) { s_nowUs += us; }
+    static void advanceMs(uint32_t ms) { s_nowUs += (uint64_t)ms * 1000; }
+    static void reset() { s_nowUs = 0; }
+
+private:
+    static uint64_t s_nowUs;
+};
+
+}  // namespace sim
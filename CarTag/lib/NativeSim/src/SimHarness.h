@@ -0,0 +1,143 @@
+/**
+ * Control surface for driving the simulated BLE stack.
+ *
+ * The runner in SimMain.cpp uses this to play the part of the phone:
+ * connect a central, write to a characteristic, drop the link, and inspect
+ * every notification the firmware pushed and every advertisement it set.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "SimBLE.h"
+
+namespace sim {
+
+struct Notification {
+    uint64_t timeUs;
+    uint16_t connId;
+    std::string uuid;
+    std::vector<uint8_t> data;
+};
+
+struct ConnParamRequest {
+    uint64_t timeUs;
+    uint16_t connId;
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+enum AdvertisementKind {
+    ADV_KIND_LEGACY,         // legacy advertising packet (or a set sending legacy PDUs)
+    ADV_KIND_SCAN_RESPONSE,
+    ADV_KIND_EXTENDED,
+    ADV_KIND_PERIODIC,
+};
+
+// Advertising data as handed to the controller
+struct Advertisement {
+    uint64_t timeUs;
+    AdvertisementKind kind;
+    std::vector<uint8_t> data;
+};
+
+// A start of connectable advertising, as the controller answered it
+struct AdvertisingRun {
+    uint64_t timeUs;
+    uint64_t endUs;     // 0 while it runs
+    uint16_t interval;  // shortest, 0.625 ms units; 0 for directed
+    bool directed;
+    bool ok;
+};
+
+class Ble {
+public:
+    // Central side actions; return false if the action is not possible
+    static bool connect(uint16_t connId = 0, uint16_t mtu = 23);
+    static bool disconnect(uint16_t connId = 0, int reason = ESP_GATT_CONN_TERMINATE_PEER_USER);
+    static bool write(const std::string& uuid, const std::vector<uint8_t>& data,
+                      uint16_t connId = 0);
+    static bool changeMtu(uint16_t mtu, uint16_t connId = 0);
+
+    // Write the CCCD of a notifiable characteristic; connect() turns
+    // notifications on for all of them, like the app does
+    static bool subscribe(const std::string& uuid, bool enable, uint16_t connId = 0);
+
+    // Shortest connection interval the central grants, in 1.25 ms units
+    // (iOS: 12, i.e. 15 ms); requests with a longer maximum are granted at
+    // their minimum or this floor, shorter ones are rejected
+    static void setMinInterval(uint16_t interval);
+
+    // What the central's controller supports: the largest link layer PDU
+    // payload (27 refuses data length extension) and the 2M PHY
+    static void setMaxOctets(uint16_t octets);
+    static void setPhy2m(bool supported);
+
+    // The controller refuses the next count starts of connectable
+    // advertising (Command Disallowed in the start complete event)
+    static void failAdvertisingStarts(uint32_t count);
+
+    static bool isConnected(uint16_t connId = 0);
+    static uint32_t connectedCount();
+    static uint16_t mtu(uint16_t connId = 0);
+    static bool isAdvertising();
+    static bool isBonded(uint16_t connId = 0);
+
+    static const std::vector<Notification>& notifications();
+    static const std::vector<ConnParamRequest>& connParamRequests();
+    static const std::vector<Advertisement>& advertisements();
+    static const std::vector<AdvertisingRun>& advertisingRuns();
+    static void clearNotifications();
+
+    // Called from the simulated library
+    static void recordNotification(BLECharacteristic* characteristic);
+    static bool recordNotification(uint16_t connId, uint16_t handle, const uint8_t* data, size_t len);
+    static bool recordServiceChanged(const uint8_t* address);
+    static void recordConnParams(const uint8_t* address, uint16_t minInterval, uint16_t maxInterval,
+                                 uint16_t latency, uint16_t timeout);
+    static bool requestDataLength(const uint8_t* address, uint16_t txOctets);
+    static bool requestPhy(const uint8_t* address, uint8_t txMask, uint8_t rxMask);
+    static void setGattsHandler(gatts_event_handler handler);
+    // Directed advertising only lets the central at directedTo connect,
+    // and stops by itself after 1.28 s
+    static void setAdvertising(bool advertising, const uint8_t* directedTo = nullptr);
+    // Start, then report it in the GAP start complete event: legacy
+    // advertising (instance -1) or one advertising set; only connectable
+    // advertising can be made to fail
+    static bool startAdvertising(int instance, bool connectable, uint16_t interval,
+                                 const uint8_t* directedTo = nullptr);
+    static void setEncryptionLevel(esp_ble_sec_act_t level);
+    static std::vector<esp_ble_bond_dev_t> bondedDevices();
+    static bool removeBond(const uint8_t* address);
+    static void recordAdvertisement(AdvertisementKind kind, const uint8_t* data, size_t len);
+    static void registerServer(BLEServer* server);
+    static BLEServer* server();
+    static uint16_t firstConnId();
+};
+
+// Input pin levels behind digitalRead(); every pin starts low
+class Gpio {
+public:
+    static void set(uint8_t pin, bool high);
+    static bool get(uint8_t pin);
+};
+
+// Non-volatile storage behind Preferences and the stack's bond keys.
+// Empty at every start unless loaded from a file (the runner's --nvs).
+class Nvs {
+public:
+    static const std::vector<uint8_t>* get(const std::string& key);
+    static void put(const std::string& key, const std::vector<uint8_t>& value);
+    static bool remove(const std::string& key);
+
+    // One "key hex" line per entry
+    static bool load(const std::string& path);
+    static bool save(const std::string& path);
+};
+
+}  // namespace sim
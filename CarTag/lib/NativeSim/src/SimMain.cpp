@@ -0,0 +1,593 @@
+/**
+ * Native simulator entry point.
+ *
+ * Runs the firmware's setup()/loop() against the virtual clock while a
+ * scripted central connects, writes and disconnects, then prints
+ * throughput and timing figures for the notify path.
+ *
+ * Usage: program [--duration MS] [--connect MS] [--disconnect MS]
+ *                [--reconnect MS] [--mtu N] [--write MS:UUID:HEX]
+ *                [--log-sync MS] [--log-query MS:FROM[:TO]]
+ *                [--min-interval UNITS] [--max-octets N] [--no-2m]
+ *                [--peer MS[:MTU]] [--drop MS] [--nvs FILE] [--adv-fail N]
+ *                [--ignition MS:0|1] [--dump] [--verbose]
+ *
+ * --log-sync plays the app's side of a log download from MS onwards:
+ * START, acks every half window one connection interval after the packet
+ * arrives, and after a --reconnect resumes from the last position it kept.
+ * --log-query does the same with a QUERY for samples from FROM to TO ms,
+ * and resumes by querying again from the newest sample it decoded.
+ * --min-interval sets the shortest connection interval the central grants,
+ * in 1.25 ms units (12 for an iPhone); --max-octets and --no-2m limit the
+ * data length and PHY its controller accepts.
+ * --peer connects one more central (conn 1, 2, ...) at MS, with its own
+ * MTU; it subscribes to everything like the first one.
+ * --drop loses the first central's link at MS (supervision timeout) rather
+ * than disconnecting it; a --reconnect then shows the fast reconnect path.
+ * --nvs keeps NVS, with the bond table and the stack's bond keys, in FILE
+ * from one run to the next.
+ * --adv-fail makes the controller refuse the first N starts of connectable
+ * advertising, to exercise the retries.
+ * --ignition drives the ignition line low (0) or high (1) at MS; it is
+ * high from the start, and may be given several times.
+ *
+ * The report ends with a model of what each advertising profile costs and
+ * how soon a phone would find the tag in it (see reportProfiles()).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <stdlib.h>
+
+#include "AdvertisingManager.h"
+#include "Arduino.h"
+#include "IgnitionSense.h"
+#include "LogSyncService.h"
+#include "SimHarness.h"
+#include "TelemetryBeacon.h"
+
+namespace {
+
+struct Event {
+    uint32_t atMs;
+    std::function<void()> action;
+};
+
+struct Options {
+    uint32_t durationMs = 60000;
+    uint32_t connectMs = 100;
+    uint32_t disconnectMs = 0;
+    uint32_t reconnectMs = 0;
+    uint32_t dropMs = 0;
+    uint32_t logSyncMs = 0;
+    uint32_t logQueryMs = 0;
+    uint32_t queryFromMs = 0;
+    uint32_t queryToMs = LOG_SYNC_OPEN_END;
+    uint16_t mtu = 23;
+    uint16_t minInterval = 6;
+    uint16_t maxOctets = 251;
+    bool phy2m = true;
+    bool verbose = false;
+    bool dump = false;
+    uint16_t peers = 0;
+    uint32_t advFail = 0;
+    std::string nvsPath;
+    std::vector<Event> events;
+};
+
+std::vector<uint8_t> parseHex(const std::string& hex) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        out.push_back((uint8_t)strtoul(hex.substr(i, 2).c_str(), nullptr, 16));
+    }
+    return out;
+}
+
+bool parseWrite(const std::string& spec, Event& event) {
+    size_t first = spec.find(':');
+    size_t second = spec.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos) return false;
+
+    uint32_t atMs = (uint32_t)strtoul(spec.substr(0, first).c_str(), nullptr, 10);
+    std::string uuid = spec.substr(first + 1, second - first - 1);
+    std::vector<uint8_t> data = parseHex(spec.substr(second + 1));
+    event.atMs = atMs;
+    event.action = [uuid, data]() { sim::Ble::write(uuid, data); };
+    return true;
+}
+
+bool parsePeer(const std::string& spec, Options& opts) {
+    size_t colon = spec.find(':');
+    uint32_t atMs = (uint32_t)strtoul(spec.c_str(), nullptr, 10);
+    uint16_t mtu = colon == std::string::npos ? 23 : (uint16_t)strtoul(spec.substr(colon + 1).c_str(), nullptr, 10);
+    uint16_t connId = ++opts.peers;
+    opts.events.push_back({atMs, [connId, mtu]() {
+        if (!sim::Ble::connect(connId, mtu)) printf("conn %u could not connect (not advertising)\n", connId);
+    }});
+    return atMs > 0;
+}
+
+bool parseIgnition(const std::string& spec, Options& opts) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) return false;
+    uint32_t atMs = (uint32_t)strtoul(spec.c_str(), nullptr, 10);
+    bool high = strtoul(spec.substr(colon + 1).c_str(), nullptr, 10) != 0;
+    opts.events.push_back({atMs, [high]() { sim::Gpio::set(IGNITION_PIN, high); }});
+    return true;
+}
+
+bool parseQuery(const std::string& spec, Options& opts) {
+    size_t first = spec.find(':');
+    if (first == std::string::npos) return false;
+    size_t second = spec.find(':', first + 1);
+
+    opts.logQueryMs = (uint32_t)strtoul(spec.substr(0, first).c_str(), nullptr, 10);
+    opts.queryFromMs = (uint32_t)strtoul(spec.substr(first + 1).c_str(), nullptr, 10);
+    if (second != std::string::npos) {
+        opts.queryToMs = (uint32_t)strtoul(spec.substr(second + 1).c_str(), nullptr, 10);
+    }
+    return opts.logQueryMs > 0;
+}
+
+bool parseArgs(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg == "--verbose") {
+            opts.verbose = true;
+        } else if (arg == "--no-2m") {
+            opts.phy2m = false;
+        } else if (value && arg == "--max-octets") {
+            opts.maxOctets = (uint16_t)strtoul(value, nullptr, 10); i++;
+        } else if (arg == "--dump") {
+            opts.dump = true;
+        } else if (value && arg == "--duration") {
+            opts.durationMs = (uint32_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--connect") {
+            opts.connectMs = (uint32_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--disconnect") {
+            opts.disconnectMs = (uint32_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--drop") {
+            opts.dropMs = (uint32_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--nvs") {
+            opts.nvsPath = value; i++;
+        } else if (value && arg == "--adv-fail") {
+            opts.advFail = (uint32_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--ignition") {
+            if (!parseIgnition(value, opts)) return false;
+            i++;
+        } else if (value && arg == "--reconnect") {
+            opts.reconnectMs = (uint32_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--log-sync") {
+            opts.logSyncMs = (uint32_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--log-query") {
+            if (!parseQuery(value, opts)) return false;
+            i++;
+        } else if (value && arg == "--peer") {
+            if (!parsePeer(value, opts)) return false;
+            i++;
+        } else if (value && arg == "--min-interval") {
+            opts.minInterval = (uint16_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--mtu") {
+            opts.mtu = (uint16_t)strtoul(value, nullptr, 10); i++;
+        } else if (value && arg == "--write") {
+            Event event;
+            if (!parseWrite(value, event)) return false;
+            opts.events.push_back(event);
+            i++;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The app's side of a log download
+class SyncCentral {
+public:
+    static const uint32_t ACK_DELAY_US = 7500;  // one 7.5 ms connection interval
+    static const uint8_t WINDOW = LOG_SYNC_DEFAULT_WINDOW;
+
+    void start(bool resume) {
+        std::vector<uint8_t> req(8);
+        req[0] = LOG_SYNC_OP_START;
+        putLE32(&req[1], resume ? m_sector : 0);
+        putLE16(&req[5], resume ? m_offset : 0);
+        req[7] = WINDOW;
+        send(req);
+    }
+
+    void query(uint32_t fromMs, uint32_t toMs) {
+        std::vector<uint8_t> req(10);
+        req[0] = LOG_SYNC_OP_QUERY;
+        putLE32(&req[1], fromMs);
+        putLE32(&req[5], toMs);
+        req[9] = WINDOW;
+        if (!m_query) m_fromMs = fromMs;
+        m_query = true;
+        m_toMs = toMs;
+        send(req);
+    }
+
+    void resume() {
+        if (!m_query) {
+            start(true);
+        } else {
+            query(m_samples ? m_lastSampleMs + 1 : m_fromMs, m_toMs);
+        }
+    }
+
+    // Look at new notifications and send any ack that is due
+    void poll() {
+        const auto& notes = sim::Ble::notifications();
+        for (; m_seen < notes.size(); m_seen++) {
+            const auto& n = notes[m_seen];
+            if (n.uuid != LOG_SYNC_DATA_UUID || n.data.size() < LOG_SYNC_HEADER_SIZE) continue;
+            handlePacket(n.data);
+        }
+        if (m_ackDueUs && sim::Clock::nowUs() >= m_ackDueUs) {
+            std::vector<uint8_t> ack(3);
+            ack[0] = LOG_SYNC_OP_ACK;
+            putLE16(&ack[1], (uint16_t)(m_expected - 1));
+            sim::Ble::write(LOG_SYNC_CONTROL_UUID, ack);
+            m_ackDueUs = 0;
+            m_unacked = 0;
+        }
+    }
+
+    bool incomplete() const { return m_active && !m_complete; }
+
+    void report() const {
+        if (!m_startUs) return;
+        double seconds = ((m_complete ? m_endUs : sim::Clock::nowUs()) - m_startUs) / 1e6;
+        printf("log sync          : %s, %u samples, %u bytes in %.3f s (%.1f KB/s), "
+               "%u packets discarded\n", m_complete ? "complete" : "incomplete",
+               (unsigned)m_samples, (unsigned)m_bytes, seconds,
+               seconds > 0 ? m_bytes / seconds / 1000 : 0.0, (unsigned)m_discarded);
+        if (m_samples) {
+            printf("log sync range    : %.3f s to %.3f s\n", m_firstSampleMs / 1000.0,
+                   m_lastSampleMs / 1000.0);
+        }
+    }
+
+private:
+    void send(const std::vector<uint8_t>& req) {
+        m_expected = 0;
+        m_ackDueUs = 0;
+        m_unacked = 0;
+        m_active = sim::Ble::write(LOG_SYNC_CONTROL_UUID, req);
+        if (m_active && !m_startUs) m_startUs = sim::Clock::nowUs();
+    }
+
+    void handlePacket(const std::vector<uint8_t>& p) {
+        uint16_t number = getLE16(&p[2]);
+        if (p[0] != LOG_SYNC_MAGIC || number != m_expected) {
+            m_discarded++;
+            return;
+        }
+        m_expected++;
+        m_bytes += p.size();
+        // Records are compressed blocks
+        TelemetrySample samples[TELEMETRY_BLOCK_MAX_SAMPLES];
+        for (size_t i = LOG_SYNC_HEADER_SIZE; i < p.size(); i += 1 + p[i]) {
+            if (i + 1 + p[i] > p.size()) break;
+            size_t n = decodeTelemetryBlock(&p[i + 1], p[i], samples, TELEMETRY_BLOCK_MAX_SAMPLES);
+            if (n == 0) continue;
+            if (!m_samples) m_firstSampleMs = samples[0].timestampMs;
+            m_lastSampleMs = samples[n - 1].timestampMs;
+            m_samples += n;
+        }
+        m_sector = getLE32(&p[4]);
+        m_offset = getLE16(&p[8]);
+
+        bool last = p[1] & LOG_SYNC_FLAG_LAST;
+        if (last) {
+            m_complete = true;
+            m_endUs = sim::Clock::nowUs();
+        }
+        if ((++m_unacked >= WINDOW / 2 || last) && !m_ackDueUs) {
+            m_ackDueUs = sim::Clock::nowUs() + ACK_DELAY_US;
+        }
+    }
+
+    size_t m_seen = 0;
+    bool m_active = false;
+    bool m_complete = false;
+    bool m_query = false;
+    uint32_t m_fromMs = 0;
+    uint32_t m_toMs = 0;
+    uint32_t m_firstSampleMs = 0;
+    uint32_t m_lastSampleMs = 0;
+    uint16_t m_expected = 0;
+    uint16_t m_unacked = 0;
+    uint64_t m_ackDueUs = 0;
+    uint64_t m_startUs = 0;
+    uint64_t m_endUs = 0;
+    uint32_t m_sector = 0;
+    uint16_t m_offset = 0;
+    uint32_t m_samples = 0;
+    uint32_t m_bytes = 0;
+    uint32_t m_discarded = 0;
+};
+
+void dumpNotifications() {
+    for (const auto& n : sim::Ble::notifications()) {
+        printf("%10.3f ms  conn %u  %s  ", n.timeUs / 1000.0, n.connId, n.uuid.c_str());
+        for (uint8_t b : n.data) printf("%02x", b);
+        printf("\n");
+    }
+}
+
+// The beacon's manufacturer data in one advertisement, or nullptr
+const uint8_t* findBeacon(const std::vector<uint8_t>& adv, size_t& len) {
+    for (size_t i = 0; i + 1 < adv.size() && adv[i] > 0; i += adv[i] + 1) {
+        const uint8_t* field = &adv[i + 2];
+        len = adv[i] - 1;
+        if (adv[i + 1] == 0xFF && len >= BEACON_HEADER_SIZE && getLE16(field) == BEACON_COMPANY_ID &&
+            field[2] == BEACON_MAGIC) {
+            return field;
+        }
+    }
+    return nullptr;
+}
+
+// What a scanner would have read from the beacon updates
+void reportBroadcast() {
+    static const char* KIND_NAMES[] = {"legacy", "scan response", "extended", "periodic"};
+    size_t counts[4] = {};
+    const sim::Advertisement* last = nullptr;
+    for (const auto& adv : sim::Ble::advertisements()) {
+        size_t len;
+        if (!findBeacon(adv.data, len)) continue;
+        counts[adv.kind]++;
+        last = &adv;
+    }
+    if (!last) return;
+
+    printf("broadcast         :");
+    for (int kind = 0; kind < 4; kind++) {
+        if (counts[kind]) printf(" %zu %s", counts[kind], KIND_NAMES[kind]);
+    }
+    printf(" updates (%zu-byte packets)\n", last->data.size());
+
+    size_t len;
+    const uint8_t* beacon = findBeacon(last->data, len);
+    printf("broadcast last    : %9.3f s  seq %u, battery %u%%, flags 0x%02x, channels 0x%04x, %zu bytes\n",
+           last->timeUs / 1e6, (unsigned)getLE16(beacon + 4), (unsigned)beacon[6],
+           (unsigned)beacon[7], (unsigned)getLE16(beacon + 8), len);
+}
+
+// Every start of connectable advertising, and the intervals it ran at
+void reportAdvertising() {
+    size_t ok = 0, failed = 0, directed = 0;
+    std::map<uint16_t, size_t> intervals;
+    for (const auto& run : sim::Ble::advertisingRuns()) {
+        if (!run.ok) {
+            failed++;
+        } else if (run.directed) {
+            directed++;
+        } else {
+            ok++;
+            intervals[run.interval]++;
+        }
+    }
+    printf("advertising       : %zu starts, %zu failed, %zu directed", ok, failed, directed);
+    const char* separator = ", intervals";
+    for (const auto& entry : intervals) {
+        printf("%s %.1f ms x%zu", separator, entry.first * 0.625, entry.second);
+        separator = ",";
+    }
+    printf("\n");
+}
+
+// Power and discovery model for the advertising profiles. An advertising
+// event sends ADV_IND on the three primary channels and listens after each
+// one: about ADV_EVENT_UC of charge on an ESP32 radio, on top of SLEEP_MA
+// with the controller in modem sleep between events. Events come every
+// interval (the shortest one the firmware asked for) plus the controller's
+// random 0-10 ms delay. A phone scans for a window every scan interval; an
+// event lands in a window with probability window/interval, the random
+// delay keeping the two from locking in phase. Rough figures, meant to
+// compare the profiles with each other, not to size a battery.
+const double ADV_EVENT_UC = 250.0;  // mA x ms
+const double SLEEP_MA = 1.5;
+const double ADV_DELAY_MS = 5.0;    // mean of the random delay
+
+struct Scanner {
+    const char* name;
+    double windowMs;
+    double intervalMs;
+};
+
+// Android's low latency scan (an app in the foreground looking for the
+// tag) and low power scan (in the background)
+const Scanner SCANNERS[] = {{"foreground", 4096, 4096}, {"background", 512, 5120}};
+
+// Expected time from the scanner starting to the first advertisement it
+// receives, for events every periodMs
+double discoveryMs(double periodMs, const Scanner& scanner) {
+    if (periodMs <= scanner.windowMs) {
+        // Every window catches an event; the scanner may start between windows
+        double gap = scanner.intervalMs - scanner.windowMs;
+        return gap * gap / (2 * scanner.intervalMs) + periodMs / 2;
+    }
+    return periodMs / 2 + periodMs * (scanner.intervalMs / scanner.windowMs - 1);
+}
+
+// Undirected runs by profile, told apart by their interval: discovery at
+// ADV_FAST_INTERVAL, the beacon from the first back-off step up to
+// ADV_SLOW_INTERVAL, parked at ADV_PARKED_INTERVAL
+void reportProfiles(double seconds) {
+    static const char* NAMES[] = {"discovery", "beacon", "parked"};
+    struct Profile {
+        double ms, events, discoveryMs[2];
+        uint16_t minInterval, maxInterval;
+    } profiles[3] = {};
+
+    double totalEvents = 0;
+    for (const auto& run : sim::Ble::advertisingRuns()) {
+        if (!run.ok || run.directed) continue;
+        uint64_t endUs = run.endUs ? run.endUs : sim::Clock::nowUs();
+        double ms = (endUs - run.timeUs) / 1000.0;
+        double periodMs = run.interval * 0.625 + ADV_DELAY_MS;
+        Profile& p = profiles[run.interval <= ADV_FAST_INTERVAL ? 0 : run.interval < ADV_PARKED_INTERVAL ? 1 : 2];
+        if (p.ms == 0 || run.interval < p.minInterval) p.minInterval = run.interval;
+        if (run.interval > p.maxInterval) p.maxInterval = run.interval;
+        p.ms += ms;
+        p.events += ms / periodMs;
+        for (int i = 0; i < 2; i++) p.discoveryMs[i] += ms * discoveryMs(periodMs, SCANNERS[i]);
+        totalEvents += ms / periodMs;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        const Profile& p = profiles[i];
+        if (p.ms <= 0) continue;
+        printf("profile %-10s: %8.3f s at %.1f", NAMES[i], p.ms / 1000, p.minInterval * 0.625);
+        if (p.maxInterval != p.minInterval) printf("-%.1f", p.maxInterval * 0.625);
+        printf(" ms, %.0f events, ~%.2f mA, found in ~%.2f s %s / ~%.2f s %s\n", p.events,
+               SLEEP_MA + p.events * ADV_EVENT_UC / p.ms, p.discoveryMs[0] / p.ms / 1000, SCANNERS[0].name,
+               p.discoveryMs[1] / p.ms / 1000, SCANNERS[1].name);
+    }
+    printf("advertising power : ~%.2f mA average over the run\n",
+           SLEEP_MA + totalEvents * ADV_EVENT_UC / (seconds * 1000));
+}
+
+void printReport(const Options& opts, uint64_t loops, double loopNsTotal, double loopNsMax) {
+    const auto& notes = sim::Ble::notifications();
+
+    size_t bytes = 0;
+    for (const auto& n : notes) bytes += n.data.size();
+
+    double minGapMs = 0, maxGapMs = 0, sumGapMs = 0;
+    for (size_t i = 1; i < notes.size(); i++) {
+        double gap = (notes[i].timeUs - notes[i - 1].timeUs) / 1000.0;
+        if (i == 1 || gap < minGapMs) minGapMs = gap;
+        if (gap > maxGapMs) maxGapMs = gap;
+        sumGapMs += gap;
+    }
+
+    double seconds = opts.durationMs / 1000.0;
+    printf("---- CarTag native simulation ----\n");
+    printf("virtual time      : %.3f s\n", seconds);
+    printf("loop iterations   : %llu\n", (unsigned long long)loops);
+    printf("loop host cost    : mean %.0f ns, max %.0f ns\n",
+           loops ? loopNsTotal / loops : 0.0, loopNsMax);
+    printf("notifications     : %zu (%.2f /s)\n", notes.size(), notes.size() / seconds);
+    printf("payload bytes     : %zu (%.1f B/s)\n", bytes, bytes / seconds);
+    if (notes.size() > 1) {
+        printf("notify interval   : min %.1f ms, mean %.1f ms, max %.1f ms\n",
+               minGapMs, sumGapMs / (notes.size() - 1), maxGapMs);
+    }
+    if (opts.peers) {
+        std::map<uint16_t, std::pair<size_t, size_t>> perConn;
+        for (const auto& n : notes) {
+            perConn[n.connId].first++;
+            perConn[n.connId].second += n.data.size();
+        }
+        for (const auto& entry : perConn) {
+            printf("conn %-13u : %zu notifications, %zu bytes\n", (unsigned)entry.first,
+                   entry.second.first, entry.second.second);
+        }
+    }
+    for (const auto& r : sim::Ble::connParamRequests()) {
+        printf("conn params       : %9.3f s  conn %u  %.2f-%.2f ms, latency %u, timeout %u ms\n",
+               r.timeUs / 1e6, (unsigned)r.connId, r.minInterval * 1.25, r.maxInterval * 1.25,
+               (unsigned)r.latency, (unsigned)r.timeout * 10);
+    }
+    reportBroadcast();
+    reportAdvertising();
+    reportProfiles(seconds);
+
+    size_t serviceChanged = 0;
+    for (const auto& n : notes) serviceChanged += n.uuid == "2a05";
+    if (serviceChanged) printf("service changed   : %zu indications\n", serviceChanged);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        fprintf(stderr, "usage: %s [--duration MS] [--connect MS] [--disconnect MS] "
+                        "[--reconnect MS] [--mtu N] [--write MS:UUID:HEX] [--log-sync MS] "
+                        "[--log-query MS:FROM[:TO]] [--min-interval UNITS] [--max-octets N] [--no-2m] "
+                        "[--peer MS[:MTU]] [--drop MS] [--nvs FILE] [--adv-fail N] [--ignition MS:0|1] "
+                        "[--dump] [--verbose]\n",
+                argv[0]);
+        return 2;
+    }
+    if (!opts.nvsPath.empty()) sim::Nvs::load(opts.nvsPath);
+    Serial.setMuted(!opts.verbose);
+    sim::Ble::setMinInterval(opts.minInterval);
+    sim::Ble::setMaxOctets(opts.maxOctets);
+    sim::Ble::setPhy2m(opts.phy2m);
+    sim::Ble::failAdvertisingStarts(opts.advFail);
+    sim::Gpio::set(IGNITION_PIN, true);
+
+    uint16_t mtu = opts.mtu;
+    opts.events.push_back({opts.connectMs, [mtu]() { sim::Ble::connect(0, mtu); }});
+    if (opts.disconnectMs) {
+        opts.events.push_back({opts.disconnectMs, []() { sim::Ble::disconnect(0); }});
+    }
+    if (opts.dropMs) {
+        opts.events.push_back({opts.dropMs, []() { sim::Ble::disconnect(0, ESP_GATT_CONN_TIMEOUT); }});
+    }
+
+    SyncCentral syncCentral;
+    if (opts.reconnectMs) {
+        opts.events.push_back({opts.reconnectMs, [mtu, &syncCentral]() {
+            if (!sim::Ble::connect(0, mtu)) printf("conn 0 could not reconnect (not advertising to it)\n");
+            if (syncCentral.incomplete()) syncCentral.resume();
+        }});
+    }
+    if (opts.logSyncMs) {
+        opts.events.push_back({opts.logSyncMs, [&syncCentral]() { syncCentral.start(false); }});
+    }
+    if (opts.logQueryMs) {
+        uint32_t fromMs = opts.queryFromMs, toMs = opts.queryToMs;
+        opts.events.push_back({opts.logQueryMs, [&syncCentral, fromMs, toMs]() {
+            syncCentral.query(fromMs, toMs);
+        }});
+    }
+    std::stable_sort(opts.events.begin(), opts.events.end(),
+                     [](const Event& a, const Event& b) { return a.atMs < b.atMs; });
+
+    sim::Clock::reset();
+    setup();
+
+    size_t nextEvent = 0;
+    uint64_t loops = 0;
+    double loopNsTotal = 0, loopNsMax = 0;
+
+    while (millis() < opts.durationMs) {
+        while (nextEvent < opts.events.size() && opts.events[nextEvent].atMs <= millis()) {
+            opts.events[nextEvent++].action();
+        }
+
+        uint64_t before = sim::Clock::nowUs();
+        auto start = std::chrono::steady_clock::now();
+        loop();
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+
+        if (opts.logSyncMs || opts.logQueryMs) syncCentral.poll();
+
+        loops++;
+        loopNsTotal += ns;
+        loopNsMax = std::max(loopNsMax, ns);
+
+        // A loop() that never sleeps would otherwise freeze virtual time
+        if (sim::Clock::nowUs() == before) sim::Clock::advanceMs(1);
+    }
+
+    if (opts.dump) dumpNotifications();
+    printReport(opts, loops, loopNsTotal, loopNsMax);
+    syncCentral.report();
+    if (!opts.nvsPath.empty() && !sim::Nvs::save(opts.nvsPath)) {
+        fprintf(stderr, "could not write %s\n", opts.nvsPath.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,272 @@
+/**
+ * Connectable advertising and the telemetry broadcast
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Advertiser.h"
+
+namespace {
+
+// AD types from the Bluetooth assigned numbers
+const uint8_t AD_FLAGS         = 0x01;
+const uint8_t AD_UUID128       = 0x07;  // complete list of 128-bit service UUIDs
+const uint8_t AD_NAME          = 0x09;  // complete local name
+const uint8_t AD_CONN_INTERVAL = 0x12;  // peripheral preferred connection interval range
+const uint8_t AD_MANUFACTURER  = 0xFF;
+
+const uint8_t FLAGS_GENERAL_DISCOVERABLE = 0x06;  // LE general discoverable, no BR/EDR
+
+// Preferred connection interval range (1.25 ms units); iOS connects more
+// reliably when it is advertised
+const uint16_t PREFERRED_MIN_INTERVAL = 0x06;
+const uint16_t PREFERRED_MAX_INTERVAL = 0x40;
+
+// Payload room the other fields leave for the beacon: flags, connection
+// interval, then the AD header
+const size_t LEGACY_BEACON_MAX = ADV_LEGACY_MAX - 3 - 6 - 2;
+
+// Appends one AD structure; returns the new length, or len unchanged if it does not fit
+size_t appendAd(uint8_t* out, size_t len, size_t cap, uint8_t type, const uint8_t* data, size_t n) {
+    if (len + 2 + n > cap) return len;
+    out[len] = (uint8_t)(n + 1);
+    out[len + 1] = type;
+    memcpy(out + len + 2, data, n);
+    return len + 2 + n;
+}
+
+// "4fafc201-1fb5-..." to the 16 bytes in air order (little-endian)
+void parseUuid128(const char* uuid, uint8_t* out) {
+    uint8_t bytes[16] = {};
+    size_t n = 0;
+    for (const char* p = uuid; *p && p[1] && n < sizeof(bytes); p++) {
+        if (*p == '-') continue;
+        char pair[3] = {p[0], p[1], 0};
+        bytes[n++] = (uint8_t)strtoul(pair, nullptr, 16);
+        p++;
+    }
+    for (size_t i = 0; i < sizeof(bytes); i++) out[i] = bytes[sizeof(bytes) - 1 - i];
+}
+
+#if SOC_BLE_50_SUPPORTED
+const uint8_t CONNECTABLE_SET = 0;
+const uint8_t BROADCAST_SET = 1;
+
+// Legacy PDUs for the connectable set: phones that cannot scan for
+// extended advertising still find and connect to it
+esp_ble_gap_ext_adv_params_t connectableParams(uint16_t interval) {
+    esp_ble_gap_ext_adv_params_t params = {};
+    params.type = ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_IND;
+    params.interval_min = interval;
+    params.interval_max = 2 * interval;
+    params.channel_map = ADV_CHNL_ALL;
+    params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+    params.peer_addr_type = BLE_ADDR_TYPE_PUBLIC;
+    params.filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    params.tx_power = EXT_ADV_TX_PWR_NO_PREFERENCE;
+    params.primary_phy = ESP_BLE_GAP_PRI_PHY_1M;
+    params.secondary_phy = ESP_BLE_GAP_PHY_1M;
+    params.sid = CONNECTABLE_SET;
+    return params;
+}
+#else
+// Connectable undirected advertising, or high duty cycle directed
+esp_ble_adv_params_t legacyParams(uint16_t interval, esp_ble_adv_type_t type) {
+    esp_ble_adv_params_t params = {};
+    params.adv_int_min = interval;
+    params.adv_int_max = 2 * interval;
+    params.adv_type = type;
+    params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+    params.channel_map = ADV_CHNL_ALL;
+    params.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    return params;
+}
+
+void setRawData(BLEAdvertising* advertising, const uint8_t* adv, size_t advLen,
+                const uint8_t* scan, size_t scanLen) {
+    BLEAdvertisementData advData, scanData;
+    advData.addData(std::string((const char*)adv, advLen));
+    scanData.addData(std::string((const char*)scan, scanLen));
+    advertising->setAdvertisementData(advData);
+    advertising->setScanResponseData(scanData);
+}
+#endif
+
+}  // namespace
+
+void Advertiser::begin(const char* serviceUuid, const char* name) {
+    parseUuid128(serviceUuid, m_serviceUuid);
+    m_name = name;
+
+#if SOC_BLE_50_SUPPORTED
+    m_stats.extended = true;
+
+    esp_ble_gap_ext_adv_params_t params = connectableParams(0x20);
+    m_sets.setAdvertisingParams(CONNECTABLE_SET, &params);
+
+    params.type = ESP_BLE_GAP_SET_EXT_ADV_PROP_NONCONN_NONSCANNABLE_UNDIRECTED;
+    params.interval_min = params.interval_max = BEACON_ADV_INTERVAL_MS * 8 / 5;  // 0.625 ms units
+    params.sid = BROADCAST_SET;
+    m_sets.setAdvertisingParams(BROADCAST_SET, &params);
+
+    esp_ble_gap_periodic_adv_params_t periodic = {};
+    periodic.interval_min = periodic.interval_max = BEACON_ADV_INTERVAL_MS * 4 / 5;  // 1.25 ms units
+    m_sets.setPeriodicAdvertisingParams(BROADCAST_SET, &periodic);
+#endif
+    setConnectableData(nullptr, 0);
+}
+
+bool Advertiser::start(uint16_t interval) {
+    m_stats.starts++;
+#if SOC_BLE_50_SUPPORTED
+    // Parameters only change with the set stopped
+    uint8_t set = CONNECTABLE_SET;
+    m_sets.stop(1, &set);
+    esp_ble_gap_ext_adv_params_t params = connectableParams(interval);
+    bool ok = m_sets.setAdvertisingParams(CONNECTABLE_SET, &params) &&
+              m_sets.setDuration(CONNECTABLE_SET, 0);
+    if (m_directed) setConnectableData(nullptr, 0);
+    ok = ok && m_sets.start(1, CONNECTABLE_SET);
+#else
+    // Straight to the GAP API, as for directed advertising: the library's
+    // start() hides whether the stack took the call
+    BLEDevice::stopAdvertising();
+    esp_ble_adv_params_t params = legacyParams(interval, ADV_TYPE_IND);
+    bool ok = esp_ble_gap_start_advertising(&params) == ESP_OK;
+#endif
+    m_directed = false;
+    return ok;
+}
+
+void Advertiser::stop() {
+#if SOC_BLE_50_SUPPORTED
+    uint8_t set = CONNECTABLE_SET;
+    m_sets.stop(1, &set);
+#else
+    BLEDevice::stopAdvertising();
+#endif
+    m_directed = false;
+}
+
+bool Advertiser::startDirected(const uint8_t address[6], uint8_t addressType) {
+    m_stats.directed++;
+#if SOC_BLE_50_SUPPORTED
+    // Directed PDUs carry no data, and the controller refuses the
+    // parameters while the set still holds some
+    uint8_t set = CONNECTABLE_SET;
+    m_sets.stop(1, &set);
+    m_sets.setAdvertisingData(CONNECTABLE_SET, 0, nullptr);
+    m_sets.setScanRspData(CONNECTABLE_SET, 0, nullptr);
+
+    esp_ble_gap_ext_adv_params_t params = connectableParams(ADV_FAST_INTERVAL);
+    params.type = ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_HD_DIRECT;
+    params.peer_addr_type = (esp_ble_addr_type_t)addressType;
+    memcpy(params.peer_addr, address, sizeof(params.peer_addr));
+    bool ok = m_sets.setAdvertisingParams(CONNECTABLE_SET, &params) &&
+              m_sets.setDuration(CONNECTABLE_SET, DIRECTED_ADV_MS / 10) &&  // 10 ms units
+              m_sets.start(1, CONNECTABLE_SET);
+#else
+    // Not in the Arduino library: straight to the GAP API. The interval is
+    // ignored for high duty cycle directed advertising.
+    BLEDevice::stopAdvertising();
+    esp_ble_adv_params_t params = legacyParams(ADV_FAST_INTERVAL, ADV_TYPE_DIRECT_IND_HIGH);
+    memcpy(params.peer_addr, address, sizeof(params.peer_addr));
+    params.peer_addr_type = (esp_ble_addr_type_t)addressType;
+    bool ok = esp_ble_gap_start_advertising(&params) == ESP_OK;
+#endif
+    m_directed = true;
+    return ok;
+}
+
+bool Advertiser::startCompleted(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t* param,
+                                uint8_t& status) const {
+#if SOC_BLE_50_SUPPORTED
+    if (event != ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT) return false;
+    // One event per start call; the broadcast set is started on its own
+    for (uint8_t i = 0; i < param->ext_adv_start.instance_num; i++) {
+        if (param->ext_adv_start.instance[i] != CONNECTABLE_SET) continue;
+        status = (uint8_t)param->ext_adv_start.status;
+        return true;
+    }
+    return false;
+#else
+    if (event != ESP_GAP_BLE_ADV_START_COMPLETE_EVT) return false;
+    status = (uint8_t)param->adv_start_cmpl.status;
+    return true;
+#endif
+}
+
+size_t Advertiser::broadcastCapacity() const {
+#if SOC_BLE_50_SUPPORTED
+    return BEACON_MAX_DATA;
+#else
+    return LEGACY_BEACON_MAX;
+#endif
+}
+
+void Advertiser::broadcast(const uint8_t* data, size_t len) {
+    if (len == 0 && !m_broadcasting) return;
+    if (len > broadcastCapacity()) len = broadcastCapacity();
+
+#if SOC_BLE_50_SUPPORTED
+    if (len == 0) {
+        uint8_t set = BROADCAST_SET;
+        esp_ble_gap_periodic_adv_stop(BROADCAST_SET);
+        m_sets.stop(1, &set);
+        m_broadcasting = false;
+        return;
+    }
+
+    // Extended advertising names the device for scanner lists; the
+    // periodic train only needs the reading
+    uint8_t adv[2 + 32 + 2 + BEACON_MAX_DATA];
+    size_t advLen = appendAd(adv, 0, sizeof(adv), AD_NAME, (const uint8_t*)m_name, strlen(m_name));
+    advLen = appendAd(adv, advLen, sizeof(adv), AD_MANUFACTURER, data, len);
+    uint8_t periodic[2 + BEACON_MAX_DATA];
+    size_t periodicLen = appendAd(periodic, 0, sizeof(periodic), AD_MANUFACTURER, data, len);
+
+    m_sets.setAdvertisingData(BROADCAST_SET, advLen, adv);
+    m_sets.setPeriodicAdvertisingData(BROADCAST_SET, periodicLen, periodic);
+    if (!m_broadcasting) {
+        m_sets.start(1, BROADCAST_SET);
+        m_sets.startPeriodicAdvertising(BROADCAST_SET);
+    }
+#else
+    setConnectableData(data, len);
+#endif
+    m_broadcasting = len > 0;
+    if (m_broadcasting) {
+        m_stats.updates++;
+        m_stats.beaconBytes = (uint16_t)len;
+    }
+}
+
+// Flags, preferred connection interval and service UUID, name in the scan
+// response; with a beacon on a legacy controller the beacon takes the
+// UUID's place and the UUID moves to the scan response
+void Advertiser::setConnectableData(const uint8_t* beacon, size_t len) {
+    uint8_t flags = FLAGS_GENERAL_DISCOVERABLE;
+    uint8_t interval[4];
+    putLE16(interval, PREFERRED_MIN_INTERVAL);
+    putLE16(interval + 2, PREFERRED_MAX_INTERVAL);
+    uint8_t adv[ADV_LEGACY_MAX];
+    uint8_t scan[ADV_LEGACY_MAX];
+    size_t advLen = appendAd(adv, 0, sizeof(adv), AD_FLAGS, &flags, 1);
+    advLen = appendAd(adv, advLen, sizeof(adv), AD_CONN_INTERVAL, interval, sizeof(interval));
+    size_t scanLen = 0;
+    if (len > 0) {
+        advLen = appendAd(adv, advLen, sizeof(adv), AD_MANUFACTURER, beacon, len);
+        scanLen = appendAd(scan, scanLen, sizeof(scan), AD_UUID128, m_serviceUuid, sizeof(m_serviceUuid));
+    } else {
+        advLen = appendAd(adv, advLen, sizeof(adv), AD_UUID128, m_serviceUuid, sizeof(m_serviceUuid));
+    }
+    scanLen = appendAd(scan, scanLen, sizeof(scan), AD_NAME, (const uint8_t*)m_name, strlen(m_name));
+
+#if SOC_BLE_50_SUPPORTED
+    m_sets.setAdvertisingData(CONNECTABLE_SET, advLen, adv);
+    m_sets.setScanRspData(CONNECTABLE_SET, scanLen, scan);
+#else
+    setRawData(BLEDevice::getAdvertising(), adv, advLen, scan, scanLen);
+#endif
+}
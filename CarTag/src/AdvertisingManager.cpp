@@ -0,0 +1,187 @@
+/**
+ * Advertising state machine
+ */
+
+#include "AdvertisingManager.h"
+
+namespace {
+
+const char* const NAMES[ADV_STATE_COUNT] = {"off", "settling", "directed", "fast", "backoff", "parked",
+                                            "retry"};
+
+}  // namespace
+
+const char* advStateName(AdvState state) {
+    return state < ADV_STATE_COUNT ? NAMES[state] : "?";
+}
+
+void AdvertisingManager::enter(AdvState state, uint32_t nowMs) {
+    m_stats.previous = m_stats.state;
+    m_stats.state = state;
+    m_stats.stateSinceMs = nowMs;
+    m_stats.entered[state]++;
+
+    // Every advertising state starts with a start; a start made for the
+    // state being left no longer counts
+    m_due = state == ADV_STATE_DIRECTED || state == ADV_STATE_FAST || state == ADV_STATE_BACKOFF ||
+            state == ADV_STATE_PARKED;
+    m_awaiting = false;
+    if (state == ADV_STATE_FAST) m_interval = ADV_FAST_INTERVAL;
+    if (state == ADV_STATE_PARKED) m_interval = ADV_PARKED_INTERVAL;
+}
+
+void AdvertisingManager::begin(bool ignition, uint32_t nowMs) {
+    m_parked = !ignition;
+    enter(ADV_STATE_FAST, nowMs);
+}
+
+void AdvertisingManager::ignition(bool on, uint32_t nowMs) {
+    m_parked = !on;
+    switch (m_stats.state) {
+        case ADV_STATE_FAST:
+            // A window still open just ends as the ignition says
+            if (on) enter(ADV_STATE_FAST, nowMs);
+            break;
+        case ADV_STATE_BACKOFF:
+        case ADV_STATE_PARKED:
+            enter(on ? ADV_STATE_FAST : ADV_STATE_PARKED, nowMs);
+            break;
+        case ADV_STATE_RETRY:
+            m_resume = on ? ADV_STATE_FAST : m_resume == ADV_STATE_BACKOFF ? ADV_STATE_PARKED : m_resume;
+            break;
+        default:
+            // Off, settling and directed all end in a discovery window
+            break;
+    }
+}
+
+void AdvertisingManager::connected(bool full, uint32_t nowMs) {
+    m_retryMs = ADV_RETRY_MS;
+    enter(full ? ADV_STATE_OFF : ADV_STATE_FAST, nowMs);
+}
+
+void AdvertisingManager::disconnected(bool full, bool directed, uint32_t nowMs) {
+    if (full) return;
+    if (directed) {
+        enter(ADV_STATE_DIRECTED, nowMs);
+        return;
+    }
+    switch (m_stats.state) {
+        case ADV_STATE_OFF:
+            enter(ADV_STATE_SETTLING, nowMs);
+            m_deadlineMs = nowMs + ADV_RESTART_DELAY_MS;
+            break;
+        case ADV_STATE_BACKOFF:
+        case ADV_STATE_PARKED:
+            enter(ADV_STATE_FAST, nowMs);
+            break;
+        default:
+            // Already on its way back, or advertising fast
+            break;
+    }
+}
+
+void AdvertisingManager::failed(uint32_t nowMs) {
+    AdvState state = m_stats.state;
+    m_resume = state == ADV_STATE_BACKOFF || state == ADV_STATE_PARKED ? state : ADV_STATE_FAST;
+    enter(ADV_STATE_RETRY, nowMs);
+    m_deadlineMs = nowMs + m_retryMs;
+    m_retryMs = m_retryMs * 2 < ADV_RETRY_MAX_MS ? m_retryMs * 2 : ADV_RETRY_MAX_MS;
+}
+
+AdvAction AdvertisingManager::service(uint32_t nowMs) {
+    if (m_awaiting && nowMs - m_awaitingSinceMs >= ADV_START_TIMEOUT_MS) {
+        m_stats.timeouts++;
+        failed(nowMs);
+    }
+
+    uint32_t inState = nowMs - m_stats.stateSinceMs;
+    switch (m_stats.state) {
+        case ADV_STATE_SETTLING:
+            if ((int32_t)(nowMs - m_deadlineMs) >= 0) enter(ADV_STATE_FAST, nowMs);
+            break;
+        case ADV_STATE_RETRY:
+            if ((int32_t)(nowMs - m_deadlineMs) >= 0) enter(m_resume, nowMs);
+            break;
+        case ADV_STATE_DIRECTED:
+            if (inState >= DIRECTED_ADV_MS) enter(ADV_STATE_FAST, nowMs);
+            break;
+        case ADV_STATE_FAST:
+            if (inState < ADV_DISCOVERY_MS) break;
+            if (m_parked) {
+                enter(ADV_STATE_PARKED, nowMs);
+                break;
+            }
+            m_interval = 2 * ADV_FAST_INTERVAL < ADV_SLOW_INTERVAL ? 2 * ADV_FAST_INTERVAL : ADV_SLOW_INTERVAL;
+            enter(ADV_STATE_BACKOFF, nowMs);
+            break;
+        case ADV_STATE_BACKOFF:
+            if (inState >= ADV_BACKOFF_STEP_MS && m_interval < ADV_SLOW_INTERVAL) {
+                m_interval = m_interval * 2 < ADV_SLOW_INTERVAL ? m_interval * 2 : ADV_SLOW_INTERVAL;
+                enter(ADV_STATE_BACKOFF, nowMs);
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (!m_due) return ADV_ACTION_NONE;
+    m_due = false;
+    if (m_stats.state == ADV_STATE_DIRECTED) return ADV_ACTION_DIRECTED;
+    m_stats.interval = m_interval;
+    return ADV_ACTION_START;
+}
+
+void AdvertisingManager::requested(bool ok, uint32_t nowMs) {
+    if (!ok) {
+        m_stats.failures++;
+        failed(nowMs);
+        return;
+    }
+    m_awaiting = true;
+    m_awaitingSinceMs = nowMs;
+}
+
+void AdvertisingManager::startCompleted(uint8_t status, uint32_t nowMs) {
+    if (!m_awaiting) return;
+    m_awaiting = false;
+    if (status != 0) {
+        m_stats.failures++;
+        failed(nowMs);
+        return;
+    }
+    m_stats.starts++;
+    m_retryMs = ADV_RETRY_MS;
+}
+
+uint32_t AdvertisingManager::msUntilService(uint32_t nowMs) const {
+    if (m_due) return 0;
+    uint32_t wait = UINT32_MAX;
+    if (m_awaiting) {
+        uint32_t waited = nowMs - m_awaitingSinceMs;
+        wait = waited < ADV_START_TIMEOUT_MS ? ADV_START_TIMEOUT_MS - waited : 0;
+    }
+
+    uint32_t inState = nowMs - m_stats.stateSinceMs;
+    uint32_t until = UINT32_MAX;
+    switch (m_stats.state) {
+        case ADV_STATE_SETTLING:
+        case ADV_STATE_RETRY:
+            until = (int32_t)(m_deadlineMs - nowMs) > 0 ? m_deadlineMs - nowMs : 0;
+            break;
+        case ADV_STATE_DIRECTED:
+            until = inState < DIRECTED_ADV_MS ? DIRECTED_ADV_MS - inState : 0;
+            break;
+        case ADV_STATE_FAST:
+            until = inState < ADV_DISCOVERY_MS ? ADV_DISCOVERY_MS - inState : 0;
+            break;
+        case ADV_STATE_BACKOFF:
+            if (m_interval < ADV_SLOW_INTERVAL) {
+                until = inState < ADV_BACKOFF_STEP_MS ? ADV_BACKOFF_STEP_MS - inState : 0;
+            }
+            break;
+        default:
+            break;
+    }
+    return until < wait ? until : wait;
+}
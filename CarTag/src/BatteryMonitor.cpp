@@ -0,0 +1,194 @@
+/**
+ * Battery voltage acquisition
+ */
+
+#include <Arduino.h>
+
+#include "BatteryMonitor.h"
+#include "SampleTimer.h"
+
+#if defined(CARTAG_BATTERY_ADC) && !defined(CARTAG_NATIVE)
+#define BATTERY_USE_ADC 1
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#endif
+
+namespace {
+
+struct CurvePoint {
+    uint16_t mv;
+    uint8_t percent;
+};
+
+// Resting open-circuit voltage of a single Li-ion cell
+const CurvePoint DISCHARGE_CURVE[] = {
+    {3300, 0}, {3500, 5}, {3600, 10}, {3700, 25}, {3750, 40}, {3800, 55},
+    {3850, 65}, {3900, 75}, {4000, 85}, {4100, 95}, {4200, 100},
+};
+const size_t CURVE_POINTS = sizeof(DISCHARGE_CURVE) / sizeof(DISCHARGE_CURVE[0]);
+
+#ifdef BATTERY_USE_ADC
+
+// One DMA frame per interrupt; the store buffer holds a bit over one poll
+// interval of conversions (2 bytes each)
+const uint32_t DMA_FRAME_BYTES = 256;
+const uint32_t DMA_BUFFER_BYTES = 4096;
+const adc1_channel_t ADC_CHANNEL = (adc1_channel_t)digitalPinToAnalogChannel(BATTERY_ADC_PIN);
+
+esp_adc_cal_characteristics_t g_calibration;
+
+uint16_t codeToPinMv(uint32_t code) {
+    return (uint16_t)esp_adc_cal_raw_to_voltage(code, &g_calibration);
+}
+
+#else
+
+// Simulated cell: drains from full to empty in 100 s and starts over, as
+// the old battery simulation did, with ADC-like noise on every conversion
+const uint32_t SIM_CYCLE_MS = 100000;
+const uint32_t SIM_MAX_BACKLOG = 2048;
+uint32_t g_noiseState = 12345;
+
+uint16_t simulatedCode(uint64_t timeUs) {
+    uint32_t phase = (uint32_t)((timeUs / 1000) % SIM_CYCLE_MS);
+    uint32_t batteryMv = 4200 - (uint32_t)((uint64_t)900 * phase / SIM_CYCLE_MS);
+    uint32_t pinMv = batteryMv * BATTERY_DIVIDER_DEN / BATTERY_DIVIDER_NUM;
+
+    g_noiseState = g_noiseState * 1103515245u + 12345u;
+    int32_t noise = (int32_t)((g_noiseState >> 16) % 81) - 40;  // +-40 mV
+    int32_t code = (int32_t)((pinMv + noise) * 4095 / 3300);
+    return (uint16_t)(code < 0 ? 0 : code > 4095 ? 4095 : code);
+}
+
+uint16_t codeToPinMv(uint32_t code) {
+    return (uint16_t)(code * 3300 / 4095);
+}
+
+#endif
+
+}  // namespace
+
+uint8_t batteryPercentFromMv(uint16_t mv) {
+    if (mv <= DISCHARGE_CURVE[0].mv) return 0;
+    for (size_t i = 1; i < CURVE_POINTS; i++) {
+        const CurvePoint& hi = DISCHARGE_CURVE[i];
+        if (mv < hi.mv) {
+            const CurvePoint& lo = DISCHARGE_CURVE[i - 1];
+            return (uint8_t)(lo.percent + (uint32_t)(mv - lo.mv) * (hi.percent - lo.percent) /
+                                              (hi.mv - lo.mv));
+        }
+    }
+    return 100;
+}
+
+void BatteryMonitor::addConversion(uint16_t code) {
+    int32_t average;
+    m_stats.conversions++;
+    if (m_block.push(code, average)) finishBlock((uint32_t)average);
+}
+
+// Calibrate the rounded block average rather than every conversion
+void BatteryMonitor::finishBlock(uint32_t code) {
+    uint32_t mv = (uint32_t)codeToPinMv(code) * BATTERY_DIVIDER_NUM / BATTERY_DIVIDER_DEN;
+    m_rawMv = (uint16_t)mv;
+
+    // The low-pass seeds itself from the first block, which is also
+    // published straight away, so readings do not ramp up from 0 V
+    bool first = m_stats.blocks++ == 0;
+    int32_t filtered = m_lowPass.push(m_spikes.push((int32_t)mv));
+
+    if (first || ++m_decimation == BATTERY_FILTER_DECIMATION) {
+        m_decimation = 0;
+        m_filteredMv = (uint16_t)filtered;
+        m_percent = batteryPercentFromMv(m_filteredMv);
+        m_stats.updates++;
+    }
+}
+
+#ifdef BATTERY_USE_ADC
+
+bool BatteryMonitor::begin() {
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &g_calibration);
+
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = DMA_BUFFER_BYTES;
+    init.conv_num_each_intr = DMA_FRAME_BYTES;
+    init.adc1_chan_mask = 1u << ADC_CHANNEL;
+    init.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+    adc_digi_pattern_config_t pattern = {};
+    pattern.atten = ADC_ATTEN_DB_11;
+    pattern.channel = ADC_CHANNEL;
+    pattern.unit = 0;  // ADC1
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = 1;  // required on the ESP32
+    config.conv_limit_num = 250;
+    config.pattern_num = 1;
+    config.adc_pattern = &pattern;
+    config.sample_freq_hz = BATTERY_ADC_RATE_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    if (adc_digi_controller_configure(&config) != ESP_OK) return false;
+
+    return adc_digi_start() == ESP_OK;
+}
+
+bool BatteryMonitor::measured() const { return true; }
+
+bool BatteryMonitor::poll() {
+    uint32_t updatesBefore = m_stats.updates;
+    uint8_t buf[DMA_FRAME_BYTES];
+    uint32_t len = 0;
+
+    // Zero timeout: only frames the DMA has already completed
+    for (;;) {
+        esp_err_t err = adc_digi_read_bytes(buf, sizeof(buf), &len, 0);
+        if (err == ESP_ERR_INVALID_STATE) {
+            m_stats.overruns++;  // data was lost, but what is left is valid
+        } else if (err != ESP_OK) {
+            break;
+        }
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            const adc_digi_output_data_t* result = (const adc_digi_output_data_t*)(buf + i);
+            if (result->type1.channel != ADC_CHANNEL) continue;
+            addConversion(result->type1.data);
+        }
+        if (len < sizeof(buf)) break;
+    }
+    return m_stats.updates != updatesBefore;
+}
+
+#else
+
+bool BatteryMonitor::begin() {
+    m_lastPollUs = SampleTimer::nowUs();
+    return true;
+}
+
+bool BatteryMonitor::measured() const { return false; }
+
+bool BatteryMonitor::poll() {
+    uint32_t updatesBefore = m_stats.updates;
+    uint64_t now = SampleTimer::nowUs();
+    uint64_t due = (now - m_lastPollUs) * BATTERY_ADC_RATE_HZ / 1000000;
+    if (due == 0) return false;
+
+    // A real DMA buffer would have overflowed and dropped the oldest data
+    uint64_t periodUs = 1000000 / BATTERY_ADC_RATE_HZ;
+    if (due > SIM_MAX_BACKLOG) {
+        m_stats.overruns++;
+        m_lastPollUs = now - SIM_MAX_BACKLOG * periodUs;
+        due = SIM_MAX_BACKLOG;
+    }
+
+    for (uint64_t i = 0; i < due; i++) {
+        m_lastPollUs += periodUs;
+        addConversion(simulatedCode(m_lastPollUs));
+    }
+    return m_stats.updates != updatesBefore;
+}
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * Bonded centrals and the fast reconnect path
+ */
+
+#include <string.h>
+
+#include "BondTable.h"
+#include "TelemetryFrame.h"
+
+void GattSignature::add(const char* uuid, uint16_t handle) {
+    for (const char* p = uuid; *p; p++) {
+        m_hash = (m_hash ^ (uint8_t)*p) * 16777619u;
+    }
+    m_hash = (m_hash ^ (uint8_t)handle) * 16777619u;
+    m_hash = (m_hash ^ (uint8_t)(handle >> 8)) * 16777619u;
+}
+
+int BondTable::indexOf(const uint8_t address[6]) const {
+    for (size_t i = 0; i < m_count; i++) {
+        if (memcmp(m_bonds[i].address, address, sizeof(m_bonds[i].address)) == 0) return (int)i;
+    }
+    return -1;
+}
+
+bool BondTable::add(const uint8_t address[6], uint8_t addressType, uint32_t gattSignature,
+                    Bond* evicted) {
+    int index = indexOf(address);
+    bool evicting = index < 0 && m_count == CARTAG_MAX_BONDS;
+    Bond bond;
+    if (index >= 0) {
+        bond = m_bonds[index];
+    } else {
+        memcpy(bond.address, address, sizeof(bond.address));
+        bond.gattSignature = gattSignature;
+        if (evicting) {
+            if (evicted) *evicted = m_bonds[m_count - 1];
+        } else {
+            m_count++;
+        }
+        index = (int)m_count - 1;
+    }
+    bond.addressType = addressType;
+
+    memmove(&m_bonds[1], &m_bonds[0], index * sizeof(Bond));
+    m_bonds[0] = bond;
+    return evicting;
+}
+
+bool BondTable::remove(const uint8_t address[6]) {
+    int index = indexOf(address);
+    if (index < 0) return false;
+    memmove(&m_bonds[index], &m_bonds[index + 1], (m_count - index - 1) * sizeof(Bond));
+    m_count--;
+    return true;
+}
+
+const Bond* BondTable::find(const uint8_t address[6]) const {
+    int index = indexOf(address);
+    return index < 0 ? nullptr : &m_bonds[index];
+}
+
+void BondTable::retain(const uint8_t (*addresses)[6], size_t count) {
+    for (size_t i = m_count; i-- > 0;) {
+        bool kept = false;
+        for (size_t j = 0; j < count && !kept; j++) {
+            kept = memcmp(m_bonds[i].address, addresses[j], sizeof(m_bonds[i].address)) == 0;
+        }
+        if (!kept) remove(m_bonds[i].address);
+    }
+}
+
+bool BondTable::gattChanged(const uint8_t address[6]) {
+    int index = indexOf(address);
+    if (index < 0 || m_bonds[index].gattSignature == m_gattSignature) return false;
+    m_bonds[index].gattSignature = m_gattSignature;
+    m_stats.serviceChanged++;
+    return true;
+}
+
+void BondTable::linkLost(const uint8_t address[6], uint32_t nowMs) {
+    if (indexOf(address) < 0) return;
+    memcpy(m_lost, address, sizeof(m_lost));
+    m_waiting = true;
+    m_directed = false;
+    m_lostMs = nowMs;
+}
+
+const Bond* BondTable::reconnectTarget() const {
+    return m_waiting && !m_directed ? find(m_lost) : nullptr;
+}
+
+void BondTable::directedStarted() {
+    m_directed = true;
+    m_stats.directed++;
+}
+
+void BondTable::connected(const uint8_t address[6], uint32_t nowMs) {
+    if (!m_waiting || memcmp(address, m_lost, sizeof(m_lost)) != 0) return;
+    m_waiting = false;
+
+    uint32_t elapsed = nowMs - m_lostMs;
+    m_stats.reconnects++;
+    if (m_directed && elapsed <= DIRECTED_ADV_MS) m_stats.directedHits++;
+    m_stats.lastMs = elapsed;
+    if (m_stats.reconnects == 1 || elapsed < m_stats.fastestMs) m_stats.fastestMs = elapsed;
+}
+
+size_t BondTable::save(uint8_t* out, size_t cap) const {
+    size_t len = 2 + m_count * BOND_RECORD_SIZE;
+    if (cap < len) return 0;
+    out[0] = BOND_TABLE_VERSION;
+    out[1] = (uint8_t)m_count;
+    uint8_t* p = out + 2;
+    for (size_t i = 0; i < m_count; i++, p += BOND_RECORD_SIZE) {
+        memcpy(p, m_bonds[i].address, 6);
+        p[6] = m_bonds[i].addressType;
+        putLE32(p + 7, m_bonds[i].gattSignature);
+    }
+    return len;
+}
+
+bool BondTable::load(const uint8_t* data, size_t len) {
+    m_count = 0;
+    if (len < 2 || data[0] != BOND_TABLE_VERSION || data[1] > CARTAG_MAX_BONDS ||
+        len != 2 + data[1] * (size_t)BOND_RECORD_SIZE) {
+        return false;
+    }
+    const uint8_t* p = data + 2;
+    for (size_t i = 0; i < data[1]; i++, p += BOND_RECORD_SIZE) {
+        memcpy(m_bonds[i].address, p, 6);
+        m_bonds[i].addressType = p[6];
+        m_bonds[i].gattSignature = getLE32(p + 7);
+    }
+    m_count = data[1];
+    return true;
+}
@@ -0,0 +1,94 @@
+/**
+ * OBD-II over CAN (ISO 15765-4) vehicle backend
+ */
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "CanObdBackend.h"
+
+// Modes 01, 02 and 09 echo the PID. A reply for a PID that was not asked
+// for is left over from an earlier request, e.g. a second ECU's answer.
+static bool answersRequest(const uint8_t* req, size_t reqLen, const uint8_t* data, size_t len) {
+    if ((req[0] != 0x01 && req[0] != 0x02 && req[0] != 0x09) || reqLen < 2) return true;
+    if (len < 2) return false;
+    size_t pids = req[0] == 0x01 ? reqLen - 1 : 1;
+    for (size_t i = 0; i < pids; i++) {
+        if (data[1] == req[1 + i]) return true;
+    }
+    return false;
+}
+
+ObdStatus CanObdBackend::request(const uint8_t* req, size_t reqLen,
+                                 uint8_t* resp, size_t respCap, size_t& respLen) {
+    // Functional requests must fit in a single frame
+    if (reqLen == 0 || reqLen > 7) return OBD_NO_DATA;
+
+    // Whatever is still queued answers an earlier request
+    CanFrame frame;
+    while (m_bus.receive(frame, 0)) m_stale++;
+
+    IsoTpSegmenter tx;
+    tx.start(req, reqLen);
+    tx.next(frame);
+    frame.id = OBD_CAN_FUNCTIONAL_ID;
+    if (!m_bus.send(frame, OBD_CAN_TIMEOUT_MS)) return OBD_BUS_ERROR;
+
+    m_rx.reset();
+    uint32_t responder = 0;   // locked to one ECU once it starts a multi-frame reply
+    uint32_t start = millis();
+    uint32_t timeout = OBD_CAN_TIMEOUT_MS;
+
+    for (;;) {
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= timeout || !m_bus.receive(frame, timeout - elapsed)) return OBD_NO_DATA;
+        if (!isObdResponseId(frame.id)) continue;
+        if (responder != 0 && frame.id != responder) continue;
+
+        switch (m_rx.feed(frame)) {
+            case ISOTP_RX_SEND_FLOW_CONTROL: {
+                responder = frame.id;
+                CanFrame fc;
+                isoTpFlowControl(fc, ISOTP_FC_CONTINUE, 0, 0);
+                fc.id = responder - OBD_CAN_PHYSICAL_OFFSET;
+                if (!m_bus.send(fc, OBD_CAN_TIMEOUT_MS)) return OBD_BUS_ERROR;
+                start = millis();
+                timeout = ISOTP_FRAME_TIMEOUT_MS;
+                break;
+            }
+            case ISOTP_RX_IN_PROGRESS:
+                start = millis();
+                timeout = ISOTP_FRAME_TIMEOUT_MS;
+                break;
+            case ISOTP_RX_COMPLETE: {
+                const uint8_t* data = m_rx.data();
+                size_t len = m_rx.length();
+
+                // Negative response; "response pending" means keep waiting
+                if (data[0] == 0x7F) {
+                    if (len >= 3 && data[1] == req[0] && data[2] == 0x78) {
+                        start = millis();
+                        timeout = OBD_CAN_PENDING_TIMEOUT_MS;
+                        break;
+                    }
+                    return OBD_NO_DATA;
+                }
+                if (data[0] != (uint8_t)(req[0] + 0x40) || !answersRequest(req, reqLen, data, len)) {
+                    responder = 0;
+                    break;
+                }
+
+                if (len > respCap) return OBD_BUFFER_FULL;
+                memcpy(resp, data, len);
+                respLen = len;
+                m_lastResponder = (uint16_t)frame.id;
+                if (len > 7) m_multiFrame++;
+                return OBD_OK;
+            }
+            case ISOTP_RX_ERROR:
+                return OBD_BUS_ERROR;
+            case ISOTP_RX_IGNORED:
+                break;
+        }
+    }
+}
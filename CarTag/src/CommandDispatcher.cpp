@@ -0,0 +1,321 @@
+/**
+ * Binary command protocol for writes to the telemetry characteristic
+ */
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "CommandDispatcher.h"
+
+namespace {
+
+// Response payload under construction. Writes past capacity are dropped
+// and the response fails with STATUS_TOO_LONG.
+struct Reply {
+    uint8_t* data;
+    uint8_t capacity;
+    uint8_t length;
+    bool overflow;
+
+    bool fits(size_t n) {
+        if (length + n <= capacity) return true;
+        overflow = true;
+        return false;
+    }
+    size_t room() const { return capacity - length; }
+
+    void u8(uint8_t v) {
+        if (fits(1)) data[length++] = v;
+    }
+    void u16(uint16_t v) {
+        if (!fits(2)) return;
+        putLE16(data + length, v);
+        length += 2;
+    }
+    void u32(uint32_t v) {
+        if (!fits(4)) return;
+        putLE32(data + length, v);
+        length += 4;
+    }
+};
+
+typedef CommandStatus (*CommandHandler)(CommandContext& ctx, const OpcodeStats* stats,
+                                        const uint8_t* payload, uint8_t len, Reply& reply);
+
+struct OpcodeEntry {
+    uint8_t opcode;
+    uint8_t minPayload;
+    uint8_t maxPayload;
+    CommandHandler handler;
+};
+
+CommandStatus handlePing(CommandContext&, const OpcodeStats*, const uint8_t*, uint8_t, Reply&) {
+    return STATUS_OK;
+}
+
+CommandStatus handleSetInterval(CommandContext& ctx, const OpcodeStats*,
+                                const uint8_t* payload, uint8_t len, Reply&) {
+    DeviceConfig candidate = *ctx.config;
+    bool ok = candidate.set(CONFIG_SAMPLE_INTERVAL_MS, getLE16(payload));
+    if (len >= 4) ok = ok && candidate.set(CONFIG_BATCH_LATENCY_MS, getLE16(payload + 2));
+    if (!ok) return STATUS_BAD_VALUE;
+    *ctx.config = candidate;
+    return STATUS_OK;
+}
+
+CommandStatus handleStartStream(CommandContext& ctx, const OpcodeStats*, const uint8_t*, uint8_t, Reply&) {
+    ctx.config->set(CONFIG_STREAM_ENABLED, 1);
+    return STATUS_OK;
+}
+
+CommandStatus handleStopStream(CommandContext& ctx, const OpcodeStats*, const uint8_t*, uint8_t, Reply&) {
+    ctx.config->set(CONFIG_STREAM_ENABLED, 0);
+    return STATUS_OK;
+}
+
+CommandStatus handleSnapshot(CommandContext& ctx, const OpcodeStats*, const uint8_t*, uint8_t,
+                             Reply& reply) {
+    static uint16_t snapshotSequence = 0;
+    size_t len = encodeTelemetryFrame(ctx.snapshot(), snapshotSequence++, reply.data, reply.capacity);
+    if (len == 0) return STATUS_TOO_LONG;
+    reply.length = (uint8_t)len;
+    return STATUS_OK;
+}
+
+CommandStatus handleConfigRead(CommandContext& ctx, const OpcodeStats*, const uint8_t* payload,
+                               uint8_t, Reply& reply) {
+    uint32_t value;
+    if (!ctx.config->get(payload[0], value)) return STATUS_BAD_VALUE;
+    reply.u8(payload[0]);
+    reply.u32(value);
+    return STATUS_OK;
+}
+
+CommandStatus handleConfigWrite(CommandContext& ctx, const OpcodeStats*, const uint8_t* payload,
+                                uint8_t, Reply& reply) {
+    if (!ctx.config->set(payload[0], getLE32(payload + 1))) return STATUS_BAD_VALUE;
+    reply.u8(payload[0]);
+    reply.u32(getLE32(payload + 1));
+    return STATUS_OK;
+}
+
+CommandStatus handleReadStats(CommandContext&, const OpcodeStats* stats, const uint8_t* payload,
+                              uint8_t, Reply& reply) {
+    if (payload[0] >= OP_COUNT) return STATUS_BAD_VALUE;
+    const OpcodeStats& s = stats[payload[0]];
+    reply.u32(s.calls);
+    reply.u32(s.totalUs);
+    reply.u32(s.maxUs);
+    return STATUS_OK;
+}
+
+// Sample period jitter histogram, as many bins from the requested one as
+// fit in the central's response
+CommandStatus handleReadJitter(CommandContext& ctx, const OpcodeStats*, const uint8_t* payload,
+                               uint8_t len, Reply& reply) {
+    uint8_t first = len ? payload[0] : 0;
+    if (first >= SAMPLE_JITTER_BINS) return STATUS_BAD_VALUE;
+
+    const SampleJitter& jitter = *ctx.jitter;
+    reply.u32(jitter.periodUs);
+    reply.u32(jitter.ticks);
+    reply.u32(jitter.maxLateUs);
+    reply.u32(jitter.maxEarlyUs);
+
+    if (!reply.fits(2)) return STATUS_TOO_LONG;
+    uint8_t n = (reply.room() - 2) / 4;
+    if (n > SAMPLE_JITTER_BINS - first) n = SAMPLE_JITTER_BINS - first;
+    reply.u8(first);
+    reply.u8(n);
+    for (uint8_t i = 0; i < n; i++) reply.u32(jitter.bins[first + i]);
+    return STATUS_OK;
+}
+
+CommandStatus handleReadBattery(CommandContext& ctx, const OpcodeStats*, const uint8_t*, uint8_t,
+                                Reply& reply) {
+    const BatteryMonitor& battery = *ctx.battery;
+    BatteryStats stats = battery.stats();
+    reply.u16(battery.rawMv());
+    reply.u16(battery.filteredMv());
+    reply.u8(battery.percent());
+    reply.u8(battery.measured() ? 1 : 0);
+    reply.u32(stats.blocks);
+    reply.u32(stats.updates);
+    return STATUS_OK;
+}
+
+CommandStatus handleReadConnection(CommandContext& ctx, const OpcodeStats*, const uint8_t*, uint8_t,
+                                   Reply& reply) {
+    const Peer* peer = ctx.peers->find(ctx.connId);
+    if (!peer) return STATUS_BAD_VALUE;
+    ConnManagerStats stats = peer->connection.stats();
+    reply.u8(stats.profile);
+    reply.u8(stats.previous);
+    reply.u16(stats.interval);
+    reply.u16(stats.latency);
+    reply.u16(stats.timeout);
+    reply.u32(stats.transitions);
+    reply.u32(stats.rejected);
+    reply.u32(stats.adjusted);
+    reply.u32(millis() - stats.profileSinceMs);
+    return STATUS_OK;
+}
+
+CommandStatus handleReadLink(CommandContext& ctx, const OpcodeStats*, const uint8_t*, uint8_t,
+                             Reply& reply) {
+    const Peer* peer = ctx.peers->find(ctx.connId);
+    if (!peer) return STATUS_BAD_VALUE;
+    LinkStats link = peer->link.stats();
+    reply.u8(link.txPhy);
+    reply.u8(link.rxPhy);
+    reply.u16(link.txOctets);
+    reply.u16(link.rxOctets);
+    reply.u16(link.mtu);
+    reply.u8(link.phy);
+    reply.u8(link.dataLength);
+    reply.u32(link.settleMs);
+    return STATUS_OK;
+}
+
+// One connected central per request; index counts connected centrals only
+CommandStatus handleReadPeers(CommandContext& ctx, const OpcodeStats*, const uint8_t* payload,
+                              uint8_t len, Reply& reply) {
+    uint8_t index = len ? payload[0] : 0;
+    const Peer* peer = nullptr;
+    for (size_t i = 0, n = 0; i < CARTAG_MAX_PEERS && !peer; i++) {
+        const Peer& slot = ctx.peers->slot(i);
+        if (slot.active() && n++ == index) peer = &slot;
+    }
+    if (!peer) return STATUS_BAD_VALUE;
+
+    reply.u8((uint8_t)ctx.peers->count());
+    reply.u8(index);
+    reply.u16(peer->connId);
+    reply.u16(peer->mtu);
+    reply.u8(peer->subscriptions);
+    reply.u8(peer->connId == ctx.connId ? 1 : 0);
+    reply.u16(peer->stats.queueDepth);
+    reply.u16(peer->stats.maxQueueDepth);
+    reply.u32(peer->stats.notifications);
+    reply.u32(peer->stats.bytes);
+    reply.u32(peer->stats.droppedFrames);
+    reply.u32(peer->stats.droppedSamples);
+    reply.u32(millis() - peer->connectedMs);
+    reply.u32(peer->logAcked.sector);
+    reply.u16((uint16_t)peer->logAcked.offset);
+    return STATUS_OK;
+}
+
+// Reconnect figures, then one bond per request (most recent first)
+CommandStatus handleReadBonds(CommandContext& ctx, const OpcodeStats*, const uint8_t* payload,
+                              uint8_t len, Reply& reply) {
+    uint8_t index = len ? payload[0] : 0;
+    ReconnectStats stats = ctx.bonds->stats();
+    reply.u8((uint8_t)ctx.bonds->count());
+    reply.u32(stats.reconnects);
+    reply.u32(stats.directed);
+    reply.u32(stats.directedHits);
+    reply.u32(stats.lastMs);
+    reply.u32(stats.fastestMs);
+    reply.u32(stats.serviceChanged);
+    reply.u32(ctx.bonds->gattSignature());
+    if (index >= ctx.bonds->count()) return len ? STATUS_BAD_VALUE : STATUS_OK;
+
+    const Bond& bond = ctx.bonds->at(index);
+    bool connected = false;
+    for (size_t i = 0; i < CARTAG_MAX_PEERS && !connected; i++) {
+        const Peer& slot = ctx.peers->slot(i);
+        connected = slot.active() && memcmp(slot.address, bond.address, sizeof(bond.address)) == 0;
+    }
+    reply.u8(index);
+    for (uint8_t b : bond.address) reply.u8(b);
+    reply.u8(bond.addressType);
+    reply.u8(connected ? 1 : 0);
+    reply.u32(bond.gattSignature);
+    return STATUS_OK;
+}
+
+CommandStatus handleReadAdvertising(CommandContext& ctx, const OpcodeStats*, const uint8_t*, uint8_t,
+                                   Reply& reply) {
+    AdvManagerStats stats = ctx.advertising->stats();
+    reply.u8(stats.state);
+    reply.u8(stats.previous);
+    reply.u16(stats.interval);
+    reply.u32(millis() - stats.stateSinceMs);
+    reply.u32(stats.starts);
+    reply.u32(stats.failures);
+    reply.u32(stats.timeouts);
+    for (uint32_t entered : stats.entered) reply.u32(entered);
+    return STATUS_OK;
+}
+
+// Indexed by opcode
+constexpr OpcodeEntry OPCODE_TABLE[] = {
+    {OP_PING,         0, 0, handlePing},
+    {OP_SET_INTERVAL, 2, 4, handleSetInterval},
+    {OP_START_STREAM, 0, 0, handleStartStream},
+    {OP_STOP_STREAM,  0, 0, handleStopStream},
+    {OP_SNAPSHOT,     0, 0, handleSnapshot},
+    {OP_CONFIG_READ,  1, 1, handleConfigRead},
+    {OP_CONFIG_WRITE, 5, 5, handleConfigWrite},
+    {OP_READ_STATS,   1, 1, handleReadStats},
+    {OP_READ_JITTER,  0, 1, handleReadJitter},
+    {OP_READ_BATTERY, 0, 0, handleReadBattery},
+    {OP_READ_CONNECTION, 0, 0, handleReadConnection},
+    {OP_READ_LINK,    0, 0, handleReadLink},
+    {OP_READ_PEERS,   0, 1, handleReadPeers},
+    {OP_READ_BONDS,   0, 1, handleReadBonds},
+    {OP_READ_ADVERTISING, 0, 0, handleReadAdvertising},
+};
+
+constexpr bool opcodeTableIsDense() {
+    for (size_t i = 0; i < sizeof(OPCODE_TABLE) / sizeof(OPCODE_TABLE[0]); i++) {
+        if (OPCODE_TABLE[i].opcode != i) return false;
+    }
+    return sizeof(OPCODE_TABLE) / sizeof(OPCODE_TABLE[0]) == OP_COUNT;
+}
+
+static_assert(opcodeTableIsDense(), "OPCODE_TABLE must list every opcode in order");
+
+}  // namespace
+
+size_t CommandDispatcher::dispatch(const Command& cmd, uint8_t* out, size_t cap) {
+    if (cmd.length < COMMAND_HEADER_SIZE || cap < RESPONSE_HEADER_SIZE) return 0;
+    if (cap > RESPONSE_MAX_FRAME) cap = RESPONSE_MAX_FRAME;
+
+    uint8_t opcode = cmd.data[0];
+    uint8_t payloadLen = cmd.data[2];
+    if (COMMAND_HEADER_SIZE + payloadLen != cmd.length) return 0;
+
+    Reply reply = {out + RESPONSE_HEADER_SIZE, (uint8_t)(cap - RESPONSE_HEADER_SIZE), 0, false};
+    CommandStatus status;
+
+    if (opcode >= OP_COUNT) {
+        status = STATUS_UNKNOWN_OPCODE;
+    } else {
+        const OpcodeEntry& entry = OPCODE_TABLE[opcode];
+        if (payloadLen < entry.minPayload || payloadLen > entry.maxPayload) {
+            status = STATUS_BAD_LENGTH;
+        } else {
+            unsigned long start = micros();
+            m_context.connId = cmd.connId;
+            status = entry.handler(m_context, m_stats, cmd.data + COMMAND_HEADER_SIZE,
+                                   payloadLen, reply);
+            uint32_t elapsed = (uint32_t)(micros() - start);
+
+            OpcodeStats& s = m_stats[opcode];
+            s.calls++;
+            s.totalUs += elapsed;
+            if (elapsed > s.maxUs) s.maxUs = elapsed;
+        }
+    }
+
+    if (status == STATUS_OK && reply.overflow) status = STATUS_TOO_LONG;
+    if (status != STATUS_OK) reply.length = 0;
+    out[0] = RESPONSE_MAGIC;
+    out[1] = opcode;
+    out[2] = cmd.data[1];
+    out[3] = status;
+    out[4] = reply.length;
+    return RESPONSE_HEADER_SIZE + reply.length;
+}
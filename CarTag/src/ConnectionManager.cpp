@@ -0,0 +1,93 @@
+/**
+ * Connection parameter policy
+ */
+
+#include "ConnectionManager.h"
+
+namespace {
+
+// Indexed by ConnProfile. The supervision timeout must exceed
+// (1 + latency) * max interval * 2.
+const ConnParams PROFILES[CONN_PROFILE_COUNT] = {
+    {24, 48, 0, 400},   // none: the old fixed parameters
+    {80, 160, 4, 600},  // idle
+    {24, 48, 0, 400},   // stream
+    {6, 9, 0, 200},     // race
+    {6, 12, 0, 400},    // bulk
+};
+
+const char* const NAMES[CONN_PROFILE_COUNT] = {"none", "idle", "stream", "race", "bulk"};
+
+}  // namespace
+
+const ConnParams& connProfileParams(ConnProfile profile) {
+    return PROFILES[profile < CONN_PROFILE_COUNT ? profile : CONN_PROFILE_NONE];
+}
+
+const char* connProfileName(ConnProfile profile) {
+    return NAMES[profile < CONN_PROFILE_COUNT ? profile : CONN_PROFILE_NONE];
+}
+
+ConnProfile selectConnProfile(const ConnWorkload& workload) {
+    if (workload.bulkTransfer) return CONN_PROFILE_BULK;
+    if (!workload.streaming) return CONN_PROFILE_IDLE;
+    return workload.batchLatencyMs <= CONN_RACE_LATENCY_MS ? CONN_PROFILE_RACE : CONN_PROFILE_STREAM;
+}
+
+void ConnectionManager::connected(uint16_t interval, uint16_t latency, uint16_t timeout,
+                                  uint32_t nowMs) {
+    m_wanted = CONN_PROFILE_NONE;
+    m_rejected = CONN_PROFILE_NONE;
+    m_stats.previous = m_stats.profile;
+    m_stats.profile = CONN_PROFILE_NONE;
+    m_stats.interval = interval;
+    m_stats.latency = latency;
+    m_stats.timeout = timeout;
+    m_stats.profileSinceMs = nowMs;
+}
+
+bool ConnectionManager::update(ConnProfile wanted, uint32_t nowMs, ConnParams& params) {
+    if (wanted != m_wanted) {
+        m_wanted = wanted;
+        m_wantedSinceMs = nowMs;
+        m_rejected = CONN_PROFILE_NONE;
+    }
+    if (wanted == m_stats.profile || wanted == m_rejected) return false;
+
+    // Speed up at once, slow down only once the workload has settled. Until
+    // the first request the link runs at what the central connected with,
+    // which service discovery and the first subscriptions rely on.
+    bool slower = m_stats.profile == CONN_PROFILE_NONE
+                      ? connProfileParams(wanted).minInterval > m_stats.interval
+                      : wanted < m_stats.profile;
+    if (slower && nowMs - m_wantedSinceMs < CONN_PROFILE_HOLD_MS) return false;
+
+    m_stats.previous = m_stats.profile;
+    m_stats.profile = wanted;
+    m_stats.profileSinceMs = nowMs;
+    m_stats.transitions++;
+    params = connProfileParams(wanted);
+    return true;
+}
+
+uint32_t ConnectionManager::msUntilUpdate(uint32_t nowMs) const {
+    if (m_wanted == m_stats.profile || m_wanted == m_rejected) return UINT32_MAX;
+    uint32_t waited = nowMs - m_wantedSinceMs;
+    return waited < CONN_PROFILE_HOLD_MS ? CONN_PROFILE_HOLD_MS - waited : 0;
+}
+
+void ConnectionManager::granted(uint8_t status, uint16_t interval, uint16_t latency,
+                                uint16_t timeout) {
+    if (status != 0) {
+        // The link keeps its old parameters, and so its old profile
+        m_stats.rejected++;
+        m_rejected = m_stats.profile;
+        m_stats.profile = m_stats.previous;
+        return;
+    }
+    const ConnParams& asked = connProfileParams(m_stats.profile);
+    if (interval < asked.minInterval || interval > asked.maxInterval) m_stats.adjusted++;
+    m_stats.interval = interval;
+    m_stats.latency = latency;
+    m_stats.timeout = timeout;
+}
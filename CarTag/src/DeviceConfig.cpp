@@ -0,0 +1,48 @@
+/**
+ * Runtime configuration, readable and writable over BLE
+ */
+
+#include "DeviceConfig.h"
+#include "TelemetryFrame.h"
+
+struct ConfigLimits {
+    uint32_t min;
+    uint32_t max;
+    uint32_t defaultValue;
+};
+
+#ifdef CARTAG_TELEMETRY_ASCII
+#define DEFAULT_TELEMETRY_FORMAT TELEMETRY_FORMAT_ASCII
+#else
+#define DEFAULT_TELEMETRY_FORMAT TELEMETRY_FORMAT_BINARY
+#endif
+
+// Indexed by ConfigKey
+static const ConfigLimits CONFIG_LIMITS[CONFIG_KEY_COUNT] = {
+    {1, 1000, SAMPLE_INTERVAL_MS},  // the sample timer runs at 1 Hz-1 kHz
+    {0, 60000, BATCH_MAX_LATENCY_MS},
+    {TELEMETRY_FORMAT_BINARY, TELEMETRY_FORMAT_ASCII, DEFAULT_TELEMETRY_FORMAT},
+    {0, 1, 1},
+    {0, 1, 1},
+    {0, 1, 1},
+    {0, 60000, BROADCAST_INTERVAL_MS},  // faster values refresh at BEACON_MIN_INTERVAL_MS
+};
+
+DeviceConfig::DeviceConfig() {
+    for (int i = 0; i < CONFIG_KEY_COUNT; i++) {
+        m_values[i] = CONFIG_LIMITS[i].defaultValue;
+    }
+}
+
+bool DeviceConfig::get(uint8_t key, uint32_t& value) const {
+    if (key >= CONFIG_KEY_COUNT) return false;
+    value = m_values[key];
+    return true;
+}
+
+bool DeviceConfig::set(uint8_t key, uint32_t value) {
+    if (key >= CONFIG_KEY_COUNT) return false;
+    if (value < CONFIG_LIMITS[key].min || value > CONFIG_LIMITS[key].max) return false;
+    m_values[key] = value;
+    return true;
+}
@@ -0,0 +1,256 @@
+/**
+ * ELM327-compatible command interpreter
+ */
+
+#include <Arduino.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Elm327.h"
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse exactly digits hex characters; -1 on a bad digit
+static long parseHex(const char* text, int digits) {
+    long value = 0;
+    for (int i = 0; i < digits; i++) {
+        int v = hexValue(text[i]);
+        if (v < 0) return -1;
+        value = value << 4 | v;
+    }
+    return value;
+}
+
+Elm327::Elm327(VehicleBackend& backend, BytePipe<NUS_PIPE_SIZE>& out)
+    : m_backend(backend), m_out(out) {
+    m_lastCommand[0] = '\0';
+    reset();
+}
+
+void Elm327::reset() {
+    m_echo = true;
+    m_linefeeds = false;
+    m_spaces = true;
+    m_headers = false;
+}
+
+void Elm327::feed(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)data[i];
+
+        if (c == '\r') {
+            m_line[m_lineLen] = '\0';
+            if (m_lineOverflow) {
+                m_stats.errors++;
+                reply("?");
+            } else {
+                execute(m_line);
+            }
+            m_lineLen = 0;
+            m_lineOverflow = false;
+        } else if (c == ' ' || c == '\n' || c == '\0') {
+            // The ELM ignores spaces and line feeds in commands
+        } else if (m_lineLen < ELM_LINE_MAX) {
+            m_line[m_lineLen++] = (char)toupper((unsigned char)c);
+        } else {
+            m_lineOverflow = true;
+        }
+    }
+}
+
+void Elm327::execute(const char* line) {
+    unsigned long start = micros();
+
+    // An empty line repeats the previous command
+    if (line[0] == '\0') {
+        if (m_lastCommand[0] == '\0') {
+            print(">");
+            return;
+        }
+        line = m_lastCommand;
+    } else if (line != m_lastCommand) {
+        strncpy(m_lastCommand, line, ELM_LINE_MAX);
+        m_lastCommand[ELM_LINE_MAX] = '\0';
+    }
+
+    if (m_echo) {
+        print(line);
+        print("\r");
+    }
+
+    if (line[0] == 'A' && line[1] == 'T') {
+        executeAt(line + 2);
+    } else {
+        executeObd(line);
+    }
+
+    uint32_t elapsed = (uint32_t)(micros() - start);
+    m_stats.commands++;
+    m_stats.totalTurnaroundUs += elapsed;
+    if (elapsed > m_stats.maxTurnaroundUs) m_stats.maxTurnaroundUs = elapsed;
+}
+
+void Elm327::executeAt(const char* cmd) {
+    char text[32];
+
+    if (strcmp(cmd, "Z") == 0) {
+        reset();
+        print("\r");
+        reply(ELM_VERSION);
+    } else if (strcmp(cmd, "D") == 0) {
+        reset();
+        reply("OK");
+    } else if (strcmp(cmd, "I") == 0) {
+        reply(ELM_VERSION);
+    } else if (strcmp(cmd, "@1") == 0) {
+        reply("CarTag OBD-II Gateway");
+    } else if ((cmd[0] == 'E' || cmd[0] == 'L' || cmd[0] == 'S' || cmd[0] == 'H') &&
+               (cmd[1] == '0' || cmd[1] == '1') && cmd[2] == '\0') {
+        bool on = cmd[1] == '1';
+        switch (cmd[0]) {
+            case 'E': m_echo = on; break;
+            case 'L': m_linefeeds = on; break;
+            case 'S': m_spaces = on; break;
+            case 'H': m_headers = on; break;
+        }
+        reply("OK");
+    } else if (strncmp(cmd, "SP", 2) == 0 || strncmp(cmd, "ST", 2) == 0 ||
+               strncmp(cmd, "AT", 2) == 0) {
+        // Protocol is fixed by the backend; timeouts are the backend's too
+        reply("OK");
+    } else if (strncmp(cmd, "SUB", 3) == 0) {
+        executeSubscribe(cmd + 3, true);
+    } else if (strncmp(cmd, "UNSUB", 5) == 0) {
+        executeSubscribe(cmd + 5, false);
+    } else if (strcmp(cmd, "DPN") == 0) {
+        text[0] = m_backend.protocolNumber();
+        text[1] = '\0';
+        reply(text);
+    } else if (strcmp(cmd, "DP") == 0) {
+        reply(m_backend.protocolName());
+    } else if (strcmp(cmd, "RV") == 0) {
+        uint16_t mv = m_backend.supplyMillivolts();
+        snprintf(text, sizeof(text), "%u.%uV", mv / 1000, (mv % 1000) / 100);
+        reply(text);
+    } else {
+        m_stats.errors++;
+        reply("?");
+    }
+}
+
+void Elm327::executeObd(const char* hex) {
+    uint8_t req[ELM_LINE_MAX / 2];
+    size_t reqLen = 0;
+
+    size_t len = strlen(hex);
+    if (len < 2 || len % 2 != 0) {
+        m_stats.errors++;
+        reply("?");
+        return;
+    }
+    for (size_t i = 0; i < len; i += 2) {
+        int hi = hexValue(hex[i]);
+        int lo = hexValue(hex[i + 1]);
+        if (hi < 0 || lo < 0) {
+            m_stats.errors++;
+            reply("?");
+            return;
+        }
+        req[reqLen++] = (uint8_t)(hi << 4 | lo);
+    }
+
+    uint8_t resp[64];
+    size_t respLen = 0;
+    m_stats.obdRequests++;
+    ObdStatus status = m_backend.request(req, reqLen, resp, sizeof(resp), respLen);
+
+    if (status == OBD_NO_DATA) {
+        m_stats.errors++;
+        reply("NO DATA");
+        return;
+    }
+    if (status != OBD_OK) {
+        m_stats.errors++;
+        reply("CAN ERROR");
+        return;
+    }
+
+    printResponse(resp, respLen);
+    endLine();
+    print(">");
+}
+
+void Elm327::executeSubscribe(const char* args, bool subscribe) {
+    size_t len = strlen(args);
+    bool ok;
+
+    if (!m_scheduler) {
+        ok = false;
+    } else if (subscribe) {
+        long pid = len == 6 ? parseHex(args, 2) : -1;
+        long periodMs = len == 6 ? parseHex(args + 2, 4) : -1;
+        ok = pid >= 0 && periodMs >= 0 &&
+             m_scheduler->subscribe((uint8_t)pid, (uint16_t)periodMs, millis());
+    } else if (len == 0) {
+        m_scheduler->clear();
+        ok = true;
+    } else {
+        long pid = len == 2 ? parseHex(args, 2) : -1;
+        ok = pid >= 0 && m_scheduler->unsubscribe((uint8_t)pid);
+    }
+
+    if (!ok) m_stats.errors++;
+    reply(ok ? "OK" : "?");
+}
+
+void Elm327::pushResult(const uint8_t* resp, size_t len) {
+    printResponse(resp, len);
+}
+
+// One response line; with headers on, CAN replies show the ECU id and the
+// PCI length byte
+void Elm327::printResponse(const uint8_t* resp, size_t len) {
+    if (m_headers) {
+        uint16_t header = m_backend.responseHeader();
+        char id[4] = {HEX_DIGITS[(header >> 8) & 0xF], HEX_DIGITS[(header >> 4) & 0xF],
+                      HEX_DIGITS[header & 0xF], '\0'};
+        print(id);
+        printHexByte((uint8_t)len, m_spaces);
+    }
+    for (size_t i = 0; i < len; i++) {
+        printHexByte(resp[i], m_spaces && (i > 0 || m_headers));
+    }
+    endLine();
+}
+
+void Elm327::print(const char* text) {
+    m_out.write(text);
+}
+
+void Elm327::printHexByte(uint8_t value, bool leadingSpace) {
+    char text[4];
+    size_t n = 0;
+    if (leadingSpace) text[n++] = ' ';
+    text[n++] = HEX_DIGITS[value >> 4];
+    text[n++] = HEX_DIGITS[value & 0xF];
+    m_out.write((const uint8_t*)text, n);
+}
+
+void Elm327::endLine() {
+    print(m_linefeeds ? "\r\n" : "\r");
+}
+
+// One-line reply followed by the blank line and prompt
+void Elm327::reply(const char* text) {
+    print(text);
+    endLine();
+    endLine();
+    print(">");
+}
@@ -0,0 +1,128 @@
+/**
+ * Event-driven firmware task
+ */
+
+#include <Arduino.h>
+
+#include "EventTask.h"
+
+EventTask::EventTask(const char* name, EventTaskHandler handler, uint8_t priority,
+                     uint8_t core, uint32_t stackBytes)
+    : m_name(name), m_handler(handler), m_priority(priority), m_core(core),
+      m_stackBytes(stackBytes) {}
+
+void EventTask::runOnce(uint32_t events) {
+    unsigned long start = micros();
+    m_sleepMs = m_handler(events, millis());
+    uint32_t elapsed = (uint32_t)(micros() - start);
+
+    m_stats.wakeups++;
+    if (events == 0) m_stats.timeouts++;
+    if (elapsed > m_stats.maxRunUs) m_stats.maxRunUs = elapsed;
+}
+
+#ifdef CARTAG_NATIVE
+
+namespace {
+
+EventTask* g_tasks[EVENT_TASK_MAX];
+uint8_t g_priorities[EVENT_TASK_MAX];
+size_t g_taskCount = 0;
+
+}  // namespace
+
+bool EventTask::start() {
+    if (m_started || g_taskCount == EVENT_TASK_MAX) return false;
+
+    // Keep the table sorted by priority so runReady() visits the most
+    // urgent task first, as the RTOS scheduler would
+    size_t i = g_taskCount++;
+    while (i > 0 && g_priorities[i - 1] < m_priority) {
+        g_tasks[i] = g_tasks[i - 1];
+        g_priorities[i] = g_priorities[i - 1];
+        i--;
+    }
+    g_tasks[i] = this;
+    g_priorities[i] = m_priority;
+
+    m_started = true;
+    runOnce(0);
+    m_wakeMs = millis() + m_sleepMs;
+    return true;
+}
+
+void EventTask::signal(uint32_t events) {
+    if (m_started) m_pending |= events;
+}
+
+void EventTask::signalFromIsr(uint32_t events) { signal(events); }
+
+size_t EventTask::runReady(uint32_t nowMs) {
+    size_t runs = 0;
+    bool ran = true;
+    while (ran) {
+        ran = false;
+        for (size_t i = 0; i < g_taskCount; i++) {
+            EventTask* task = g_tasks[i];
+            bool due = task->m_sleepMs != EVENT_TASK_WAIT_FOREVER &&
+                       (int32_t)(nowMs - task->m_wakeMs) >= 0;
+            if (!task->m_pending && !due) continue;
+
+            uint32_t events = task->m_pending;
+            task->m_pending = 0;
+            task->runOnce(events);
+            task->m_wakeMs = nowMs + task->m_sleepMs;
+            runs++;
+
+            // Start over so a task woken by this one runs before any
+            // lower-priority work
+            ran = true;
+            break;
+        }
+    }
+    return runs;
+}
+
+TaskLock::TaskLock() {}
+void TaskLock::lock() {}
+void TaskLock::unlock() {}
+
+#else
+
+bool EventTask::start() {
+    if (m_handle) return false;
+    return xTaskCreatePinnedToCore(entry, m_name, m_stackBytes, this, m_priority,
+                                   &m_handle, m_core) == pdPASS;
+}
+
+void EventTask::entry(void* arg) {
+    EventTask* task = static_cast<EventTask*>(arg);
+    uint32_t events = 0;
+    for (;;) {
+        task->runOnce(events);
+        events = 0;
+        TickType_t wait = task->m_sleepMs == EVENT_TASK_WAIT_FOREVER
+                              ? portMAX_DELAY
+                              : pdMS_TO_TICKS(task->m_sleepMs);
+        xTaskNotifyWait(0, 0xFFFFFFFFu, &events, wait);
+    }
+}
+
+void EventTask::signal(uint32_t events) {
+    if (m_handle) xTaskNotify(m_handle, events, eSetBits);
+}
+
+void EventTask::signalFromIsr(uint32_t events) {
+    if (!m_handle) return;
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(m_handle, events, eSetBits, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+size_t EventTask::runReady(uint32_t) { return 0; }
+
+TaskLock::TaskLock() { m_mutex = xSemaphoreCreateMutexStatic(&m_storage); }
+void TaskLock::lock() { xSemaphoreTake(m_mutex, portMAX_DELAY); }
+void TaskLock::unlock() { xSemaphoreGive(m_mutex); }
+
+#endif
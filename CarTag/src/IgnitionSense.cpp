@@ -0,0 +1,47 @@
+/**
+ * Ignition line sensing
+ */
+
+#include <Arduino.h>
+
+#include "IgnitionSense.h"
+
+#if defined(CARTAG_IGNITION_SENSE) || defined(CARTAG_NATIVE)
+#define IGNITION_USE_PIN 1
+#endif
+
+void IgnitionSense::begin(uint32_t nowMs) {
+#ifdef IGNITION_USE_PIN
+    pinMode(IGNITION_PIN, INPUT);
+#endif
+    m_level = m_on = read();
+    m_levelSinceMs = nowMs;
+    m_stats.lastChangeMs = nowMs;
+}
+
+bool IgnitionSense::poll(uint32_t nowMs) {
+    bool level = read();
+    if (level != m_level) {
+        // A level that flips back before the debounce time never counted
+        if (level == m_on) m_stats.glitches++;
+        m_level = level;
+        m_levelSinceMs = nowMs;
+    }
+    if (m_level == m_on || nowMs - m_levelSinceMs < IGNITION_DEBOUNCE_MS) return false;
+    m_on = m_level;
+    m_stats.changes++;
+    m_stats.lastChangeMs = nowMs;
+    return true;
+}
+
+#ifdef IGNITION_USE_PIN
+
+bool IgnitionSense::sensed() const { return true; }
+bool IgnitionSense::read() const { return digitalRead(IGNITION_PIN) == HIGH; }
+
+#else
+
+bool IgnitionSense::sensed() const { return false; }
+bool IgnitionSense::read() const { return true; }
+
+#endif
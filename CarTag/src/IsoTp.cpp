@@ -0,0 +1,138 @@
+/**
+ * ISO 15765-2 (ISO-TP) segmentation and reassembly
+ */
+
+#include <string.h>
+
+#include "IsoTp.h"
+
+static void padFrame(CanFrame& frame, size_t used) {
+    for (size_t i = used; i < 8; i++) frame.data[i] = ISOTP_PADDING;
+    frame.length = 8;
+}
+
+void isoTpFlowControl(CanFrame& frame, uint8_t status, uint8_t blockSize, uint8_t stMin) {
+    frame.data[0] = ISOTP_FLOW_CONTROL | status;
+    frame.data[1] = blockSize;
+    frame.data[2] = stMin;
+    padFrame(frame, 3);
+}
+
+void IsoTpReassembler::reset() {
+    m_length = 0;
+    m_received = 0;
+    m_active = false;
+}
+
+IsoTpRxResult IsoTpReassembler::feed(const CanFrame& frame) {
+    if (frame.length == 0) return ISOTP_RX_IGNORED;
+    uint8_t pci = frame.data[0] & 0xF0;
+
+    if (pci == ISOTP_SINGLE_FRAME) {
+        size_t len = frame.data[0] & 0x0F;
+        if (len == 0 || len > 7 || len + 1 > frame.length) return ISOTP_RX_ERROR;
+        memcpy(m_data, frame.data + 1, len);
+        m_length = m_received = len;
+        m_active = false;
+        return ISOTP_RX_COMPLETE;
+    }
+
+    if (pci == ISOTP_FIRST_FRAME) {
+        if (frame.length < 8) return ISOTP_RX_ERROR;
+        size_t len = (size_t)(frame.data[0] & 0x0F) << 8 | frame.data[1];
+        if (len < 8 || len > ISOTP_MAX_MESSAGE) {
+            reset();
+            return ISOTP_RX_ERROR;
+        }
+        memcpy(m_data, frame.data + 2, 6);
+        m_length = len;
+        m_received = 6;
+        m_sequence = 1;
+        m_active = true;
+        return ISOTP_RX_SEND_FLOW_CONTROL;
+    }
+
+    if (pci == ISOTP_CONSECUTIVE_FRAME) {
+        if (!m_active) return ISOTP_RX_IGNORED;
+        if ((frame.data[0] & 0x0F) != m_sequence) {
+            reset();
+            return ISOTP_RX_ERROR;
+        }
+        size_t chunk = m_length - m_received;
+        if (chunk > 7) chunk = 7;
+        if (chunk + 1 > frame.length) {
+            reset();
+            return ISOTP_RX_ERROR;
+        }
+        memcpy(m_data + m_received, frame.data + 1, chunk);
+        m_received += chunk;
+        m_sequence = (m_sequence + 1) & 0x0F;
+        if (m_received < m_length) return ISOTP_RX_IN_PROGRESS;
+        m_active = false;
+        return ISOTP_RX_COMPLETE;
+    }
+
+    return ISOTP_RX_IGNORED;
+}
+
+bool IsoTpSegmenter::start(const uint8_t* data, size_t len) {
+    if (len == 0 || len > ISOTP_MAX_MESSAGE) return false;
+    memcpy(m_data, data, len);
+    m_length = len;
+    m_sent = 0;
+    m_sequence = 1;
+    m_waitFc = false;
+    return true;
+}
+
+bool IsoTpSegmenter::next(CanFrame& frame) {
+    if (m_waitFc || m_sent == m_length) return false;
+
+    if (m_sent == 0 && m_length <= 7) {
+        frame.data[0] = ISOTP_SINGLE_FRAME | (uint8_t)m_length;
+        memcpy(frame.data + 1, m_data, m_length);
+        padFrame(frame, 1 + m_length);
+        m_sent = m_length;
+        return true;
+    }
+
+    if (m_sent == 0) {
+        frame.data[0] = ISOTP_FIRST_FRAME | (uint8_t)(m_length >> 8);
+        frame.data[1] = (uint8_t)m_length;
+        memcpy(frame.data + 2, m_data, 6);
+        frame.length = 8;
+        m_sent = 6;
+        m_waitFc = true;
+        return true;
+    }
+
+    size_t chunk = m_length - m_sent;
+    if (chunk > 7) chunk = 7;
+    frame.data[0] = ISOTP_CONSECUTIVE_FRAME | m_sequence;
+    memcpy(frame.data + 1, m_data + m_sent, chunk);
+    padFrame(frame, 1 + chunk);
+    m_sent += chunk;
+    m_sequence = (m_sequence + 1) & 0x0F;
+
+    if (m_blockSize != 0 && --m_blockLeft == 0 && m_sent < m_length) m_waitFc = true;
+    return true;
+}
+
+bool IsoTpSegmenter::onFlowControl(const CanFrame& frame) {
+    if (!m_waitFc || frame.length < 3 || (frame.data[0] & 0xF0) != ISOTP_FLOW_CONTROL) return true;
+
+    switch (frame.data[0] & 0x0F) {
+        case ISOTP_FC_CONTINUE:
+            m_blockSize = m_blockLeft = frame.data[1];
+            // 0x00-0x7F are milliseconds; 0xF1-0xF9 are 100-900 us, rounded up
+            m_stMin = frame.data[2] <= 0x7F ? frame.data[2] : 1;
+            m_waitFc = false;
+            return true;
+        case ISOTP_FC_WAIT:
+            return true;
+        default:
+            m_sent = m_length;
+            m_waitFc = false;
+            return false;
+    }
+}
@@ -0,0 +1,95 @@
+/**
+ * Link layer negotiation after a connection comes up
+ */
+
+#include "LinkNegotiator.h"
+
+const char* linkPhyName(uint8_t phy) {
+    switch (phy) {
+        case LINK_PHY_1M:    return "1M";
+        case LINK_PHY_2M:    return "2M";
+        case LINK_PHY_CODED: return "coded";
+        default:             return "?";
+    }
+}
+
+const char* linkOutcomeName(LinkOutcome outcome) {
+    switch (outcome) {
+        case LINK_PENDING:     return "pending";
+        case LINK_ACCEPTED:    return "accepted";
+        case LINK_REFUSED:     return "refused";
+        case LINK_UNSUPPORTED: return "unsupported";
+        default:               return "not requested";
+    }
+}
+
+void LinkNegotiator::connected(uint32_t nowMs) {
+    m_connectedMs = nowMs;
+    m_requestMs = nowMs;
+    m_stats = {};
+    m_stats.txPhy = LINK_PHY_1M;
+    m_stats.rxPhy = LINK_PHY_1M;
+    m_stats.txOctets = LINK_DEFAULT_OCTETS;
+    m_stats.rxOctets = LINK_DEFAULT_OCTETS;
+    m_stats.mtu = 23;
+}
+
+void LinkNegotiator::dataLengthRequested(bool sent, uint32_t nowMs) {
+    m_stats.dataLength = sent ? LINK_PENDING : LINK_REFUSED;
+    m_requestMs = nowMs;
+    settle(nowMs);
+}
+
+void LinkNegotiator::phyRequested(bool sent, uint32_t nowMs) {
+    m_stats.phy = sent ? LINK_PENDING : LINK_REFUSED;
+    m_requestMs = nowMs;
+    settle(nowMs);
+}
+
+void LinkNegotiator::phyUnsupported(uint32_t nowMs) {
+    m_stats.phy = LINK_UNSUPPORTED;
+    settle(nowMs);
+}
+
+void LinkNegotiator::dataLengthUpdated(uint8_t status, uint16_t txOctets, uint16_t rxOctets,
+                                       uint32_t nowMs) {
+    // The central may also change the data length on its own; take the
+    // values either way, but only an answer settles a pending request
+    if (status == 0) {
+        m_stats.txOctets = txOctets;
+        m_stats.rxOctets = rxOctets;
+    }
+    if (m_stats.dataLength == LINK_PENDING) {
+        m_stats.dataLength = status == 0 && txOctets > LINK_DEFAULT_OCTETS ? LINK_ACCEPTED : LINK_REFUSED;
+        settle(nowMs);
+    }
+}
+
+void LinkNegotiator::phyUpdated(uint8_t status, uint8_t txPhy, uint8_t rxPhy, uint32_t nowMs) {
+    if (status == 0) {
+        m_stats.txPhy = txPhy;
+        m_stats.rxPhy = rxPhy;
+    }
+    if (m_stats.phy == LINK_PENDING) {
+        m_stats.phy = status == 0 && txPhy == LINK_PHY_2M ? LINK_ACCEPTED : LINK_REFUSED;
+        settle(nowMs);
+    }
+}
+
+bool LinkNegotiator::service(uint32_t nowMs) {
+    if (settled() || nowMs - m_requestMs < LINK_NEGOTIATION_TIMEOUT_MS) return false;
+    if (m_stats.phy == LINK_PENDING) m_stats.phy = LINK_REFUSED;
+    if (m_stats.dataLength == LINK_PENDING) m_stats.dataLength = LINK_REFUSED;
+    settle(nowMs);
+    return true;
+}
+
+uint32_t LinkNegotiator::msUntilTimeout(uint32_t nowMs) const {
+    if (settled()) return UINT32_MAX;
+    uint32_t waited = nowMs - m_requestMs;
+    return waited < LINK_NEGOTIATION_TIMEOUT_MS ? LINK_NEGOTIATION_TIMEOUT_MS - waited : 0;
+}
+
+void LinkNegotiator::settle(uint32_t nowMs) {
+    if (settled() && m_stats.settleMs == 0) m_stats.settleMs = nowMs - m_connectedMs;
+}
@@ -0,0 +1,266 @@
+/**
+ * Bulk download of the offline telemetry log
+ */
+
+#include <BLE2902.h>
+#include <string.h>
+#ifndef CARTAG_NATIVE
+#include <esp_gatts_api.h>
+#endif
+
+#include "LogSyncService.h"
+
+void LogSyncService::begin(BLEServer* server) {
+    m_server = server;
+    BLEService* service = server->createService(LOG_SYNC_SERVICE_UUID);
+
+    BLECharacteristic* control = service->createCharacteristic(
+        LOG_SYNC_CONTROL_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    control->setCallbacks(this);
+
+    m_dataCharacteristic = service->createCharacteristic(
+        LOG_SYNC_DATA_UUID,
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    m_dataCharacteristic->addDescriptor(new BLE2902());
+
+    m_statsCharacteristic = service->createCharacteristic(
+        LOG_SYNC_STATS_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    m_statsCharacteristic->addDescriptor(new BLE2902());
+
+    service->start();
+    publishStats(0);
+}
+
+void LogSyncService::onWrite(BLECharacteristic* characteristic, esp_ble_gatts_cb_param_t* param) {
+    Request request = {};
+    request.connId = param->write.conn_id;
+    size_t len = characteristic->getLength();
+    request.length = (uint8_t)(len < sizeof(request.data) ? len : sizeof(request.data));
+    memcpy(request.data, characteristic->getData(), request.length);
+    if (request.length > 0 && m_requests.push(request) && m_controlListener) m_controlListener();
+}
+
+uint32_t LogSyncService::service(uint32_t nowMs, size_t (*payloadLimitOf)(uint16_t connId)) {
+    Request request;
+    while (m_requests.pop(request)) {
+        if (running() && request.connId != m_owner) continue;
+        handle(request, nowMs);
+    }
+    if (!running()) return UINT32_MAX;
+
+    size_t payloadLimit = payloadLimitOf(m_owner);
+    if (payloadLimit < LOG_SYNC_MIN_PACKET) {
+        finish(LOG_SYNC_STOPPED, nowMs);
+        return UINT32_MAX;
+    }
+    if (payloadLimit > LOG_SYNC_MAX_PACKET) payloadLimit = LOG_SYNC_MAX_PACKET;
+
+    // Go back to the first unacknowledged packet if the acks stopped coming
+    if (inFlight() > 0 && nowMs - m_lastAckMs >= LOG_SYNC_ACK_TIMEOUT_MS) {
+        m_stats.resent += inFlight();
+        m_nextPacket = m_ackedPackets;
+        m_cursor = m_stats.acked;
+        m_drained = false;
+        m_lastAckMs = nowMs;
+    }
+
+    while (!m_drained && inFlight() < m_stats.window) sendPacket(payloadLimit, nowMs);
+
+    if (m_drained && inFlight() == 0) {
+        finish(LOG_SYNC_COMPLETE, nowMs);
+        return UINT32_MAX;
+    }
+
+    if (nowMs - m_lastStatsMs >= LOG_SYNC_STATS_PERIOD_MS) publishStats(nowMs);
+    uint32_t statsWait = LOG_SYNC_STATS_PERIOD_MS - (nowMs - m_lastStatsMs);
+    if (inFlight() == 0) return statsWait;
+    uint32_t ackWait = LOG_SYNC_ACK_TIMEOUT_MS - (nowMs - m_lastAckMs);
+    return ackWait < statsWait ? ackWait : statsWait;
+}
+
+void LogSyncService::disconnected(uint16_t connId) {
+    if (connId != m_owner) return;
+    if (running()) m_stats.state = LOG_SYNC_STOPPED;
+    m_owner = LOG_SYNC_NO_OWNER;
+}
+
+void LogSyncService::reset() {
+    Request request;
+    while (m_requests.pop(request)) {}
+    disconnected(m_owner);
+}
+
+void LogSyncService::handle(const Request& request, uint32_t nowMs) {
+    const uint8_t* p = request.data;
+    if (p[0] == LOG_SYNC_OP_START || p[0] == LOG_SYNC_OP_QUERY || p[0] == LOG_SYNC_OP_RECENT) {
+        m_owner = request.connId;
+    }
+    switch (p[0]) {
+        case LOG_SYNC_OP_START: {
+            LogCursor from = m_log.oldest();
+            if (request.length >= 7) {
+                uint32_t sector = getLE32(p + 1);
+                if (sector == LOG_SYNC_RESUME) {
+                    if (m_stats.acked.sector != 0) from = m_stats.acked;
+                } else if (sector != 0) {
+                    from = {sector, getLE16(p + 5)};
+                }
+            }
+            uint8_t window = request.length >= 8 ? p[7] : LOG_SYNC_DEFAULT_WINDOW;
+            m_ranged = false;
+            start(from, window, nowMs);
+            break;
+        }
+        case LOG_SYNC_OP_QUERY: {
+            if (request.length < 5) break;
+            uint32_t toMs = request.length >= 9 ? getLE32(p + 5) : LOG_SYNC_OPEN_END;
+            uint8_t window = request.length >= 10 ? p[9] : LOG_SYNC_DEFAULT_WINDOW;
+            query(getLE32(p + 1), toMs, window, nowMs);
+            break;
+        }
+        case LOG_SYNC_OP_RECENT: {
+            if (request.length < 5) break;
+            uint32_t duration = getLE32(p + 1);
+            uint8_t window = request.length >= 6 ? p[5] : LOG_SYNC_DEFAULT_WINDOW;
+            query(duration < nowMs ? nowMs - duration : 0, LOG_SYNC_OPEN_END, window, nowMs);
+            break;
+        }
+        case LOG_SYNC_OP_ACK: {
+            if (!running() || request.length < 3) break;
+            uint16_t packet = getLE16(p + 1);
+            // Only packets in flight; stale acks from before a go-back are ignored
+            if ((uint16_t)(packet - m_ackedPackets) < inFlight()) {
+                m_ackedPackets = packet + 1;
+                m_stats.acked = m_sentCursors[packet % LOG_SYNC_MAX_WINDOW];
+                m_lastAckMs = nowMs;
+            }
+            break;
+        }
+        case LOG_SYNC_OP_STOP:
+            if (running()) finish(LOG_SYNC_STOPPED, nowMs);
+            break;
+    }
+}
+
+void LogSyncService::start(LogCursor from, uint8_t window, uint32_t nowMs) {
+    if (window == 0) window = LOG_SYNC_DEFAULT_WINDOW;
+    if (window > LOG_SYNC_MAX_WINDOW) window = LOG_SYNC_MAX_WINDOW;
+
+    m_cursor = from;
+    m_nextPacket = 0;
+    m_ackedPackets = 0;
+    m_drained = false;
+    m_startMs = nowMs;
+    m_lastAckMs = nowMs;
+
+    m_stats = {};
+    m_stats.state = LOG_SYNC_RUNNING;
+    m_stats.window = window;
+    m_stats.acked = from;
+    publishStats(nowMs);
+}
+
+void LogSyncService::query(uint32_t fromMs, uint32_t toMs, uint8_t window, uint32_t nowMs) {
+    m_ranged = true;
+    m_fromMs = fromMs;
+    m_toMs = toMs;
+    start(m_log.seek(fromMs), window, nowMs);
+}
+
+void LogSyncService::finish(LogSyncState state, uint32_t nowMs) {
+    m_stats.state = state;
+    updateRate(nowMs);
+    publishStats(nowMs);
+}
+
+void LogSyncService::updateRate(uint32_t nowMs) {
+    m_stats.elapsedMs = nowMs - m_startMs;
+    if (m_stats.elapsedMs > 0) {
+        m_stats.bytesPerSecond = (uint32_t)((uint64_t)m_stats.bytes * 1000 / m_stats.elapsedMs);
+    }
+}
+
+// Pack whole records until the next one would not fit. The log is read
+// into a scratch buffer so a record that does not fit stays unread. For a
+// QUERY, blocks that end before the range are skipped and the first block
+// that starts after it ends the transfer; samples in a block are always
+// less than TELEMETRY_LOG_BLOCK_MS after its base timestamp.
+void LogSyncService::sendPacket(size_t payloadLimit, uint32_t nowMs) {
+    uint8_t packet[LOG_SYNC_MAX_PACKET];
+    uint8_t record[TELEMETRY_LOG_MAX_PAYLOAD];
+    size_t len = LOG_SYNC_HEADER_SIZE;
+    uint8_t flags = 0;
+
+    for (;;) {
+        LogCursor before = m_cursor;
+        size_t recordLen = m_log.read(m_cursor, record, sizeof(record));
+        if (recordLen == 0) {
+            flags |= LOG_SYNC_FLAG_LAST;
+            break;
+        }
+        if (m_ranged && recordLen >= TELEMETRY_BLOCK_HEADER_SIZE) {
+            uint32_t baseMs = getLE32(record + 4);
+            if (baseMs > m_toMs) {
+                m_cursor = before;
+                flags |= LOG_SYNC_FLAG_LAST;
+                break;
+            }
+            if (baseMs + TELEMETRY_LOG_BLOCK_MS <= m_fromMs) continue;
+        }
+        if (len + 1 + recordLen > payloadLimit) {
+            m_cursor = before;
+            break;
+        }
+        packet[len++] = (uint8_t)recordLen;
+        memcpy(packet + len, record, recordLen);
+        len += recordLen;
+        m_stats.records++;
+    }
+
+    uint16_t number = m_nextPacket++;
+    packet[0] = LOG_SYNC_MAGIC;
+    packet[1] = flags;
+    putLE16(packet + 2, number);
+    putLE32(packet + 4, m_cursor.sector);
+    putLE16(packet + 8, (uint16_t)m_cursor.offset);
+    m_sentCursors[number % LOG_SYNC_MAX_WINDOW] = m_cursor;
+    m_drained = (flags & LOG_SYNC_FLAG_LAST) != 0;
+
+    notifyOwner(m_dataCharacteristic, packet, len);
+
+    m_stats.payloadSize = (uint16_t)payloadLimit;
+    m_stats.bytes += len;
+    updateRate(nowMs);
+}
+
+void LogSyncService::publishStats(uint32_t nowMs) {
+    uint8_t value[LOG_SYNC_STATS_SIZE];
+    value[0] = m_stats.state;
+    value[1] = m_stats.window;
+    putLE16(value + 2, m_stats.payloadSize);
+    putLE32(value + 4, m_stats.records);
+    putLE32(value + 8, m_stats.bytes);
+    putLE32(value + 12, m_stats.elapsedMs);
+    putLE32(value + 16, m_stats.bytesPerSecond);
+    putLE32(value + 20, m_stats.acked.sector);
+    putLE16(value + 24, (uint16_t)m_stats.acked.offset);
+    putLE16(value + 26, m_stats.resent);
+
+    m_lastStatsMs = nowMs;
+    m_statsCharacteristic->setValue(value, sizeof(value));
+    if (m_stats.state != LOG_SYNC_IDLE) notifyOwner(m_statsCharacteristic, value, sizeof(value));
+}
+
+// BLECharacteristic::notify() would go to every connected central
+void LogSyncService::notifyOwner(BLECharacteristic* characteristic, uint8_t* data, size_t len) {
+    if (m_owner == LOG_SYNC_NO_OWNER) return;
+    esp_ble_gatts_send_indicate(m_server->getGattsIf(), m_owner, characteristic->getHandle(),
+                                (uint16_t)len, data, false);
+}
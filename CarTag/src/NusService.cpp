@@ -0,0 +1,36 @@
+/**
+ * Nordic UART Service endpoint
+ */
+
+#include <BLE2902.h>
+
+#include "NusService.h"
+
+void NusService::begin(BLEServer* server) {
+    BLEService* service = server->createService(NUS_SERVICE_UUID);
+
+    BLECharacteristic* rxCharacteristic = service->createCharacteristic(
+        NUS_RX_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    rxCharacteristic->setCallbacks(this);
+
+    m_txCharacteristic = service->createCharacteristic(
+        NUS_TX_UUID,
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    m_txCharacteristic->addDescriptor(new BLE2902());
+
+    service->start();
+}
+
+void NusService::onWrite(BLECharacteristic* characteristic) {
+    m_rx.write(characteristic->getData(), characteristic->getLength());
+    if (m_rxListener) m_rxListener();
+}
+
+void NusService::reset() {
+    m_rx.consume(m_rx.available());
+    m_tx.consume(m_tx.available());
+}
@@ -0,0 +1,43 @@
+/**
+ * ESP32 flash partition as a FlashStore
+ */
+
+#ifndef CARTAG_NATIVE
+
+#include <esp_partition.h>
+
+#include "PartitionFlash.h"
+
+bool PartitionFlash::begin() {
+    m_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                           TELEMETRY_PARTITION_LABEL);
+    if (!m_partition) return false;
+    m_sectors = m_partition->size / FLASH_SECTOR_SIZE;
+    return m_sectors >= 2;
+}
+
+bool PartitionFlash::read(uint32_t offset, void* out, size_t len) {
+    m_stats.reads++;
+    if (m_partition && esp_partition_read(m_partition, offset, out, len) == ESP_OK) return true;
+    m_stats.errors++;
+    return false;
+}
+
+bool PartitionFlash::write(uint32_t offset, const void* data, size_t len) {
+    m_stats.writes++;
+    if (m_partition && esp_partition_write(m_partition, offset, data, len) == ESP_OK) return true;
+    m_stats.errors++;
+    return false;
+}
+
+bool PartitionFlash::erase(uint32_t sector) {
+    m_stats.erases++;
+    if (m_partition &&
+        esp_partition_erase_range(m_partition, sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE) == ESP_OK) {
+        return true;
+    }
+    m_stats.errors++;
+    return false;
+}
+
+#endif
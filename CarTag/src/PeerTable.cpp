@@ -0,0 +1,53 @@
+/**
+ * Per-central connection contexts
+ */
+
+#include <string.h>
+
+#include "PeerTable.h"
+
+PeerTable::PeerTable() {
+    for (Peer& peer : m_peers) peer.connId = PEER_NO_CONN;
+}
+
+Peer* PeerTable::add(uint16_t connId, const uint8_t address[6], uint32_t nowMs) {
+    if (find(connId)) return nullptr;
+    for (Peer& peer : m_peers) {
+        if (peer.active()) continue;
+        peer = Peer();
+        peer.connId = connId;
+        memcpy(peer.address, address, sizeof(peer.address));
+        peer.mtu = ATT_DEFAULT_MTU;
+        peer.connectedMs = nowMs;
+        m_count++;
+        return &peer;
+    }
+    return nullptr;
+}
+
+bool PeerTable::remove(uint16_t connId) {
+    Peer* peer = find(connId);
+    if (!peer) return false;
+    peer->connId = PEER_NO_CONN;
+    m_count--;
+    return true;
+}
+
+Peer* PeerTable::find(uint16_t connId) {
+    if (connId == PEER_NO_CONN) return nullptr;
+    for (Peer& peer : m_peers) {
+        if (peer.connId == connId) return &peer;
+    }
+    return nullptr;
+}
+
+const Peer* PeerTable::find(uint16_t connId) const {
+    return const_cast<PeerTable*>(this)->find(connId);
+}
+
+Peer* PeerTable::findByAddress(const uint8_t address[6]) {
+    for (Peer& peer : m_peers) {
+        if (peer.active() && memcmp(peer.address, address, sizeof(peer.address)) == 0) return &peer;
+    }
+    return nullptr;
+}
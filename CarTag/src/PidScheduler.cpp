@@ -0,0 +1,174 @@
+/**
+ * On-device OBD-II PID polling scheduler
+ */
+
+#include "PidScheduler.h"
+
+// Signed distance so comparisons survive millis() wrapping
+static inline int32_t msUntil(uint32_t due, uint32_t now) {
+    return (int32_t)(due - now);
+}
+
+PidScheduler::PidScheduler(VehicleBackend& backend, PidResultCallback onResult)
+    : m_backend(backend), m_onResult(onResult) {}
+
+bool PidScheduler::subscribe(uint8_t pid, uint16_t periodMs, uint32_t nowMs) {
+    if (periodMs == 0) return false;
+
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_subs[i].pid == pid) {
+            m_subs[i].periodMs = periodMs;
+            m_subs[i].nextDueMs = nowMs;
+            return true;
+        }
+    }
+    if (m_count == PID_SCHEDULER_MAX) return false;
+
+    m_subs[m_count++] = {pid, periodMs, nowMs, 0, 0, 0};
+    return true;
+}
+
+bool PidScheduler::unsubscribe(uint8_t pid) {
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_subs[i].pid == pid) {
+            m_subs[i] = m_subs[--m_count];
+            return true;
+        }
+    }
+    return false;
+}
+
+void PidScheduler::clear() {
+    m_count = 0;
+}
+
+void PidScheduler::resetMultiPid() {
+    m_multiPid = MULTI_PID_UNKNOWN;
+}
+
+// Pick up to maxCount due PIDs, most overdue first, so a slow bus degrades
+// every PID evenly. Once one PID is due, others due within the coalescing
+// window ride along in the same request. Each picked PID is rescheduled
+// before it is polled.
+size_t PidScheduler::takeDue(uint32_t nowMs, PidSubscription** out, size_t maxCount) {
+    size_t n = 0;
+    while (n < maxCount) {
+        uint32_t horizon = n == 0 ? nowMs : nowMs + PID_COALESCE_WINDOW_MS;
+        PidSubscription* next = nullptr;
+        for (size_t i = 0; i < m_count; i++) {
+            PidSubscription* s = &m_subs[i];
+            if (msUntil(s->nextDueMs, horizon) > 0) continue;
+            bool taken = false;
+            for (size_t j = 0; j < n; j++) taken |= out[j] == s;
+            if (taken) continue;
+            if (!next || msUntil(s->nextDueMs, next->nextDueMs) < 0) next = s;
+        }
+        if (!next) break;
+
+        int32_t late = -msUntil(next->nextDueMs, nowMs);
+        if (late > 0 && (uint32_t)late > next->lateMs) next->lateMs = (uint32_t)late;
+        out[n++] = next;
+    }
+
+    // Keep the original phase, but never try to catch up on missed slots.
+    // PIDs polled early move onto the group's phase so they stay coalesced.
+    for (size_t i = 0; i < n; i++) {
+        bool early = msUntil(out[i]->nextDueMs, nowMs) > 0;
+        out[i]->nextDueMs += out[i]->periodMs;
+        if (early || msUntil(out[i]->nextDueMs, nowMs) <= 0) out[i]->nextDueMs = nowMs + out[i]->periodMs;
+    }
+    return n;
+}
+
+void PidScheduler::pollSingle(PidSubscription* sub) {
+    uint8_t req[2] = {0x01, sub->pid};
+    uint8_t resp[16];
+    size_t respLen = 0;
+
+    sub->polls++;
+    m_stats.singleRequests++;
+    // A reply for another PID (a late one, or another ECU's) is no answer
+    ObdStatus status = m_backend.request(req, sizeof(req), resp, sizeof(resp), respLen);
+    if (status == OBD_OK && respLen >= 2 && resp[0] == 0x41 && resp[1] == sub->pid) {
+        m_onResult(resp, respLen);
+    } else {
+        sub->failures++;
+    }
+}
+
+// One request for several PIDs. The combined reply "41 p1 d.. p2 d.." is
+// split back into per-PID results using each PID's data length. Returns
+// false if the ECU rejected the form and the PIDs still need polling.
+bool PidScheduler::pollMulti(PidSubscription** subs, size_t n) {
+    uint8_t req[1 + OBD_MAX_PIDS_PER_REQUEST] = {0x01};
+    for (size_t i = 0; i < n; i++) req[1 + i] = subs[i]->pid;
+
+    uint8_t resp[1 + OBD_MAX_PIDS_PER_REQUEST * 5];
+    size_t respLen = 0;
+    m_stats.multiRequests++;
+    ObdStatus status = m_backend.request(req, 1 + n, resp, sizeof(resp), respLen);
+
+    bool answered[OBD_MAX_PIDS_PER_REQUEST] = {};
+    size_t found = 0;
+    if (status == OBD_OK && respLen > 0 && resp[0] == 0x41) {
+        size_t pos = 1;
+        while (pos < respLen) {
+            uint8_t pid = resp[pos];
+            uint8_t dataLen = obdPidDataLength(pid);
+            if (dataLen == 0 || pos + 1 + dataLen > respLen) break;
+
+            for (size_t i = 0; i < n; i++) {
+                if (subs[i]->pid != pid || answered[i]) continue;
+                uint8_t single[2 + 4] = {0x41, pid};
+                for (uint8_t b = 0; b < dataLen; b++) single[2 + b] = resp[pos + 1 + b];
+                m_onResult(single, 2 + dataLen);
+                answered[i] = true;
+                found++;
+                break;
+            }
+            pos += 1 + dataLen;
+        }
+    }
+
+    // Until an ECU has answered one multi-PID request, a failure means it
+    // does not support them: stop asking and poll these PIDs one by one
+    if (found == 0 && m_multiPid != MULTI_PID_SUPPORTED) {
+        m_multiPid = MULTI_PID_REJECTED;
+        m_stats.fallbacks++;
+        return false;
+    }
+
+    m_multiPid = MULTI_PID_SUPPORTED;
+    for (size_t i = 0; i < n; i++) {
+        subs[i]->polls++;
+        if (!answered[i]) subs[i]->failures++;
+    }
+    return true;
+}
+
+size_t PidScheduler::run(uint32_t nowMs, size_t maxPolls) {
+    size_t polled = 0;
+
+    while (polled < maxPolls) {
+        size_t batch = m_multiPid == MULTI_PID_REJECTED ? 1 : OBD_MAX_PIDS_PER_REQUEST;
+        if (batch > maxPolls - polled) batch = maxPolls - polled;
+
+        PidSubscription* due[OBD_MAX_PIDS_PER_REQUEST];
+        size_t n = takeDue(nowMs, due, batch);
+        if (n == 0) break;
+
+        if (n == 1 || !pollMulti(due, n)) {
+            for (size_t i = 0; i < n; i++) pollSingle(due[i]);
+        }
+        polled += n;
+    }
+    return polled;
+}
+
+uint32_t PidScheduler::nextDueMs(uint32_t nowMs) const {
+    uint32_t earliest = nowMs + 86400000UL;
+    for (size_t i = 0; i < m_count; i++) {
+        if (msUntil(m_subs[i].nextDueMs, earliest) < 0) earliest = m_subs[i].nextDueMs;
+    }
+    return earliest;
+}
@@ -0,0 +1,50 @@
+/**
+ * In-memory flash for the native build
+ */
+
+#include <string.h>
+
+#include "RamFlash.h"
+
+RamFlash::RamFlash(uint32_t sectors)
+    : m_data(new uint8_t[(size_t)sectors * FLASH_SECTOR_SIZE]), m_sectors(sectors) {
+    memset(m_data, 0xFF, (size_t)sectors * FLASH_SECTOR_SIZE);
+}
+
+RamFlash::~RamFlash() { delete[] m_data; }
+
+bool RamFlash::read(uint32_t offset, void* out, size_t len) {
+    m_stats.reads++;
+    if ((uint64_t)offset + len > (uint64_t)m_sectors * FLASH_SECTOR_SIZE) {
+        m_stats.errors++;
+        return false;
+    }
+    memcpy(out, m_data + offset, len);
+    return true;
+}
+
+bool RamFlash::write(uint32_t offset, const void* data, size_t len) {
+    m_stats.writes++;
+    if ((uint64_t)offset + len > (uint64_t)m_sectors * FLASH_SECTOR_SIZE) {
+        m_stats.errors++;
+        return false;
+    }
+    const uint8_t* src = (const uint8_t*)data;
+    bool clean = true;
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] & ~m_data[offset + i]) clean = false;
+        m_data[offset + i] &= src[i];
+    }
+    if (!clean) m_stats.errors++;
+    return clean;
+}
+
+bool RamFlash::erase(uint32_t sector) {
+    m_stats.erases++;
+    if (sector >= m_sectors) {
+        m_stats.errors++;
+        return false;
+    }
+    memset(m_data + (size_t)sector * FLASH_SECTOR_SIZE, 0xFF, FLASH_SECTOR_SIZE);
+    return true;
+}
@@ -0,0 +1,115 @@
+/**
+ * Hardware-timer sample clock
+ */
+
+#include "SampleTimer.h"
+
+#ifdef CARTAG_NATIVE
+#include "SimClock.h"
+#else
+#include <esp_timer.h>
+#endif
+
+void IRAM_ATTR SampleTimer::tick(uint64_t timestampUs) {
+    // The first tick after start() has no interval to measure
+    if (m_lastTickUs != 0) {
+        uint32_t interval = (uint32_t)(timestampUs - m_lastTickUs);
+        uint32_t deviation;
+        if (interval >= m_jitter.periodUs) {
+            deviation = interval - m_jitter.periodUs;
+            if (deviation > m_jitter.maxLateUs) m_jitter.maxLateUs = deviation;
+        } else {
+            deviation = m_jitter.periodUs - interval;
+            if (deviation > m_jitter.maxEarlyUs) m_jitter.maxEarlyUs = deviation;
+        }
+
+        uint32_t bin = 0;
+        while (deviation && bin < SAMPLE_JITTER_BINS - 1) {
+            deviation >>= 1;
+            bin++;
+        }
+        m_jitter.bins[bin]++;
+        m_jitter.ticks++;
+    }
+    m_lastTickUs = timestampUs;
+    m_onTick(timestampUs);
+}
+
+#ifdef CARTAG_NATIVE
+
+bool SampleTimer::begin(SampleTickCallback onTick) {
+    m_onTick = onTick;
+    return true;
+}
+
+void SampleTimer::start(uint32_t periodUs) {
+    if (periodUs < SAMPLE_PERIOD_MIN_US) periodUs = SAMPLE_PERIOD_MIN_US;
+    if (periodUs > SAMPLE_PERIOD_MAX_US) periodUs = SAMPLE_PERIOD_MAX_US;
+    if (m_running && periodUs == m_jitter.periodUs) return;
+
+    m_jitter = {};
+    m_jitter.periodUs = periodUs;
+    m_lastTickUs = 0;
+    m_nextTickUs = nowUs() + periodUs;
+    m_running = m_onTick != nullptr;
+}
+
+void SampleTimer::stop() { m_running = false; }
+
+void SampleTimer::poll() {
+    uint64_t now = nowUs();
+    while (m_running && m_nextTickUs <= now) {
+        uint64_t due = m_nextTickUs;
+        m_nextTickUs += m_jitter.periodUs;
+        tick(due);
+    }
+}
+
+uint64_t SampleTimer::nowUs() { return sim::Clock::nowUs(); }
+
+#else
+
+SampleTimer* SampleTimer::s_instance = nullptr;
+
+bool SampleTimer::begin(SampleTickCallback onTick) {
+    if (m_timer) return false;
+    m_onTick = onTick;
+    s_instance = this;
+
+    // 80 MHz APB clock / 80 = 1 MHz, so alarm values are microseconds
+    m_timer = timerBegin(0, 80, true);
+    if (!m_timer) return false;
+    timerAttachInterrupt(m_timer, isr, true);
+    return true;
+}
+
+void SampleTimer::start(uint32_t periodUs) {
+    if (!m_timer) return;
+    if (periodUs < SAMPLE_PERIOD_MIN_US) periodUs = SAMPLE_PERIOD_MIN_US;
+    if (periodUs > SAMPLE_PERIOD_MAX_US) periodUs = SAMPLE_PERIOD_MAX_US;
+    if (m_running && periodUs == m_jitter.periodUs) return;
+
+    timerAlarmDisable(m_timer);
+    m_jitter = {};
+    m_jitter.periodUs = periodUs;
+    m_lastTickUs = 0;
+    timerWrite(m_timer, 0);
+    timerAlarmWrite(m_timer, periodUs, true);
+    timerAlarmEnable(m_timer);
+    m_running = true;
+}
+
+void SampleTimer::stop() {
+    if (m_timer) timerAlarmDisable(m_timer);
+    m_running = false;
+}
+
+void SampleTimer::poll() {}
+
+void IRAM_ATTR SampleTimer::isr() {
+    s_instance->tick((uint64_t)esp_timer_get_time());
+}
+
+uint64_t SampleTimer::nowUs() { return (uint64_t)esp_timer_get_time(); }
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * Simulated engine ECU
+ */
+
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+
+#include "SimulatedEcu.h"
+
+// PIDs answered by pidData(), reported through the 0x00/0x20 support bitmaps
+static const uint8_t SUPPORTED_PIDS[] = {0x04, 0x05, 0x0C, 0x0D, 0x0F, 0x11, 0x1F, 0x20, 0x2F};
+
+static void supportBitmap(uint8_t base, uint8_t* out) {
+    out[0] = out[1] = out[2] = out[3] = 0;
+    for (uint8_t pid : SUPPORTED_PIDS) {
+        if (pid > base && pid <= base + 32) {
+            uint8_t bit = pid - base - 1;
+            out[bit / 8] |= 0x80 >> (bit % 8);
+        }
+    }
+}
+
+size_t SimulatedEcu::pidData(uint8_t pid, uint32_t nowMs, uint8_t* out) {
+    // One-minute drive cycle between roughly 10 and 110 km/h
+    const float TWO_PI_F = 6.2831853f;
+    float speed = 60.0f + 50.0f * sinf(TWO_PI_F * (nowMs % 60000) / 60000.0f);
+    float rpm = 800.0f + speed * 35.0f + 300.0f * sinf(TWO_PI_F * (nowMs % 3000) / 3000.0f);
+    float coolant = 20.0f + 70.0f * (1.0f - expf(-(float)nowMs / 120000.0f));
+    float load = 20.0f + speed * 0.5f;
+    float throttle = 10.0f + speed * 0.6f;
+
+    switch (pid) {
+        case 0x00:
+        case 0x20:
+            supportBitmap(pid, out);
+            return 4;
+        case 0x04:
+            out[0] = (uint8_t)(load * 255.0f / 100.0f);
+            return 1;
+        case 0x05:
+            out[0] = (uint8_t)(coolant + 40.0f);
+            return 1;
+        case 0x0C: {
+            uint16_t raw = (uint16_t)(rpm * 4.0f);
+            out[0] = raw >> 8;
+            out[1] = raw & 0xFF;
+            return 2;
+        }
+        case 0x0D:
+            out[0] = (uint8_t)speed;
+            return 1;
+        case 0x0F:
+            out[0] = 25 + 40;
+            return 1;
+        case 0x11:
+            out[0] = (uint8_t)(throttle * 255.0f / 100.0f);
+            return 1;
+        case 0x1F: {
+            uint16_t seconds = (uint16_t)(nowMs / 1000);
+            out[0] = seconds >> 8;
+            out[1] = seconds & 0xFF;
+            return 2;
+        }
+        case 0x2F:
+            out[0] = 75 * 255 / 100;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Stored trouble codes (mode 03), two bytes each: P0133, P0420, P0171
+static const uint8_t STORED_DTCS[] = {0x01, 0x33, 0x04, 0x20, 0x01, 0x71};
+static const char VIN[] = "1HGCM82633A004352";
+
+ObdStatus SimulatedEcu::request(const uint8_t* req, size_t reqLen,
+                                uint8_t* resp, size_t respCap, size_t& respLen) {
+    m_requests++;
+    if (reqLen == 0) return OBD_NO_DATA;
+
+    switch (req[0]) {
+        case 0x01:
+            return currentData(req, reqLen, resp, respCap, respLen);
+        case 0x03:
+            // 43, count, then the codes; longer than a single CAN frame
+            if (reqLen != 1) return OBD_NO_DATA;
+            if (respCap < 2 + sizeof(STORED_DTCS)) return OBD_BUFFER_FULL;
+            resp[0] = 0x43;
+            resp[1] = sizeof(STORED_DTCS) / 2;
+            memcpy(resp + 2, STORED_DTCS, sizeof(STORED_DTCS));
+            respLen = 2 + sizeof(STORED_DTCS);
+            return OBD_OK;
+        case 0x09:
+            // VIN: 49 02, one data item, then 17 characters
+            if (reqLen != 2 || req[1] != 0x02) return OBD_NO_DATA;
+            if (respCap < 3 + 17) return OBD_BUFFER_FULL;
+            resp[0] = 0x49;
+            resp[1] = 0x02;
+            resp[2] = 0x01;
+            memcpy(resp + 3, VIN, 17);
+            respLen = 3 + 17;
+            return OBD_OK;
+        default:
+            return OBD_NO_DATA;
+    }
+}
+
+ObdStatus SimulatedEcu::currentData(const uint8_t* req, size_t reqLen,
+                                    uint8_t* resp, size_t respCap, size_t& respLen) {
+    if (reqLen < 2 || reqLen > 7) return OBD_NO_DATA;
+    if (reqLen > 2 && !m_multiPid) return OBD_NO_DATA;
+
+    // Like a real ECU, unsupported PIDs are left out of a multi-PID reply
+    uint32_t now = millis();
+    uint8_t data[4];
+    size_t pos = 1;
+    for (size_t i = 1; i < reqLen; i++) {
+        size_t n = pidData(req[i], now, data);
+        if (n == 0) continue;
+        if (pos + 1 + n > respCap) return OBD_BUFFER_FULL;
+        resp[pos++] = req[i];
+        for (size_t b = 0; b < n; b++) resp[pos++] = data[b];
+    }
+    if (pos == 1) return OBD_NO_DATA;
+
+    resp[0] = 0x41;
+    respLen = pos;
+    return OBD_OK;
+}
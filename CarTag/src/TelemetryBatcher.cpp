@@ -0,0 +1,138 @@
+/**
+ * Accumulates telemetry samples and packs them into batch frames
+ */
+
+#include "TelemetryBatcher.h"
+
+TelemetryBatcher::TelemetryBatcher(uint32_t maxLatencyMs) : m_maxLatencyMs(maxLatencyMs) {}
+
+void TelemetryBatcher::push(const TelemetrySample& sample) {
+    m_ring[m_written % TELEMETRY_BATCH_RING_SIZE] = sample;
+    m_written++;
+}
+
+size_t TelemetryBatcher::pending(BatchCursor& cursor) const {
+    uint32_t behind = m_written - cursor.next;
+    if (behind > TELEMETRY_BATCH_RING_SIZE) {
+        cursor.dropped += behind - TELEMETRY_BATCH_RING_SIZE;
+        cursor.next = m_written - TELEMETRY_BATCH_RING_SIZE;
+        cursor.sentMask = 0;
+        behind = TELEMETRY_BATCH_RING_SIZE;
+    }
+    return behind;
+}
+
+// Number of samples from sequence from on that fit in one frame of cap
+// bytes. Records share the first sample's channel mask and a 16-bit time
+// offset, so a change of mask or a long gap also ends the batch.
+size_t TelemetryBatcher::fitCount(uint32_t from, size_t count, size_t cap) const {
+    if (count == 0 || cap < TELEMETRY_BATCH_HEADER_SIZE) return 0;
+    if (m_compressed) {
+        uint8_t scratch[TELEMETRY_BATCH_MAX_PAYLOAD];
+        TelemetryBlockEncoder encoder;
+        encoder.begin(scratch, cap < sizeof(scratch) ? cap : sizeof(scratch), 0);
+        while (encoder.count() < count && encoder.add(at(from + encoder.count()))) {}
+        return encoder.count();
+    }
+
+    const TelemetrySample& first = at(from);
+    size_t recordSize = telemetryBatchRecordSize(first.channelMask);
+    size_t room = (cap - TELEMETRY_BATCH_HEADER_SIZE) / recordSize;
+    if (room > 255) room = 255;
+
+    size_t n = 0;
+    while (n < count && n < room) {
+        const TelemetrySample& s = at(from + n);
+        if (s.channelMask != first.channelMask) break;
+        if (s.timestampMs - first.timestampMs > 0xFFFF) break;
+        n++;
+    }
+    return n;
+}
+
+bool TelemetryBatcher::ready(BatchCursor& cursor, size_t payloadLimit, uint32_t nowMs) const {
+    size_t count = pending(cursor);
+    if (count == 0) return false;
+    const TelemetrySample& first = at(cursor.next);
+    if (nowMs - first.timestampMs >= m_maxLatencyMs) return true;
+
+    // Full once some pending samples no longer fit, or there is no room for
+    // one more record
+    size_t n = fitCount(cursor.next, count, payloadLimit);
+    if (n < count || count == TELEMETRY_BATCH_RING_SIZE) return true;
+    if (m_compressed) return n == TELEMETRY_BLOCK_MAX_SAMPLES;
+    size_t recordSize = telemetryBatchRecordSize(first.channelMask);
+    return TELEMETRY_BATCH_HEADER_SIZE + (n + 1) * recordSize > payloadLimit || n == 255;
+}
+
+uint32_t TelemetryBatcher::msUntilReady(BatchCursor& cursor, size_t payloadLimit,
+                                        uint32_t nowMs) const {
+    if (pending(cursor) == 0) return UINT32_MAX;
+    if (ready(cursor, payloadLimit, nowMs)) return 0;
+    return m_maxLatencyMs - (nowMs - at(cursor.next).timestampMs);
+}
+
+// One single frame with as many of the head sample's unsent channels as
+// fit; the cursor moves on once all of them are out
+size_t TelemetryBatcher::flushSplit(BatchCursor& cursor, uint8_t* out, size_t payloadLimit) const {
+    TelemetrySample part = at(cursor.next);
+    uint16_t unsent = part.channelMask & ~cursor.sentMask;
+    part.channelMask = 0;
+    size_t len = TELEMETRY_HEADER_SIZE;
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS && len + 2 <= payloadLimit; ch++) {
+        if (!(unsent & (1u << ch))) continue;
+        part.channelMask |= 1u << ch;
+        len += 2;
+    }
+
+    len = encodeTelemetryFrame(part, (uint16_t)cursor.next, out, payloadLimit);
+    if (len == 0 || (unsent && !part.channelMask)) {
+        // Not even a header fits
+        cursor.next++;
+        cursor.dropped++;
+        cursor.sentMask = 0;
+        return 0;
+    }
+    if (cursor.sentMask == 0) cursor.split++;
+    cursor.sentMask |= part.channelMask;
+    if (cursor.sentMask == at(cursor.next).channelMask) {
+        cursor.next++;
+        cursor.sentMask = 0;
+    }
+    return len;
+}
+
+size_t TelemetryBatcher::flush(BatchCursor& cursor, uint8_t* out, size_t payloadLimit) const {
+    size_t count = pending(cursor);
+    if (count == 0) return 0;
+
+    // Finish a sample already being split, or split one that no batch can hold
+    if (cursor.sentMask != 0 || fitCount(cursor.next, count, payloadLimit) == 0) {
+        return flushSplit(cursor, out, payloadLimit);
+    }
+    uint16_t firstSequence = (uint16_t)cursor.next;
+    size_t n, len;
+
+    if (m_compressed) {
+        TelemetryBlockEncoder encoder;
+        encoder.begin(out, payloadLimit, firstSequence);
+        while (encoder.count() < count && encoder.add(at(cursor.next + encoder.count()))) {}
+        n = encoder.count();
+        len = encoder.finish();
+    } else {
+        n = fitCount(cursor.next, count, payloadLimit);
+        if (n == 0) return 0;
+
+        const TelemetrySample& first = at(cursor.next);
+        writeTelemetryBatchHeader(out, firstSequence, first.timestampMs, (uint8_t)n, first.channelMask);
+
+        len = TELEMETRY_BATCH_HEADER_SIZE;
+        for (size_t i = 0; i < n; i++) {
+            len += writeTelemetryBatchRecord(out + len, at(cursor.next + i), first.timestampMs);
+        }
+    }
+    if (n == 0) return 0;
+
+    cursor.next += n;
+    return len;
+}
@@ -0,0 +1,29 @@
+/**
+ * Telemetry beacon: the latest sample in advertising data
+ */
+
+#include "TelemetryBeacon.h"
+
+size_t encodeTelemetryBeacon(const TelemetrySample& sample, uint16_t sequence,
+                             uint8_t* out, size_t cap) {
+    if (cap < BEACON_HEADER_SIZE) return 0;
+
+    // Lowest channel ids first, as many as fit
+    uint16_t mask = 0;
+    size_t len = BEACON_HEADER_SIZE;
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+        if (!(sample.channelMask & (1u << ch)) || len + 2 > cap) continue;
+        putLE16(out + len, (uint16_t)sample.channels[ch]);
+        mask |= 1u << ch;
+        len += 2;
+    }
+
+    putLE16(out, BEACON_COMPANY_ID);
+    out[2] = BEACON_MAGIC;
+    out[3] = BEACON_VERSION;
+    putLE16(out + 4, sequence);
+    out[6] = sample.batteryLevel;
+    out[7] = sample.flags;
+    putLE16(out + 8, mask);
+    return len;
+}
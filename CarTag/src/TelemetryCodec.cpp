@@ -0,0 +1,175 @@
+/**
+ * Compressed telemetry blocks
+ */
+
+#include "TelemetryCodec.h"
+
+namespace {
+
+const uint32_t CHANGED_TIME    = 1u << 0;
+const uint32_t CHANGED_BATTERY = 1u << 1;
+const uint32_t CHANGED_FLAGS   = 1u << 2;
+const int CHANGED_CHANNEL_SHIFT = 3;
+
+inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+uint8_t* putVarint(uint8_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// False on a truncated or overlong varint
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+void TelemetryBlockEncoder::begin(uint8_t* out, size_t cap, uint16_t firstSequence) {
+    m_out = out;
+    m_cap = cap;
+    m_len = 0;
+    m_count = 0;
+    m_firstSequence = firstSequence;
+}
+
+bool TelemetryBlockEncoder::add(const TelemetrySample& sample) {
+    if (!m_out || m_count == TELEMETRY_BLOCK_MAX_SAMPLES) return false;
+
+    TelemetrySample prev = m_prev;
+    int64_t prevDelta = m_prevDelta;
+    if (m_count == 0) {
+        // Everything is encoded against zero except the timestamp, which
+        // the header carries
+        prev = {};
+        prev.timestampMs = sample.timestampMs;
+        prevDelta = 0;
+    } else if (sample.channelMask != m_channelMask || (int32_t)(sample.timestampMs - prev.timestampMs) < 0) {
+        return false;
+    }
+
+    uint8_t encoded[TELEMETRY_BLOCK_MAX_SAMPLE_SIZE];
+    uint8_t* p = encoded;
+    uint32_t changed = 0;
+    uint64_t values[3 + TELEMETRY_MAX_CHANNELS] = {};
+
+    int64_t delta = (int64_t)(uint32_t)(sample.timestampMs - prev.timestampMs);
+    if (delta != prevDelta) {
+        changed |= CHANGED_TIME;
+        values[0] = zigzag(delta - prevDelta);
+    }
+    if (sample.batteryLevel != prev.batteryLevel) {
+        changed |= CHANGED_BATTERY;
+        values[1] = zigzag((int64_t)sample.batteryLevel - prev.batteryLevel);
+    }
+    if (sample.flags != prev.flags) changed |= CHANGED_FLAGS;
+
+    int bit = CHANGED_CHANNEL_SHIFT;
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+        if (!(sample.channelMask & (1u << ch))) continue;
+        if (sample.channels[ch] != prev.channels[ch]) {
+            changed |= 1u << bit;
+            values[bit] = zigzag((int64_t)sample.channels[ch] - prev.channels[ch]);
+        }
+        bit++;
+    }
+
+    p = putVarint(p, changed);
+    if (changed & CHANGED_TIME) p = putVarint(p, values[0]);
+    if (changed & CHANGED_BATTERY) p = putVarint(p, values[1]);
+    if (changed & CHANGED_FLAGS) *p++ = sample.flags;
+    for (int b = CHANGED_CHANNEL_SHIFT; b < bit; b++) {
+        if (changed & (1u << b)) p = putVarint(p, values[b]);
+    }
+
+    size_t header = m_count == 0 ? TELEMETRY_BLOCK_HEADER_SIZE : 0;
+    size_t n = p - encoded;
+    if (m_len + header + n > m_cap) return false;
+
+    if (m_count == 0) {
+        m_out[0] = TELEMETRY_BLOCK_MAGIC;
+        m_out[1] = TELEMETRY_VERSION;
+        putLE16(m_out + 2, m_firstSequence);
+        putLE32(m_out + 4, sample.timestampMs);
+        m_out[8] = 0;
+        m_out[9] = 0;
+        putLE16(m_out + 10, sample.channelMask);
+        m_len = TELEMETRY_BLOCK_HEADER_SIZE;
+        m_channelMask = sample.channelMask;
+    }
+    for (size_t i = 0; i < n; i++) m_out[m_len + i] = encoded[i];
+    m_len += n;
+    m_count++;
+    m_prev = sample;
+    m_prevDelta = delta;
+    return true;
+}
+
+size_t TelemetryBlockEncoder::finish() {
+    if (m_count == 0) return 0;
+    m_out[8] = m_count;
+    return m_len;
+}
+
+size_t decodeTelemetryBlock(const uint8_t* in, size_t len, TelemetrySample* out,
+                            size_t maxSamples) {
+    if (len < TELEMETRY_BLOCK_HEADER_SIZE || in[0] != TELEMETRY_BLOCK_MAGIC) return 0;
+    size_t count = in[8];
+    if (count > maxSamples) return 0;
+
+    const uint8_t* p = in + TELEMETRY_BLOCK_HEADER_SIZE;
+    const uint8_t* end = in + len;
+    uint16_t mask = getLE16(in + 10);
+
+    TelemetrySample prev = {};
+    prev.timestampMs = getLE32(in + 4);
+    int64_t prevDelta = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t changed, v;
+        if (!getVarint(p, end, changed)) return 0;
+
+        TelemetrySample s = prev;
+        s.channelMask = mask;
+        int64_t delta = prevDelta;
+        if (changed & CHANGED_TIME) {
+            if (!getVarint(p, end, v)) return 0;
+            delta += unzigzag(v);
+        }
+        s.timestampMs = prev.timestampMs + (uint32_t)delta;
+        if (changed & CHANGED_BATTERY) {
+            if (!getVarint(p, end, v)) return 0;
+            s.batteryLevel = (uint8_t)(prev.batteryLevel + unzigzag(v));
+        }
+        if (changed & CHANGED_FLAGS) {
+            if (p >= end) return 0;
+            s.flags = *p++;
+        }
+        int bit = CHANGED_CHANNEL_SHIFT;
+        for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+            if (!(mask & (1u << ch))) continue;
+            if (changed & (1ull << bit)) {
+                if (!getVarint(p, end, v)) return 0;
+                s.channels[ch] = (int16_t)(prev.channels[ch] + unzigzag(v));
+            }
+            bit++;
+        }
+        s.timestampUs = (uint64_t)s.timestampMs * 1000;
+
+        out[i] = s;
+        prev = s;
+        prevDelta = delta;
+    }
+    return count;
+}
@@ -0,0 +1,86 @@
+/**
+ * CarTag telemetry frame encoding
+ */
+
+#include "TelemetryFrame.h"
+
+#include <stdio.h>
+
+static size_t channelCount(uint16_t mask) {
+    size_t n = 0;
+    for (; mask; mask &= mask - 1) n++;
+    return n;
+}
+
+static uint8_t* writeChannels(uint8_t* p, const TelemetrySample& sample) {
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+        if (sample.channelMask & (1u << ch)) {
+            putLE16(p, (uint16_t)sample.channels[ch]);
+            p += 2;
+        }
+    }
+    return p;
+}
+
+size_t encodeTelemetryFrame(const TelemetrySample& sample, uint16_t sequence,
+                            uint8_t* out, size_t cap) {
+    size_t len = TELEMETRY_HEADER_SIZE + 2 * channelCount(sample.channelMask);
+    if (len > cap) return 0;
+
+    out[0] = TELEMETRY_MAGIC;
+    out[1] = TELEMETRY_VERSION;
+    putLE16(out + 2, sequence);
+    putLE32(out + 4, sample.timestampMs);
+    out[8] = sample.batteryLevel;
+    out[9] = sample.flags;
+    putLE16(out + 10, sample.channelMask);
+
+    writeChannels(out + TELEMETRY_HEADER_SIZE, sample);
+    return len;
+}
+
+size_t telemetryBatchRecordSize(uint16_t channelMask) {
+    return TELEMETRY_BATCH_RECORD_SIZE + 2 * channelCount(channelMask);
+}
+
+void writeTelemetryBatchHeader(uint8_t* out, uint16_t firstSequence, uint32_t baseMs,
+                               uint8_t count, uint16_t channelMask) {
+    out[0] = TELEMETRY_BATCH_MAGIC;
+    out[1] = TELEMETRY_VERSION;
+    putLE16(out + 2, firstSequence);
+    putLE32(out + 4, baseMs);
+    out[8] = count;
+    out[9] = 0;
+    putLE16(out + 10, channelMask);
+}
+
+size_t writeTelemetryBatchRecord(uint8_t* out, const TelemetrySample& sample, uint32_t baseMs) {
+    putLE16(out, (uint16_t)(sample.timestampMs - baseMs));
+    out[2] = sample.batteryLevel;
+    out[3] = sample.flags;
+    return writeChannels(out + TELEMETRY_BATCH_RECORD_SIZE, sample) - out;
+}
+
+size_t encodeTelemetryAscii(const TelemetrySample& sample, char* out, size_t cap) {
+    int n = snprintf(out, cap, "%u%%", (unsigned)sample.batteryLevel);
+    return n < 0 || (size_t)n >= cap ? 0 : (size_t)n;
+}
+
+size_t telemetryLayoutDescriptor(uint8_t* out, size_t cap) {
+    // magic, version, header size, then the byte offset of each header field
+    // and the width of one channel value; batch magic, header and record size
+    // follow
+    static const uint8_t layout[] = {
+        TELEMETRY_MAGIC, TELEMETRY_VERSION, TELEMETRY_HEADER_SIZE,
+        2,   // sequence
+        4,   // timestamp
+        8,   // battery
+        9,   // flags
+        10,  // channel mask
+        2,   // bytes per channel value
+        TELEMETRY_BATCH_MAGIC, TELEMETRY_BATCH_HEADER_SIZE, TELEMETRY_BATCH_RECORD_SIZE,
+    };
+    if (cap < sizeof(layout)) return 0;
+    for (size_t i = 0; i < sizeof(layout); i++) out[i] = layout[i];
+    return sizeof(layout);
+}
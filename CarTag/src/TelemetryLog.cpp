@@ -0,0 +1,304 @@
+/**
+ * Flash ring log of telemetry samples
+ */
+
+#include <string.h>
+
+#include "TelemetryLog.h"
+
+namespace {
+
+const uint8_t RECORD_FREE      = 0xFF;
+const uint8_t RECORD_WRITTEN   = 0xFE;  // payload programmed, not yet committed
+const uint8_t RECORD_COMMITTED = 0xFC;
+
+const uint32_t ERASED_WORD = 0xFFFFFFFF;
+
+uint32_t recordSize(size_t payloadLen) {
+    return (uint32_t)(TELEMETRY_LOG_RECORD_HEADER + payloadLen + 3) & ~3u;
+}
+
+bool allErased(const uint8_t* p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+uint16_t crc16Ccitt(const uint8_t* data, size_t len, uint16_t crc) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+bool TelemetryLog::begin() {
+    if (!m_flash.begin() || m_flash.sectorCount() < 2 ||
+        m_flash.sectorCount() > TELEMETRY_LOG_MAX_SECTORS) {
+        return false;
+    }
+
+    // Only the headers: the newest sector is the head, the oldest the tail
+    uint32_t headErase = 0;
+    for (uint32_t i = 0; i < m_flash.sectorCount(); i++) {
+        SectorHeader header;
+        if (!readHeader(i, header)) continue;
+        m_firstMs[i] = header.firstMs;
+        if (!m_hasHead || header.sequence > m_headSeq) {
+            m_headIndex = i;
+            m_headSeq = header.sequence;
+            headErase = header.eraseCount;
+        }
+        if (!m_hasHead || header.sequence < m_tailSeq) m_tailSeq = header.sequence;
+        if (header.eraseCount > m_stats.maxEraseCount) m_stats.maxEraseCount = header.eraseCount;
+        m_hasHead = true;
+    }
+
+    if (m_hasHead) {
+        m_writeOffset = scanForEnd(m_headIndex);
+        m_stats.usedSectors = m_headSeq - m_tailSeq + 1;
+    } else {
+        // Empty log: the first sector opened will be sector 0, sequence 1
+        m_headIndex = m_flash.sectorCount() - 1;
+        m_headSeq = 0;
+        m_tailSeq = 1;
+    }
+
+    // The sector after the head was normally erased ahead of time. If power
+    // failed first, service() erases it again; its header is gone by then,
+    // so its erase count is taken from the head's neighbouring sector.
+    m_nextEraseCount = m_hasHead ? headErase : 1;
+    m_nextErased = isErased((m_headIndex + 1) % m_flash.sectorCount());
+    m_bootSeq = m_headSeq + 1;
+    m_bootStart = m_hasHead ? LogCursor{m_headSeq, m_writeOffset}
+                            : LogCursor{m_bootSeq, TELEMETRY_LOG_HEADER_SIZE};
+    startBlock();
+    m_ready = true;
+    return true;
+}
+
+bool TelemetryLog::append(const TelemetrySample& sample) {
+    if (!m_ready) return false;
+
+    if (pending() && sample.timestampMs - m_blockStartMs >= TELEMETRY_LOG_BLOCK_MS && !writeBlock()) {
+        return false;
+    }
+    if (!pending()) m_blockStartMs = sample.timestampMs;
+    if (!m_encoder.add(sample)) {
+        if (!writeBlock()) return false;
+        m_blockStartMs = sample.timestampMs;
+        if (!m_encoder.add(sample)) return false;
+    }
+    m_sampleSeq++;
+    m_stats.samples++;
+    return true;
+}
+
+bool TelemetryLog::flush() {
+    return !pending() || writeBlock();
+}
+
+void TelemetryLog::startBlock() {
+    m_encoder.begin(m_block, sizeof(m_block), m_sampleSeq);
+}
+
+bool TelemetryLog::writeBlock() {
+    uint8_t record[TELEMETRY_LOG_RECORD_HEADER + TELEMETRY_LOG_MAX_PAYLOAD + 3];
+    size_t len = m_encoder.finish();
+    uint32_t size = recordSize(len);
+
+    if (!m_hasHead || m_writeOffset + size > FLASH_SECTOR_SIZE) {
+        if (!m_nextErased) return false;
+        if (!openNext(m_blockStartMs)) return false;
+    }
+
+    record[0] = RECORD_WRITTEN;
+    record[1] = (uint8_t)len;
+    putLE16(record + 2, crc16Ccitt(m_block, len));
+    memcpy(record + TELEMETRY_LOG_RECORD_HEADER, m_block, len);
+    for (uint32_t i = TELEMETRY_LOG_RECORD_HEADER + len; i < size; i++) record[i] = 0xFF;
+
+    // Payload first, then the state byte: a record cut short by a power
+    // loss is never seen as committed
+    uint32_t address = m_headIndex * FLASH_SECTOR_SIZE + m_writeOffset;
+    const uint8_t committed = RECORD_COMMITTED;
+    if (!m_flash.write(address, record, size) || !m_flash.write(address, &committed, 1)) {
+        // Leave the rest of this sector alone and start a fresh one
+        m_stats.writeErrors++;
+        m_writeOffset = FLASH_SECTOR_SIZE;
+        return false;
+    }
+
+    m_writeOffset += size;
+    m_stats.records++;
+    m_stats.bytes += size;
+    startBlock();
+    return true;
+}
+
+bool TelemetryLog::service() {
+    if (!m_ready || m_nextErased) return false;
+
+    // Recycling the tail drops the oldest records
+    uint32_t next = (m_headIndex + 1) % m_flash.sectorCount();
+    SectorHeader header;
+    if (readHeader(next, header)) {
+        m_nextEraseCount = header.eraseCount + 1;
+        if (m_hasHead && header.sequence == m_tailSeq && m_tailSeq != m_headSeq) {
+            m_tailSeq++;
+            m_stats.droppedSectors++;
+            m_stats.usedSectors--;
+        }
+    }
+
+    m_stats.erases++;
+    if (!m_flash.erase(next)) {
+        m_stats.writeErrors++;
+        return false;
+    }
+    m_nextErased = true;
+    return true;
+}
+
+LogCursor TelemetryLog::oldest() const {
+    return {m_hasHead ? m_tailSeq : m_headSeq + 1, TELEMETRY_LOG_HEADER_SIZE};
+}
+
+LogCursor TelemetryLog::seek(uint32_t fromMs) const {
+    // Sectors opened this boot start in time order: find the last one that
+    // starts at or before fromMs
+    uint32_t lo = m_bootSeq > m_tailSeq ? m_bootSeq : m_tailSeq;
+    uint32_t hi = m_headSeq + 1;
+    if (!m_hasHead || lo >= hi || m_firstMs[indexOf(lo)] > fromMs) {
+        return m_bootStart.sector < m_tailSeq ? oldest() : m_bootStart;
+    }
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (m_firstMs[indexOf(mid)] <= fromMs) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return {lo, TELEMETRY_LOG_HEADER_SIZE};
+}
+
+size_t TelemetryLog::read(LogCursor& cursor, uint8_t* out, size_t cap) {
+    if (!m_ready || !m_hasHead) return 0;
+    if (cursor.sector < m_tailSeq) cursor = oldest();
+    if (cursor.offset < TELEMETRY_LOG_HEADER_SIZE) cursor.offset = TELEMETRY_LOG_HEADER_SIZE;
+
+    while (cursor.sector <= m_headSeq) {
+        uint32_t base = indexOf(cursor.sector) * FLASH_SECTOR_SIZE;
+        uint32_t end = cursor.sector == m_headSeq ? m_writeOffset : FLASH_SECTOR_SIZE;
+
+        while (cursor.offset + TELEMETRY_LOG_RECORD_HEADER <= end) {
+            uint8_t head[TELEMETRY_LOG_RECORD_HEADER];
+            if (!m_flash.read(base + cursor.offset, head, sizeof(head))) return 0;
+            if (head[0] == RECORD_FREE) break;
+
+            size_t len = head[1];
+            uint32_t size = recordSize(len);
+            if (len == 0 || len > TELEMETRY_LOG_MAX_PAYLOAD || cursor.offset + size > end) break;
+
+            uint32_t at = cursor.offset;
+            cursor.offset += size;
+            if (head[0] != RECORD_COMMITTED || len > cap ||
+                !m_flash.read(base + at + TELEMETRY_LOG_RECORD_HEADER, out, len) ||
+                crc16Ccitt(out, len) != getLE16(head + 2)) {
+                m_stats.tornRecords++;
+                continue;
+            }
+            return len;
+        }
+
+        // Caught up with the writer: stay put so later appends are found
+        if (cursor.sector == m_headSeq) return 0;
+        cursor.sector++;
+        cursor.offset = TELEMETRY_LOG_HEADER_SIZE;
+    }
+    return 0;
+}
+
+bool TelemetryLog::readHeader(uint32_t index, SectorHeader& header) {
+    uint8_t raw[TELEMETRY_LOG_HEADER_SIZE];
+    if (!m_flash.read(index * FLASH_SECTOR_SIZE, raw, sizeof(raw))) return false;
+    header.magic = getLE32(raw);
+    header.sequence = getLE32(raw + 4);
+    header.eraseCount = getLE32(raw + 8);
+    header.firstMs = getLE32(raw + 12);
+    return header.magic == TELEMETRY_LOG_MAGIC && header.sequence != ERASED_WORD;
+}
+
+bool TelemetryLog::isErased(uint32_t index) {
+    uint8_t chunk[256];
+    for (uint32_t offset = 0; offset < FLASH_SECTOR_SIZE; offset += sizeof(chunk)) {
+        if (!m_flash.read(index * FLASH_SECTOR_SIZE + offset, chunk, sizeof(chunk))) return false;
+        if (!allErased(chunk, sizeof(chunk))) return false;
+    }
+    return true;
+}
+
+// Claim the pre-erased sector after the head. The magic goes in last so a
+// header cut short is not mistaken for a valid one.
+bool TelemetryLog::openNext(uint32_t firstMs) {
+    uint32_t next = (m_headIndex + 1) % m_flash.sectorCount();
+    uint8_t raw[TELEMETRY_LOG_HEADER_SIZE];
+    putLE32(raw, TELEMETRY_LOG_MAGIC);
+    putLE32(raw + 4, m_headSeq + 1);
+    putLE32(raw + 8, m_nextEraseCount);
+    putLE32(raw + 12, firstMs);
+
+    m_nextErased = false;
+    if (!m_flash.write(next * FLASH_SECTOR_SIZE + 4, raw + 4, sizeof(raw) - 4) ||
+        !m_flash.write(next * FLASH_SECTOR_SIZE, raw, 4)) {
+        m_stats.writeErrors++;
+        return false;
+    }
+
+    if (!m_hasHead) m_tailSeq = m_headSeq + 1;
+    m_firstMs[next] = firstMs;
+    m_hasHead = true;
+    m_headIndex = next;
+    m_headSeq++;
+    m_writeOffset = TELEMETRY_LOG_HEADER_SIZE;
+    m_stats.bytes += TELEMETRY_LOG_HEADER_SIZE;
+    m_stats.usedSectors++;
+    if (m_nextEraseCount > m_stats.maxEraseCount) m_stats.maxEraseCount = m_nextEraseCount;
+    return true;
+}
+
+// Write position in the head sector: the first free record slot, or the
+// end of the sector if a torn record makes the rest of it unsafe to use
+uint32_t TelemetryLog::scanForEnd(uint32_t index) {
+    uint32_t base = index * FLASH_SECTOR_SIZE;
+    uint32_t offset = TELEMETRY_LOG_HEADER_SIZE;
+    while (offset + TELEMETRY_LOG_RECORD_HEADER <= FLASH_SECTOR_SIZE) {
+        uint8_t head[TELEMETRY_LOG_RECORD_HEADER];
+        if (!m_flash.read(base + offset, head, sizeof(head))) return FLASH_SECTOR_SIZE;
+        if (head[0] == RECORD_FREE) {
+            if (allErased(head, sizeof(head))) return offset;
+            m_stats.tornRecords++;
+            return FLASH_SECTOR_SIZE;
+        }
+
+        size_t len = head[1];
+        if (len == 0 || len > TELEMETRY_LOG_MAX_PAYLOAD || offset + recordSize(len) > FLASH_SECTOR_SIZE) {
+            m_stats.tornRecords++;
+            return FLASH_SECTOR_SIZE;
+        }
+        if (head[0] != RECORD_COMMITTED) m_stats.tornRecords++;
+        offset += recordSize(len);
+    }
+    return offset;
+}
+
+uint32_t TelemetryLog::indexOf(uint32_t sequence) const {
+    uint32_t n = m_flash.sectorCount();
+    return (m_headIndex + n - (m_headSeq - sequence) % n) % n;
+}
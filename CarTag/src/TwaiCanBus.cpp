@@ -0,0 +1,77 @@
+/**
+ * ESP32 TWAI (CAN 2.0) controller
+ */
+
+#ifndef CARTAG_NATIVE
+
+#include <Arduino.h>
+#include <string.h>
+#include "driver/twai.h"
+
+#include "TwaiCanBus.h"
+
+bool TwaiCanBus::begin() {
+    twai_general_config_t general = TWAI_GENERAL_CONFIG_DEFAULT(
+        (gpio_num_t)TWAI_TX_PIN, (gpio_num_t)TWAI_RX_PIN, TWAI_MODE_NORMAL);
+    general.rx_queue_len = 32;
+    twai_timing_config_t timing = TWAI_TIMING_CONFIG_500KBITS();
+
+    // Single filter, standard frame: the id sits in bits 31..21 and a set
+    // mask bit means "don't care", so only the low three id bits, RTR and
+    // the data bytes are left open
+    twai_filter_config_t filter;
+    filter.acceptance_code = (uint32_t)OBD_CAN_RESPONSE_ID << 21;
+    filter.acceptance_mask = ~((uint32_t)OBD_CAN_RESPONSE_MASK << 21);
+    filter.single_filter = true;
+
+    if (twai_driver_install(&general, &timing, &filter) != ESP_OK) return false;
+    m_started = twai_start() == ESP_OK;
+    return m_started;
+}
+
+bool TwaiCanBus::send(const CanFrame& frame, uint32_t timeoutMs) {
+    if (!m_started) return false;
+
+    twai_message_t message = {};
+    message.identifier = frame.id;
+    message.data_length_code = frame.length;
+    memcpy(message.data, frame.data, frame.length);
+
+    if (twai_transmit(&message, pdMS_TO_TICKS(timeoutMs)) != ESP_OK) {
+        m_stats.errors++;
+        recover();
+        return false;
+    }
+    m_stats.txFrames++;
+    return true;
+}
+
+bool TwaiCanBus::receive(CanFrame& frame, uint32_t timeoutMs) {
+    if (!m_started) return false;
+
+    twai_message_t message;
+    for (;;) {
+        if (twai_receive(&message, pdMS_TO_TICKS(timeoutMs)) != ESP_OK) return false;
+        // The filter runs on every frame, but extended ids can still alias it
+        if (!message.extd && !message.rtr && isObdResponseId(message.identifier)) break;
+        m_stats.filtered++;
+    }
+
+    frame.id = message.identifier;
+    frame.length = message.data_length_code > 8 ? 8 : message.data_length_code;
+    memcpy(frame.data, message.data, frame.length);
+    m_stats.rxFrames++;
+    return true;
+}
+
+void TwaiCanBus::recover() {
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK) return;
+    if (status.state == TWAI_STATE_BUS_OFF) {
+        twai_initiate_recovery();
+    } else if (status.state == TWAI_STATE_STOPPED) {
+        twai_start();
+    }
+}
+
+#endif
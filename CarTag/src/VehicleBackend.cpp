@@ -0,0 +1,21 @@
+/**
+ * Interface between the OBD-II engine and whatever talks to the car
+ */
+
+#include "VehicleBackend.h"
+
+uint8_t obdPidDataLength(uint8_t pid) {
+    switch (pid) {
+        case 0x00: case 0x01: case 0x20: case 0x40: case 0x60:
+            return 4;
+        case 0x03: case 0x0C: case 0x10: case 0x1F: case 0x21:
+        case 0x31: case 0x42: case 0x5E:
+            return 2;
+        case 0x04: case 0x05: case 0x06: case 0x07: case 0x08: case 0x09:
+        case 0x0A: case 0x0B: case 0x0D: case 0x0E: case 0x0F: case 0x11:
+        case 0x1C: case 0x2F: case 0x33: case 0x46: case 0x5C:
+            return 1;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,68 @@
+/**
+ * In-process CAN loopback
+ */
+
+#include "VirtualCanBus.h"
+
+bool VirtualCanBus::attach(CanNode* node) {
+    if (m_nodeCount == VIRTUAL_CAN_MAX_NODES) return false;
+    m_nodes[m_nodeCount++] = node;
+    return true;
+}
+
+bool VirtualCanBus::send(const CanFrame& frame, uint32_t timeoutMs) {
+    (void)timeoutMs;
+    m_stats.txFrames++;
+    for (size_t i = 0; i < m_nodeCount; i++) m_nodes[i]->onFrame(frame, *this);
+    return true;
+}
+
+bool VirtualCanBus::receive(CanFrame& frame, uint32_t timeoutMs) {
+    (void)timeoutMs;
+    if (!m_rx.pop(frame)) return false;
+    m_stats.rxFrames++;
+    return true;
+}
+
+void VirtualCanBus::inject(const CanFrame& frame) {
+    if (!isObdResponseId(frame.id)) {
+        m_stats.filtered++;
+        return;
+    }
+    if (!m_rx.push(frame)) m_stats.errors++;
+}
+
+void CanEcuNode::onFrame(const CanFrame& frame, VirtualCanBus& bus) {
+    uint32_t physicalId = m_responseId - OBD_CAN_PHYSICAL_OFFSET;
+    if (frame.id != OBD_CAN_FUNCTIONAL_ID && frame.id != physicalId) return;
+
+    if (frame.length > 0 && (frame.data[0] & 0xF0) == ISOTP_FLOW_CONTROL) {
+        if (m_tx.waitingForFlowControl() && m_tx.onFlowControl(frame)) transmit(bus);
+        return;
+    }
+
+    IsoTpRxResult result = m_rx.feed(frame);
+    if (result == ISOTP_RX_SEND_FLOW_CONTROL) {
+        CanFrame fc;
+        isoTpFlowControl(fc, ISOTP_FC_CONTINUE, 0, 0);
+        fc.id = m_responseId;
+        bus.inject(fc);
+        return;
+    }
+    if (result != ISOTP_RX_COMPLETE) return;
+
+    // Unsupported requests go unanswered, as ECUs do on the functional address
+    uint8_t resp[ISOTP_MAX_MESSAGE];
+    size_t respLen = 0;
+    if (m_ecu.request(m_rx.data(), m_rx.length(), resp, sizeof(resp), respLen) != OBD_OK) return;
+    if (m_tx.start(resp, respLen)) transmit(bus);
+}
+
+// Separation time is ignored: the loopback has no receiver to overrun
+void CanEcuNode::transmit(VirtualCanBus& bus) {
+    CanFrame frame;
+    while (m_tx.next(frame)) {
+        frame.id = m_responseId;
+        bus.inject(frame);
+    }
+}
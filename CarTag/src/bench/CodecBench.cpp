@@ -0,0 +1,239 @@
+/**
+ * Host benchmark for the compressed telemetry blocks in TelemetryCodec.h
+ *
+ * Encodes two synthetic 50 Hz traces three ways: single 0xCA frames, 0xCB
+ * batches and 0xCE compressed blocks, the last two packed into
+ * notification-sized payloads. Reports bytes per sample and compression
+ * ratio against frames, encode and decode cost per sample, and checks that
+ * every block decodes back to the samples it was built from.
+ *
+ *   battery  battery channel only: slow discharge with ADC noise
+ *   obd      battery, rpm, speed, coolant and load; the PIDs only change
+ *            every ~100 ms, like a PidScheduler round, and sample times
+ *            jitter by a millisecond now and then
+ *
+ * Built only in the native_codec_bench environment.
+ * Usage: pio run -e native_codec_bench && .pio/build/native_codec_bench/program
+ *        [--samples N] [--payload BYTES]
+ */
+
+#ifdef CARTAG_CODEC_BENCH
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "TelemetryBatcher.h"
+#include "TelemetryCodec.h"
+#include "TelemetryFrame.h"
+
+namespace {
+
+const uint32_t SAMPLE_MS = 20;
+const int TIMING_RUNS = 5;
+
+volatile size_t g_sink;
+
+uint32_t nextNoise(uint32_t& state) {
+    state = state * 1103515245u + 12345u;
+    return state >> 16;
+}
+
+TelemetrySample baseSample(uint32_t timestampMs) {
+    TelemetrySample s = {};
+    s.timestampMs = timestampMs;
+    s.timestampUs = (uint64_t)timestampMs * 1000;
+    return s;
+}
+
+std::vector<TelemetrySample> makeBatteryTrace(size_t n) {
+    std::vector<TelemetrySample> out(n);
+    uint32_t noise = 1;
+    for (size_t i = 0; i < n; i++) {
+        TelemetrySample s = baseSample(1000 + i * SAMPLE_MS);
+        double mv = 4150 - 600.0 * i / n;
+        s.batteryLevel = (uint8_t)std::max(0L, lround((mv - 3300) / 8.5));
+        s.flags = s.batteryLevel < 20 ? TELEMETRY_FLAG_LOW_BATTERY : 0;
+        s.channelMask = 1u << CHANNEL_BATTERY_MV;
+        s.channels[CHANNEL_BATTERY_MV] = (int16_t)(lround(mv) + (int)(nextNoise(noise) % 7) - 3);
+        out[i] = s;
+    }
+    return out;
+}
+
+std::vector<TelemetrySample> makeObdTrace(size_t n) {
+    std::vector<TelemetrySample> out(n);
+    uint32_t noise = 7;
+    uint32_t t = 1000;
+    int16_t rpm = 800, speed = 0, coolant = 40, load = 20, mv = 14100;
+    for (size_t i = 0; i < n; i++) {
+        // Mostly on time; the sample task is late by a millisecond sometimes
+        t += SAMPLE_MS;
+        uint32_t jitter = nextNoise(noise) % 16 == 0 ? 1 : 0;
+        TelemetrySample s = baseSample(t + jitter);
+
+        // One PID round every five samples
+        if (i % 5 == 0) {
+            double phase = 2 * M_PI * i / 3000.0;
+            speed = (int16_t)lround(60 + 50 * sin(phase));
+            rpm = (int16_t)(lround(800 + speed * 35 + 200 * sin(phase * 7)) / 4 * 4);
+            load = (int16_t)(25 + nextNoise(noise) % 40);
+            if (coolant < 90 && i % 250 == 0) coolant++;
+            mv = (int16_t)(14100 + (int)(nextNoise(noise) % 61) - 30);
+        }
+        s.batteryLevel = 100;
+        s.channelMask = (1u << CHANNEL_BATTERY_MV) | (1u << CHANNEL_RPM) | (1u << CHANNEL_SPEED_KMH) |
+                        (1u << CHANNEL_COOLANT_C) | (1u << CHANNEL_LOAD_PCT);
+        s.channels[CHANNEL_BATTERY_MV] = mv;
+        s.channels[CHANNEL_RPM] = rpm;
+        s.channels[CHANNEL_SPEED_KMH] = speed;
+        s.channels[CHANNEL_COOLANT_C] = coolant;
+        s.channels[CHANNEL_LOAD_PCT] = load;
+        out[i] = s;
+    }
+    return out;
+}
+
+// Best-of-N wall time per sample for one pass of run()
+template <typename Run>
+double nsPerSample(size_t n, Run run) {
+    double best = 1e30;
+    for (int r = 0; r < TIMING_RUNS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ns / n);
+    }
+    return best;
+}
+
+size_t frameBytes(const std::vector<TelemetrySample>& in) {
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    size_t total = 0;
+    for (size_t i = 0; i < in.size(); i++) total += encodeTelemetryFrame(in[i], (uint16_t)i, frame, sizeof(frame));
+    return total;
+}
+
+// Same packing rule as TelemetryBatcher: records until the payload is full
+size_t batchBytes(const std::vector<TelemetrySample>& in, size_t payload) {
+    std::vector<uint8_t> batch(payload);
+    size_t total = 0, i = 0;
+    while (i < in.size()) {
+        uint32_t baseMs = in[i].timestampMs;
+        size_t len = TELEMETRY_BATCH_HEADER_SIZE;
+        uint8_t count = 0;
+        while (i < in.size() && count < 255 && in[i].timestampMs - baseMs <= 0xFFFF &&
+               len + telemetryBatchRecordSize(in[i].channelMask) <= payload) {
+            len += writeTelemetryBatchRecord(&batch[len], in[i], baseMs);
+            count++;
+            i++;
+        }
+        writeTelemetryBatchHeader(&batch[0], 0, baseMs, count, in[i - 1].channelMask);
+        total += len;
+    }
+    return total;
+}
+
+// Encode the trace into blocks of at most payload bytes, appended to out
+void encodeBlocks(const std::vector<TelemetrySample>& in, size_t payload,
+                  std::vector<std::vector<uint8_t>>& out) {
+    std::vector<uint8_t> block(payload);
+    TelemetryBlockEncoder encoder;
+    out.clear();
+    encoder.begin(&block[0], payload, 0);
+    for (size_t i = 0; i < in.size(); i++) {
+        if (encoder.add(in[i])) continue;
+        size_t len = encoder.finish();
+        out.emplace_back(block.begin(), block.begin() + len);
+        encoder.begin(&block[0], payload, (uint16_t)i);
+        encoder.add(in[i]);
+    }
+    size_t len = encoder.finish();
+    if (len) out.emplace_back(block.begin(), block.begin() + len);
+}
+
+bool sameSample(const TelemetrySample& a, const TelemetrySample& b) {
+    if (a.timestampMs != b.timestampMs || a.batteryLevel != b.batteryLevel ||
+        a.flags != b.flags || a.channelMask != b.channelMask) {
+        return false;
+    }
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+        if ((a.channelMask & (1u << ch)) && a.channels[ch] != b.channels[ch]) return false;
+    }
+    return true;
+}
+
+void benchTrace(const char* name, const std::vector<TelemetrySample>& in, size_t payload) {
+    size_t n = in.size();
+    size_t frames = frameBytes(in);
+    size_t batches = batchBytes(in, payload);
+
+    std::vector<std::vector<uint8_t>> blocks;
+    double encodeNs = nsPerSample(n, [&]() { encodeBlocks(in, payload, blocks); });
+    size_t blockTotal = 0;
+    for (const auto& b : blocks) blockTotal += b.size();
+
+    std::vector<TelemetrySample> decoded(n);
+    size_t decodedCount = 0;
+    double decodeNs = nsPerSample(n, [&]() {
+        decodedCount = 0;
+        for (const auto& b : blocks) {
+            decodedCount += decodeTelemetryBlock(b.data(), b.size(), &decoded[decodedCount],
+                                                 n - decodedCount);
+        }
+    });
+
+    size_t mismatches = decodedCount == n ? 0 : n;
+    for (size_t i = 0; i < decodedCount && i < n; i++) {
+        if (!sameSample(in[i], decoded[i])) mismatches++;
+    }
+
+    printf("%-8s %-12s %10zu %8.2f %8s\n", name, "0xCA frames", frames, (double)frames / n, "1.0x");
+    printf("%-8s %-12s %10zu %8.2f %7.1fx\n", "", "0xCB batches", batches, (double)batches / n,
+           (double)frames / batches);
+    printf("%-8s %-12s %10zu %8.2f %7.1fx   %zu blocks, %.0f samples/block, "
+           "encode %.1f ns/sample, decode %.1f ns/sample, round trip %s\n",
+           "", "0xCE blocks", blockTotal, (double)blockTotal / n, (double)frames / blockTotal,
+           blocks.size(), (double)n / blocks.size(), encodeNs, decodeNs,
+           mismatches ? "FAILED" : "ok");
+    g_sink += blockTotal + mismatches;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t samples = 100000;
+    size_t payload = 244;   // 247-byte MTU
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            samples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--payload" && i + 1 < argc) {
+            payload = strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--samples N] [--payload BYTES]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (samples == 0 || payload < TELEMETRY_BLOCK_HEADER_SIZE + TELEMETRY_BLOCK_MAX_SAMPLE_SIZE ||
+        payload > TELEMETRY_BATCH_MAX_PAYLOAD) {
+        fprintf(stderr, "samples must be > 0 and payload %d..%d bytes\n",
+                TELEMETRY_BLOCK_HEADER_SIZE + TELEMETRY_BLOCK_MAX_SAMPLE_SIZE,
+                TELEMETRY_BATCH_MAX_PAYLOAD);
+        return 2;
+    }
+
+    printf("---- TelemetryCodec benchmark, %zu samples at %u ms, %zu-byte payloads ----\n",
+           samples, (unsigned)SAMPLE_MS, payload);
+    printf("%-8s %-12s %10s %8s %8s\n", "trace", "encoding", "bytes", "B/sample", "ratio");
+    benchTrace("battery", makeBatteryTrace(samples), payload);
+    benchTrace("obd", makeObdTrace(samples), payload);
+    return 0;
+}
+
+#endif
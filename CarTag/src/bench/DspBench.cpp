@@ -0,0 +1,252 @@
+/**
+ * Host benchmark for the fixed-point filter kernels in FixedDsp.h
+ *
+ * Runs every kernel over the same synthetic 12-bit sensor signal (slow
+ * wave, fast wave, noise and occasional spikes) next to a double
+ * precision reference of the same filter, then reports the cost per
+ * sample of both and the fixed-point error in LSB.
+ *
+ * Built only in the native_bench environment.
+ * Usage: pio run -e native_bench && .pio/build/native_bench/program [--samples N]
+ */
+
+#ifdef CARTAG_DSP_BENCH
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "FixedDsp.h"
+
+namespace {
+
+const double SAMPLE_HZ = 1000.0;
+const int TIMING_RUNS = 5;
+
+volatile int64_t g_sink;
+
+std::vector<int32_t> makeSignal(size_t n) {
+    std::vector<int32_t> out(n);
+    uint32_t noise = 1;
+    for (size_t i = 0; i < n; i++) {
+        double t = i / SAMPLE_HZ;
+        double v = 2048 + 1500 * sin(2 * M_PI * 5 * t) + 300 * sin(2 * M_PI * 180 * t);
+        noise = noise * 1103515245u + 12345u;
+        v += (int32_t)((noise >> 16) % 101) - 50;
+        if (i % 997 == 0) v += 1800;  // spike
+        out[i] = (int32_t)lround(v < 0 ? 0 : v > 4095 ? 4095 : v);
+    }
+    return out;
+}
+
+// Best-of-N wall time per input sample for one pass of run()
+template <typename Run>
+double nsPerSample(size_t n, Run run) {
+    double best = 1e30;
+    for (int r = 0; r < TIMING_RUNS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ns / n);
+    }
+    return best;
+}
+
+struct Result {
+    const char* name;
+    double fixedNs;
+    double doubleNs;
+    double maxErr;
+    double rmsErr;
+};
+
+// Compare outputs sample by sample; both vectors have the same length
+Result compare(const char* name, double fixedNs, double doubleNs,
+               const std::vector<int32_t>& fixed, const std::vector<double>& reference) {
+    double maxErr = 0, sumSq = 0;
+    for (size_t i = 0; i < fixed.size(); i++) {
+        double err = fabs(fixed[i] - reference[i]);
+        maxErr = std::max(maxErr, err);
+        sumSq += err * err;
+    }
+    return {name, fixedNs, doubleNs, maxErr, fixed.empty() ? 0 : sqrt(sumSq / fixed.size())};
+}
+
+Result benchMovingAverage(const std::vector<int32_t>& in) {
+    const size_t N = 16;
+    std::vector<int32_t> fixed;
+    std::vector<double> reference;
+
+    double fixedNs = nsPerSample(in.size(), [&]() {
+        dsp::MovingAverage<int32_t, N> filter;
+        fixed.clear();
+        for (int32_t x : in) fixed.push_back(filter.push(x));
+    });
+    double doubleNs = nsPerSample(in.size(), [&]() {
+        double window[N] = {};
+        double sum = 0;
+        size_t pos = 0;
+        reference.clear();
+        for (int32_t x : in) {
+            sum += x - window[pos];
+            window[pos] = x;
+            pos = (pos + 1) % N;
+            reference.push_back(sum / N);
+        }
+    });
+    return compare("MovingAverage<16>", fixedNs, doubleNs, fixed, reference);
+}
+
+Result benchOnePole(const std::vector<int32_t>& in) {
+    std::vector<int32_t> fixed;
+    std::vector<double> reference;
+
+    double fixedNs = nsPerSample(in.size(), [&]() {
+        dsp::OnePoleLowPass<4> filter;
+        fixed.clear();
+        for (int32_t x : in) fixed.push_back(filter.push(x));
+    });
+    double doubleNs = nsPerSample(in.size(), [&]() {
+        double y = in.empty() ? 0 : in[0];
+        reference.clear();
+        for (int32_t x : in) {
+            y += (x - y) / 16.0;
+            reference.push_back(y);
+        }
+    });
+    return compare("OnePoleLowPass<4>", fixedNs, doubleNs, fixed, reference);
+}
+
+Result benchBiquad(const std::vector<int32_t>& in) {
+    const dsp::BiquadDesign design = dsp::designLowPass(50, SAMPLE_HZ);
+    std::vector<int32_t> fixed;
+    std::vector<double> reference;
+
+    double fixedNs = nsPerSample(in.size(), [&]() {
+        dsp::BiquadCascade<2> filter;
+        filter.setStage(0, design);
+        filter.setStage(1, design);
+        fixed.clear();
+        for (int32_t x : in) fixed.push_back(filter.push(x));
+    });
+    double doubleNs = nsPerSample(in.size(), [&]() {
+        double state[2][4] = {};
+        reference.clear();
+        for (int32_t sample : in) {
+            double x = sample;
+            for (auto& s : state) {
+                double y = design.b0 * x + design.b1 * s[0] + design.b2 * s[1] -
+                           design.a1 * s[2] - design.a2 * s[3];
+                s[1] = s[0];
+                s[0] = x;
+                s[3] = s[2];
+                s[2] = y;
+                x = y;
+            }
+            reference.push_back(x);
+        }
+    });
+    return compare("BiquadCascade<2> 50 Hz", fixedNs, doubleNs, fixed, reference);
+}
+
+Result benchCic(const std::vector<int32_t>& in) {
+    const int ORDER = 3;
+    const uint32_t R = 8;
+    std::vector<int32_t> fixed;
+    std::vector<double> reference;
+
+    double fixedNs = nsPerSample(in.size(), [&]() {
+        dsp::CicDecimator<ORDER, R> filter;
+        fixed.clear();
+        int32_t out;
+        for (int32_t x : in) {
+            if (filter.push(x, out)) fixed.push_back(out);
+        }
+    });
+    // Reference: direct convolution with the CIC impulse response, R-long
+    // boxcars convolved ORDER times. Running integrators in double would
+    // lose precision once they grow past 2^53.
+    std::vector<double> h(1, 1.0);
+    for (int k = 0; k < ORDER; k++) {
+        std::vector<double> next(h.size() + R - 1, 0.0);
+        for (size_t i = 0; i < h.size(); i++) {
+            for (uint32_t j = 0; j < R; j++) next[i + j] += h[i] / R;
+        }
+        h = next;
+    }
+    double doubleNs = nsPerSample(in.size(), [&]() {
+        reference.clear();
+        for (size_t n = R - 1; n < in.size(); n += R) {
+            double acc = 0;
+            for (size_t k = 0; k < h.size() && k <= n; k++) acc += h[k] * in[n - k];
+            reference.push_back(acc);
+        }
+    });
+    return compare("CicDecimator<3, 8>", fixedNs, doubleNs, fixed, reference);
+}
+
+Result benchMedian(const std::vector<int32_t>& in) {
+    const size_t N = 5;
+    std::vector<int32_t> fixed;
+    std::vector<double> reference;
+
+    double fixedNs = nsPerSample(in.size(), [&]() {
+        dsp::MedianFilter<int32_t, N> filter;
+        fixed.clear();
+        for (int32_t x : in) fixed.push_back(filter.push(x));
+    });
+    double doubleNs = nsPerSample(in.size(), [&]() {
+        double window[N];
+        size_t count = 0, pos = 0;
+        reference.clear();
+        for (int32_t x : in) {
+            window[pos] = x;
+            pos = (pos + 1) % N;
+            if (count < N) count++;
+            double sorted[N];
+            std::copy(window, window + count, sorted);
+            std::nth_element(sorted, sorted + count / 2, sorted + count);
+            reference.push_back(sorted[count / 2]);
+        }
+    });
+    return compare("MedianFilter<5>", fixedNs, doubleNs, fixed, reference);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t samples = 1000000;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--samples" && i + 1 < argc) {
+            samples = strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--samples N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<int32_t> in = makeSignal(samples);
+    Result results[] = {
+        benchMovingAverage(in),
+        benchOnePole(in),
+        benchBiquad(in),
+        benchCic(in),
+        benchMedian(in),
+    };
+
+    printf("---- FixedDsp benchmark, %zu samples ----\n", samples);
+    printf("%-24s %12s %12s %10s %10s\n", "kernel", "fixed ns/s", "double ns/s", "max LSB", "rms LSB");
+    for (const Result& r : results) {
+        printf("%-24s %12.2f %12.2f %10.3f %10.3f\n", r.name, r.fixedNs, r.doubleNs,
+               r.maxErr, r.rmsErr);
+        g_sink += (int64_t)r.maxErr;
+    }
+    return 0;
+}
+
+#endif
@@ -10,6 +10,49 @@
 #include <BLEServer.h>
 #include <BLEUtils.h>
 #include <BLE2902.h>
+#include <BLESecurity.h>
+#include <Preferences.h>
+#ifndef CARTAG_NATIVE
+#include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
+#include <soc/soc_caps.h>
+#endif
+
+#include "Advertiser.h"
+#include "AdvertisingManager.h"
+#include "BatteryMonitor.h"
+#include "BondTable.h"
+#include "CommandDispatcher.h"
+#include "CommandQueue.h"
+#include "ConnectionManager.h"
+#include "DeviceConfig.h"
+#include "Elm327.h"
+#include "EventTask.h"
+#include "IgnitionSense.h"
+#include "LinkNegotiator.h"
+#include "LogSyncService.h"
+#include "NusService.h"
+#include "PeerTable.h"
+#include "PidScheduler.h"
+#ifdef CARTAG_NATIVE
+#include "RamFlash.h"
+#else
+#include "PartitionFlash.h"
+#endif
+#include "SampleTimer.h"
+#include "SimulatedEcu.h"
+#include "SpscQueue.h"
+#if defined(CARTAG_CAN_TWAI)
+#include "CanObdBackend.h"
+#include "TwaiCanBus.h"
+#elif defined(CARTAG_CAN_LOOPBACK)
+#include "CanObdBackend.h"
+#include "VirtualCanBus.h"
+#endif
+#include "TelemetryBatcher.h"
+#include "TelemetryBeacon.h"
+#include "TelemetryFrame.h"
+#include "TelemetryLog.h"
 
 // Define UUIDs for the BLE service and characteristics
 // You can generate your own UUIDs at https://www.uuidgenerator.net/
@@ -18,55 +61,1256 @@
 
 BLEServer* pServer = NULL;
 BLECharacteristic* pCharacteristic = NULL;
-bool deviceConnected = false;
+
+// Connectable advertising, plus the latest sample in the advertising data
+// every CONFIG_BROADCAST_MS for scanners that never connect. The BLE event
+// task runs the advertising state machine from queued connection and GAP
+// events, so no callback ever restarts advertising or waits for the stack.
+Advertiser advertiser;
+AdvertisingManager advertisingManager;
+
+// Centrals that bonded, saved in NVS. One whose link drops gets directed
+// advertising straight away, and a Service Changed indication when it
+// comes back if it last saw another GATT database. Build with
+// -D CARTAG_NO_BONDING to connect without pairing, as before.
+BondTable bonds;
+Preferences nvs;
+
+// Up to CARTAG_MAX_PEERS centrals at once. The BLE callbacks keep the count
+// and which connection ids are up; everything else about a connection lives
+// in its PeerTable slot.
+volatile uint8_t connectedCount = 0;
+volatile uint32_t connectedIds = 0;
 bool oldDeviceConnected = false;
+bool deviceConnected() { return connectedCount > 0; }
 
-// Battery simulation variables
-int batteryLevel = 100;
-int updateCount = 0;
+// Battery voltage from the ADC (or the simulated cell), sampled and
+// filtered in the background; the level is logged, and sent as text in
+// ASCII mode, every 2 seconds
+BatteryMonitor batteryMonitor;
 unsigned long lastUpdateTime = 0;
 const unsigned long UPDATE_INTERVAL = 2000;  // 2 seconds
 
+// Ignition line, polled with the battery; it moves advertising between the
+// driving and parked profiles, and its coming on opens a discovery window
+IgnitionSense ignition;
+
+// Runtime settings (telemetry format, sample interval, batch latency, streaming).
+// Binary frames are the default; build with -D CARTAG_TELEMETRY_ASCII to keep
+// the "<battery>%" text for older app builds.
+DeviceConfig deviceConfig;
+
+// Binary telemetry is sampled every CONFIG_SAMPLE_INTERVAL_MS and sent in
+// batches sized to each central's negotiated MTU; a batch never waits
+// longer than CONFIG_BATCH_LATENCY_MS. Every central reads the same ring.
+const uint16_t PREFERRED_MTU = 517;
+TelemetryBatcher telemetryBatcher(BATCH_MAX_LATENCY_MS);
+
+// The sample timer interrupt queues each tick's timestamp; the sampler
+// reads the sensors for every queued tick, so samples keep the timer's
+// spacing even when the task runs late
+SampleTimer sampleTimer;
+SpscQueue<uint64_t, 64> sampleTicks;
+volatile uint32_t droppedSampleTicks = 0;
+
+// Samples handed from the sampling task to the publishing task
+SpscQueue<TelemetrySample, 32> sampleQueue;
+
+// While no central is connected, samples go to the flash log instead. The
+// logger task owns the log, and does its sector erases, so the sampler
+// only ever pushes onto this queue; it holds a few seconds of samples,
+// well over the time one erase takes.
+#ifdef CARTAG_NATIVE
+const uint32_t NATIVE_LOG_SECTORS = 64;
+RamFlash logFlash(NATIVE_LOG_SECTORS);
+#else
+PartitionFlash logFlash;
+#endif
+TelemetryLog telemetryLog(logFlash);
+SpscQueue<TelemetrySample, 128> logQueue;
+volatile uint32_t droppedLogSamples = 0;
+
+// The app downloads the log through its own service; the logger task runs
+// the transfer since it owns the log
+LogSyncService logSync(telemetryLog);
+volatile bool logSyncActive = false;
+
+// Connection parameters follow each central's workload (idle, streaming,
+// race, log download), and every new link asks for 2M PHY and 251-byte
+// PDUs. The BLE callbacks queue connection changes, subscriptions and what
+// the central granted; the BLE event task owns the peer table and the
+// policy, and sends requests.
+enum ConnEventType : uint8_t {
+    CONN_EVENT_CONNECT,      // interval, latency, timeout
+    CONN_EVENT_UPDATE,       // interval, latency, timeout
+    CONN_EVENT_DISCONNECT,   // status: reason
+    CONN_EVENT_MTU,          // mtu
+    CONN_EVENT_PHY,          // tx phy, rx phy
+    CONN_EVENT_DATA_LENGTH,  // tx octets, rx octets
+    CONN_EVENT_SUBSCRIBE,    // PeerSubscription, 1 for on
+    CONN_EVENT_BONDED,       // address type; status: pairing failure reason
+    CONN_EVENT_ADVERTISING,  // status: connectable advertising start complete
+};
+struct ConnEvent {
+    ConnEventType type;
+    uint8_t status;
+    uint16_t connId;     // PEER_NO_CONN for GAP events, which carry the address
+    uint8_t address[6];
+    uint16_t value[3];
+};
+PeerTable peers;
+
+// A connection queues about five events as it comes up (connect, MTU,
+// parameters, data length, PHY), one when it pairs, and one per CCCD
+// write. The last slots are kept for connects and disconnects; should even
+// those overflow, the BLE task reconciles the peer table against
+// connectedIds.
+#ifndef CONN_EVENTS_PER_PEER
+#define CONN_EVENTS_PER_PEER 10
+#endif
+constexpr size_t CONN_EVENT_RESERVE = 2 * CARTAG_MAX_PEERS;
+constexpr size_t queueCapacity(size_t n, size_t capacity = 2) {
+    return capacity >= n ? capacity : queueCapacity(n, capacity * 2);
+}
+SpscQueue<ConnEvent, queueCapacity(CARTAG_MAX_PEERS * CONN_EVENTS_PER_PEER + CONN_EVENT_RESERVE)>
+    connEvents;
+volatile uint32_t connEventDrops = 0;  // written by the BLE host task only
+uint32_t reportedConnEventDrops = 0;
+
+// Guards the peer table and the bond table. Held while notifying, so a slot is never reused
+// for another central halfway through a send.
+TaskLock peerLock;
+
+// CCCD handles of the characteristics whose subscriptions are tracked per
+// central, filled in by setup()
+struct WatchedCccd {
+    uint16_t handle;
+    PeerSubscription subscription;
+};
+WatchedCccd watchedCccds[4];
+size_t watchedCccdCount = 0;
+
+// Writes from the app, handed from the BLE task to loop()
+CommandQueue commandQueue;
+uint32_t reportedCommandDrops = 0;
+
+// Nordic UART Service used by the app's OBD screen, answered by an ELM327
+// style interpreter. The simulated ECU stands in for the car by default;
+// CARTAG_CAN_TWAI talks to the OBD-II CAN bus through the TWAI controller,
+// and CARTAG_CAN_LOOPBACK puts the simulated ECU behind the same CAN/ISO-TP
+// stack on a virtual bus.
+NusService nus;
+#if defined(CARTAG_CAN_TWAI)
+TwaiCanBus canBus;
+CanObdBackend vehicle(canBus);
+#elif defined(CARTAG_CAN_LOOPBACK)
+SimulatedEcu simulatedEcu;
+CanEcuNode simulatedEcuNode(simulatedEcu);
+VirtualCanBus canBus;
+CanObdBackend vehicle(canBus);
+#else
+SimulatedEcu vehicle;
+#endif
+Elm327 elm(vehicle, nus.tx());
+
+// PIDs the app subscribed to with ATSUB are polled here and only the results
+// are pushed; the latest values also ride along as telemetry channels
+void onPidResult(const uint8_t* resp, size_t len);
+PidScheduler pidScheduler(vehicle, onPidResult);
+uint16_t obdChannelMask = 0;
+int16_t obdChannels[TELEMETRY_MAX_CHANNELS];
+
+TelemetrySample readSample(uint64_t timestampUs);
+TelemetrySample snapshotSample() { return readSample(SampleTimer::nowUs()); }
+CommandDispatcher commandDispatcher({&deviceConfig, snapshotSample, &sampleTimer.jitter(),
+                                     &batteryMonitor, &peers, &bonds, &advertisingManager,
+                                     PEER_NO_CONN});
+
+// Work is split into tasks that sleep until a BLE callback or another task
+// signals them, or until their own next deadline. Sampling runs on the
+// application core at the highest priority so it never waits behind the
+// BLE controller and host on the protocol core. Build with
+// -D CARTAG_LEGACY_LOOP to run everything from the polling loop() instead.
+enum TaskEvent : uint32_t {
+    EVENT_CONNECTED    = 1 << 0,
+    EVENT_DISCONNECTED = 1 << 1,
+    EVENT_COMMAND      = 1 << 2,  // write queued on the battery characteristic
+    EVENT_NUS_RX       = 1 << 3,  // bytes written to the NUS RX pipe
+    EVENT_SAMPLE       = 1 << 4,  // sample queued for publishing
+    EVENT_CONFIG       = 1 << 5,  // a command may have changed the settings
+    EVENT_SAMPLE_TICK  = 1 << 6,  // the sample timer fired
+    EVENT_LOG          = 1 << 7,  // sample queued for the flash log
+    EVENT_SYNC         = 1 << 8,  // log sync control write
+    EVENT_WORKLOAD     = 1 << 9,  // streaming, PID polls or log sync changed
+    EVENT_CONN_PARAMS  = 1 << 10, // the central updated the connection parameters
+    EVENT_IGNITION     = 1 << 11, // the ignition came on or went off
+};
+
+uint32_t bleTaskHandler(uint32_t events, uint32_t now);
+uint32_t samplerTaskHandler(uint32_t events, uint32_t now);
+uint32_t publisherTaskHandler(uint32_t events, uint32_t now);
+uint32_t commandTaskHandler(uint32_t events, uint32_t now);
+uint32_t batteryTaskHandler(uint32_t events, uint32_t now);
+uint32_t loggerTaskHandler(uint32_t events, uint32_t now);
+
+EventTask bleTask("ble_events", bleTaskHandler, 4, EVENT_TASK_CORE_PROTOCOL, 3072);
+EventTask samplerTask("sampler", samplerTaskHandler, 5, EVENT_TASK_CORE_APP, 3072);
+EventTask publisherTask("publisher", publisherTaskHandler, 3, EVENT_TASK_CORE_APP, 4096);
+EventTask commandTask("commands", commandTaskHandler, 3, EVENT_TASK_CORE_APP, 8192);
+EventTask batteryTask("battery", batteryTaskHandler, 2, EVENT_TASK_CORE_APP, 3072);
+EventTask loggerTask("logger", loggerTaskHandler, 1, EVENT_TASK_CORE_APP, 4096);
+
+void queueConnEvent(ConnEventType type, uint8_t status, uint16_t connId, const uint8_t* address,
+                    uint16_t v0 = 0, uint16_t v1 = 0, uint16_t v2 = 0) {
+    bool lifecycle = type == CONN_EVENT_CONNECT || type == CONN_EVENT_DISCONNECT;
+    if (!lifecycle && connEvents.size() >= connEvents.capacity() - CONN_EVENT_RESERVE) {
+        connEventDrops++;
+        return;
+    }
+    ConnEvent event = {type, status, connId, {}, {v0, v1, v2}};
+    if (address) memcpy(event.address, address, sizeof(event.address));
+    if (!connEvents.push(event)) connEventDrops++;
+}
+
+uint32_t connIdBit(uint16_t connId) { return connId < 32 ? 1u << connId : 0; }
+
 // Callback class to handle connection events
 class MyServerCallbacks : public BLEServerCallbacks {
-    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t *param) {
-        deviceConnected = true;
-        Serial.println("Device connected");
-        
-        // Update connection parameters for stability
-        // min interval, max interval, latency, timeout (in units of 1.25ms, 1.25ms, intervals, 10ms)
-        pServer->updateConnParams(param->connect.remote_bda, 24, 48, 0, 400);
+    void onConnect(BLEServer*, esp_ble_gatts_cb_param_t* param) {
+        // The BLE task gives it a peer slot and picks connection parameters
+        // for the workload. Queued first, so the BLE task never sees the
+        // connection up without its event on the way.
+        queueConnEvent(CONN_EVENT_CONNECT, 0, param->connect.conn_id, param->connect.remote_bda,
+                       param->connect.conn_params.interval, param->connect.conn_params.latency,
+                       param->connect.conn_params.timeout);
+        connectedCount++;
+        connectedIds |= connIdBit(param->connect.conn_id);
+        bleTask.signal(EVENT_CONNECTED);
     }
 
-    void onDisconnect(BLEServer* pServer) {
-        deviceConnected = false;
-        Serial.println("Device disconnected");
-        
-        // Immediately restart advertising on disconnect
-        // This helps recovery when client disconnects unexpectedly
-        delay(100);  // Brief delay for BLE stack
-        pServer->startAdvertising();
-        Serial.println("Auto-restarted advertising after disconnect");
+    // The central drives the MTU exchange; we advertise PREFERRED_MTU as our
+    // limit in setup() and size its telemetry batches to whatever it settles on
+    void onMtuChanged(BLEServer*, esp_ble_gatts_cb_param_t* param) {
+        queueConnEvent(CONN_EVENT_MTU, 0, param->mtu.conn_id, nullptr, param->mtu.mtu);
+        bleTask.signal(EVENT_CONN_PARAMS);
+    }
+
+    void onDisconnect(BLEServer*, esp_ble_gatts_cb_param_t* param) {
+        queueConnEvent(CONN_EVENT_DISCONNECT, (uint8_t)param->disconnect.reason, param->disconnect.conn_id,
+                       nullptr);
+        connectedCount--;
+        connectedIds &= ~connIdBit(param->disconnect.conn_id);
+        // The BLE event task restarts advertising without blocking this callback
+        bleTask.signal(EVENT_DISCONNECTED);
     }
 };
 
+// Connection parameters, data length and PHY granted (or refused) by the
+// central, the outcome of pairing or of encrypting with stored keys, and
+// whether connectable advertising started
+void onGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    uint8_t status;
+    switch (event) {
+        case ESP_GAP_BLE_AUTH_CMPL_EVT:
+            queueConnEvent(CONN_EVENT_BONDED,
+                           param->ble_security.auth_cmpl.success ? 0 : param->ble_security.auth_cmpl.fail_reason,
+                           PEER_NO_CONN, param->ble_security.auth_cmpl.bd_addr,
+                           param->ble_security.auth_cmpl.addr_type);
+            break;
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+            queueConnEvent(CONN_EVENT_UPDATE, (uint8_t)param->update_conn_params.status, PEER_NO_CONN,
+                           param->update_conn_params.bda, param->update_conn_params.conn_int,
+                           param->update_conn_params.latency, param->update_conn_params.timeout);
+            break;
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+            // No address in this one; the BLE task matches it to the pending request
+            queueConnEvent(CONN_EVENT_DATA_LENGTH, (uint8_t)param->pkt_data_length_cmpl.status,
+                           PEER_NO_CONN, nullptr, param->pkt_data_length_cmpl.params.tx_len,
+                           param->pkt_data_length_cmpl.params.rx_len);
+            break;
+#if SOC_BLE_50_SUPPORTED
+        case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+            queueConnEvent(CONN_EVENT_PHY, (uint8_t)param->phy_update.status, PEER_NO_CONN,
+                           param->phy_update.bda, param->phy_update.tx_phy, param->phy_update.rx_phy);
+            break;
+#endif
+        default:
+            if (!advertiser.startCompleted(event, param, status)) return;
+            queueConnEvent(CONN_EVENT_ADVERTISING, status, PEER_NO_CONN, nullptr);
+            break;
+    }
+    bleTask.signal(EVENT_CONN_PARAMS);
+}
+
+// CCCD writes, per connection: the BLE2902 descriptors only keep the last
+// value written by any central
+void onGattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t, esp_ble_gatts_cb_param_t* param) {
+    if (event != ESP_GATTS_WRITE_EVT || param->write.len < 1) return;
+    for (size_t i = 0; i < watchedCccdCount; i++) {
+        if (watchedCccds[i].handle != param->write.handle) continue;
+        queueConnEvent(CONN_EVENT_SUBSCRIBE, 0, param->write.conn_id, nullptr,
+                       watchedCccds[i].subscription, (param->write.value[0] & 0x03) ? 1 : 0);
+        bleTask.signal(EVENT_CONN_PARAMS);
+        return;
+    }
+}
+
 // Callback class to handle characteristic write events
 class MyCallbacks : public BLECharacteristicCallbacks {
-    void onWrite(BLECharacteristic* pCharacteristic) {
-        std::string value = pCharacteristic->getValue();
+    // Runs on the BLE host task: copy the write into the command queue and
+    // return straight away, loop() does the processing. The connection id
+    // routes the response back to the central that asked.
+    void onWrite(BLECharacteristic* pCharacteristic, esp_ble_gatts_cb_param_t* param) {
+        size_t len = pCharacteristic->getLength();
+        if (len > 0) {
+            commandQueue.enqueue(pCharacteristic->getData(), len, param->write.conn_id);
+            commandTask.signal(EVENT_COMMAND);
+        }
+    }
+};
+
+// Build a sample from the current sensor state
+TelemetrySample readSample(uint64_t timestampUs) {
+    TelemetrySample sample = {};
+    sample.timestampUs = timestampUs;
+    sample.timestampMs = (uint32_t)(timestampUs / 1000);
+    sample.batteryLevel = batteryMonitor.percent();
+    sample.flags = batteryMonitor.measured() ? 0 : TELEMETRY_FLAG_SIMULATED;
+    if (sample.batteryLevel < 20) {
+        sample.flags |= TELEMETRY_FLAG_LOW_BATTERY;
+    }
+    sample.channelMask = obdChannelMask | (1u << CHANNEL_BATTERY_MV);
+    sample.channels[CHANNEL_BATTERY_MV] = (int16_t)batteryMonitor.filteredMv();
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+        if (ch != CHANNEL_BATTERY_MV && (obdChannelMask & (1u << ch))) {
+            sample.channels[ch] = obdChannels[ch];
+        }
+    }
+    return sample;
+}
+
+// Sample timer interrupt
+void IRAM_ATTR onSampleTick(uint64_t timestampUs) {
+    if (!sampleTicks.push(timestampUs)) droppedSampleTicks++;
+    samplerTask.signalFromIsr(EVENT_SAMPLE_TICK);
+}
+
+// Telemetry channel a mode 01 PID feeds, or -1
+int pidChannel(uint8_t pid) {
+    switch (pid) {
+        case 0x0C: return CHANNEL_RPM;
+        case 0x0D: return CHANNEL_SPEED_KMH;
+        case 0x05: return CHANNEL_COOLANT_C;
+        case 0x04: return CHANNEL_LOAD_PCT;
+        default: return -1;
+    }
+}
+
+// Scheduled PID answered: push it to the phone and keep the decoded value
+void onPidResult(const uint8_t* resp, size_t len) {
+    if (len < 2 || resp[0] != 0x41) return;
+    elm.pushResult(resp, len);
+
+    int channel = pidChannel(resp[1]);
+    if (channel < 0 || len < 2u + obdPidDataLength(resp[1])) return;
+    int16_t value = 0;
+    switch (channel) {
+        case CHANNEL_RPM: value = ((resp[2] << 8) | resp[3]) / 4; break;
+        case CHANNEL_SPEED_KMH: value = resp[2]; break;
+        case CHANNEL_COOLANT_C: value = resp[2] - 40; break;
+        case CHANNEL_LOAD_PCT: value = resp[2] * 100 / 255; break;
+    }
+    obdChannels[channel] = value;
+    obdChannelMask |= 1u << channel;
+}
+
+// Channels whose PID is no longer polled drop out of the samples
+void pruneObdChannels() {
+    uint16_t subscribed = 0;
+    for (size_t i = 0; i < pidScheduler.count(); i++) {
+        int channel = pidChannel(pidScheduler.at(i).pid);
+        if (channel >= 0) subscribed |= 1u << channel;
+    }
+    obdChannelMask &= subscribed;
+}
+
+// Notify one central; BLECharacteristic::notify() would send to all of
+// them. Call with peerLock held.
+bool notifyPeer(Peer& peer, BLECharacteristic* characteristic, const uint8_t* data, size_t len) {
+    bool sent = esp_ble_gatts_send_indicate(pServer->getGattsIf(), peer.connId,
+                                            characteristic->getHandle(), (uint16_t)len,
+                                            (uint8_t*)data, false) == ESP_OK;
+    if (sent) {
+        peer.stats.notifications++;
+        peer.stats.bytes += len;
+    } else {
+        peer.stats.droppedFrames++;
+    }
+    return sent;
+}
+
+// Legacy one-value-per-tick text notification
+void sendAsciiTelemetry(const TelemetrySample& sample) {
+    char text[8];
+    size_t len = encodeTelemetryAscii(sample, text, sizeof(text));
+    peerLock.lock();
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (peer.active() && peer.subscribed(PEER_SUB_TELEMETRY)) {
+            notifyPeer(peer, pCharacteristic, (uint8_t*)text, len);
+        }
+    }
+    peerLock.unlock();
+}
+
+// Send every batch that is due to every subscribed central, one frame each
+// per round; a backlog larger than one MTU goes out back-to-back. Centrals
+// at the same position with the same MTU, the usual case, share the frame
+// packed for the first of them.
+void flushTelemetry(unsigned long now) {
+    static uint8_t frame[PREFERRED_MTU - ATT_NOTIFY_OVERHEAD];
+    size_t frameLen = 0;
+    BatchCursor frameFrom = {}, frameTo = {};
+    size_t frameLimit = 0;
+
+    telemetryBatcher.setMaxLatency(deviceConfig.get(CONFIG_BATCH_LATENCY_MS));
+    telemetryBatcher.setCompression(deviceConfig.get(CONFIG_COMPRESSION));
+
+    peerLock.lock();
+    bool sent;
+    do {
+        sent = false;
+        for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+            Peer& peer = peers.slot(i);
+            if (!peer.active()) continue;
+            if (!peer.subscribed(PEER_SUB_TELEMETRY)) {
+                telemetryBatcher.skip(peer.telemetry);
+                continue;
+            }
+            size_t limit = peer.mtu - ATT_NOTIFY_OVERHEAD;
+            if (!telemetryBatcher.ready(peer.telemetry, limit, now)) continue;
+
+            BatchCursor& cursor = peer.telemetry;
+            if (frameLen && cursor.next == frameFrom.next && cursor.sentMask == frameFrom.sentMask &&
+                limit == frameLimit) {
+                cursor.next = frameTo.next;
+                cursor.sentMask = frameTo.sentMask;
+                cursor.dropped += frameTo.dropped - frameFrom.dropped;
+                cursor.split += frameTo.split - frameFrom.split;
+            } else {
+                frameFrom = cursor;
+                frameLimit = limit;
+                frameLen = telemetryBatcher.flush(cursor, frame, limit);
+                frameTo = cursor;
+                if (frameLen == 0) continue;
+            }
+            notifyPeer(peer, pCharacteristic, frame, frameLen);
+            sent = true;
+        }
+    } while (sent);
+
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (!peer.active()) continue;
+        peer.stats.queueDepth = (uint16_t)telemetryBatcher.pending(peer.telemetry);
+        peer.stats.droppedSamples = peer.telemetry.dropped;
+        if (peer.telemetry.split && !peer.stats.splitSamples) {
+            Serial.printf("Central %u: samples too big for a batch at MTU %u, sending them split\n",
+                          (unsigned)peer.connId, (unsigned)peer.mtu);
+        }
+        peer.stats.splitSamples = peer.telemetry.split;
+        if (peer.stats.queueDepth > peer.stats.maxQueueDepth) {
+            peer.stats.maxQueueDepth = peer.stats.queueDepth;
+        }
+    }
+    peerLock.unlock();
+}
+
+// Handle one queued write from the app: run it through the command table and
+// notify the response on the same characteristic, to the central that wrote it
+void handleCommand(const Command& cmd) {
+    uint8_t response[RESPONSE_MAX_FRAME];
+    peerLock.lock();
+    // Sized to what this central's MTU lets through in one notification
+    Peer* peer = peers.find(cmd.connId);
+    size_t limit = peer ? peer->mtu - ATT_NOTIFY_OVERHEAD : sizeof(response);
+    if (limit > sizeof(response)) limit = sizeof(response);
+    size_t len = commandDispatcher.dispatch(cmd, response, limit);
+    if (len > 0 && peer && peer->subscribed(PEER_SUB_TELEMETRY)) {
+        notifyPeer(*peer, pCharacteristic, response, len);
+    }
+    peerLock.unlock();
+
+    if (len == 0) {
+        Serial.print("Ignored malformed command: ");
+        for (int i = 0; i < cmd.length; i++) {
+            Serial.printf("%02x", cmd.data[i]);
+        }
+        Serial.println();
+    }
+}
+
+// Drain every queued write and report any the queue had to drop; returns
+// how many commands ran
+size_t processCommands() {
+    size_t ran = commandQueue.drain(handleCommand);
+
+    CommandQueueStats stats = commandQueue.stats();
+    if (stats.dropped != reportedCommandDrops) {
+        reportedCommandDrops = stats.dropped;
+        Serial.printf("Command queue overflow: %u dropped, %u truncated, high water %u\n",
+                      (unsigned)stats.dropped, (unsigned)stats.truncated, (unsigned)stats.highWater);
+    }
+    return ran;
+}
+
+// Notify the NUS replies to every central subscribed to TX, each in chunks
+// of its own MTU, straight out of the pipe: a chunk ends early at the wrap
+// point rather than being copied into a bounce buffer. Bytes leave the pipe
+// once every subscribed central has them, so a notification the stack
+// refused goes out again on the next pass. Returns true if some central
+// is still behind.
+bool flushNus() {
+    BytePipe<NUS_PIPE_SIZE>& tx = nus.tx();
+    size_t available = tx.available();
+    size_t done = available;
+
+    peerLock.lock();
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (!peer.active() || !peer.subscribed(PEER_SUB_NUS)) continue;
+        size_t limit = peer.mtu - ATT_NOTIFY_OVERHEAD;
+        size_t span;
+        const uint8_t* data;
+        while (peer.nusSent < available && (data = tx.peek(peer.nusSent, span)) && span > 0) {
+            size_t len = span < limit ? span : limit;
+            if (peer.nusSent + len > available) len = available - peer.nusSent;
+            if (!notifyPeer(peer, nus.txCharacteristic(), data, len)) break;
+            peer.nusSent += len;
+        }
+        if (peer.nusSent < done) done = peer.nusSent;
+    }
+    tx.consume(done);
+
+    // A central that subscribes later starts with the replies after that
+    bool behind = false;
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (!peer.active()) continue;
+        peer.nusSent = peer.subscribed(PEER_SUB_NUS) ? peer.nusSent - done : available - done;
+        if (peer.nusSent < available - done) behind = true;
+    }
+    peerLock.unlock();
+    return behind;
+}
+
+// Run every complete OBD/AT line received over NUS, poll due PIDs and
+// notify the replies; returns ms until the next PID is due or a refused
+// reply is sent again
+uint32_t serviceNus(unsigned long now) {
+    size_t span;
+    const uint8_t* data;
+    while ((data = nus.rx().peek(span)) && span > 0) {
+        elm.feed(data, span);
+        nus.rx().consume(span);
+    }
+    pruneObdChannels();
+    pidScheduler.run(now);
+    uint32_t retry = flushNus() ? NUS_RETRY_MS : EVENT_TASK_WAIT_FOREVER;
+
+    if (pidScheduler.count() == 0) return retry;
+    int32_t wait = (int32_t)(pidScheduler.nextDueMs(millis()) - millis());
+    return wait <= 0 ? 0 : (uint32_t)wait < retry ? (uint32_t)wait : retry;
+}
+
+// Queue a binary sample for every sample timer tick, for streaming while
+// connected or for the flash log while not, and report the battery level;
+// returns ms until the next battery report
+uint32_t sampleTelemetry(unsigned long now) {
+    uint64_t tickUs;
+    bool streaming = deviceConnected() && deviceConfig.get(CONFIG_STREAM_ENABLED) &&
+                     deviceConfig.get(CONFIG_TELEMETRY_FORMAT) == TELEMETRY_FORMAT_BINARY;
+    bool logging = !deviceConnected() && deviceConfig.get(CONFIG_LOG_ENABLED) && telemetryLog.ready();
+
+    // The timer only runs while binary samples are wanted; a changed
+    // interval restarts it with fresh jitter statistics
+    if (streaming || logging) {
+        sampleTimer.start(deviceConfig.get(CONFIG_SAMPLE_INTERVAL_MS) * 1000);
+        while (sampleTicks.pop(tickUs)) {
+            if (streaming) {
+                sampleQueue.push(readSample(tickUs));
+            } else if (!logQueue.push(readSample(tickUs))) {
+                droppedLogSamples++;
+            }
+        }
+    } else {
+        sampleTimer.stop();
+        while (sampleTicks.pop(tickUs)) {}
+    }
+
+    if (!deviceConnected() || !deviceConfig.get(CONFIG_STREAM_ENABLED)) {
+        return EVENT_TASK_WAIT_FOREVER;
+    }
+
+    if (now - lastUpdateTime >= UPDATE_INTERVAL) {
+        lastUpdateTime = now;
+        
+        if (deviceConfig.get(CONFIG_TELEMETRY_FORMAT) == TELEMETRY_FORMAT_ASCII) {
+            sendAsciiTelemetry(readSample(SampleTimer::nowUs()));
+        }
         
-        if (value.length() > 0) {
-            Serial.print("Received value: ");
-            for (int i = 0; i < value.length(); i++) {
-                Serial.print(value[i]);
+        Serial.print("Battery level: ");
+        Serial.print((int)batteryMonitor.percent());
+        Serial.print("% (");
+        Serial.print((int)batteryMonitor.filteredMv());
+        Serial.println(" mV)");
+    }
+    return UPDATE_INTERVAL - (now - lastUpdateTime);
+}
+
+// Move queued samples into the shared ring and send every batch that is
+// due; returns ms until the next central's pending batch reaches its
+// latency limit
+uint32_t publishTelemetry(unsigned long now) {
+    TelemetrySample sample;
+    while (sampleQueue.pop(sample)) {
+        telemetryBatcher.push(sample);
+    }
+
+    if (!deviceConnected() || !deviceConfig.get(CONFIG_STREAM_ENABLED) ||
+        deviceConfig.get(CONFIG_TELEMETRY_FORMAT) != TELEMETRY_FORMAT_BINARY) {
+        return EVENT_TASK_WAIT_FOREVER;
+    }
+    flushTelemetry(now);
+
+    uint32_t wait = UINT32_MAX;
+    peerLock.lock();
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (!peer.active() || !peer.subscribed(PEER_SUB_TELEMETRY)) continue;
+        uint32_t peerWait = telemetryBatcher.msUntilReady(peer.telemetry, peer.mtu - ATT_NOTIFY_OVERHEAD, now);
+        if (peerWait < wait) wait = peerWait;
+    }
+    peerLock.unlock();
+    return wait == UINT32_MAX ? EVENT_TASK_WAIT_FOREVER : wait;
+}
+
+// Write queued samples to the flash log, then erase the next sector ahead
+// of time so the log is ready for the next sector switch; an append only
+// waits for an erase if the queue outran it. Once logging stops, the open
+// block is written out so a log download sees every sample.
+void logTelemetry() {
+    TelemetrySample* sample;
+    while ((sample = logQueue.front())) {
+        if (!telemetryLog.append(*sample) && !(telemetryLog.service() && telemetryLog.append(*sample))) {
+            Serial.println("Telemetry log write failed");
+        }
+        logQueue.commitPop();
+    }
+    if (telemetryLog.pending() && (deviceConnected() || !deviceConfig.get(CONFIG_LOG_ENABLED))) {
+        if (!telemetryLog.flush() && !(telemetryLog.service() && telemetryLog.flush())) {
+            Serial.println("Telemetry log write failed");
+        }
+    }
+    telemetryLog.service();
+}
+
+// Payload size for the central running a log download, 0 once it is gone
+size_t syncPayloadLimit(uint16_t connId) {
+    peerLock.lock();
+    const Peer* peer = peers.find(connId);
+    size_t limit = peer ? peer->mtu - ATT_NOTIFY_OVERHEAD : 0;
+    peerLock.unlock();
+    return limit;
+}
+
+// Run the log download, if a central started one; returns ms until the
+// sync needs attention again
+uint32_t syncLog(unsigned long now) {
+    static unsigned long lastReport = 0;
+    bool wasRunning = logSync.running();
+    uint32_t wait = logSync.service(now, syncPayloadLimit);
+    LogSyncStats stats = logSync.stats();
+
+    peerLock.lock();
+    if (Peer* peer = peers.find(logSync.owner())) peer->logAcked = stats.acked;
+    peerLock.unlock();
+
+    if (logSync.running() != wasRunning) {
+        logSyncActive = logSync.running();
+        bleTask.signal(EVENT_WORKLOAD);
+    }
+    if (logSync.running() && !wasRunning) {
+        lastReport = now;
+        Serial.printf("Log sync started for conn %u, window %u\n", (unsigned)logSync.owner(),
+                      (unsigned)stats.window);
+    }
+
+    if (wasRunning && (!logSync.running() || now - lastReport >= 1000)) {
+        lastReport = now;
+        Serial.printf("Log sync %s: %u records, %u bytes in %u ms, %u.%u KB/s, %u packets resent\n",
+                      stats.state == LOG_SYNC_COMPLETE ? "complete" :
+                      stats.state == LOG_SYNC_STOPPED ? "stopped" : "running",
+                      (unsigned)stats.records, (unsigned)stats.bytes, (unsigned)stats.elapsedMs,
+                      (unsigned)(stats.bytesPerSecond / 1000), (unsigned)(stats.bytesPerSecond % 1000 / 100),
+                      (unsigned)stats.resent);
+    }
+    return wait == UINT32_MAX ? EVENT_TASK_WAIT_FOREVER : wait;
+}
+
+// The central running the transfer dropped: the app resumes from its last
+// position. Once every central is gone, queued control writes go too.
+void stopSync() {
+    uint16_t owner = logSync.owner();
+    peerLock.lock();
+    bool ownerGone = !peers.find(owner);
+    peerLock.unlock();
+
+    if (ownerGone && logSync.running()) {
+        LogSyncStats stats = logSync.stats();
+        Serial.printf("Log sync interrupted after %u records, acked up to sector %u offset %u\n",
+                      (unsigned)stats.records, (unsigned)stats.acked.sector, (unsigned)stats.acked.offset);
+    }
+    if (!deviceConnected()) {
+        logSync.reset();
+    } else if (ownerGone) {
+        logSync.disconnected(owner);
+    }
+}
+
+void logConnectionStats(const Peer& peer) {
+    ConnManagerStats stats = peer.connection.stats();
+    Serial.printf("Connection %u: profile %s, %u.%02u ms interval, latency %u, timeout %u ms, "
+                  "%u transitions, %u rejected, %u adjusted\n", (unsigned)peer.connId,
+                  connProfileName(stats.profile), (unsigned)(stats.interval * 125 / 100),
+                  (unsigned)(stats.interval * 125 % 100), (unsigned)stats.latency,
+                  (unsigned)stats.timeout * 10, (unsigned)stats.transitions,
+                  (unsigned)stats.rejected, (unsigned)stats.adjusted);
+}
+
+void logLinkStats(const Peer& peer) {
+    LinkStats link = peer.link.stats();
+    Serial.printf("Link %u: %s/%s PHY (%s), %u/%u byte PDUs (%s), MTU %u, settled after %u ms\n",
+                  (unsigned)peer.connId, linkPhyName(link.txPhy), linkPhyName(link.rxPhy), linkOutcomeName(link.phy),
+                  (unsigned)link.txOctets, (unsigned)link.rxOctets,
+                  linkOutcomeName(link.dataLength), (unsigned)link.mtu, (unsigned)link.settleMs);
+}
+
+void logPeerStats(const Peer& peer) {
+    Serial.printf("Central %u: %u notifications, %u bytes, %u frames dropped, %u samples dropped, "
+                  "queue depth %u (max %u)\n", (unsigned)peer.connId,
+                  (unsigned)peer.stats.notifications, (unsigned)peer.stats.bytes,
+                  (unsigned)peer.stats.droppedFrames, (unsigned)peer.stats.droppedSamples,
+                  (unsigned)peer.stats.queueDepth, (unsigned)peer.stats.maxQueueDepth);
+}
+
+// Ask for the largest PDUs and the 2M PHY; a refusal leaves the link as it is
+void requestLinkUpgrade(Peer& peer, unsigned long now) {
+    static uint32_t dataLengthRequests = 0;
+    peer.dataLengthOrder = dataLengthRequests++;
+    peer.link.dataLengthRequested(
+        esp_ble_gap_set_pkt_data_len(peer.address, LINK_MAX_TX_OCTETS) == ESP_OK, now);
+#if SOC_BLE_50_SUPPORTED
+    peer.link.phyRequested(
+        esp_ble_gap_set_preferred_phy(peer.address, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                      ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                      ESP_BLE_GAP_PHY_OPTIONS_NO_PREF) == ESP_OK, now);
+#else
+    peer.link.phyUnsupported(now);
+#endif
+}
+
+// A new central: give it a slot, start its link negotiation, and keep
+// advertising while there is room for another one
+void addPeer(const ConnEvent& event, unsigned long now) {
+    Peer* peer = peers.add(event.connId, event.address, now);
+    if (!peer) {
+        Serial.printf("No slot for conn %u, disconnecting\n", (unsigned)event.connId);
+        pServer->disconnect(event.connId);
+        return;
+    }
+    peer->mtu = pServer->getPeerMTU(event.connId);
+    peer->telemetry = telemetryBatcher.open();
+    peer->connection.connected(event.value[0], event.value[1], event.value[2], now);
+    peer->link.connected(now);
+    peer->link.mtuChanged(peer->mtu);
+    requestLinkUpgrade(*peer, now);
+    Serial.printf("Central %u connected, %u of %u\n", (unsigned)event.connId,
+                  (unsigned)peers.count(), (unsigned)CARTAG_MAX_PEERS);
+
+    uint32_t reconnects = bonds.stats().reconnects;
+    bonds.connected(event.address, now);
+    if (bonds.stats().reconnects != reconnects) {
+        Serial.printf("Bonded central back after %u ms (fastest %u ms)\n",
+                      (unsigned)bonds.stats().lastMs, (unsigned)bonds.stats().fastestMs);
+    }
+    advertisingManager.connected(peers.full(), now);
+}
+
+// Supervision timeout and the like: the central did not mean to leave
+bool linkLost(uint8_t reason) {
+    return reason == ESP_GATT_CONN_TIMEOUT || reason == ESP_GATT_CONN_LMP_TIMEOUT ||
+           reason == ESP_GATT_CONN_FAIL_ESTABLISH;
+}
+
+void removePeer(uint16_t connId, uint8_t reason, unsigned long now) {
+    Peer* peer = peers.find(connId);
+    if (peer) {
+        Serial.printf("Central %u disconnected (reason 0x%02x)\n", (unsigned)connId, reason);
+        logConnectionStats(*peer);
+        logLinkStats(*peer);
+        logPeerStats(*peer);
+        if (peer->bonded && linkLost(reason)) bonds.linkLost(peer->address, now);
+        peers.remove(connId);
+    }
+    advertisingManager.disconnected(peers.full(), bonds.reconnectTarget() != nullptr, now);
+}
+
+// Report events the queue had to drop and, if a connect or disconnect was
+// among them, bring the peer table back in line with the callbacks: a slot
+// whose connection is gone is freed, and a connection that never got a slot
+// (its address and parameters were lost) is dropped so the central comes
+// back through a fresh connect
+void reconcilePeers(unsigned long now) {
+    static bool pending = false;
+    uint32_t drops = connEventDrops;
+    if (drops != reportedConnEventDrops) {
+        reportedConnEventDrops = drops;
+        pending = true;
+        Serial.printf("Connection event queue overflow: %u dropped\n", (unsigned)drops);
+    }
+    // Events still queued may settle it yet
+    if (!pending || !connEvents.empty()) return;
+    pending = false;
+
+    uint32_t up = connectedIds;
+    uint32_t known = 0;
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        if (peers.slot(i).active()) known |= connIdBit(peers.slot(i).connId);
+    }
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (peer.active() && connIdBit(peer.connId) && !(up & connIdBit(peer.connId))) {
+            removePeer(peer.connId, 0, now);
+        }
+    }
+    for (uint16_t connId = 0; connId < 32; connId++) {
+        if (!(up & ~known & connIdBit(connId))) continue;
+        Serial.printf("Central %u lost its connect event, disconnecting\n", (unsigned)connId);
+        pServer->disconnect(connId);
+        // Connecting stopped advertising all the same
+        advertisingManager.connected(peers.full(), now);
+    }
+}
+
+void saveBonds() {
+    uint8_t blob[BOND_TABLE_MAX_BLOB];
+    size_t len = bonds.save(blob, sizeof(blob));
+    if (nvs.putBytes("bonds", blob, len) != len) Serial.println("Bond table write failed");
+}
+
+// Paired, or encrypted with the keys from an earlier pairing. A central
+// that cached another GATT database is told to discover again.
+void bondPeer(Peer& peer, const ConnEvent& event) {
+    if (event.status != 0) {
+        Serial.printf("Central %u did not pair (reason 0x%02x)\n", (unsigned)peer.connId, event.status);
+        return;
+    }
+    Bond evicted;
+    if (bonds.add(peer.address, (uint8_t)event.value[0], bonds.gattSignature(), &evicted)) {
+        esp_ble_remove_bond_device(evicted.address);
+    }
+    peer.bonded = true;
+    if (bonds.gattChanged(peer.address)) {
+        esp_ble_gatts_send_service_change_indication(pServer->getGattsIf(), peer.address);
+        Serial.printf("Central %u cached another GATT database, Service Changed sent\n",
+                      (unsigned)peer.connId);
+    }
+    saveBonds();
+}
+
+// The data length event carries no address; requests go out one per new
+// connection, so it answers the oldest one still pending, whichever slot
+// that central got
+Peer* pendingDataLength() {
+    Peer* oldest = nullptr;
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (!peer.active() || peer.link.stats().dataLength != LINK_PENDING) continue;
+        if (!oldest || (int32_t)(peer.dataLengthOrder - oldest->dataLengthOrder) < 0) oldest = &peer;
+    }
+    return oldest;
+}
+
+void handleConnEvent(const ConnEvent& event, unsigned long now) {
+    if (event.type == CONN_EVENT_CONNECT) {
+        addPeer(event, now);
+        return;
+    }
+    if (event.type == CONN_EVENT_DISCONNECT) {
+        removePeer(event.connId, event.status, now);
+        return;
+    }
+    if (event.type == CONN_EVENT_ADVERTISING) {
+        advertisingManager.startCompleted(event.status, now);
+        return;
+    }
+
+    Peer* peer = event.type == CONN_EVENT_DATA_LENGTH ? pendingDataLength()
+               : event.connId == PEER_NO_CONN ? peers.findByAddress(event.address)
+               : peers.find(event.connId);
+    if (!peer) return;
+    bool wasSettled = peer->link.settled();
+
+    switch (event.type) {
+        case CONN_EVENT_UPDATE:
+            peer->connection.granted(event.status, event.value[0], event.value[1], event.value[2]);
+            if (event.status != 0) {
+                Serial.printf("Connection %u parameters rejected (status 0x%02x), staying at %s\n",
+                              (unsigned)peer->connId, event.status,
+                              connProfileName(peer->connection.stats().profile));
             }
-            Serial.println();
-            
-            // Handle incoming commands here
-            // Example: parse JSON or specific command strings
+            break;
+        case CONN_EVENT_MTU:
+            peer->mtu = event.value[0];
+            peer->link.mtuChanged(event.value[0]);
+            break;
+        case CONN_EVENT_PHY:
+            peer->link.phyUpdated(event.status, (uint8_t)event.value[0], (uint8_t)event.value[1], now);
+            break;
+        case CONN_EVENT_DATA_LENGTH:
+            peer->link.dataLengthUpdated(event.status, event.value[0], event.value[1], now);
+            break;
+        case CONN_EVENT_SUBSCRIBE:
+            if (event.value[1]) {
+                peer->subscriptions |= event.value[0];
+            } else {
+                peer->subscriptions &= ~event.value[0];
+            }
+            break;
+        case CONN_EVENT_BONDED:
+            bondPeer(*peer, event);
+            break;
+        default:
+            break;
+    }
+    if (!wasSettled && peer->link.settled()) logLinkStats(*peer);
+}
+
+// Take in connection changes, subscriptions and granted parameters, then
+// move each central's link to the profile its workload calls for; returns
+// ms until a held-back move to a slower profile or a link request timeout
+// is due
+uint32_t serviceConnection(unsigned long now) {
+    peerLock.lock();
+    ConnEvent event;
+    while (connEvents.pop(event)) handleConnEvent(event, now);
+    reconcilePeers(now);
+
+    bool binary = deviceConfig.get(CONFIG_STREAM_ENABLED) &&
+                  deviceConfig.get(CONFIG_TELEMETRY_FORMAT) == TELEMETRY_FORMAT_BINARY;
+    bool polling = pidScheduler.count() > 0;
+    uint32_t wait = UINT32_MAX;
+
+    for (size_t i = 0; i < CARTAG_MAX_PEERS; i++) {
+        Peer& peer = peers.slot(i);
+        if (!peer.active()) continue;
+        if (peer.link.service(now)) logLinkStats(peer);
+
+        ConnWorkload workload = {
+            (binary && peer.subscribed(PEER_SUB_TELEMETRY)) || (polling && peer.subscribed(PEER_SUB_NUS)),
+            deviceConfig.get(CONFIG_BATCH_LATENCY_MS),
+            logSyncActive && logSync.owner() == peer.connId};
+        ConnProfile from = peer.connection.stats().profile;
+        ConnParams params;
+        if (peer.connection.update(selectConnProfile(workload), now, params)) {
+            pServer->updateConnParams(peer.address, params.minInterval, params.maxInterval,
+                                      params.latency, params.timeout);
+            Serial.printf("Connection %u profile %s -> %s\n", (unsigned)peer.connId,
+                          connProfileName(from), connProfileName(peer.connection.stats().profile));
         }
+
+        uint32_t updateWait = peer.connection.msUntilUpdate(now);
+        uint32_t linkWait = peer.link.msUntilTimeout(now);
+        if (updateWait < wait) wait = updateWait;
+        if (linkWait < wait) wait = linkWait;
     }
-};
+    peerLock.unlock();
+    return wait == UINT32_MAX ? EVENT_TASK_WAIT_FOREVER : wait;
+}
+
+// Do what the advertising state machine asks for: restart undirected
+// advertising at its interval, or point directed advertising at the bonded
+// central that lost its link. Returns ms until it next has something to do.
+uint32_t serviceAdvertising(unsigned long now) {
+    static AdvState logged = ADV_STATE_OFF;
+    static uint16_t loggedInterval = 0;
+    peerLock.lock();
+    switch (advertisingManager.service(now)) {
+        case ADV_ACTION_START:
+            advertisingManager.requested(advertiser.start(advertisingManager.interval()), now);
+            break;
+        case ADV_ACTION_DIRECTED: {
+            const Bond* target = bonds.reconnectTarget();
+            if (!target) {
+                // It came back some other way meanwhile
+                advertisingManager.requested(advertiser.start(advertisingManager.interval()), now);
+                break;
+            }
+            advertisingManager.requested(advertiser.startDirected(target->address, target->addressType), now);
+            bonds.directedStarted();
+            Serial.printf("Directed advertising to bonded central %02x:%02x:%02x:%02x:%02x:%02x\n",
+                          target->address[0], target->address[1], target->address[2],
+                          target->address[3], target->address[4], target->address[5]);
+            break;
+        }
+        default:
+            break;
+    }
+    AdvManagerStats stats = advertisingManager.stats();
+    uint32_t wait = advertisingManager.msUntilService(now);
+    peerLock.unlock();
+
+    if (stats.state != logged || stats.interval != loggedInterval) {
+        Serial.printf("Advertising %s -> %s", advStateName(logged), advStateName(stats.state));
+        if (stats.state == ADV_STATE_FAST || stats.state == ADV_STATE_BACKOFF) {
+            Serial.printf(", %u.%u ms interval", (unsigned)(stats.interval * 5 / 8),
+                          (unsigned)(stats.interval * 50 / 8 % 10));
+        }
+        Serial.println();
+        logged = stats.state;
+        loggedInterval = stats.interval;
+    }
+    return wait == UINT32_MAX ? EVENT_TASK_WAIT_FOREVER : wait;
+}
+
+// The ignition changed: advertising moves to the profile for it
+void applyIgnition(unsigned long now) {
+    bool on = ignition.on();
+    peerLock.lock();
+    advertisingManager.ignition(on, now);
+    peerLock.unlock();
+    Serial.printf("Ignition %s\n", on ? "on" : "off");
+}
+
+// Refresh the beacon, connected or not; returns ms until the next refresh
+uint32_t serviceBroadcast(unsigned long now) {
+    static unsigned long lastBroadcastMs = 0;
+    static uint16_t beaconSequence = 0;
+
+    uint32_t interval = deviceConfig.get(CONFIG_BROADCAST_MS);
+    if (interval == 0) {
+        if (advertiser.broadcasting()) {
+            advertiser.broadcast(nullptr, 0);
+            Serial.println("Telemetry broadcast stopped");
+        }
+        return EVENT_TASK_WAIT_FOREVER;
+    }
+    if (interval < BEACON_MIN_INTERVAL_MS) interval = BEACON_MIN_INTERVAL_MS;
+
+    bool started = advertiser.broadcasting();
+    if (started && now - lastBroadcastMs < interval) return interval - (now - lastBroadcastMs);
+
+    uint8_t beacon[BEACON_MAX_DATA];
+    size_t len = encodeTelemetryBeacon(snapshotSample(), beaconSequence++, beacon,
+                                       advertiser.broadcastCapacity());
+    advertiser.broadcast(beacon, len);
+    lastBroadcastMs = now;
+    if (!started) {
+        Serial.printf("Telemetry broadcast every %u ms in %s advertising, %u bytes\n",
+                      (unsigned)interval, advertiser.stats().extended ? "extended" : "legacy",
+                      (unsigned)len);
+    }
+    return interval;
+}
+
+void logTelemetryStats() {
+    TelemetryLogStats stats = telemetryLog.stats();
+    Serial.printf("Telemetry log: %u sectors in use, %u samples in %u blocks (%u bytes) this boot, "
+                  "%u erases, %u sectors recycled, %u torn, %u errors, %u samples dropped\n",
+                  (unsigned)stats.usedSectors, (unsigned)stats.samples, (unsigned)stats.records,
+                  (unsigned)stats.bytes,
+                  (unsigned)stats.erases, (unsigned)stats.droppedSectors, (unsigned)stats.tornRecords,
+                  (unsigned)stats.writeErrors, (unsigned)droppedLogSamples);
+}
+
+// Shared streaming state, dropped when the last central goes away; each
+// central's own position in the ring goes with its peer slot
+void resetTelemetry() {
+    TelemetrySample sample;
+    while (sampleQueue.pop(sample)) {}
+}
+
+void resetObd() {
+    nus.reset();
+    elm.reset();
+    pidScheduler.clear();
+    obdChannelMask = 0;
+}
+
+void logTaskStats(const EventTask& task) {
+    EventTaskStats stats = task.stats();
+    Serial.printf("Task %s: %u wakeups (%u timed), longest run %u us\n", task.name(),
+                  (unsigned)stats.wakeups, (unsigned)stats.timeouts, (unsigned)stats.maxRunUs);
+}
+
+// Connection changes: update the peer table, fan the news out to the tasks
+// that own connection state, and let the advertising state machine restart
+// advertising once a disconnect frees a slot. Also keeps the telemetry
+// beacon fresh.
+uint32_t bleTaskHandler(uint32_t events, uint32_t now) {
+    // First, so the other tasks see the peer table without the central
+    // that just left
+    uint32_t wait = serviceConnection(now);
+    if (events & EVENT_IGNITION) applyIgnition(now);
+    uint32_t advertisingWait = serviceAdvertising(now);
+    uint32_t broadcastWait = serviceBroadcast(now);
+    if (advertisingWait < wait) wait = advertisingWait;
+    if (broadcastWait < wait) wait = broadcastWait;
+
+    if (events & EVENT_DISCONNECTED) {
+        samplerTask.signal(EVENT_DISCONNECTED);
+        publisherTask.signal(EVENT_DISCONNECTED);
+        commandTask.signal(EVENT_DISCONNECTED);
+        loggerTask.signal(EVENT_DISCONNECTED);
+
+        logTaskStats(samplerTask);
+        logTaskStats(publisherTask);
+        logTaskStats(commandTask);
+
+        const SampleJitter& jitter = sampleTimer.jitter();
+        Serial.printf("Sample timer: %u intervals at %u us, max late %u us, max early %u us, %u ticks dropped\n",
+                      (unsigned)jitter.ticks, (unsigned)jitter.periodUs, (unsigned)jitter.maxLateUs,
+                      (unsigned)jitter.maxEarlyUs, (unsigned)droppedSampleTicks);
+    }
+    if (events & EVENT_CONNECTED) {
+        logTelemetryStats();
+        samplerTask.signal(EVENT_CONNECTED);
+        commandTask.signal(EVENT_CONNECTED);
+    }
+    return wait;
+}
+
+uint32_t samplerTaskHandler(uint32_t, uint32_t now) {
+    uint32_t wait = sampleTelemetry(now);
+    if (!sampleQueue.empty()) publisherTask.signal(EVENT_SAMPLE);
+    if (!logQueue.empty()) loggerTask.signal(EVENT_LOG);
+    return wait;
+}
+
+uint32_t publisherTaskHandler(uint32_t events, uint32_t now) {
+    if ((events & EVENT_DISCONNECTED) && !deviceConnected()) resetTelemetry();
+    return publishTelemetry(now);
+}
+
+// Drain the battery ADC's DMA buffer well before it can fill, and sample
+// the ignition line
+uint32_t batteryTaskHandler(uint32_t, uint32_t now) {
+    batteryMonitor.poll();
+    if (ignition.poll(now)) bleTask.signal(EVENT_IGNITION);
+    return BATTERY_POLL_INTERVAL_MS;
+}
+
+// Lowest priority: flash writes, erases and log downloads run whenever
+// nothing else needs the CPU
+uint32_t loggerTaskHandler(uint32_t events, uint32_t now) {
+    if (events & EVENT_DISCONNECTED) stopSync();
+    logTelemetry();
+    if (!deviceConnected()) return EVENT_TASK_WAIT_FOREVER;
+    return syncLog(now);
+}
+
+// Writes to the battery characteristic and NUS traffic, plus the PID
+// polls the app subscribed to
+uint32_t commandTaskHandler(uint32_t events, uint32_t now) {
+    // The ELM327 session is shared by every central on NUS
+    if ((events & EVENT_DISCONNECTED) && !deviceConnected()) resetObd();
+
+    if (processCommands() > 0) {
+        // Streaming, format or intervals may have changed
+        samplerTask.signal(EVENT_CONFIG);
+        publisherTask.signal(EVENT_CONFIG);
+        bleTask.signal(EVENT_WORKLOAD);
+    }
+    if (events & EVENT_NUS_RX) bleTask.signal(EVENT_WORKLOAD);  // PID subscriptions may have changed
+    if (!deviceConnected()) return EVENT_TASK_WAIT_FOREVER;
+    return serviceNus(now);
+}
+
+void signCharacteristic(GattSignature& signature, BLECharacteristic* characteristic) {
+    signature.add(characteristic->getUUID().toString().c_str(), characteristic->getHandle());
+    const char* descriptors[] = {"2902", TELEMETRY_LAYOUT_DESCRIPTOR_UUID};
+    for (const char* uuid : descriptors) {
+        if (BLEDescriptor* descriptor = characteristic->getDescriptorByUUID(uuid)) {
+            signature.add(uuid, descriptor->getHandle());
+        }
+    }
+}
+
+// Fingerprint of the GATT database a bonded central may have cached: every
+// service, characteristic and descriptor with its handle
+uint32_t gattDatabaseSignature() {
+    struct { const char* service; const char* characteristic; } attributes[] = {
+        {SERVICE_UUID, CHARACTERISTIC_UUID},
+        {NUS_SERVICE_UUID, NUS_RX_UUID},
+        {NUS_SERVICE_UUID, NUS_TX_UUID},
+        {LOG_SYNC_SERVICE_UUID, LOG_SYNC_CONTROL_UUID},
+        {LOG_SYNC_SERVICE_UUID, LOG_SYNC_DATA_UUID},
+        {LOG_SYNC_SERVICE_UUID, LOG_SYNC_STATS_UUID},
+    };
+    GattSignature signature;
+    const char* service = nullptr;
+    for (const auto& attribute : attributes) {
+        BLEService* pService = pServer->getServiceByUUID(attribute.service);
+        if (attribute.service != service) {
+            service = attribute.service;
+            signature.add(service, pService->getHandle());
+        }
+        signCharacteristic(signature, pService->getCharacteristic(attribute.characteristic));
+    }
+    return signature.value();
+}
+
+// Bonds from NVS, checked against the keys the BLE stack kept: bonds it
+// lost are dropped, and bonds from before the table existed are adopted
+// with an unknown GATT database
+void loadBonds() {
+    uint8_t blob[BOND_TABLE_MAX_BLOB];
+    size_t len = nvs.getBytes("bonds", blob, sizeof(blob));
+    if (len > 0 && !bonds.load(blob, len)) Serial.println("Bond table unreadable, starting empty");
+
+    int count = esp_ble_get_bond_device_num();
+    esp_ble_bond_dev_t* list = count > 0 ? new esp_ble_bond_dev_t[count] : nullptr;
+    if (list && esp_ble_get_bond_device_list(&count, list) == ESP_OK) {
+        uint8_t (*addresses)[6] = new uint8_t[count][6];
+        for (int i = 0; i < count; i++) memcpy(addresses[i], list[i].bd_addr, 6);
+        bonds.retain(addresses, count);
+        delete[] addresses;
+
+        for (int i = count; i-- > 0;) {
+            if (bonds.find(list[i].bd_addr)) continue;
+            Bond evicted;
+            if (bonds.add(list[i].bd_addr, list[i].bond_key.pid_key.addr_type, BOND_GATT_UNKNOWN, &evicted)) {
+                esp_ble_remove_bond_device(evicted.address);
+            }
+        }
+    } else {
+        bonds.retain(nullptr, 0);
+    }
+    delete[] list;
+
+    uint8_t checked[BOND_TABLE_MAX_BLOB];
+    size_t checkedLen = bonds.save(checked, sizeof(checked));
+    if (checkedLen != len || memcmp(checked, blob, len) != 0) saveBonds();
+    Serial.printf("%u bonded centrals\n", (unsigned)bonds.count());
+}
+
+void watchSubscription(BLECharacteristic* characteristic, PeerSubscription subscription) {
+    BLEDescriptor* cccd = characteristic->getDescriptorByUUID("2902");
+    if (cccd && watchedCccdCount < sizeof(watchedCccds) / sizeof(watchedCccds[0])) {
+        watchedCccds[watchedCccdCount++] = {cccd->getHandle(), subscription};
+    }
+}
 
 void setup() {
     Serial.begin(115200);
@@ -74,10 +1318,13 @@ void setup() {
 
     // Initialize BLE
     BLEDevice::init("CarTag");
+    BLEDevice::setMTU(PREFERRED_MTU);
     
     // Create the BLE Server
     pServer = BLEDevice::createServer();
     pServer->setCallbacks(new MyServerCallbacks());
+    BLEDevice::setCustomGapHandler(onGapEvent);
+    BLEDevice::setCustomGattsHandler(onGattsEvent);
 
     // Create the BLE Service
     BLEService* pService = pServer->createService(SERVICE_UUID);
@@ -94,6 +1341,12 @@ void setup() {
     BLE2902* pDescriptor = new BLE2902();
     pDescriptor->setNotifications(true);
     pCharacteristic->addDescriptor(pDescriptor);
+
+    // Publish the binary frame layout so clients can decode without hardcoding offsets
+    BLEDescriptor* pLayoutDescriptor = new BLEDescriptor(TELEMETRY_LAYOUT_DESCRIPTOR_UUID);
+    uint8_t layout[16];
+    pLayoutDescriptor->setValue(layout, telemetryLayoutDescriptor(layout, sizeof(layout)));
+    pCharacteristic->addDescriptor(pLayoutDescriptor);
     
     // Set callbacks for write events
     pCharacteristic->setCallbacks(new MyCallbacks());
@@ -104,60 +1357,132 @@ void setup() {
     // Start the service
     pService->start();
 
-    // Start advertising
-    BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
-    pAdvertising->addServiceUUID(SERVICE_UUID);
-    pAdvertising->setScanResponse(true);
-    pAdvertising->setMinPreferred(0x06);  // functions that help with iPhone connections issue
-    BLEDevice::startAdvertising();
+    // Nordic UART Service alongside the battery service. It is not added to
+    // the advertising data: two 128-bit UUIDs do not fit in 31 bytes, and the
+    // app finds the device by name anyway.
+    nus.begin(pServer);
+    nus.setRxListener([]() { commandTask.signal(EVENT_NUS_RX); });
+    elm.setScheduler(&pidScheduler);
+
+    logSync.begin(pServer);
+    logSync.setControlListener([]() { loggerTask.signal(EVENT_SYNC); });
+
+    watchSubscription(pCharacteristic, PEER_SUB_TELEMETRY);
+    watchSubscription(pServer->getServiceByUUID(NUS_SERVICE_UUID)->getCharacteristic(NUS_TX_UUID),
+                      PEER_SUB_NUS);
+    BLEService* logService = pServer->getServiceByUUID(LOG_SYNC_SERVICE_UUID);
+    watchSubscription(logService->getCharacteristic(LOG_SYNC_DATA_UUID), PEER_SUB_LOG_DATA);
+    watchSubscription(logService->getCharacteristic(LOG_SYNC_STATS_UUID), PEER_SUB_LOG_STATS);
+
+    // Just Works bonding: the central is asked to encrypt on every connect,
+    // pairing the first time and reusing its keys after that
+    nvs.begin("cartag");
+    bonds.setGattSignature(gattDatabaseSignature());
+#ifndef CARTAG_NO_BONDING
+    BLESecurity* security = new BLESecurity();
+    security->setAuthenticationMode(ESP_LE_AUTH_BOND);
+    security->setCapability(ESP_IO_CAP_NONE);
+    security->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+    security->setRespEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+    BLEDevice::setEncryptionLevel(ESP_BLE_SEC_ENCRYPT);
+    loadBonds();
+#endif
+
+    if (!batteryMonitor.begin()) Serial.println("Battery ADC failed to start");
+
+    // setup() runs on the application core, so the sample timer interrupt
+    // is serviced there too
+    if (!sampleTimer.begin(onSampleTick)) Serial.println("Sample timer failed to start");
+
+    if (telemetryLog.begin()) {
+        logTelemetryStats();
+    } else {
+        Serial.println("Telemetry log partition not found, logging disabled");
+    }
+
+#if defined(CARTAG_CAN_LOOPBACK)
+    canBus.attach(&simulatedEcuNode);
+#endif
+#if defined(CARTAG_CAN_TWAI) || defined(CARTAG_CAN_LOOPBACK)
+    if (!canBus.begin()) Serial.println("CAN controller failed to start");
+#endif
+
+    // Start advertising, discovery first whether the car is running or not
+    ignition.begin(millis());
+    advertiser.begin(SERVICE_UUID, "CarTag");
+    advertisingManager.begin(ignition.on(), millis());
+    serviceAdvertising(millis());
     
     Serial.println("BLE device is ready and advertising!");
     Serial.print("Device name: CarTag");
     Serial.println();
+
+#ifndef CARTAG_LEGACY_LOOP
+    if (!bleTask.start() || !samplerTask.start() ||
+        !publisherTask.start() || !commandTask.start() || !batteryTask.start() ||
+        !loggerTask.start()) {
+        Serial.println("Failed to start firmware tasks");
+    }
+#endif
 }
 
+#ifdef CARTAG_LEGACY_LOOP
+
 void loop() {
+#ifdef CARTAG_NATIVE
+    sampleTimer.poll();
+#endif
+
+    // Peer slots first, so a central that left is gone before anything
+    // below notifies
+    serviceConnection(millis());
+    serviceAdvertising(millis());
+    serviceBroadcast(millis());
+
     // Handle connection state changes
-    if (deviceConnected && !oldDeviceConnected) {
-        // Device just connected
-        oldDeviceConnected = deviceConnected;
+    if (deviceConnected() && !oldDeviceConnected) {
+        // First central just connected
+        oldDeviceConnected = true;
     }
     
-    if (!deviceConnected && oldDeviceConnected) {
-        // Device just disconnected - advertising already restarted in callback
-        // This is a backup in case the callback didn't fire
-        oldDeviceConnected = deviceConnected;
+    if (!deviceConnected() && oldDeviceConnected) {
+        // Last central just disconnected; serviceAdvertising() restarts
+        // advertising
+        oldDeviceConnected = false;
+        resetTelemetry();
+        resetObd();
     }
+    stopSync();
     
-    // If connected, you can send notifications
-    if (deviceConnected) {
-        unsigned long currentTime = millis();
-        
-        // Send battery update every 2 seconds
-        if (currentTime - lastUpdateTime >= UPDATE_INTERVAL) {
-            lastUpdateTime = currentTime;
-            updateCount++;
-            
-            // Decrease battery by 1% every 3 updates
-            if (updateCount >= 1) {
-                batteryLevel = batteryLevel - 2;
-                updateCount = 0;
-                
-                // Reset to 100 when reaching 0
-                if (batteryLevel < 0) {
-                    batteryLevel = 100;
-                }
-            }
-            
-            // Send battery level as string
-            String batteryStr = String(batteryLevel) + "%";
-            pCharacteristic->setValue(batteryStr.c_str());
-            pCharacteristic->notify();
-            
-            Serial.print("Battery level: ");
-            Serial.println(batteryStr);
-        }
+    batteryMonitor.poll();
+    if (ignition.poll(millis())) applyIgnition(millis());
+    processCommands();
+    if (deviceConnected()) {
+        serviceNus(millis());
+        syncLog(millis());
     }
     
+    // If connected and streaming, sample and send notifications
+    unsigned long currentTime = millis();
+    sampleTelemetry(currentTime);
+    publishTelemetry(currentTime);
+    logTelemetry();
+    
     delay(10);  // Small delay to prevent watchdog issues
 }
+
+#else
+
+void loop() {
+#ifdef CARTAG_NATIVE
+    // No RTOS on the host: fire due timer ticks and run whichever tasks are
+    // due on the virtual clock
+    sampleTimer.poll();
+    EventTask::runReady(millis());
+#else
+    // Everything runs in the tasks started by setup()
+    vTaskDelete(NULL);
+#endif
+}
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * ISO-TP segmentation and reassembly
+ */
+
+#include <string.h>
+#include <unity.h>
+
+#include "IsoTp.h"
+
+namespace {
+
+IsoTpReassembler rx;
+
+CanFrame firstFrame(size_t len) {
+    CanFrame frame = {};
+    frame.id = 0x7E8;
+    frame.length = 8;
+    frame.data[0] = ISOTP_FIRST_FRAME | (uint8_t)(len >> 8);
+    frame.data[1] = (uint8_t)len;
+    for (int i = 2; i < 8; i++) frame.data[i] = (uint8_t)i;
+    return frame;
+}
+
+CanFrame consecutiveFrame(uint8_t sequence) {
+    CanFrame frame = {};
+    frame.id = 0x7E8;
+    frame.length = 8;
+    frame.data[0] = ISOTP_CONSECUTIVE_FRAME | (sequence & 0x0F);
+    memset(frame.data + 1, 0xA5, 7);
+    return frame;
+}
+
+}  // namespace
+
+void setUp() { rx.reset(); }
+void tearDown() {}
+
+void test_single_frame_round_trip() {
+    const uint8_t message[] = {0x41, 0x0C, 0x1A, 0xF8};
+    IsoTpSegmenter tx;
+    TEST_ASSERT_TRUE(tx.start(message, sizeof(message)));
+
+    CanFrame frame;
+    TEST_ASSERT_TRUE(tx.next(frame));
+    TEST_ASSERT_EQUAL(ISOTP_RX_COMPLETE, rx.feed(frame));
+    TEST_ASSERT_EQUAL(sizeof(message), rx.length());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(message, rx.data(), sizeof(message));
+    TEST_ASSERT_FALSE(tx.next(frame));
+    TEST_ASSERT_TRUE(tx.done());
+}
+
+void test_longest_message_wraps_sequence() {
+    // 6 bytes in the first frame and 7 per CF: 18 CFs, numbered 1..15, 0, 1, 2
+    uint8_t message[ISOTP_MAX_MESSAGE];
+    for (size_t i = 0; i < sizeof(message); i++) message[i] = (uint8_t)(i * 7 + 3);
+
+    IsoTpSegmenter tx;
+    TEST_ASSERT_TRUE(tx.start(message, sizeof(message)));
+
+    CanFrame frame;
+    TEST_ASSERT_TRUE(tx.next(frame));
+    TEST_ASSERT_EQUAL_HEX8(ISOTP_FIRST_FRAME, frame.data[0] & 0xF0);
+    TEST_ASSERT_EQUAL(ISOTP_RX_SEND_FLOW_CONTROL, rx.feed(frame));
+    TEST_ASSERT_FALSE(tx.next(frame));
+    TEST_ASSERT_TRUE(tx.waitingForFlowControl());
+
+    CanFrame fc = {};
+    isoTpFlowControl(fc, ISOTP_FC_CONTINUE, 0, 0);
+    TEST_ASSERT_TRUE(tx.onFlowControl(fc));
+
+    int frames = 0;
+    bool wrapped = false;
+    IsoTpRxResult result = ISOTP_RX_IN_PROGRESS;
+    while (tx.next(frame)) {
+        TEST_ASSERT_EQUAL_HEX8(ISOTP_CONSECUTIVE_FRAME, frame.data[0] & 0xF0);
+        TEST_ASSERT_EQUAL_HEX8((frames + 1) & 0x0F, frame.data[0] & 0x0F);
+        if ((frame.data[0] & 0x0F) == 0) wrapped = true;
+        TEST_ASSERT_EQUAL(ISOTP_RX_IN_PROGRESS, result);
+        result = rx.feed(frame);
+        frames++;
+    }
+
+    TEST_ASSERT_EQUAL(18, frames);
+    TEST_ASSERT_TRUE(wrapped);
+    TEST_ASSERT_TRUE(tx.done());
+    TEST_ASSERT_EQUAL(ISOTP_RX_COMPLETE, result);
+    TEST_ASSERT_EQUAL(sizeof(message), rx.length());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(message, rx.data(), sizeof(message));
+}
+
+void test_block_size_waits_for_flow_control() {
+    uint8_t message[40];
+    for (size_t i = 0; i < sizeof(message); i++) message[i] = (uint8_t)i;
+
+    IsoTpSegmenter tx;
+    TEST_ASSERT_TRUE(tx.start(message, sizeof(message)));
+    CanFrame frame;
+    TEST_ASSERT_TRUE(tx.next(frame));
+    TEST_ASSERT_EQUAL(ISOTP_RX_SEND_FLOW_CONTROL, rx.feed(frame));
+
+    // Two CFs per block: 34 bytes after the first frame take five CFs
+    CanFrame fc = {};
+    isoTpFlowControl(fc, ISOTP_FC_CONTINUE, 2, 0);
+    int blocks = 0;
+    while (!tx.done()) {
+        TEST_ASSERT_TRUE(tx.onFlowControl(fc));
+        blocks++;
+        while (tx.next(frame)) rx.feed(frame);
+    }
+
+    TEST_ASSERT_EQUAL(3, blocks);
+    TEST_ASSERT_EQUAL(sizeof(message), rx.length());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(message, rx.data(), sizeof(message));
+}
+
+void test_out_of_order_consecutive_frame_aborts() {
+    TEST_ASSERT_EQUAL(ISOTP_RX_SEND_FLOW_CONTROL, rx.feed(firstFrame(20)));
+    TEST_ASSERT_EQUAL(ISOTP_RX_ERROR, rx.feed(consecutiveFrame(2)));
+
+    // The transfer is gone: the CF that was due is no longer expected
+    TEST_ASSERT_EQUAL(ISOTP_RX_IGNORED, rx.feed(consecutiveFrame(1)));
+}
+
+void test_repeated_consecutive_frame_aborts() {
+    TEST_ASSERT_EQUAL(ISOTP_RX_SEND_FLOW_CONTROL, rx.feed(firstFrame(30)));
+    TEST_ASSERT_EQUAL(ISOTP_RX_IN_PROGRESS, rx.feed(consecutiveFrame(1)));
+    TEST_ASSERT_EQUAL(ISOTP_RX_ERROR, rx.feed(consecutiveFrame(1)));
+}
+
+void test_first_frame_longer_than_max_is_rejected() {
+    TEST_ASSERT_EQUAL(ISOTP_RX_ERROR, rx.feed(firstFrame(ISOTP_MAX_MESSAGE + 1)));
+    TEST_ASSERT_EQUAL(ISOTP_RX_IGNORED, rx.feed(consecutiveFrame(1)));
+
+    // Also when it interrupts a transfer already under way
+    TEST_ASSERT_EQUAL(ISOTP_RX_SEND_FLOW_CONTROL, rx.feed(firstFrame(20)));
+    TEST_ASSERT_EQUAL(ISOTP_RX_ERROR, rx.feed(firstFrame(0xFFF)));
+    TEST_ASSERT_EQUAL(ISOTP_RX_IGNORED, rx.feed(consecutiveFrame(1)));
+
+    uint8_t message[ISOTP_MAX_MESSAGE + 1] = {};
+    IsoTpSegmenter tx;
+    TEST_ASSERT_FALSE(tx.start(message, sizeof(message)));
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_frame_round_trip);
+    RUN_TEST(test_longest_message_wraps_sequence);
+    RUN_TEST(test_block_size_waits_for_flow_control);
+    RUN_TEST(test_out_of_order_consecutive_frame_aborts);
+    RUN_TEST(test_repeated_consecutive_frame_aborts);
+    RUN_TEST(test_first_frame_longer_than_max_is_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+/**
+ * Compressed telemetry block round trips and limits
+ */
+
+#include <unity.h>
+
+#include "TelemetryCodec.h"
+
+namespace {
+
+uint8_t block[1024];
+TelemetrySample decoded[TELEMETRY_BLOCK_MAX_SAMPLES];
+
+TelemetrySample makeSample(uint32_t timestampMs, uint16_t mask) {
+    TelemetrySample sample = {};
+    sample.timestampMs = timestampMs;
+    sample.timestampUs = (uint64_t)timestampMs * 1000;
+    sample.batteryLevel = 87;
+    sample.channelMask = mask;
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+        if (mask & (1u << ch)) sample.channels[ch] = (int16_t)(100 * ch + 5);
+    }
+    return sample;
+}
+
+void assertSameSample(const TelemetrySample& expected, const TelemetrySample& actual) {
+    TEST_ASSERT_EQUAL_UINT32(expected.timestampMs, actual.timestampMs);
+    TEST_ASSERT_EQUAL_UINT8(expected.batteryLevel, actual.batteryLevel);
+    TEST_ASSERT_EQUAL_UINT8(expected.flags, actual.flags);
+    TEST_ASSERT_EQUAL_UINT16(expected.channelMask, actual.channelMask);
+    for (int ch = 0; ch < TELEMETRY_MAX_CHANNELS; ch++) {
+        if (expected.channelMask & (1u << ch)) TEST_ASSERT_EQUAL_INT16(expected.channels[ch], actual.channels[ch]);
+    }
+}
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip_keeps_every_field() {
+    // Jittery intervals (negative delta-of-delta), extreme channel values,
+    // battery steps both ways and flag changes
+    const uint32_t times[] = {4000000000u, 4000000020u, 4000000039u, 4000000061u, 4000000061u,
+                              4000000080u, 4000000500u, 4000000520u};
+    const int16_t values[] = {0, INT16_MAX, INT16_MIN, -1, 1, INT16_MIN, INT16_MAX, 12345};
+    const size_t count = sizeof(times) / sizeof(times[0]);
+    TelemetrySample samples[count];
+
+    TelemetryBlockEncoder encoder;
+    encoder.begin(block, sizeof(block), 0xFFFE);
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = makeSample(times[i], 0x0015);
+        samples[i].batteryLevel = (uint8_t)(i % 2 ? 100 : i);
+        samples[i].flags = (uint8_t)(i / 3);
+        samples[i].channels[0] = values[i];
+        samples[i].channels[2] = values[count - 1 - i];
+        TEST_ASSERT_TRUE(encoder.add(samples[i]));
+    }
+    size_t len = encoder.finish();
+    TEST_ASSERT_GREATER_THAN(TELEMETRY_BLOCK_HEADER_SIZE, len);
+
+    TEST_ASSERT_EQUAL(count, decodeTelemetryBlock(block, len, decoded, TELEMETRY_BLOCK_MAX_SAMPLES));
+    for (size_t i = 0; i < count; i++) assertSameSample(samples[i], decoded[i]);
+
+    // Any truncation is refused rather than decoded short
+    for (size_t cut = 0; cut < len; cut++) {
+        TEST_ASSERT_EQUAL(0, decodeTelemetryBlock(block, cut, decoded, TELEMETRY_BLOCK_MAX_SAMPLES));
+    }
+}
+
+void test_steady_samples_cost_one_byte() {
+    TelemetryBlockEncoder encoder;
+    encoder.begin(block, sizeof(block), 0);
+    TEST_ASSERT_TRUE(encoder.add(makeSample(1000, 0x0003)));
+    size_t first = encoder.size();
+    for (uint32_t i = 1; i <= 10; i++) TEST_ASSERT_TRUE(encoder.add(makeSample(1000 + 20 * i, 0x0003)));
+    TEST_ASSERT_EQUAL(first + 10 + 1, encoder.size());  // the second sample sets the interval
+}
+
+void test_mask_change_ends_block() {
+    TelemetryBlockEncoder encoder;
+    encoder.begin(block, sizeof(block), 7);
+    TEST_ASSERT_TRUE(encoder.add(makeSample(1000, 0x0003)));
+    TEST_ASSERT_TRUE(encoder.add(makeSample(1020, 0x0003)));
+    size_t before = encoder.size();
+
+    TelemetrySample wider = makeSample(1040, 0x0007);
+    TEST_ASSERT_FALSE(encoder.add(wider));
+    TEST_ASSERT_FALSE(encoder.add(makeSample(1040, 0x0001)));
+    TEST_ASSERT_EQUAL(before, encoder.size());
+    TEST_ASSERT_EQUAL(2, encoder.count());
+
+    size_t len = encoder.finish();
+    TEST_ASSERT_EQUAL(2, decodeTelemetryBlock(block, len, decoded, TELEMETRY_BLOCK_MAX_SAMPLES));
+    assertSameSample(makeSample(1020, 0x0003), decoded[1]);
+
+    // The refused sample starts the next block
+    encoder.begin(block, sizeof(block), 9);
+    TEST_ASSERT_TRUE(encoder.add(wider));
+    len = encoder.finish();
+    TEST_ASSERT_EQUAL(1, decodeTelemetryBlock(block, len, decoded, TELEMETRY_BLOCK_MAX_SAMPLES));
+    assertSameSample(wider, decoded[0]);
+}
+
+void test_time_going_backwards_ends_block() {
+    TelemetryBlockEncoder encoder;
+    encoder.begin(block, sizeof(block), 0);
+    TEST_ASSERT_TRUE(encoder.add(makeSample(5000, 0x0001)));
+    TEST_ASSERT_TRUE(encoder.add(makeSample(5020, 0x0001)));
+    size_t before = encoder.size();
+
+    TEST_ASSERT_FALSE(encoder.add(makeSample(5019, 0x0001)));
+    TEST_ASSERT_FALSE(encoder.add(makeSample(0, 0x0001)));
+    TEST_ASSERT_EQUAL(before, encoder.size());
+
+    // A repeated timestamp is a zero delta, not a step back
+    TEST_ASSERT_TRUE(encoder.add(makeSample(5020, 0x0001)));
+
+    size_t len = encoder.finish();
+    TEST_ASSERT_EQUAL(3, decodeTelemetryBlock(block, len, decoded, TELEMETRY_BLOCK_MAX_SAMPLES));
+    TEST_ASSERT_EQUAL_UINT32(5020, decoded[2].timestampMs);
+}
+
+void test_timestamp_wrap_is_not_a_step_back() {
+    TelemetryBlockEncoder encoder;
+    encoder.begin(block, sizeof(block), 0);
+    TEST_ASSERT_TRUE(encoder.add(makeSample(0xFFFFFFF0u, 0x0001)));
+    TEST_ASSERT_TRUE(encoder.add(makeSample(0x00000004u, 0x0001)));
+
+    size_t len = encoder.finish();
+    TEST_ASSERT_EQUAL(2, decodeTelemetryBlock(block, len, decoded, TELEMETRY_BLOCK_MAX_SAMPLES));
+    TEST_ASSERT_EQUAL_UINT32(0x00000004u, decoded[1].timestampMs);
+}
+
+void test_block_holds_at_most_255_samples() {
+    TelemetryBlockEncoder encoder;
+    encoder.begin(block, sizeof(block), 0);
+    for (uint32_t i = 0; i < TELEMETRY_BLOCK_MAX_SAMPLES; i++) {
+        TEST_ASSERT_TRUE(encoder.add(makeSample(1000 + 20 * i, 0x0001)));
+    }
+    TEST_ASSERT_EQUAL(TELEMETRY_BLOCK_MAX_SAMPLES, encoder.count());
+    TEST_ASSERT_FALSE(encoder.add(makeSample(1000 + 20 * TELEMETRY_BLOCK_MAX_SAMPLES, 0x0001)));
+
+    size_t len = encoder.finish();
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(block), len);
+    TEST_ASSERT_EQUAL(TELEMETRY_BLOCK_MAX_SAMPLES,
+                      decodeTelemetryBlock(block, len, decoded, TELEMETRY_BLOCK_MAX_SAMPLES));
+    TEST_ASSERT_EQUAL_UINT32(1000 + 20 * (TELEMETRY_BLOCK_MAX_SAMPLES - 1),
+                             decoded[TELEMETRY_BLOCK_MAX_SAMPLES - 1].timestampMs);
+
+    // A reader with less room gets nothing rather than a partial block
+    TEST_ASSERT_EQUAL(0, decodeTelemetryBlock(block, len, decoded, TELEMETRY_BLOCK_MAX_SAMPLES - 1));
+}
+
+void test_sample_that_does_not_fit_is_refused() {
+    TelemetryBlockEncoder encoder;
+    encoder.begin(block, TELEMETRY_BLOCK_HEADER_SIZE + 16, 0);
+    TelemetrySample sample = makeSample(1000, 0x000F);
+    sample.channels[0] = INT16_MIN;
+    TEST_ASSERT_TRUE(encoder.add(sample));
+
+    size_t before = encoder.size();
+    sample.timestampMs += 20;
+    sample.channels[0] = INT16_MAX;
+    sample.channels[1] = INT16_MIN;
+    sample.channels[2] = INT16_MAX;
+    sample.channels[3] = INT16_MIN;
+    TEST_ASSERT_FALSE(encoder.add(sample));
+    TEST_ASSERT_EQUAL(before, encoder.size());
+    TEST_ASSERT_EQUAL(1, encoder.count());
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_keeps_every_field);
+    RUN_TEST(test_steady_samples_cost_one_byte);
+    RUN_TEST(test_mask_change_ends_block);
+    RUN_TEST(test_time_going_backwards_ends_block);
+    RUN_TEST(test_timestamp_wrap_is_not_a_step_back);
+    RUN_TEST(test_block_holds_at_most_255_samples);
+    RUN_TEST(test_sample_that_does_not_fit_is_refused);
+    return UNITY_END();
+}
@@ -0,0 +1,189 @@
+/**
+ * Flash ring log recovery and wrap-around
+ */
+
+#include <unity.h>
+
+#include "RamFlash.h"
+#include "TelemetryLog.h"
+
+namespace {
+
+// Flash that loses power after a budget of programmed bytes: the write
+// that runs out is cut short, and every write and erase after it fails
+class PowerCutFlash : public FlashStore {
+public:
+    explicit PowerCutFlash(FlashStore& flash) : m_flash(flash) {}
+
+    void cutAfter(size_t bytes) {
+        m_armed = true;
+        m_budget = bytes;
+    }
+
+    bool begin() override { return m_flash.begin(); }
+    uint32_t sectorCount() const override { return m_flash.sectorCount(); }
+
+    bool read(uint32_t offset, void* out, size_t len) override { return m_flash.read(offset, out, len); }
+
+    bool write(uint32_t offset, const void* data, size_t len) override {
+        if (!m_armed) return m_flash.write(offset, data, len);
+        size_t n = len < m_budget ? len : m_budget;
+        if (n > 0) m_flash.write(offset, data, n);
+        m_budget -= n;
+        return n == len;
+    }
+
+    bool erase(uint32_t sector) override {
+        return (!m_armed || m_budget > 0) && m_flash.erase(sector);
+    }
+
+private:
+    FlashStore& m_flash;
+    bool m_armed = false;
+    size_t m_budget = 0;
+};
+
+TelemetrySample makeSample(uint32_t i) {
+    TelemetrySample sample = {};
+    sample.timestampMs = 1000 + i * 20;
+    sample.timestampUs = (uint64_t)sample.timestampMs * 1000;
+    sample.batteryLevel = (uint8_t)(60 + i / 500 % 40);
+    sample.channelMask = 0x0003;
+    sample.channels[0] = (int16_t)(12000 + (i * 37) % 500);
+    sample.channels[1] = (int16_t)((i * 91) % 6000 - 3000);
+    return sample;
+}
+
+// As the logger task does: erase ahead and retry when the log asks for it
+void appendRange(TelemetryLog& log, uint32_t from, uint32_t to) {
+    for (uint32_t i = from; i < to; i++) {
+        TelemetrySample sample = makeSample(i);
+        if (!log.append(sample)) {
+            TEST_ASSERT_TRUE(log.service());
+            TEST_ASSERT_TRUE(log.append(sample));
+        }
+        log.service();
+    }
+}
+
+// Decode the whole log, checking the samples run on without a gap; returns
+// how many there were and the index of the first
+size_t readBack(TelemetryLog& log, uint32_t& first) {
+    LogCursor cursor = log.oldest();
+    uint8_t payload[TELEMETRY_LOG_MAX_PAYLOAD];
+    TelemetrySample samples[TELEMETRY_BLOCK_MAX_SAMPLES];
+    size_t total = 0;
+    size_t len;
+    while ((len = log.read(cursor, payload, sizeof(payload))) > 0) {
+        size_t count = decodeTelemetryBlock(payload, len, samples, TELEMETRY_BLOCK_MAX_SAMPLES);
+        TEST_ASSERT_GREATER_THAN(0, count);
+        for (size_t i = 0; i < count; i++) {
+            if (total == 0) first = (samples[i].timestampMs - 1000) / 20;
+            TelemetrySample expected = makeSample(first + total);
+            TEST_ASSERT_EQUAL_UINT32(expected.timestampMs, samples[i].timestampMs);
+            TEST_ASSERT_EQUAL_UINT8(expected.batteryLevel, samples[i].batteryLevel);
+            TEST_ASSERT_EQUAL_UINT16(expected.channelMask, samples[i].channelMask);
+            TEST_ASSERT_EQUAL_INT16(expected.channels[0], samples[i].channels[0]);
+            TEST_ASSERT_EQUAL_INT16(expected.channels[1], samples[i].channels[1]);
+            total++;
+        }
+    }
+    return total;
+}
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_empty_log_reads_nothing() {
+    RamFlash flash(4);
+    TelemetryLog log(flash);
+    TEST_ASSERT_TRUE(log.begin());
+
+    uint32_t first = 0;
+    TEST_ASSERT_EQUAL(0, readBack(log, first));
+    TEST_ASSERT_EQUAL_UINT32(0, log.stats().usedSectors);
+}
+
+void test_recovers_after_torn_write() {
+    // Cut the power at every byte of the record being written, the commit
+    // byte after it included
+    for (size_t budget = 0; budget <= TELEMETRY_LOG_RECORD_HEADER + TELEMETRY_LOG_MAX_PAYLOAD + 4; budget++) {
+        RamFlash ram(8);
+        PowerCutFlash flash(ram);
+        {
+            TelemetryLog log(flash);
+            TEST_ASSERT_TRUE(log.begin());
+            appendRange(log, 0, 200);
+            TEST_ASSERT_TRUE(log.flush());
+            appendRange(log, 200, 210);
+            flash.cutAfter(budget);
+            if (log.flush()) continue;  // the whole record made it
+        }
+
+        // Reboot on what the flash holds
+        TelemetryLog log(ram);
+        TEST_ASSERT_TRUE(log.begin());
+        if (budget > 0) TEST_ASSERT_GREATER_THAN(0, log.stats().tornRecords);
+
+        uint32_t first = 0;
+        TEST_ASSERT_EQUAL(200, readBack(log, first));
+        TEST_ASSERT_EQUAL_UINT32(0, first);
+
+        // The torn record is skipped and the log carries on after it
+        appendRange(log, 200, 260);
+        TEST_ASSERT_TRUE(log.flush());
+        TEST_ASSERT_EQUAL(260, readBack(log, first));
+
+        TelemetryLog again(ram);
+        TEST_ASSERT_TRUE(again.begin());
+        TEST_ASSERT_EQUAL(260, readBack(again, first));
+        TEST_ASSERT_EQUAL_UINT32(0, again.stats().writeErrors);
+    }
+}
+
+void test_ring_wraps_and_drops_oldest() {
+    const uint32_t sectors = 4;
+    const uint32_t total = 20000;
+    RamFlash flash(sectors);
+    TelemetryLog log(flash);
+    TEST_ASSERT_TRUE(log.begin());
+    appendRange(log, 0, total);
+    TEST_ASSERT_TRUE(log.flush());
+
+    TelemetryLogStats stats = log.stats();
+    TEST_ASSERT_GREATER_THAN(0, stats.droppedSectors);
+    TEST_ASSERT_GREATER_THAN(1, stats.maxEraseCount);
+    TEST_ASSERT_LESS_OR_EQUAL(sectors - 1, stats.usedSectors);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.writeErrors);
+
+    // What is left runs without a gap up to the newest sample
+    uint32_t first = 0;
+    size_t kept = readBack(log, first);
+    TEST_ASSERT_GREATER_THAN(0, first);
+    TEST_ASSERT_EQUAL(total, first + kept);
+
+    // A reboot finds the same head and tail
+    TelemetryLog reopened(flash);
+    TEST_ASSERT_TRUE(reopened.begin());
+    TEST_ASSERT_EQUAL_UINT32(log.oldest().sector, reopened.oldest().sector);
+    TEST_ASSERT_EQUAL_UINT32(stats.usedSectors, reopened.stats().usedSectors);
+    uint32_t reopenedFirst = 0;
+    TEST_ASSERT_EQUAL(kept, readBack(reopened, reopenedFirst));
+    TEST_ASSERT_EQUAL_UINT32(first, reopenedFirst);
+
+    // and keeps wrapping from there
+    appendRange(reopened, total, total + 5000);
+    TEST_ASSERT_TRUE(reopened.flush());
+    kept = readBack(reopened, reopenedFirst);
+    TEST_ASSERT_EQUAL(total + 5000, reopenedFirst + kept);
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_log_reads_nothing);
+    RUN_TEST(test_recovers_after_torn_write);
+    RUN_TEST(test_ring_wraps_and_drops_oldest);
+    return UNITY_END();
+}
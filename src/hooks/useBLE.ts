@@ -35,6 +35,60 @@ const log = {
 const SERVICE_UUID = '4fafc201-1fb5-459e-8fcc-c5c9c331914b';
 const CHARACTERISTIC_UUID = 'beb5483e-36e1-4688-b7f5-ea07361b26a8';
 
+// Binary telemetry frame layout (see CarTag/include/TelemetryFrame.h)
+const TELEMETRY_MAGIC = 0xca;
+const TELEMETRY_HEADER_SIZE = 12;
+const TELEMETRY_BATTERY_OFFSET = 8;
+const TELEMETRY_BATCH_MAGIC = 0xcb;
+const TELEMETRY_BATCH_RECORD_SIZE = 4;
+const TELEMETRY_BLOCK_MAGIC = 0xce; // compressed block (see TelemetryCodec.h)
+const PREFERRED_MTU = 247; // lets the firmware pack more samples per notification
+
+// Battery of the newest record in a batch frame, or null if truncated
+const readBatchBattery = (frame: string): number | null => {
+  const count = frame.charCodeAt(8);
+  let mask = frame.charCodeAt(10) | (frame.charCodeAt(11) << 8);
+  let channels = 0;
+  for (; mask; mask &= mask - 1) channels++;
+  const recordSize = TELEMETRY_BATCH_RECORD_SIZE + 2 * channels;
+  const offset = TELEMETRY_HEADER_SIZE + (count - 1) * recordSize + 2;
+  return count > 0 && offset < frame.length ? frame.charCodeAt(offset) : null;
+};
+
+// Battery of the newest sample in a compressed block, or null if malformed.
+// Samples are walked in order: a changed-field bitmap, then varints for the
+// fields that changed (bit 1 is the zigzag battery delta).
+const readBlockBattery = (frame: string): number | null => {
+  let pos = TELEMETRY_HEADER_SIZE;
+  const readVarint = (): number | null => {
+    let value = 0;
+    for (let scale = 1; pos < frame.length; scale *= 128) {
+      const byte = frame.charCodeAt(pos++);
+      value += (byte & 0x7f) * scale;
+      if (!(byte & 0x80)) return value;
+    }
+    return null;
+  };
+
+  const count = frame.charCodeAt(8);
+  let battery = 0;
+  for (let i = 0; i < count; i++) {
+    const changed = readVarint();
+    if (changed === null) return null;
+    for (let bit = 0; 2 ** bit <= changed; bit++) {
+      if (!(Math.floor(changed / 2 ** bit) & 1)) continue;
+      if (bit === 2) {
+        pos++; // raw flags byte
+        continue;
+      }
+      const value = readVarint();
+      if (value === null) return null;
+      if (bit === 1) battery = (battery + (value % 2 ? -(value + 1) / 2 : value / 2)) & 0xff;
+    }
+  }
+  return count > 0 && pos <= frame.length ? battery : null;
+};
+
 /**
  * Deferred pattern - converts event-driven APIs to Promise-based.
  * Useful for single-shot async operations where you need to resolve/reject
@@ -211,6 +265,47 @@ export function useBLE() {
         // Decode base64 to string
         const decoded = decodeBase64(value);
 
+        // Binary telemetry frame: read the battery byte at its fixed offset
+        if (
+          decoded.length >= TELEMETRY_HEADER_SIZE &&
+          decoded.charCodeAt(0) === TELEMETRY_MAGIC
+        ) {
+          const battery = decoded.charCodeAt(TELEMETRY_BATTERY_OFFSET);
+          return {
+            counter: battery,
+            timestamp: new Date(),
+            raw: `${battery}%`,
+          };
+        }
+
+        // Batch frame: several samples per notification, show the newest
+        if (
+          decoded.length > TELEMETRY_HEADER_SIZE &&
+          decoded.charCodeAt(0) === TELEMETRY_BATCH_MAGIC
+        ) {
+          const battery = readBatchBattery(decoded);
+          if (battery === null) return null;
+          return {
+            counter: battery,
+            timestamp: new Date(),
+            raw: `${battery}%`,
+          };
+        }
+
+        // Compressed block: decode up to the newest sample's battery
+        if (
+          decoded.length > TELEMETRY_HEADER_SIZE &&
+          decoded.charCodeAt(0) === TELEMETRY_BLOCK_MAGIC
+        ) {
+          const battery = readBlockBattery(decoded);
+          if (battery === null) return null;
+          return {
+            counter: battery,
+            timestamp: new Date(),
+            raw: `${battery}%`,
+          };
+        }
+
         // Try parsing as integer first
         const counterValue = parseInt(decoded, 10);
         if (!isNaN(counterValue)) {
@@ -425,6 +520,7 @@ export function useBLE() {
         const connectedDevice = await device.connect({
           timeout: CONNECTION_TIMEOUT,
           refreshGatt: 'OnConnected', // Refresh GATT cache on connection
+          requestMTU: PREFERRED_MTU,
         });
         
         connectionAttemptActive = false;
@@ -11,8 +11,14 @@ import {
 import { ConnectionStatus, OBDData, OBDState } from '../types';
 
 // ========== Configuration ==========
-// Adjust this value to change how often OBD data is polled (in milliseconds)
-const POLLING_INTERVAL = 500; // ms between each OBD command cycle
+// How often the CarTag firmware polls each PID on its own. Format is
+// ATSUB <pid><period in ms>, both hex; results arrive as "41 XX .." lines.
+const PID_SUBSCRIPTIONS = [
+  'ATSUB0C0032\r', // RPM every 50 ms
+  'ATSUB0D0032\r', // Speed every 50 ms
+  'ATSUB0401F4\r', // Engine load every 500 ms
+  'ATSUB0507D0\r', // Coolant temperature every 2 s
+];
 
 const TARGET_DEVICE_NAME = 'CarTag';
 const RECONNECT_DELAY = 3000;
@@ -27,14 +33,6 @@ const NUS_SERVICE_UUID = '6e400001-b5a3-f393-e0a9-e50e24dcca9e';
 const NUS_RX_UUID = '6e400002-b5a3-f393-e0a9-e50e24dcca9e'; // Write (Phone -> ESP32)
 const NUS_TX_UUID = '6e400003-b5a3-f393-e0a9-e50e24dcca9e'; // Notify (ESP32 -> Phone)
 
-// OBD-II PID Commands
-const OBD_COMMANDS = {
-  RPM: '010C\r',
-  SPEED: '010D\r',
-  COOLANT_TEMP: '0105\r',
-  ENGINE_LOAD: '0104\r',
-} as const;
-
 // Logging helper
 const log = {
   debug: (...args: unknown[]) => __DEV__ && console.log('[OBD]', ...args),
@@ -208,9 +206,7 @@ export function useOBD() {
   const disconnectCompleteRef = useRef<Deferred<void, Error> | null>(null);
   
   // OBD-specific refs
-  const pollingIntervalRef = useRef<ReturnType<typeof setInterval> | null>(null);
   const isPollingRef = useRef(false);
-  const commandIndexRef = useRef(0); // Track which command to send next
   
   // Current OBD values (updated as responses come in)
   const obdValuesRef = useRef<{
@@ -309,30 +305,34 @@ export function useOBD() {
   }, []);
 
   // Handle incoming OBD response - parse and update the appropriate value
+  // One notification may carry several pushed results, one per line
   const handleOBDResponse = useCallback((response: string) => {
-    const parsed = parseAnyOBDResponse(response);
-    if (!parsed) {
+    const results = response
+      .split(/[\r\n>]+/)
+      .map(parseAnyOBDResponse)
+      .filter((parsed): parsed is { pid: string; value: number } => parsed !== null);
+    if (results.length === 0) {
       log.debug('Could not parse response:', response);
       return;
     }
     
-    log.info('Parsed OBD:', parsed.pid, '=', parsed.value);
-    
-    // Update the appropriate value
-    switch (parsed.pid) {
-      case '0C':
-        obdValuesRef.current.rpm = parsed.value;
-        break;
-      case '0D':
-        obdValuesRef.current.speed = parsed.value;
-        break;
-      case '05':
-        obdValuesRef.current.coolantTemp = parsed.value;
-        break;
-      case '04':
-        obdValuesRef.current.engineLoad = parsed.value;
-        break;
-    }
+    // Update the appropriate values
+    results.forEach((parsed) => {
+      switch (parsed.pid) {
+        case '0C':
+          obdValuesRef.current.rpm = parsed.value;
+          break;
+        case '0D':
+          obdValuesRef.current.speed = parsed.value;
+          break;
+        case '05':
+          obdValuesRef.current.coolantTemp = parsed.value;
+          break;
+        case '04':
+          obdValuesRef.current.engineLoad = parsed.value;
+          break;
+      }
+    });
     
     // Update state with current values
     setState((prev) => ({
@@ -362,56 +362,35 @@ export function useOBD() {
     }
   }, []);
 
-  // Commands to cycle through
-  const OBD_COMMAND_LIST = [
-    OBD_COMMANDS.RPM,
-    OBD_COMMANDS.SPEED,
-    OBD_COMMANDS.COOLANT_TEMP,
-    OBD_COMMANDS.ENGINE_LOAD,
-  ];
-
-  // Send next OBD command in cycle
-  const sendNextCommand = useCallback(async () => {
+  // Start polling OBD data - the firmware polls the ECU itself, so we only
+  // subscribe once and then receive results as they come
+  const startPolling = useCallback(async () => {
     const device = deviceRef.current;
-    if (!device || !isPollingRef.current) {
-      return;
-    }
-
-    const command = OBD_COMMAND_LIST[commandIndexRef.current];
-    await sendCommand(device, command);
-    
-    // Move to next command
-    commandIndexRef.current = (commandIndexRef.current + 1) % OBD_COMMAND_LIST.length;
-  }, [sendCommand]);
-
-  // Start polling OBD data
-  const startPolling = useCallback(() => {
-    if (isPollingRef.current) {
+    if (isPollingRef.current || !device) {
       return;
     }
 
-    log.info('Starting OBD polling');
+    log.info('Subscribing to OBD PIDs');
     isPollingRef.current = true;
-    commandIndexRef.current = 0;
     setState((prev) => ({ ...prev, isPolling: true }));
 
-    // Send commands at interval - responses are handled asynchronously
-    sendNextCommand();
-    pollingIntervalRef.current = setInterval(sendNextCommand, COMMAND_DELAY);
-  }, [sendNextCommand]);
+    for (const command of PID_SUBSCRIPTIONS) {
+      await sendCommand(device, command);
+      await new Promise((resolve) => setTimeout(resolve, COMMAND_DELAY));
+    }
+  }, [sendCommand]);
 
   // Stop polling OBD data
   const stopPolling = useCallback(() => {
-    if (pollingIntervalRef.current) {
-      clearInterval(pollingIntervalRef.current);
-      pollingIntervalRef.current = null;
+    if (isPollingRef.current && deviceRef.current) {
+      sendCommand(deviceRef.current, 'ATUNSUB\r');
     }
     isPollingRef.current = false;
     // Reset values
     obdValuesRef.current = { rpm: null, speed: null, coolantTemp: null, engineLoad: null };
     setState((prev) => ({ ...prev, isPolling: false }));
     log.info('Stopped OBD polling');
-  }, []);
+  }, [sendCommand]);
 
   // Subscribe to TX characteristic for notifications
   const subscribeToNotifications = useCallback(async (device: Device) => {